@@ -0,0 +1,910 @@
+﻿#include "ClientConfig.h"
+#include "EmberConsumer.h"
+#include "ember_consumer.h"
+extern "C" {
+#include "emberplus.h"
+}
+#include "DeviceContents.h"
+#include "DeviceAction.h"
+#include "APIFormat.h"
+#include "APICodec.h"
+#include "Capture.h"
+#include "LineUnitPanel.h"
+#include "Utilities.h"
+#include "Output.h"
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+
+// ====================================================================
+// コンバータ処理経路ベンチマーク
+// ====================================================================
+// Ember+ ツリーは合成スナップショットをリプレイ用セッションへ読み込んで構築する
+// （プロバイダ・HWIF への接続は行わず、送信はリプレイ中として抑止される）
+// 疑似プロバイダ（EmberProvider）は使用しない。ソケット・スケジューリングの揺らぎが
+// 処理経路の計測値に混ざり、別プロセスの起動も必要になるため、受信はリプレイで与える
+// プロバイダとの接続を含む負荷・耐久確認は EmberProvider と LineUnitSimulator で行う
+// 結果は JSON でファイルへ出力する（トレース出力が標準出力を使用するため）
+//
+// 使用法 : bench [-iterations N] [-fanout N] [-filter 名前の一部] [-o 出力先]
+
+using namespace utilities;
+
+/// <summary>LINE UNIT 受信処理（Client.cpp）</summary>
+extern void LineUnitCommand(CLineUnitPanel& panel, char* recvBuffer);
+
+/// <summary>既定の計測回数</summary>
+#define BENCH_DEFAULT_ITERATIONS	200000
+/// <summary>既定の兄弟ノード数（対象ノードの前に並べるダミー）</summary>
+#define BENCH_DEFAULT_FANOUT		16
+/// <summary>ウォームアップ回数の割合（計測回数 / n）</summary>
+#define BENCH_WARMUP_DIVISOR		10
+/// <summary>メモリ計測用ツリーの最上位ノード番号（対象ツリーと重ならない番号）</summary>
+#define BENCH_MEMORY_TOP_NUMBER		1000
+/// <summary>メモリ計測用ツリーのチャンネル数</summary>
+#define BENCH_MEMORY_CHANNELS		256
+/// <summary>メモリ計測用ツリーのチャンネルあたりパラメータ数</summary>
+#define BENCH_MEMORY_PARAMETERS		16
+/// <summary>ラベル計測用ツリーの最上位ノード番号（対象ツリーと重ならない番号）</summary>
+#define BENCH_LABEL_TOP_NUMBER		2000
+/// <summary>ラベル計測用マトリックスの Target/Source 数</summary>
+#define BENCH_LABEL_SIGNALS			4096
+
+/// <summary>
+/// 合成ツリー要素
+/// </summary>
+struct BenchElement
+{
+	/// <summary>文字列パス</summary>
+	const char* pPath;
+	/// <summary>種別（GlowElementType）</summary>
+	int nType;
+	/// <summary>パラメータ型（GlowParameterType）</summary>
+	int nParameterType;
+};
+
+/// <summary>
+/// 合成ツリー末端（LINE UNIT 対応表が使用するパス）
+/// </summary>
+static const BenchElement BenchLeaves[] =
+{
+	{ "/root/suite/s-1/switcher/n-1/abTrans/n-#/sw/t/btn",			GlowElementType_Parameter,	GlowParameterType_Integer },
+	{ "/root/suite/s-1/switcher/n-1/abTrans/n-#/sw/t/tally",		GlowElementType_Parameter,	GlowParameterType_Integer },
+	{ "/root/suite/s-1/switcher/n-1/abTrans/n-#/sw/b/btn",			GlowElementType_Parameter,	GlowParameterType_Integer },
+	{ "/root/suite/s-1/switcher/n-1/abTrans/n-#/sw/b/tally",		GlowElementType_Parameter,	GlowParameterType_Integer },
+	{ "/root/suite/s-1/switcher/n-1/abTrans/n-#/trans/cut",			GlowElementType_Function,	GlowParameterType_None },
+	{ "/root/suite/s-1/switcher/n-1/abTrans/n-#/trans/auto",		GlowElementType_Function,	GlowParameterType_None },
+	{ "/root/suite/s-1/switcher/n-1/xptSw/n-#/sw/btn",				GlowElementType_Parameter,	GlowParameterType_Integer },
+	{ "/root/suite/s-1/switcher/n-1/xptSw/n-#/sw/tally",			GlowElementType_Parameter,	GlowParameterType_Integer },
+	{ "/root/suite/s-1/switcher/n-1/scene/n-#/nextTrans/fader",		GlowElementType_Parameter,	GlowParameterType_Real },
+};
+/// <summary>合成ツリー末端数</summary>
+static const int BenchLeafCount = (int)(sizeof(BenchLeaves) / sizeof(BenchLeaves[0]));
+
+/// <summary>
+/// 計測結果
+/// </summary>
+struct BenchResult
+{
+	/// <summary>名称</summary>
+	std::string sName;
+	/// <summary>計測回数</summary>
+	long long nIterations;
+	/// <summary>1 回あたり（nsec）</summary>
+	double dNsPerOp;
+};
+
+/// <summary>
+/// 計測用コンシューマ
+/// </summary>
+/// <remarks>
+/// マトリックス受信時のラベル収集（Watcher から呼び出す処理）を直接呼び出す
+/// </remarks>
+class CBenchEmberConsumer : public CNmosEmberConsumer
+{
+public:
+	using CEmberConsumer::ResetMatrixLabels;
+	using CEmberConsumer::GetConsumerResult;
+};
+
+/// <summary>計測回数</summary>
+static long long m_nIterations = BENCH_DEFAULT_ITERATIONS;
+/// <summary>計測対象（名前の一部、空なら全て）</summary>
+static std::string m_sFilter = "";
+/// <summary>計測結果</summary>
+static std::vector<BenchResult> m_vResults;
+
+/// <summary>
+/// 計測
+/// </summary>
+/// <param name="sName">名称</param>
+/// <param name="nDivisor">計測回数の縮小率（重い処理向け）</param>
+/// <param name="fnOperation">計測対象（引数は通し番号）</param>
+static void RunBench(const std::string& sName, int nDivisor, const std::function<void(long long)>& fnOperation)
+{
+	if (!m_sFilter.empty() && (sName.find(m_sFilter) == std::string::npos))
+		return;
+
+	long long nIterations = m_nIterations / ((nDivisor > 0) ? nDivisor : 1);
+	if (nIterations <= 0)
+		nIterations = 1;
+
+	for (long long i = 0; i < nIterations / BENCH_WARMUP_DIVISOR; ++i)
+		fnOperation(i);
+
+	auto tpStart = std::chrono::steady_clock::now();
+	for (long long i = 0; i < nIterations; ++i)
+		fnOperation(i);
+	auto nElapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - tpStart).count();
+
+	BenchResult sResult{ sName, nIterations, (double)nElapsed / (double)nIterations };
+	m_vResults.push_back(sResult);
+	fprintf(stderr, "%-28s %12lld iterations %12.1f ns/op\n", sName.c_str(), nIterations, sResult.dNsPerOp);
+}
+
+/// <summary>
+/// トレース出力（設定による抑止なし）
+/// </summary>
+/// <param name="pFileName"></param>
+/// <param name="nLineNumber"></param>
+/// <param name="pFuncName"></param>
+/// <param name="pFormat"></param>
+/// <param name=""></param>
+static void WriteTrace(const char* pFileName, int nLineNumber, const char* pFuncName, const char* pFormat, ...)
+{
+	va_list arg;
+	va_start(arg, pFormat);
+	COutput::Trace(pFileName, nLineNumber, pFuncName, std::this_thread::get_id(), pFormat, arg);
+	va_end(arg);
+}
+
+/// <summary>
+/// 合成スナップショット作成
+/// </summary>
+/// <param name="sPath">出力先</param>
+/// <param name="nFanout">各階層で対象ノードの前に並べるダミー数</param>
+/// <returns></returns>
+/// <remarks>
+/// 識別子検索は子を先頭から走査するため、ダミーは対象より若い番号とする
+/// </remarks>
+static bool WriteSnapshot(const std::string& sPath, int nFanout)
+{
+	FILE* pFile = fopen(sPath.c_str(), "wb");
+	if (!pFile)
+		return false;
+
+	fprintf(pFile, "EMBERSNAPSHOT\t1\n");
+
+	// 生成済ノード（文字列パス→数値パス）、子の採番
+	std::map<std::string, std::string> mNodes{};
+	std::map<std::string, int> mChildCount{};
+	mNodes[""] = "";
+
+	for (int leaf = 0; leaf < BenchLeafCount; ++leaf)
+	{
+		std::string sParent = "";
+		std::string sLeaf = BenchLeaves[leaf].pPath;
+		size_t pos = 1;
+		while (pos <= sLeaf.size())
+		{
+			size_t next = sLeaf.find('/', pos);
+			if (next == std::string::npos)
+				next = sLeaf.size();
+			std::string sIdentifier = sLeaf.substr(pos, next - pos);
+			std::string sCurrent = sParent + "/" + sIdentifier;
+			bool isLeaf = (next == sLeaf.size());
+
+			if (mNodes.find(sCurrent) == mNodes.end())
+			{
+				const std::string& sParentNumbers = mNodes[sParent];
+				std::string sPrefix = sParentNumbers.empty() ? "" : sParentNumbers + ".";
+
+				// 初めて子を作る親にはダミーを並べる
+				int& nChildren = mChildCount[sParent];
+				if (nChildren == 0)
+				{
+					for (int i = 1; i <= nFanout; ++i)
+						fprintf(pFile, "%d\t%s%d\tf-%d\t\t0\t1\t\n", GlowElementType_Node, sPrefix.c_str(), i, i);
+					nChildren = nFanout;
+				}
+				std::string sNumbers = sPrefix + std::to_string(++nChildren);
+				mNodes[sCurrent] = sNumbers;
+
+				if (!isLeaf)
+					fprintf(pFile, "%d\t%s\t%s\t\t0\t1\t\n", GlowElementType_Node, sNumbers.c_str(), sIdentifier.c_str());
+				else if (BenchLeaves[leaf].nType == GlowElementType_Function)
+					fprintf(pFile, "%d\t%s\t%s\t\t0\t0\n", GlowElementType_Function, sNumbers.c_str(), sIdentifier.c_str());
+				else
+					fprintf(pFile, "%d\t%s\t%d\t%s\t\t%d\t0\t0\t\t0\t\t%d\t1\t1\t0\t%d\t0\t\n",
+						GlowElementType_Parameter, sNumbers.c_str(), (int)GlowFieldFlag_All, sIdentifier.c_str(),
+						BenchLeaves[leaf].nParameterType, (int)GlowAccess_ReadWrite, BenchLeaves[leaf].nParameterType);
+			}
+			sParent = sCurrent;
+			pos = next + 1;
+		}
+	}
+
+	fclose(pFile);
+	return true;
+}
+
+/// <summary>
+/// メモリ計測用スナップショット作成
+/// </summary>
+/// <param name="sPath">出力先</param>
+/// <returns></returns>
+/// <remarks>
+/// /mem/ch-N/p-M のチャンネル構成（プロバイダの典型として、チャンネル間で識別子・説明が重複する）
+/// </remarks>
+static bool WriteMemorySnapshot(const std::string& sPath)
+{
+	FILE* pFile = fopen(sPath.c_str(), "wb");
+	if (!pFile)
+		return false;
+
+	fprintf(pFile, "EMBERSNAPSHOT\t1\n");
+	fprintf(pFile, "%d\t%d\tmem\t\t0\t1\t\n", GlowElementType_Node, BENCH_MEMORY_TOP_NUMBER);
+	for (int channel = 1; channel <= BENCH_MEMORY_CHANNELS; ++channel)
+	{
+		fprintf(pFile, "%d\t%d.%d\tch-%d\tchannel\t0\t1\t\n", GlowElementType_Node, BENCH_MEMORY_TOP_NUMBER, channel, channel);
+		for (int parameter = 1; parameter <= BENCH_MEMORY_PARAMETERS; ++parameter)
+			fprintf(pFile, "%d\t%d.%d.%d\t%d\tp-%d\tparameter %d\t%d\t0\t0\t\t0\t\t%d\t1\t1\t0\t%d\t0\t\n",
+				GlowElementType_Parameter, BENCH_MEMORY_TOP_NUMBER, channel, parameter, (int)GlowFieldFlag_All, parameter, parameter,
+				GlowParameterType_Integer, (int)GlowAccess_ReadWrite, GlowParameterType_Integer);
+	}
+
+	fclose(pFile);
+	return true;
+}
+
+/// <summary>
+/// ラベル計測用スナップショット作成
+/// </summary>
+/// <param name="sPath">出力先</param>
+/// <returns></returns>
+/// <remarks>
+/// /lbl/matrix（BENCH_LABEL_SIGNALS × BENCH_LABEL_SIGNALS）と、ラベル基準ノード /lbl/labels 配下の
+/// targets/sources に信号番号を番号とする文字列パラメータを並べる
+/// </remarks>
+static bool WriteLabelSnapshot(const std::string& sPath)
+{
+	FILE* pFile = fopen(sPath.c_str(), "wb");
+	if (!pFile)
+		return false;
+
+	fprintf(pFile, "EMBERSNAPSHOT\t1\n");
+	fprintf(pFile, "%d\t%d\tlbl\t\t0\t1\t\n", GlowElementType_Node, BENCH_LABEL_TOP_NUMBER);
+	fprintf(pFile, "%d\t%d.1\tmatrix\t\t%d\t%d\t%d\t%d\t0\t0\t\t1\t%d.2\tPrimary\n",
+		GlowElementType_Matrix, BENCH_LABEL_TOP_NUMBER, GlowMatrixType_OneToN, GlowMatrixAddressingMode_Linear,
+		BENCH_LABEL_SIGNALS, BENCH_LABEL_SIGNALS, BENCH_LABEL_TOP_NUMBER);
+	fprintf(pFile, "%d\t%d.2\tlabels\t\t0\t1\t\n", GlowElementType_Node, BENCH_LABEL_TOP_NUMBER);
+	for (int kind = 1; kind <= 2; ++kind)
+	{
+		fprintf(pFile, "%d\t%d.2.%d\t%s\t\t0\t1\t\n", GlowElementType_Node, BENCH_LABEL_TOP_NUMBER, kind, (kind == 1) ? "targets" : "sources");
+		for (int signal = 0; signal < BENCH_LABEL_SIGNALS; ++signal)
+			fprintf(pFile, "%d\t%d.2.%d.%d\t%d\t%c-%d\t\t%d\t%s %04d\t0\t\t0\t\t%d\t1\t1\t0\t%d\t0\t\n",
+				GlowElementType_Parameter, BENCH_LABEL_TOP_NUMBER, kind, signal, (int)GlowFieldFlag_All, (kind == 1) ? 't' : 's', signal,
+				GlowParameterType_String, (kind == 1) ? "DEST" : "SRC", signal + 1, (int)GlowAccess_ReadWrite, GlowParameterType_String);
+	}
+
+	fclose(pFile);
+	return true;
+}
+
+/// <summary>
+/// 送信抑止用キャプチャファイル作成
+/// </summary>
+/// <param name="sPath">出力先</param>
+/// <returns></returns>
+/// <remarks>
+/// リプレイ中は HWIF 送信を行わないため、送信記録 1 件のファイルを読み込ませる
+/// </remarks>
+static bool WriteCapture(const std::string& sPath)
+{
+	FILE* pFile = fopen(sPath.c_str(), "wb");
+	if (!pFile)
+		return false;
+
+	unsigned char header[CAPTURE_FILE_HEADER_SIZE] = { 0 };
+	memcpy(header, CAPTURE_FILE_MAGIC, 4);
+	header[4] = CAPTURE_FILE_VERSION;
+	unsigned char record[CAPTURE_RECORD_HEADER_SIZE + 1] = { 0 };
+	record[8] = (unsigned char)ClientSocketId::SOCK_HWIF;
+	record[9] = (unsigned char)CaptureDirection::CAPTURE_SEND;
+	record[10] = 1;
+
+	bool res = (fwrite(header, sizeof(header), 1, pFile) == 1)
+			&& (fwrite(record, sizeof(record), 1, pFile) == 1);
+	fclose(pFile);
+	return res;
+}
+
+/// <summary>
+/// 結果出力（JSON）
+/// </summary>
+/// <param name="sPath">出力先</param>
+/// <returns></returns>
+static bool WriteResults(const std::string& sPath)
+{
+	FILE* pFile = fopen(sPath.c_str(), "wb");
+	if (!pFile)
+		return false;
+
+	fprintf(pFile, "{\n  \"benchmarks\": [\n");
+	for (size_t i = 0; i < m_vResults.size(); ++i)
+	{
+		const BenchResult& sResult = m_vResults[i];
+		fprintf(pFile, "    { \"name\": \"%s\", \"iterations\": %lld, \"ns_per_op\": %.1f, \"ops_per_sec\": %.0f }%s\n",
+			sResult.sName.c_str(), sResult.nIterations, sResult.dNsPerOp,
+			(sResult.dNsPerOp > 0.0) ? (1.0e9 / sResult.dNsPerOp) : 0.0,
+			(i + 1 < m_vResults.size()) ? "," : "");
+	}
+	fprintf(pFile, "  ]\n}\n");
+	fclose(pFile);
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	int nFanout = BENCH_DEFAULT_FANOUT;
+	std::string sOutput = "bench.json";
+	for (int i = 1; i < argc; ++i)
+	{
+		if ((strcmp(argv[i], "-iterations") == 0) && (i + 1 < argc))
+			m_nIterations = atoll(argv[++i]);
+		else if ((strcmp(argv[i], "-fanout") == 0) && (i + 1 < argc))
+			nFanout = atoi(argv[++i]);
+		else if ((strcmp(argv[i], "-filter") == 0) && (i + 1 < argc))
+			m_sFilter = argv[++i];
+		else if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc))
+			sOutput = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: %s [-iterations N] [-fanout N] [-filter name] [-o file]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	//
+	// 計測環境準備
+	//
+	std::string sSnapshot = sOutput + ".snapshot";
+	std::string sCapture = sOutput + ".capture";
+	if (!WriteSnapshot(sSnapshot, nFanout) || !WriteCapture(sCapture)
+	 || !CCapture::GetInstance()->LoadReplay(sCapture))
+	{
+		fprintf(stderr, "work file error, %s\n", sOutput.c_str());
+		return 1;
+	}
+
+	// リプレイ用セッションを生成し、ツリーを読み込む（終端のみのデータは読み捨てられる）
+	auto pBenchConsumer = new CBenchEmberConsumer();
+	m_pNmosEmberConsumer = pBenchConsumer;
+	const unsigned char eof = 0xFF;
+	m_pNmosEmberConsumer->Replay(&eof, 1);
+	Element* pRoot = m_pNmosEmberConsumer->m_sRemoteContent.pTopNode;
+	int nElements = pRoot ? element_readSnapshot(pRoot, sSnapshot.c_str()) : -1;
+	remove(sSnapshot.c_str());
+	remove(sCapture.c_str());
+	if (nElements <= 0)
+	{
+		fprintf(stderr, "snapshot load error\n");
+		return 1;
+	}
+	fprintf(stderr, "tree elements = %d, fanout = %d\n", nElements, nFanout);
+
+	// 末端の数値パス
+	std::vector<std::vector<berint>> vPaths{};
+	for (int leaf = 0; leaf < BenchLeafCount; ++leaf)
+	{
+		berint* pPath = nullptr;
+		size_t len = convertString2Path(pRoot, (pstr)BenchLeaves[leaf].pPath, &pPath);
+		if (!pPath || (len == 0))
+		{
+			fprintf(stderr, "path error, %s\n", BenchLeaves[leaf].pPath);
+			return 1;
+		}
+		vPaths.emplace_back(pPath, pPath + len);
+		freeMemory(pPath);
+	}
+
+	//
+	// パス変換・ツリー検索
+	//
+	RunBench("path.string2path", 1, [&](long long i)
+	{
+		berint* pPath = nullptr;
+		convertString2Path(pRoot, (pstr)BenchLeaves[i % BenchLeafCount].pPath, &pPath);
+		if (pPath)
+			freeMemory(pPath);
+	});
+	RunBench("path.path2string", 1, [&](long long i)
+	{
+		const auto& vPath = vPaths[i % BenchLeafCount];
+		pstr pValue = convertPath2String(pRoot, vPath.data(), (int)vPath.size());
+		if (pValue)
+			freeMemory(pValue);
+	});
+	RunBench("tree.findDescendant", 1, [&](long long i)
+	{
+		const auto& vPath = vPaths[i % BenchLeafCount];
+		element_findDescendant(pRoot, vPath.data(), (int)vPath.size(), NULL);
+	});
+
+	//
+	// 送受信要素生成
+	//
+	RunBench("content.getDirectory", 1, [&](long long i)
+	{
+		RequestId requestId = { 0 };
+		const auto& vPath = vPaths[i % BenchLeafCount];
+		releaseEmberContent(createEmberGetDirectoryContent(&requestId, vPath.data(), (int)vPath.size()));
+	});
+	RunBench("content.setParameter", 1, [&](long long i)
+	{
+		RequestId requestId = { 0 };
+		GlowParameter parameter;
+		bzero_item(parameter);
+		parameter.value.flag = GlowParameterType_Integer;
+		parameter.value.choice.integer = (berlong)(i & 0xFF);
+		const auto& vPath = vPaths[0];
+		releaseEmberContent(createEmberSetParameterContent(&requestId, vPath.data(), (int)vPath.size(), &parameter));
+	});
+	RunBench("content.invoke", 1, [&](long long i)
+	{
+		RequestId requestId = { 0 };
+		GlowInvocation invocation;
+		bzero_item(invocation);
+		const auto& vPath = vPaths[4];
+		releaseEmberContent(createEmberInvokeContent(&requestId, vPath.data(), (int)vPath.size(), &invocation));
+	});
+
+	//
+	// 割り当て集計
+	// memory.alloc は割り当て元の登録済の newobj/freeMemory の往復（集計の更新を含む）
+	//
+	RunBench("memory.alloc", 1, [&](long long i)
+	{
+		GlowValue* pValue = newobj(GlowValue);
+		freeMemory(pValue);
+	});
+
+	//
+	// ツリー使用量
+	// 合成ツリーの読み込み前後の確保量差をエレメント数で割る（共有文字列の格納領域を含む）
+	// memory.findByIdentifier は共有文字列のアドレス比較、memory.findByIdentifierNoCase は大文字・小文字を無視した比較
+	//
+	{
+		std::string sMemorySnapshot = sOutput + ".memory";
+		AllocationStatistics sBefore{};
+		AllocationStatistics sAfter{};
+		getAllocationStatistics(&sBefore, nullptr, 0);
+		int nMemoryElements = WriteMemorySnapshot(sMemorySnapshot) ? element_readSnapshot(pRoot, sMemorySnapshot.c_str()) : -1;
+		remove(sMemorySnapshot.c_str());
+		getAllocationStatistics(&sAfter, nullptr, 0);
+
+		if (nMemoryElements > 0)
+		{
+			InternStatistics sIntern{};
+			getInternStatistics(&sIntern);
+			fprintf(stderr, "memory tree = %d elements, %.1f bytes/element, %.2f blocks/element (element header = %d bytes)\n",
+				nMemoryElements,
+				(double)(sAfter.liveBytes - sBefore.liveBytes) / nMemoryElements,
+				(double)(sAfter.live - sBefore.live) / nMemoryElements,
+				(int)element_headerSize());
+			fprintf(stderr, "intern strings = %zu (%zu bytes, %zu blocks), hits = %zu / %zu\n",
+				sIntern.strings, sIntern.bytes, sIntern.blocks, sIntern.hits, sIntern.lookups);
+
+			std::vector<std::string> vMemoryPaths{};
+			std::vector<std::string> vMemoryPathsNoCase{};
+			for (int channel = 1; channel <= BENCH_MEMORY_CHANNELS; channel += 17)
+			{
+				vMemoryPaths.push_back(Format("/mem/ch-%d/p-%d", channel, (channel % BENCH_MEMORY_PARAMETERS) + 1));
+				vMemoryPathsNoCase.push_back(Format("/MEM/CH-%d/P-%d", channel, (channel % BENCH_MEMORY_PARAMETERS) + 1));
+			}
+			RunBench("memory.findByIdentifier", 1, [&](long long i)
+			{
+				berint* pPath = nullptr;
+				convertString2Path(pRoot, (pstr)vMemoryPaths[i % vMemoryPaths.size()].c_str(), &pPath);
+				if (pPath)
+					freeMemory(pPath);
+			});
+			RunBench("memory.findByIdentifierNoCase", 1, [&](long long i)
+			{
+				berint* pPath = nullptr;
+				convertString2Path(pRoot, (pstr)vMemoryPathsNoCase[i % vMemoryPathsNoCase.size()].c_str(), &pPath);
+				if (pPath)
+					freeMemory(pPath);
+			});
+		}
+		else
+			fprintf(stderr, "memory snapshot load error\n");
+	}
+
+	//
+	// マトリックスラベル（4096 信号のマトリックスに対する 40RU パネル全ボタンのラベル再設定）
+	// 前半を DEST、後半を SRC とし、ページ替相当に毎回信号番号をずらす
+	// labels.panelRefresh は参照識別による取得（DeviceAction の RefreshXptLabels 相当）、
+	// labels.panelRefreshByPath はマトリックスパス（文字列）による取得
+	//
+	{
+		std::string sLabelSnapshot = sOutput + ".labels";
+		int nLabelElements = WriteLabelSnapshot(sLabelSnapshot) ? element_readSnapshot(pRoot, sLabelSnapshot.c_str()) : -1;
+		remove(sLabelSnapshot.c_str());
+
+		std::string sMatrixPath = "/lbl/matrix";
+		berint* pMatrixPath = nullptr;
+		int nMatrixPathLength = (nLabelElements > 0) ? (int)convertString2Path(pRoot, (pstr)sMatrixPath.c_str(), &pMatrixPath) : 0;
+		Element* pMatrixElement = (nMatrixPathLength > 0) ? element_findDescendant(pRoot, pMatrixPath, nMatrixPathLength, NULL) : nullptr;
+		MatrixLabelsHandle hMatrix = MATRIX_LABELS_HANDLE_INVALID;
+		if (pMatrixElement && (pMatrixElement->type == GlowElementType_Matrix))
+		{
+			// マトリックス受信時と同じくツリーからラベルを収集する
+			EmberContent sMatrix;
+			bzero_item(sMatrix);
+			sMatrix.type = GlowType_Matrix;
+			sMatrix.pPath = pMatrixPath;
+			sMatrix.pathLength = nMatrixPathLength;
+			memcpy(&sMatrix.matrix, &pMatrixElement->glow.pMatrix->matrix, sizeof(sMatrix.matrix));
+			if (pBenchConsumer->ResetMatrixLabels(&sMatrix))
+				hMatrix = pBenchConsumer->InternMatrixLabels(sMatrixPath);
+		}
+		if (pMatrixPath)
+			freeMemory(pMatrixPath);
+
+		if (hMatrix != MATRIX_LABELS_HANDLE_INVALID)
+		{
+			const int nHalf = BTNCNT_40RU / 2;
+			size_t nSink = 0;
+			std::string sLabel{};
+			fprintf(stderr, "label tree = %d elements, signals = %d, buttons = %d\n", nLabelElements, BENCH_LABEL_SIGNALS, BTNCNT_40RU);
+			RunBench("labels.panelRefresh", 10, [&](long long i)
+			{
+				berint nTop = (berint)((i * nHalf) % BENCH_LABEL_SIGNALS);
+				for (int button = 0; button < BTNCNT_40RU; ++button)
+				{
+					berint nSignal = (nTop + (button % nHalf)) % BENCH_LABEL_SIGNALS;
+					if ((button < nHalf) ? pBenchConsumer->GetTargetLabel(hMatrix, nSignal, sLabel)
+										 : pBenchConsumer->GetSourceLabel(hMatrix, nSignal, sLabel))
+						nSink += sLabel.size();
+				}
+			});
+			RunBench("labels.panelRefreshByPath", 10, [&](long long i)
+			{
+				berint nTop = (berint)((i * nHalf) % BENCH_LABEL_SIGNALS);
+				for (int button = 0; button < BTNCNT_40RU; ++button)
+				{
+					berint nSignal = (nTop + (button % nHalf)) % BENCH_LABEL_SIGNALS;
+					if ((button < nHalf) ? pBenchConsumer->GetTargetLabel(sMatrixPath, nSignal, sLabel)
+										 : pBenchConsumer->GetSourceLabel(sMatrixPath, nSignal, sLabel))
+						nSink += sLabel.size();
+				}
+			});
+			fprintf(stderr, "label sink = %zu\n", nSink);
+		}
+		else
+			fprintf(stderr, "label snapshot load error\n");
+	}
+
+	//
+	// ボタン設定検索
+	//
+	{
+		std::vector<std::vector<std::string>> vLines{};
+		for (int button = 0; button < BTNCNT_40RU; ++button)
+			vLines.push_back({ std::to_string(button), "1", "1", "Src", Format("SRC%d", button + 1), std::to_string(button + 1), "", "1" });
+		GroupPage groupPage(1, 1, vLines);
+		RunBench("groupPage.getContent", 10, [&](long long i)
+		{
+			DeviceContent* pContent = groupPage.GetContent((int)(i % BTNCNT_40RU));
+			if (pContent)
+				delete pContent;
+		});
+	}
+
+	//
+	// ボタン状態解析（40RU、2 ボタン同時押下／同時解放で操作要求は出さない）
+	//
+	{
+		struct structBASICSTATUS_ANS basicStatus;
+		memset(&basicStatus, 0, sizeof(basicStatus));
+		basicStatus.kishu = (uint8_t)'2';
+		SetBasicStatus(basicStatus);
+
+		struct structBUTTON_40RU aStatus[2];
+		for (auto& sStatus : aStatus)
+		{
+			memset(&sStatus, '0', sizeof(sStatus));
+			sStatus.endcode = 0x0a;
+		}
+		aStatus[1].btns[3] = '1';
+		aStatus[1].btns[BTNCNT_40RU - 2] = '1';
+		RunBench("button.analyze40ru", 1, [&](long long i)
+		{
+			ActionId doneAction = ActionId::ACTION_NONE;
+			AnalyzeButtonAction(aStatus[i & 1], doneAction);
+		});
+	}
+
+	//
+	// ボタン表示出力（全ボタン送り直し、ページ替相当）
+	// 40RU は LED のみ、18D は LED と OLED
+	//
+	{
+		struct structBASICSTATUS_ANS basicStatus;
+		memset(&basicStatus, 0, sizeof(basicStatus));
+		std::vector<char> vMessages{};
+		for (char kishu : { '2', '0' })
+		{
+			basicStatus.kishu = (uint8_t)kishu;
+			SetBasicStatus(basicStatus);
+			vMessages.clear();
+			int nMessages = ComposeButtonOutput(vMessages);
+			fprintf(stderr, "button output, kishu = %c : messages = %d, bytes = %zu\n", kishu, nMessages, vMessages.size());
+			RunBench((kishu == '2') ? "button.compose40ru" : "button.compose18d", 1, [&](long long i)
+			{
+				ClearButtonOutput();
+				vMessages.clear();
+				ComposeButtonOutput(vMessages);
+			});
+		}
+		basicStatus.kishu = (uint8_t)'2';
+		SetBasicStatus(basicStatus);
+	}
+
+	//
+	// HWIF メッセージ復号（受信バッファ上の検証と型付き参照、数値フィールドの復号まで）
+	// api.init.* は送信メッセージの len / command / 終端コード設定
+	//
+	{
+		long long nSink = 0;
+		auto fnButtons = [&](const char* pName, auto message)
+		{
+			apiformat::InitMessage(message);
+			memset(message.btns, '0', sizeof(message.btns));
+			message.btns[3] = '1';
+			std::vector<char> vBuffer((const char*)&message, (const char*)&message + sizeof(message));
+			RunBench(pName, 10, [&](long long i)
+			{
+				vBuffer[apiformat::ButtonsOffset + (i & 7)] ^= 1;
+				apiformat::MessageView<decltype(message)> view(vBuffer.data(), vBuffer.size());
+				if (view.Valid())
+					nSink += apiformat::ButtonCount(vBuffer.size()) + view->btns[i & 7];
+			});
+		};
+		fnButtons("api.view.button18d", structBUTTON_18D{});
+		fnButtons("api.view.button39d", structBUTTON_39D{});
+		fnButtons("api.view.button40ru", structBUTTON_40RU{});
+
+		// 毎回値が変わるよう -128～+127 を巡回させる
+		std::vector<structROTARY> vRotary(256);
+		for (int value = -128; value < 128; ++value)
+		{
+			auto& rotary = vRotary[value + 128];
+			apiformat::InitMessage(rotary);
+			rotary.value = 0;
+			memcpy(&rotary.value, Format("%c%03d", (value < 0) ? '-' : '+', abs(value)).c_str(), sizeof(rotary.value));
+			rotary.pushed = (value & 1) ? '1' : '0';
+		}
+		RunBench("api.view.rotary", 10, [&](long long i)
+		{
+			const auto& rotary = vRotary[i & 0xFF];
+			apiformat::MessageView<structROTARY> view(&rotary, sizeof(rotary));
+			if (view.Valid())
+				nSink += apiformat::RotaryValue(*view) + (apiformat::RotaryPushed(*view) ? 1 : 0);
+		});
+
+		structSTATUS_ANS statusAns;
+		memset(&statusAns, '0', sizeof(statusAns));
+		apiformat::InitMessage(statusAns);
+		RunBench("api.view.statusAns", 10, [&](long long i)
+		{
+			statusAns.poe = (uint8_t)('0' + (i & 1));
+			apiformat::MessageView<structSTATUS_ANS> view(&statusAns, sizeof(statusAns));
+			if (view.Valid())
+				nSink += view->poe;
+		});
+		structBASICSTATUS_ANS basicStatusAns;
+		memset(&basicStatusAns, '0', sizeof(basicStatusAns));
+		apiformat::InitMessage(basicStatusAns);
+		RunBench("api.view.basicStatusAns", 10, [&](long long i)
+		{
+			basicStatusAns.kishu = (uint8_t)('0' + (i % 3));
+			apiformat::MessageView<structBASICSTATUS_ANS> view(&basicStatusAns, sizeof(basicStatusAns));
+			if (view.Valid())
+				nSink += apiformat::ParseDecimal<4>((const uint8_t*)&view->ifVersion).m_nValue + view->kishu;
+		});
+
+		RunBench("api.init.basicStatusReq", 10, [&](long long i)
+		{
+			structBASICSTATUS_REQ request;
+			apiformat::InitMessage(request);
+			nSink += request.endcode;
+		});
+		RunBench("api.init.statusLed", 10, [&](long long i)
+		{
+			structSTATUS_LED request;
+			apiformat::InitMessage(request);
+			request.powerLED = { LED_MODE::on, LED_COLOR::LEDgreen };
+			request.busyLED = { (i & 1) ? LED_MODE::blink : LED_MODE::off, LED_COLOR::LEDorange };
+			request.lockLED = { LED_MODE::off, LED_COLOR::LEDred };
+			nSink += request.busyLED.mode;
+		});
+		fprintf(stderr, "api sink = %lld\n", nSink);
+	}
+
+	//
+	// LINE UNIT 受信処理（Ember+ 要求の生成と符号化まで、送信は抑止）
+	//
+	{
+		char aPgm[10] = { 'F', 'O', 'R', 'A', 0x00, 0x04, 0x00, 0x00, 0x01, 0x01 };
+		char aPst[10] = { 'F', 'O', 'R', 'A', 0x00, 0x04, 0x00, 0x00, 0x2E, 0x01 };
+		char aXpt[10] = { 'F', 'O', 'R', 'A', 0x00, 0x04, 0x00, 0x00, 0x5B, 0x01 };
+		char aFader[11] = { 'F', 'O', 'R', 'A', 0x00, 0x05, 0x03, 0x00, 0x00, 0x00, 0x00 };
+		CLineUnitPanel panel(0, 0, "bench");
+		RunBench("lineUnit.pgm", 10, [&](long long i)
+		{
+			aPgm[8] = (char)(1 + (i % 25));
+			LineUnitCommand(panel, aPgm);
+		});
+		RunBench("lineUnit.pst", 10, [&](long long i)
+		{
+			aPst[8] = (char)(46 + (i % 25));
+			LineUnitCommand(panel, aPst);
+		});
+		RunBench("lineUnit.xpt", 10, [&](long long i)
+		{
+			aXpt[8] = (char)(91 + (i % 25));
+			LineUnitCommand(panel, aXpt);
+		});
+		RunBench("lineUnit.fader", 10, [&](long long i)
+		{
+			// 毎回送信値（百分率）が変わるよう 0～100% を往復させる
+			int percent = (int)(i % 200);
+			if (percent > 100)
+				percent = 200 - percent;
+			unsigned int value = (unsigned int)((percent * 65535 + 99) / 100);
+			aFader[9] = (char)((value >> 8) & 0xFF);
+			aFader[10] = (char)(value & 0xFF);
+			LineUnitCommand(panel, aFader);
+		});
+	}
+
+	//
+	// パラメータ通知受信（Glow 復号・ツリー反映・振り分けまで、LINE UNIT への送信は抑止）
+	// notify.registered は振り分け登録パス（PGM 列）、notify.unregistered は未登録パス（PGM 列タリー）
+	// notify.fanout は接続上限までパネルを接続した状態の notify.registered（符号化は通知ごとに 1 度）
+	//
+	{
+		std::unordered_map<std::string, int> mpDispatch{ { std::string(BenchLeaves[0].pPath), 0 } };
+		m_pNmosEmberConsumer->SetParameterDispatch(mpDispatch);
+
+		// 毎回値が変わるよう 25 通りの通知を符号化しておく
+		auto fnEncode = [](const std::vector<berint>& vPath, std::vector<std::vector<unsigned char>>& vFrames)
+		{
+			for (int value = 1; value <= 25; ++value)
+			{
+				std::vector<unsigned char> vFrame(EMBER_MAXIMUM_PACKAGE_LENGTH);
+				GlowOutput output;
+				GlowParameter parameter;
+				bzero_item(parameter);
+				parameter.value.flag = GlowParameterType_Integer;
+				parameter.value.choice.integer = value;
+				glowOutput_init(&output, vFrame.data(), (unsigned int)vFrame.size(), 0);
+				glowOutput_beginPackage(&output, true);
+				glow_writeQualifiedParameter(&output, &parameter, GlowFieldFlag_Value, vPath.data(), (int)vPath.size());
+				vFrame.resize(glowOutput_finishPackage(&output));
+				vFrames.push_back(vFrame);
+			}
+		};
+		std::vector<std::vector<unsigned char>> vRegistered{};
+		std::vector<std::vector<unsigned char>> vUnregistered{};
+		fnEncode(vPaths[0], vRegistered);
+		fnEncode(vPaths[1], vUnregistered);
+		RunBench("notify.registered", 10, [&](long long i)
+		{
+			const auto& vFrame = vRegistered[i % vRegistered.size()];
+			m_pNmosEmberConsumer->Replay(vFrame.data(), (int)vFrame.size());
+		});
+		RunBench("notify.unregistered", 10, [&](long long i)
+		{
+			const auto& vFrame = vUnregistered[i % vUnregistered.size()];
+			m_pNmosEmberConsumer->Replay(vFrame.data(), (int)vFrame.size());
+		});
+
+		std::vector<int> vPeers{};
+		for (int n = 0; n < LINE_UNIT_PANEL_MAX; ++n)
+		{
+			int aPair[2];
+			if (socketpair(AF_UNIX, SOCK_STREAM, 0, aPair) != 0)
+				break;
+			struct sockaddr_in cad {};
+			CLineUnitPanels::GetInstance()->Add(aPair[0], cad);
+			vPeers.push_back(aPair[1]);
+		}
+		RunBench("notify.fanout", 10, [&](long long i)
+		{
+			const auto& vFrame = vRegistered[i % vRegistered.size()];
+			m_pNmosEmberConsumer->Replay(vFrame.data(), (int)vFrame.size());
+		});
+		CLineUnitPanels::GetInstance()->Clear();
+		for (int peer : vPeers)
+			close(peer);
+
+		//
+		// 監視パラメータ通知（EmberValue ボタンのパラメータ変化から再描画対象になるまで）
+		// Watcher の代わりに結果を取り出してパラメータ通知処理を呼び出す
+		//
+		std::string sDevice = sOutput + ".device.csv";
+		FILE* pDevice = fopen(sDevice.c_str(), "w");
+		if (pDevice)
+		{
+			fprintf(pDevice, "1,0,0,EmberValue,VALUE,%s,1,1\n", BenchLeaves[3].pPath);
+			fclose(pDevice);
+		}
+		ClearDeviceStatus(sDevice);
+		remove(sDevice.c_str());
+		// 監視パスの振り分け登録（リプレイ後の要求展開で登録される）
+		m_pNmosEmberConsumer->Replay(&eof, 1);
+		std::vector<int> vDirty{};
+		IsUpdateMatrix();
+		TakeDirtyButtons(vDirty);
+
+		std::vector<std::vector<unsigned char>> vWatched{};
+		fnEncode(vPaths[3], vWatched);
+		long long nDirty = 0;
+		long long nWatched = 0;
+		RunBench("notify.watched", 10, [&](long long i)
+		{
+			const auto& vFrame = vWatched[i % vWatched.size()];
+			m_pNmosEmberConsumer->Replay(vFrame.data(), (int)vFrame.size());
+			EmberContent* pResult;
+			while ((pResult = pBenchConsumer->GetConsumerResult()) != nullptr)
+			{
+				EmberContentPtr pOwnedResult(pResult);
+				if (pResult->type == GlowType_Parameter)
+					pBenchConsumer->ProcessParameterResult(pOwnedResult);
+			}
+			++nWatched;
+			if (IsUpdateMatrix() && (TakeDirtyButtons(vDirty) == 1) && (vDirty[0] == 0))
+				++nDirty;
+		});
+		fprintf(stderr, "watched parameter dirty = %lld / %lld\n", nDirty, nWatched);
+		ClearDeviceStatus("");
+	}
+
+	//
+	// トレース出力
+	// output.trace は設定（OutputTrace）に従った呼び出し、output.write は設定によらず整形・出力まで
+	//
+	RunBench("output.trace", 1, [&](long long i)
+	{
+		Trace(__FILE__, __LINE__, __FUNCTION__, "bench trace %lld\n", i);
+	});
+	RunBench("output.write", 10, [&](long long i)
+	{
+		WriteTrace(__FILE__, __LINE__, __FUNCTION__, "bench trace %lld\n", i);
+	});
+
+	// 計測後も確保中のままの割り当ては計測対象の解放漏れ
+	AllocationStatistics sAllocation{};
+	int nSites = getAllocationStatistics(&sAllocation, nullptr, 0);
+	fprintf(stderr, "memory live = %lld blocks (%lld bytes), peak = %lld blocks, total = %lld allocations, %d sites\n",
+		sAllocation.live, sAllocation.liveBytes, sAllocation.peak, sAllocation.total, nSites);
+
+	if (!WriteResults(sOutput))
+	{
+		fprintf(stderr, "output error, %s\n", sOutput.c_str());
+		return 1;
+	}
+	fprintf(stderr, "results : %s\n", sOutput.c_str());
+	return 0;
+}
@@ -0,0 +1,1287 @@
+﻿/*
+   Ember+ provider stand-in
+
+   CEmberConsumer / LINE UNIT 変換の負荷・規模確認用の疑似プロバイダ
+   libember_slim の glowtx/emberframing でエンコードし、
+   合成ツリー（深さ・分岐数・パラメータ数・N×M マトリックスとラベル）を提供する
+
+   - GetDirectory / Subscribe / Unsubscribe / Invoke に応答する
+   - パラメータ設定・マトリックス接続を適用し、要求元と監視中のコンシューマへ通知する
+   - パラメータ・接続・ラベルの変更を指定レートで発生させる（変更ストーム）
+*/
+
+#include "SocketEx.h"
+#include "emberplus.h"
+#include "emberinternal.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#ifdef WIN32
+#define PROVIDER_SEND_FLAGS 0
+#else
+#include <sys/select.h>
+#include <sys/time.h>
+#define PROVIDER_SEND_FLAGS MSG_NOSIGNAL
+#define _stricmp(val1, val2) strcasecmp(val1, val2)
+#define _strdup(pStr) strdup(pStr)
+#endif
+
+
+// ====================================================================
+//
+// definitions
+//
+// ====================================================================
+
+/// <summary>待ち受けポート既定値</summary>
+#define PROVIDER_PORT_DEF           9000
+/// <summary>同時接続コンシューマ数上限（監視ビット幅）</summary>
+#define PROVIDER_CLIENT_MAX         8
+/// <summary>送信パッケージ領域</summary>
+#define PROVIDER_TX_BUFFER_SIZE     4096
+/// <summary>受信パッケージ領域（コンシューマと同じ上限）</summary>
+#define PROVIDER_RX_BUFFER_SIZE     1290
+/// <summary>1パッケージへ追記を続ける目安（エスケープ後バイト数）</summary>
+/// <remarks>
+/// 1要素の追記で EMBER_MAXIMUM_PACKAGE_LENGTH を超えない余裕を残す
+/// </remarks>
+#define PROVIDER_PACKAGE_THRESHOLD  640
+/// <summary>マトリックス信号・接続の1パッケージあたり件数</summary>
+#define PROVIDER_SIGNAL_CHUNK       32
+/// <summary>ストーム発生・送信の周期（msec）</summary>
+#define PROVIDER_TICK_MSEC          10
+/// <summary>統計出力周期（msec）</summary>
+#define PROVIDER_REPORT_MSEC        5000
+/// <summary>追加パス指定数上限</summary>
+#define PROVIDER_ADD_PATH_MAX       64
+/// <summary>識別子長上限</summary>
+#define PROVIDER_IDENTIFIER_LENGTH  64
+
+/// <summary>
+/// 提供エレメント
+/// </summary>
+/// <remarks>
+/// 子の番号は 1 からの連番とし、ppChildren[number - 1] で参照する
+/// </remarks>
+typedef struct tagProviderElement
+{
+    GlowElementType type;
+    berint number;
+    pstr pIdentifier;
+    struct tagProviderElement* pParent;
+    struct tagProviderElement** ppChildren;
+    int childCount;
+    int childCapacity;
+
+    /// <summary>変更通知先コンシューマ（接続スロットのビット）</summary>
+    unsigned int watchMask;
+
+    /// <summary>パラメータ値</summary>
+    GlowValue value;
+
+    /// <summary>マトリックス信号数</summary>
+    berint targetCount;
+    berint sourceCount;
+    /// <summary>ターゲット毎の接続ソース（未接続は -1）</summary>
+    berint* pConnections;
+    /// <summary>ラベルノードパス（targets=1 / sources=2 の親）</summary>
+    berint labelsPath[GLOW_MAX_TREE_DEPTH];
+    int labelsPathLength;
+} ProviderElement;
+
+/// <summary>
+/// 起動設定
+/// </summary>
+typedef struct tagProviderConfig
+{
+    unsigned short port;
+    int depth;
+    int fanout;
+    int params;
+    int matrices;
+    int targets;
+    int sources;
+    double paramRate;
+    double connectionRate;
+    double labelRate;
+    int duration;
+    unsigned int seed;
+    int addPathCount;
+    pcstr addPaths[PROVIDER_ADD_PATH_MAX];
+} ProviderConfig;
+
+/// <summary>
+/// 接続コンシューマ
+/// </summary>
+typedef struct tagProviderClient
+{
+    SOCKET sock;
+    int slot;
+    GlowReader* pReader;
+    byte* pRxBuffer;
+    GlowOutput output;
+    byte* pTxBuffer;
+    bool isPackageOpen;
+} ProviderClient;
+
+/// <summary>
+/// 統計
+/// </summary>
+typedef struct tagProviderStatistics
+{
+    unsigned long long rxBytes;
+    unsigned long long rxCommands;
+    unsigned long long txBytes;
+    unsigned long long txPackages;
+    unsigned long long parameterChanges;
+    unsigned long long connectionChanges;
+    unsigned long long labelChanges;
+    unsigned long long notifications;
+} ProviderStatistics;
+
+
+// ====================================================================
+//
+// globals
+//
+// ====================================================================
+
+static ProviderConfig config;
+static ProviderStatistics statistics;
+static ProviderElement root;
+static ProviderClient clients[PROVIDER_CLIENT_MAX];
+
+/// <summary>ストーム対象</summary>
+static ProviderElement** ppParameters = NULL;
+static int parameterCount = 0;
+static ProviderElement** ppLabels = NULL;
+static int labelCount = 0;
+static ProviderElement** ppMatrices = NULL;
+static int matrixCount = 0;
+
+static unsigned int randomState = 1;
+
+
+// ====================================================================
+//
+// utils
+//
+// ====================================================================
+
+static void onThrowError(int error, pcstr pMessage)
+{
+    fprintf(stderr, "ember error %d: '%s'\n", error, pMessage);
+}
+
+static void onFailAssertion(pcstr pFileName, int lineNumber)
+{
+    fprintf(stderr, "ember assertion failed @ %s:%d\n", pFileName, lineNumber);
+}
+
+static void* allocMemoryImpl(size_t size)
+{
+    return malloc(size);
+}
+
+static void freeMemoryImpl(void* pMemory)
+{
+    free(pMemory);
+}
+
+/// <summary>単調増加時刻（msec）</summary>
+/// <returns></returns>
+static unsigned long long monotonicMilliseconds()
+{
+#ifdef WIN32
+    return (unsigned long long)GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000ull + (unsigned long long)ts.tv_nsec / 1000000ull;
+#endif
+}
+
+/// <summary>擬似乱数（xorshift、シード指定で再現可能）</summary>
+/// <param name="range"></param>
+/// <returns>0 以上 range 未満</returns>
+static int nextRandom(int range)
+{
+    unsigned int x = randomState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    randomState = x;
+    return (range > 0) ? (int)(x % (unsigned int)range) : 0;
+}
+
+
+// ====================================================================
+//
+// tree
+//
+// ====================================================================
+
+/// <summary>子エレメント追加</summary>
+/// <param name="pParent"></param>
+/// <param name="type"></param>
+/// <param name="pIdentifier"></param>
+/// <returns></returns>
+static ProviderElement* element_addChild(ProviderElement* pParent, GlowElementType type, pcstr pIdentifier)
+{
+    ProviderElement* pChild;
+
+    if (pParent->childCount >= pParent->childCapacity)
+    {
+        int capacity = (pParent->childCapacity > 0) ? pParent->childCapacity * 2 : 4;
+        ProviderElement** ppChildren = (ProviderElement**)realloc(pParent->ppChildren, sizeof(ProviderElement*) * capacity);
+        if (!ppChildren)
+            return NULL;
+        pParent->ppChildren = ppChildren;
+        pParent->childCapacity = capacity;
+    }
+
+    pChild = (ProviderElement*)calloc(1, sizeof(ProviderElement));
+    if (!pChild)
+        return NULL;
+    pChild->type = type;
+    pChild->number = pParent->childCount + 1;
+    pChild->pIdentifier = _strdup(pIdentifier);
+    pChild->pParent = pParent;
+    pParent->ppChildren[pParent->childCount++] = pChild;
+
+    return pChild;
+}
+
+/// <summary>識別子で子エレメント検索</summary>
+/// <param name="pParent"></param>
+/// <param name="pIdentifier"></param>
+/// <returns></returns>
+static ProviderElement* element_findChild(const ProviderElement* pParent, pcstr pIdentifier)
+{
+    for (int i = 0; i < pParent->childCount; ++i)
+    {
+        if (strcmp(pParent->ppChildren[i]->pIdentifier, pIdentifier) == 0)
+            return pParent->ppChildren[i];
+    }
+    return NULL;
+}
+
+/// <summary>番号パスでエレメント検索</summary>
+/// <param name="pPath"></param>
+/// <param name="pathLength"></param>
+/// <returns>空パスは root</returns>
+static ProviderElement* element_find(const berint* pPath, int pathLength)
+{
+    ProviderElement* pCursor = &root;
+    for (int i = 0; (i < pathLength) && pCursor; ++i)
+    {
+        if ((pPath[i] < 1) || (pPath[i] > pCursor->childCount))
+            return NULL;
+        pCursor = pCursor->ppChildren[pPath[i] - 1];
+    }
+    return pCursor;
+}
+
+/// <summary>エレメントの番号パス取得</summary>
+/// <param name="pThis"></param>
+/// <param name="pPath"></param>
+/// <returns>パス長</returns>
+static int element_getPath(const ProviderElement* pThis, berint* pPath)
+{
+    berint reversed[GLOW_MAX_TREE_DEPTH];
+    int length = 0;
+
+    for (; pThis && (pThis != &root) && (length < GLOW_MAX_TREE_DEPTH); pThis = pThis->pParent)
+        reversed[length++] = pThis->number;
+    for (int i = 0; i < length; ++i)
+        pPath[i] = reversed[length - 1 - i];
+
+    return length;
+}
+
+/// <summary>エレメント解放（子を含む）</summary>
+/// <param name="pThis"></param>
+static void element_free(ProviderElement* pThis)
+{
+    for (int i = 0; i < pThis->childCount; ++i)
+    {
+        element_free(pThis->ppChildren[i]);
+        free(pThis->ppChildren[i]);
+    }
+    free(pThis->ppChildren);
+    free(pThis->pIdentifier);
+    free(pThis->pConnections);
+    if (pThis->type == GlowElementType_Parameter)
+        glowValue_free(&pThis->value);
+    memset(pThis, 0, sizeof(ProviderElement));
+}
+
+/// <summary>監視ビット解除（子を含む）</summary>
+/// <param name="pThis"></param>
+/// <param name="mask"></param>
+static void element_clearWatch(ProviderElement* pThis, unsigned int mask)
+{
+    pThis->watchMask &= ~mask;
+    for (int i = 0; i < pThis->childCount; ++i)
+        element_clearWatch(pThis->ppChildren[i], mask);
+}
+
+/// <summary>ストーム対象リストへ追加</summary>
+/// <param name="pppList"></param>
+/// <param name="pCount"></param>
+/// <param name="pElement"></param>
+static void appendTarget(ProviderElement*** pppList, int* pCount, ProviderElement* pElement)
+{
+    ProviderElement** ppList = (ProviderElement**)realloc(*pppList, sizeof(ProviderElement*) * (*pCount + 1));
+    if (!ppList)
+        return;
+    ppList[(*pCount)++] = pElement;
+    *pppList = ppList;
+}
+
+/// <summary>整数パラメータ追加</summary>
+/// <param name="pParent"></param>
+/// <param name="pIdentifier"></param>
+/// <param name="value"></param>
+/// <returns></returns>
+static ProviderElement* addIntegerParameter(ProviderElement* pParent, pcstr pIdentifier, berlong value)
+{
+    ProviderElement* pParameter = element_addChild(pParent, GlowElementType_Parameter, pIdentifier);
+    if (pParameter)
+    {
+        pParameter->value.flag = GlowParameterType_Integer;
+        pParameter->value.choice.integer = value;
+    }
+    return pParameter;
+}
+
+/// <summary>文字列パラメータ追加</summary>
+/// <param name="pParent"></param>
+/// <param name="pIdentifier"></param>
+/// <param name="pValue"></param>
+/// <returns></returns>
+static ProviderElement* addStringParameter(ProviderElement* pParent, pcstr pIdentifier, pcstr pValue)
+{
+    ProviderElement* pParameter = element_addChild(pParent, GlowElementType_Parameter, pIdentifier);
+    if (pParameter)
+    {
+        pParameter->value.flag = GlowParameterType_String;
+        pParameter->value.choice.pString = _strdup(pValue);
+    }
+    return pParameter;
+}
+
+/// <summary>合成ノード生成（再帰）</summary>
+/// <param name="pParent"></param>
+/// <param name="level">現在の深さ（1 始まり）</param>
+static void buildNodes(ProviderElement* pParent, int level)
+{
+    char identifier[PROVIDER_IDENTIFIER_LENGTH];
+
+    if (level > config.depth)
+    {
+        // 最下層ノードにパラメータを配置
+        for (int i = 1; i <= config.params; ++i)
+        {
+            snprintf(identifier, sizeof(identifier), "p-%d", i);
+            ProviderElement* pParameter = addIntegerParameter(pParent, identifier, 0);
+            if (pParameter)
+                appendTarget(&ppParameters, &parameterCount, pParameter);
+        }
+        return;
+    }
+
+    for (int i = 1; i <= config.fanout; ++i)
+    {
+        snprintf(identifier, sizeof(identifier), "n-%d", i);
+        ProviderElement* pNode = element_addChild(pParent, GlowElementType_Node, identifier);
+        if (pNode)
+            buildNodes(pNode, level + 1);
+    }
+}
+
+/// <summary>合成マトリックスとラベル生成</summary>
+/// <remarks>
+/// matrices/m-k がマトリックス、matrices/labels/m-k/targets|sources がラベル
+/// ラベルの basePath は labels/m-k（コンシューマは末尾 1/2 を付与して参照）
+/// </remarks>
+static void buildMatrices()
+{
+    char identifier[PROVIDER_IDENTIFIER_LENGTH];
+    char value[PROVIDER_IDENTIFIER_LENGTH];
+    ProviderElement* pMatrices;
+    ProviderElement* pLabels;
+
+    if (config.matrices <= 0)
+        return;
+
+    pMatrices = element_addChild(&root, GlowElementType_Node, "matrices");
+    if (!pMatrices)
+        return;
+
+    // マトリックスをラベルノードより先に番号付けする
+    for (int k = 1; k <= config.matrices; ++k)
+    {
+        snprintf(identifier, sizeof(identifier), "m-%d", k);
+        ProviderElement* pMatrix = element_addChild(pMatrices, GlowElementType_Matrix, identifier);
+        if (!pMatrix)
+            continue;
+        pMatrix->targetCount = config.targets;
+        pMatrix->sourceCount = config.sources;
+        pMatrix->pConnections = (berint*)malloc(sizeof(berint) * (config.targets > 0 ? config.targets : 1));
+        for (int t = 0; t < config.targets; ++t)
+            pMatrix->pConnections[t] = (config.sources > 0) ? (t % config.sources) : -1;
+        appendTarget(&ppMatrices, &matrixCount, pMatrix);
+    }
+
+    pLabels = element_addChild(pMatrices, GlowElementType_Node, "labels");
+    if (!pLabels)
+        return;
+
+    for (int k = 1; k <= config.matrices; ++k)
+    {
+        ProviderElement* pMatrix = pMatrices->ppChildren[k - 1];
+        snprintf(identifier, sizeof(identifier), "m-%d", k);
+        ProviderElement* pLabelNode = element_addChild(pLabels, GlowElementType_Node, identifier);
+        if (!pLabelNode)
+            continue;
+        pMatrix->labelsPathLength = element_getPath(pLabelNode, pMatrix->labelsPath);
+
+        ProviderElement* pTargets = element_addChild(pLabelNode, GlowElementType_Node, "targets");
+        ProviderElement* pSources = element_addChild(pLabelNode, GlowElementType_Node, "sources");
+        for (int t = 0; pTargets && (t < config.targets); ++t)
+        {
+            snprintf(identifier, sizeof(identifier), "t-%d", t);
+            snprintf(value, sizeof(value), "DST %d", t + 1);
+            ProviderElement* pLabel = addStringParameter(pTargets, identifier, value);
+            if (pLabel)
+                appendTarget(&ppLabels, &labelCount, pLabel);
+        }
+        for (int s = 0; pSources && (s < config.sources); ++s)
+        {
+            snprintf(identifier, sizeof(identifier), "s-%d", s);
+            snprintf(value, sizeof(value), "SRC %d", s + 1);
+            ProviderElement* pLabel = addStringParameter(pSources, identifier, value);
+            if (pLabel)
+                appendTarget(&ppLabels, &labelCount, pLabel);
+        }
+    }
+}
+
+/// <summary>識別子パス指定のエレメント追加</summary>
+/// <param name="pSpec">"/a/b/c[:int|real|string|bool|function|node]"</param>
+/// <remarks>
+/// 途中のノードは無ければ生成する
+/// 実機のパス（LINE UNIT 対応表の参照先など）を合成ツリーへ加える用途
+/// </remarks>
+static void addPath(pcstr pSpec)
+{
+    char buffer[1024];
+    char* pType;
+    char* pToken;
+    char* pNext;
+    ProviderElement* pCursor = &root;
+    GlowElementType type = GlowElementType_Parameter;
+    GlowParameterType valueType = GlowParameterType_Integer;
+
+    snprintf(buffer, sizeof(buffer), "%s", pSpec);
+    pType = strrchr(buffer, ':');
+    if (pType)
+    {
+        *pType++ = '\0';
+        if (_stricmp(pType, "real") == 0)
+            valueType = GlowParameterType_Real;
+        else if (_stricmp(pType, "string") == 0)
+            valueType = GlowParameterType_String;
+        else if (_stricmp(pType, "bool") == 0)
+            valueType = GlowParameterType_Boolean;
+        else if (_stricmp(pType, "function") == 0)
+            type = GlowElementType_Function;
+        else if (_stricmp(pType, "node") == 0)
+            type = GlowElementType_Node;
+    }
+
+    for (pToken = buffer; pToken && *pToken; pToken = pNext)
+    {
+        while (*pToken == '/')
+            pToken++;
+        if (*pToken == '\0')
+            break;
+        pNext = strchr(pToken, '/');
+        if (pNext)
+            *pNext++ = '\0';
+
+        bool isLast = (pNext == NULL) || (*pNext == '\0');
+        ProviderElement* pChild = element_findChild(pCursor, pToken);
+        if (!pChild)
+        {
+            pChild = element_addChild(pCursor, isLast ? type : GlowElementType_Node, pToken);
+            if (!pChild)
+                return;
+            if (isLast && (type == GlowElementType_Parameter))
+            {
+                pChild->value.flag = valueType;
+                if (valueType == GlowParameterType_String)
+                    pChild->value.choice.pString = _strdup("");
+                appendTarget(&ppParameters, &parameterCount, pChild);
+            }
+        }
+        pCursor = pChild;
+    }
+}
+
+
+// ====================================================================
+//
+// output
+//
+// ====================================================================
+
+/// <summary>送信パッケージ確定・送信</summary>
+/// <param name="pClient"></param>
+static void client_flush(ProviderClient* pClient)
+{
+    if (!pClient->isPackageOpen)
+        return;
+
+    unsigned int txLength = glowOutput_finishPackage(&pClient->output);
+    pClient->isPackageOpen = false;
+
+    int sendlen = send(pClient->sock, (const char*)pClient->pTxBuffer, txLength, PROVIDER_SEND_FLAGS);
+    if (sendlen > 0)
+    {
+        statistics.txBytes += sendlen;
+        statistics.txPackages++;
+    }
+}
+
+/// <summary>送信パッケージへの追記開始</summary>
+/// <param name="pClient"></param>
+/// <returns></returns>
+static GlowOutput* client_beginWrite(ProviderClient* pClient)
+{
+    if (!pClient->isPackageOpen)
+    {
+        glowOutput_beginPackage(&pClient->output, true);
+        pClient->isPackageOpen = true;
+    }
+    return &pClient->output;
+}
+
+/// <summary>送信パッケージへの追記終了</summary>
+/// <param name="pClient"></param>
+/// <remarks>
+/// 目安を超えたらその場で送信し、次の追記は新しいパッケージとする
+/// </remarks>
+static void client_endWrite(ProviderClient* pClient)
+{
+    if (pClient->isPackageOpen
+     && (pClient->output.base.base.position >= PROVIDER_PACKAGE_THRESHOLD))
+        client_flush(pClient);
+}
+
+/// <summary>エレメント書き出し</summary>
+/// <param name="pClient"></param>
+/// <param name="pElement"></param>
+/// <param name="isFull">false 時は値のみ（変更通知）</param>
+static void writeElement(ProviderClient* pClient, const ProviderElement* pElement, bool isFull)
+{
+    berint path[GLOW_MAX_TREE_DEPTH];
+    int pathLength = element_getPath(pElement, path);
+    GlowOutput* pOut = client_beginWrite(pClient);
+
+    switch (pElement->type)
+    {
+    case GlowElementType_Node:
+    {
+        GlowNode node;
+        bzero_item(node);
+        node.pIdentifier = pElement->pIdentifier;
+        node.isOnline = true;
+        glow_writeQualifiedNode(pOut, &node, (GlowFieldFlags)(GlowFieldFlag_Identifier | GlowFieldFlag_IsOnline), path, pathLength);
+        break;
+    }
+    case GlowElementType_Parameter:
+    {
+        GlowParameter parameter;
+        bzero_item(parameter);
+        parameter.pIdentifier = pElement->pIdentifier;
+        parameter.value = pElement->value;
+        parameter.access = GlowAccess_ReadWrite;
+        parameter.type = pElement->value.flag;
+        glow_writeQualifiedParameter(pOut, &parameter,
+            isFull ? (GlowFieldFlags)(GlowFieldFlag_Identifier | GlowFieldFlag_Value | GlowFieldFlag_Access | GlowFieldFlag_Type)
+                   : GlowFieldFlag_Value,
+            path, pathLength);
+        break;
+    }
+    case GlowElementType_Matrix:
+    {
+        GlowMatrix matrix;
+        GlowLabel label;
+        bzero_item(matrix);
+        bzero_item(label);
+        memcpy(label.basePath, pElement->labelsPath, sizeof(berint) * pElement->labelsPathLength);
+        label.basePathLength = pElement->labelsPathLength;
+        label.pDescription = (pstr)"labels";
+        matrix.pIdentifier = pElement->pIdentifier;
+        matrix.type = GlowMatrixType_OneToN;
+        matrix.addressingMode = GlowMatrixAddressingMode_Linear;
+        matrix.targetCount = pElement->targetCount;
+        matrix.sourceCount = pElement->sourceCount;
+        matrix.pLabels = (label.basePathLength > 0) ? &label : NULL;
+        matrix.labelsLength = (label.basePathLength > 0) ? 1 : 0;
+        glow_writeQualifiedMatrix(pOut, &matrix, GlowFieldFlag_All, path, pathLength);
+        break;
+    }
+    case GlowElementType_Function:
+    {
+        GlowFunction function;
+        bzero_item(function);
+        function.pIdentifier = pElement->pIdentifier;
+        glow_writeQualifiedFunction(pOut, &function, GlowFieldFlag_Identifier, path, pathLength);
+        break;
+    }
+    default:
+        break;
+    }
+
+    client_endWrite(pClient);
+}
+
+/// <summary>マトリックス接続書き出し</summary>
+/// <param name="pClient"></param>
+/// <param name="pMatrix"></param>
+/// <param name="top">先頭ターゲット</param>
+/// <param name="count">件数</param>
+/// <param name="disposition"></param>
+static void writeConnections(ProviderClient* pClient, const ProviderElement* pMatrix, int top, int count, GlowConnectionDisposition disposition)
+{
+    berint path[GLOW_MAX_TREE_DEPTH];
+    int pathLength = element_getPath(pMatrix, path);
+    GlowOutput* pOut = client_beginWrite(pClient);
+
+    glow_writeConnectionsPrefix(pOut, path, pathLength);
+    for (int t = top; (t < top + count) && (t < pMatrix->targetCount); ++t)
+    {
+        GlowConnection connection;
+        berint source = pMatrix->pConnections[t];
+        bzero_item(connection);
+        connection.target = t;
+        connection.pSources = (source >= 0) ? &source : NULL;
+        connection.sourcesLength = (source >= 0) ? 1 : 0;
+        connection.operation = GlowConnectionOperation_Absolute;
+        connection.disposition = disposition;
+        glow_writeConnection(pOut, &connection);
+    }
+    glow_writeConnectionsSuffix(pOut);
+
+    client_endWrite(pClient);
+}
+
+/// <summary>マトリックス全体（内容・信号・接続）書き出し</summary>
+/// <param name="pClient"></param>
+/// <param name="pMatrix"></param>
+static void writeMatrixDirectory(ProviderClient* pClient, const ProviderElement* pMatrix)
+{
+    berint path[GLOW_MAX_TREE_DEPTH];
+    int pathLength = element_getPath(pMatrix, path);
+
+    writeElement(pClient, pMatrix, true);
+
+    for (int top = 0; top < pMatrix->targetCount; top += PROVIDER_SIGNAL_CHUNK)
+    {
+        GlowOutput* pOut = client_beginWrite(pClient);
+        glow_writeTargetsPrefix(pOut, path, pathLength);
+        for (int t = top; (t < top + PROVIDER_SIGNAL_CHUNK) && (t < pMatrix->targetCount); ++t)
+        {
+            GlowSignal signal = { t };
+            glow_writeTarget(pOut, &signal);
+        }
+        glow_writeTargetsSuffix(pOut);
+        client_endWrite(pClient);
+    }
+    for (int top = 0; top < pMatrix->sourceCount; top += PROVIDER_SIGNAL_CHUNK)
+    {
+        GlowOutput* pOut = client_beginWrite(pClient);
+        glow_writeSourcesPrefix(pOut, path, pathLength);
+        for (int s = top; (s < top + PROVIDER_SIGNAL_CHUNK) && (s < pMatrix->sourceCount); ++s)
+        {
+            GlowSignal signal = { s };
+            glow_writeSource(pOut, &signal);
+        }
+        glow_writeSourcesSuffix(pOut);
+        client_endWrite(pClient);
+    }
+    for (int top = 0; top < pMatrix->targetCount; top += PROVIDER_SIGNAL_CHUNK)
+        writeConnections(pClient, pMatrix, top, PROVIDER_SIGNAL_CHUNK, GlowConnectionDisposition_Tally);
+}
+
+/// <summary>変更通知（監視中のコンシューマと要求元）</summary>
+/// <param name="pElement"></param>
+/// <param name="pRequester">要求元（ストーム時は NULL）</param>
+static void notifyElement(const ProviderElement* pElement, ProviderClient* pRequester)
+{
+    for (int i = 0; i < PROVIDER_CLIENT_MAX; ++i)
+    {
+        ProviderClient* pClient = &clients[i];
+        if (!pClient->pReader)
+            continue;
+        if (((pElement->watchMask & (1u << i)) == 0) && (pClient != pRequester))
+            continue;
+        writeElement(pClient, pElement, false);
+        statistics.notifications++;
+    }
+}
+
+/// <summary>接続変更通知（監視中のコンシューマと要求元）</summary>
+/// <param name="pMatrix"></param>
+/// <param name="target"></param>
+/// <param name="pRequester">要求元（ストーム時は NULL）</param>
+static void notifyConnection(const ProviderElement* pMatrix, berint target, ProviderClient* pRequester)
+{
+    for (int i = 0; i < PROVIDER_CLIENT_MAX; ++i)
+    {
+        ProviderClient* pClient = &clients[i];
+        if (!pClient->pReader)
+            continue;
+        if (((pMatrix->watchMask & (1u << i)) == 0) && (pClient != pRequester))
+            continue;
+        writeConnections(pClient, pMatrix, target, 1, GlowConnectionDisposition_Modified);
+        statistics.notifications++;
+    }
+}
+
+
+// ====================================================================
+//
+// glow handlers
+//
+// ====================================================================
+
+/// <summary>
+/// コマンド受信
+/// </summary>
+/// <param name="pCommand"></param>
+/// <param name="pPath">コマンドを含むエレメントのパス</param>
+/// <param name="pathLength"></param>
+/// <param name="state"></param>
+static void onCommand(const GlowCommand* pCommand, const berint* pPath, int pathLength, voidptr state)
+{
+    ProviderClient* pClient = (ProviderClient*)state;
+    ProviderElement* pElement = element_find(pPath, pathLength);
+    unsigned int mask = 1u << pClient->slot;
+
+    statistics.rxCommands++;
+    if (!pElement)
+        return;
+
+    switch (pCommand->number)
+    {
+    case GlowCommandType_GetDirectory:
+        pElement->watchMask |= mask;
+        if (pElement->type == GlowElementType_Matrix)
+        {
+            writeMatrixDirectory(pClient, pElement);
+        }
+        else if (pElement->type == GlowElementType_Node)
+        {
+            for (int i = 0; i < pElement->childCount; ++i)
+            {
+                pElement->ppChildren[i]->watchMask |= mask;
+                writeElement(pClient, pElement->ppChildren[i], true);
+            }
+        }
+        else
+        {
+            writeElement(pClient, pElement, true);
+        }
+        break;
+
+    case GlowCommandType_Subscribe:
+        pElement->watchMask |= mask;
+        break;
+
+    case GlowCommandType_Unsubscribe:
+        pElement->watchMask &= ~mask;
+        break;
+
+    case GlowCommandType_Invoke:
+    {
+        GlowInvocationResult result;
+        bzero_item(result);
+        result.invocationId = pCommand->options.invocation.invocationId;
+        result.hasError = (pElement->type != GlowElementType_Function);
+
+        // 結果は単独パッケージとして送る
+        client_flush(pClient);
+        unsigned int txLength = glow_writeInvocationResultPackage(&pClient->output, &result);
+        int sendlen = send(pClient->sock, (const char*)pClient->pTxBuffer, txLength, PROVIDER_SEND_FLAGS);
+        if (sendlen > 0)
+        {
+            statistics.txBytes += sendlen;
+            statistics.txPackages++;
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+/// <summary>
+/// パラメータ受信（値設定）
+/// </summary>
+/// <param name="pParameter"></param>
+/// <param name="fields"></param>
+/// <param name="pPath"></param>
+/// <param name="pathLength"></param>
+/// <param name="state"></param>
+static void onParameter(const GlowParameter* pParameter, GlowFieldFlags fields, const berint* pPath, int pathLength, voidptr state)
+{
+    ProviderClient* pClient = (ProviderClient*)state;
+    ProviderElement* pElement = element_find(pPath, pathLength);
+
+    statistics.rxCommands++;
+    if (!pElement || (pElement->type != GlowElementType_Parameter) || ((fields & GlowFieldFlag_Value) == 0))
+        return;
+
+    glowValue_free(&pElement->value);
+    glowValue_copyFrom(&pElement->value, &pParameter->value);
+    statistics.parameterChanges++;
+
+    notifyElement(pElement, pClient);
+}
+
+/// <summary>
+/// 接続受信（接続変更）
+/// </summary>
+/// <param name="pConnection"></param>
+/// <param name="pPath">マトリックスのパス</param>
+/// <param name="pathLength"></param>
+/// <param name="state"></param>
+static void onConnection(const GlowConnection* pConnection, const berint* pPath, int pathLength, voidptr state)
+{
+    ProviderClient* pClient = (ProviderClient*)state;
+    ProviderElement* pMatrix = element_find(pPath, pathLength);
+
+    statistics.rxCommands++;
+    if (!pMatrix || (pMatrix->type != GlowElementType_Matrix)
+     || (pConnection->target < 0) || (pConnection->target >= pMatrix->targetCount))
+        return;
+
+    // OneToN のためターゲットあたり 1 ソース
+    if ((pConnection->operation == GlowConnectionOperation_Disconnect) || (pConnection->sourcesLength <= 0))
+        pMatrix->pConnections[pConnection->target] = -1;
+    else if ((pConnection->pSources[0] >= 0) && (pConnection->pSources[0] < pMatrix->sourceCount))
+        pMatrix->pConnections[pConnection->target] = pConnection->pSources[0];
+    statistics.connectionChanges++;
+
+    notifyConnection(pMatrix, pConnection->target, pClient);
+}
+
+/// <summary>
+/// Ember 以外のパッケージ受信（キープアライブ）
+/// </summary>
+/// <param name="pPackage"></param>
+/// <param name="length"></param>
+/// <param name="state"></param>
+static void onOtherPackageReceived(const byte* pPackage, int length, voidptr state)
+{
+    ProviderClient* pClient = (ProviderClient*)state;
+    byte buffer[16];
+
+    if (length >= 4
+     && pPackage[1] == EMBER_MESSAGE_ID
+     && pPackage[2] == EMBER_COMMAND_KEEPALIVE_REQUEST)
+    {
+        unsigned int txLength = emberFraming_writeKeepAliveResponse(buffer, sizeof(buffer), pPackage[0]);
+        int sendlen = send(pClient->sock, (const char*)buffer, txLength, PROVIDER_SEND_FLAGS);
+        if (sendlen > 0)
+            statistics.txBytes += sendlen;
+    }
+}
+
+
+// ====================================================================
+//
+// clients
+//
+// ====================================================================
+
+/// <summary>接続受け入れ</summary>
+/// <param name="sock"></param>
+static void acceptClient(SOCKET sock)
+{
+    for (int i = 0; i < PROVIDER_CLIENT_MAX; ++i)
+    {
+        ProviderClient* pClient = &clients[i];
+        if (pClient->pReader)
+            continue;
+
+        bzero_item(*pClient);
+        pClient->sock = sock;
+        pClient->slot = i;
+        pClient->pReader = newobj(GlowReader);
+        pClient->pRxBuffer = newarr(byte, PROVIDER_RX_BUFFER_SIZE);
+        pClient->pTxBuffer = newarr(byte, PROVIDER_TX_BUFFER_SIZE);
+        glowReader_init(pClient->pReader, NULL, onParameter, onCommand, NULL, (voidptr)pClient, pClient->pRxBuffer, PROVIDER_RX_BUFFER_SIZE);
+        pClient->pReader->base.onConnection = onConnection;
+        pClient->pReader->onOtherPackageReceived = onOtherPackageReceived;
+        glowOutput_init(&pClient->output, pClient->pTxBuffer, PROVIDER_TX_BUFFER_SIZE, 0);
+        printf("consumer connected, slot = %d\n", i);
+        return;
+    }
+
+    fprintf(stderr, "too many consumers, connection refused.\n");
+    closesocket(sock);
+}
+
+/// <summary>切断</summary>
+/// <param name="pClient"></param>
+static void closeClient(ProviderClient* pClient)
+{
+    printf("consumer disconnected, slot = %d\n", pClient->slot);
+    element_clearWatch(&root, 1u << pClient->slot);
+    closesocket(pClient->sock);
+    glowReader_free(pClient->pReader);
+    freeMemory(pClient->pReader);
+    freeMemory(pClient->pRxBuffer);
+    freeMemory(pClient->pTxBuffer);
+    bzero_item(*pClient);
+}
+
+
+// ====================================================================
+//
+// storm
+//
+// ====================================================================
+
+/// <summary>パラメータ値変更</summary>
+/// <param name="pParameter"></param>
+static void changeParameter(ProviderElement* pParameter)
+{
+    char value[PROVIDER_IDENTIFIER_LENGTH];
+
+    switch (pParameter->value.flag)
+    {
+    case GlowParameterType_Integer:
+        pParameter->value.choice.integer = (pParameter->value.choice.integer + 1) % 1000;
+        break;
+    case GlowParameterType_Real:
+        pParameter->value.choice.real = (double)nextRandom(10001) / 100.0;
+        break;
+    case GlowParameterType_Boolean:
+        pParameter->value.choice.boolean = !pParameter->value.choice.boolean;
+        break;
+    case GlowParameterType_String:
+        snprintf(value, sizeof(value), "%s #%d", pParameter->pIdentifier, nextRandom(10000));
+        glowValue_free(&pParameter->value);
+        pParameter->value.flag = GlowParameterType_String;
+        pParameter->value.choice.pString = _strdup(value);
+        break;
+    default:
+        break;
+    }
+}
+
+/// <summary>変更ストーム発生</summary>
+/// <param name="pDebts">種別毎の未発生件数（端数繰越）</param>
+/// <param name="elapsed">前回からの経過（msec）</param>
+static void generateStorm(double* pDebts, unsigned long long elapsed)
+{
+    pDebts[0] += config.paramRate * elapsed / 1000.0;
+    pDebts[1] += config.connectionRate * elapsed / 1000.0;
+    pDebts[2] += config.labelRate * elapsed / 1000.0;
+
+    for (; (pDebts[0] >= 1.0) && (parameterCount > 0); pDebts[0] -= 1.0)
+    {
+        ProviderElement* pParameter = ppParameters[nextRandom(parameterCount)];
+        changeParameter(pParameter);
+        statistics.parameterChanges++;
+        notifyElement(pParameter, NULL);
+    }
+    for (; (pDebts[1] >= 1.0) && (matrixCount > 0); pDebts[1] -= 1.0)
+    {
+        ProviderElement* pMatrix = ppMatrices[nextRandom(matrixCount)];
+        if ((pMatrix->targetCount <= 0) || (pMatrix->sourceCount <= 0))
+            continue;
+        berint target = nextRandom(pMatrix->targetCount);
+        pMatrix->pConnections[target] = nextRandom(pMatrix->sourceCount);
+        statistics.connectionChanges++;
+        notifyConnection(pMatrix, target, NULL);
+    }
+    for (; (pDebts[2] >= 1.0) && (labelCount > 0); pDebts[2] -= 1.0)
+    {
+        ProviderElement* pLabel = ppLabels[nextRandom(labelCount)];
+        changeParameter(pLabel);
+        statistics.labelChanges++;
+        notifyElement(pLabel, NULL);
+    }
+
+    // 上限に届かない端数は次周期へ（対象なしの場合は捨てる）
+    for (int i = 0; i < 3; ++i)
+    {
+        if (pDebts[i] > 1.0)
+            pDebts[i] = 0.0;
+    }
+}
+
+
+// ====================================================================
+//
+// entry point
+//
+// ====================================================================
+
+/// <summary>使用方法出力</summary>
+/// <param name="pName"></param>
+static void printUsage(pcstr pName)
+{
+    printf("usage: %s [options]\n", pName);
+    printf("  -port <n>          listen port (default %d)\n", PROVIDER_PORT_DEF);
+    printf("  -depth <n>         synthetic node depth (default 2)\n");
+    printf("  -fanout <n>        child nodes per node (default 4)\n");
+    printf("  -params <n>        parameters per leaf node (default 8)\n");
+    printf("  -matrices <n>      number of matrices (default 1)\n");
+    printf("  -targets <n>       targets per matrix (default 32)\n");
+    printf("  -sources <n>       sources per matrix (default 32)\n");
+    printf("  -param-rate <n>    parameter changes per second (default 0)\n");
+    printf("  -conn-rate <n>     connection changes per second (default 0)\n");
+    printf("  -label-rate <n>    label changes per second (default 0)\n");
+    printf("  -duration <sec>    exit after seconds (default 0 = run forever)\n");
+    printf("  -seed <n>          random seed (default 1)\n");
+    printf("  -add <path[:type]> add element by identifier path, type = int|real|string|bool|function|node\n");
+}
+
+/// <summary>起動引数解析</summary>
+/// <param name="argc"></param>
+/// <param name="argv"></param>
+/// <returns></returns>
+static bool parseArguments(int argc, char** argv)
+{
+    config.port = PROVIDER_PORT_DEF;
+    config.depth = 2;
+    config.fanout = 4;
+    config.params = 8;
+    config.matrices = 1;
+    config.targets = 32;
+    config.sources = 32;
+    config.seed = 1;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        pcstr pKey = argv[i];
+        pcstr pValue = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (!pValue)
+            return false;
+
+        if (strcmp(pKey, "-port") == 0)
+            config.port = (unsigned short)atoi(pValue);
+        else if (strcmp(pKey, "-depth") == 0)
+            config.depth = atoi(pValue);
+        else if (strcmp(pKey, "-fanout") == 0)
+            config.fanout = atoi(pValue);
+        else if (strcmp(pKey, "-params") == 0)
+            config.params = atoi(pValue);
+        else if (strcmp(pKey, "-matrices") == 0)
+            config.matrices = atoi(pValue);
+        else if (strcmp(pKey, "-targets") == 0)
+            config.targets = atoi(pValue);
+        else if (strcmp(pKey, "-sources") == 0)
+            config.sources = atoi(pValue);
+        else if (strcmp(pKey, "-param-rate") == 0)
+            config.paramRate = atof(pValue);
+        else if (strcmp(pKey, "-conn-rate") == 0)
+            config.connectionRate = atof(pValue);
+        else if (strcmp(pKey, "-label-rate") == 0)
+            config.labelRate = atof(pValue);
+        else if (strcmp(pKey, "-duration") == 0)
+            config.duration = atoi(pValue);
+        else if (strcmp(pKey, "-seed") == 0)
+            config.seed = (unsigned int)strtoul(pValue, NULL, 10);
+        else if ((strcmp(pKey, "-add") == 0) && (config.addPathCount < PROVIDER_ADD_PATH_MAX))
+            config.addPaths[config.addPathCount++] = pValue;
+        else
+            return false;
+        ++i;
+    }
+
+    // 深さは番号パス上限から root と最下層パラメータ分を除く
+    if ((config.depth < 0) || (config.depth > GLOW_MAX_TREE_DEPTH - 2)
+     || (config.fanout < 0) || (config.params < 0) || (config.matrices < 0)
+     || (config.targets < 0) || (config.sources < 0) || (config.port == 0))
+        return false;
+
+    randomState = (config.seed != 0) ? config.seed : 1;
+    return true;
+}
+
+/// <summary>統計出力</summary>
+/// <param name="elapsed">前回からの経過（msec）</param>
+static void reportStatistics(unsigned long long elapsed)
+{
+    static ProviderStatistics last;
+    double seconds = (elapsed > 0) ? elapsed / 1000.0 : 1.0;
+    int connected = 0;
+
+    for (int i = 0; i < PROVIDER_CLIENT_MAX; ++i)
+    {
+        if (clients[i].pReader)
+            connected++;
+    }
+
+    printf("consumers = %d, rx = %.1f KB/s (%.0f cmd/s), tx = %.1f KB/s (%.0f pkg/s), changes param/conn/label = %.0f/%.0f/%.0f per sec, notifications = %.0f/s\n",
+           connected,
+           (statistics.rxBytes - last.rxBytes) / 1024.0 / seconds,
+           (statistics.rxCommands - last.rxCommands) / seconds,
+           (statistics.txBytes - last.txBytes) / 1024.0 / seconds,
+           (statistics.txPackages - last.txPackages) / seconds,
+           (statistics.parameterChanges - last.parameterChanges) / seconds,
+           (statistics.connectionChanges - last.connectionChanges) / seconds,
+           (statistics.labelChanges - last.labelChanges) / seconds,
+           (statistics.notifications - last.notifications) / seconds);
+    fflush(stdout);
+    last = statistics;
+}
+
+int main(int argc, char** argv)
+{
+    SOCKET listenSocket;
+    struct sockaddr_in address;
+    int reuse = 1;
+    byte buffer[1024];
+    double debts[3] = { 0.0, 0.0, 0.0 };
+
+    if (!parseArguments(argc, argv))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+#ifdef WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    {
+        fprintf(stderr, "error at WSAStartup\n");
+        return 1;
+    }
+#endif
+
+    ember_init(onThrowError, onFailAssertion, allocMemoryImpl, freeMemoryImpl);
+
+    buildNodes(&root, 1);
+    buildMatrices();
+    for (int i = 0; i < config.addPathCount; ++i)
+        addPath(config.addPaths[i]);
+    printf("tree built, parameters = %d, matrices = %d (%dx%d), labels = %d\n",
+           parameterCount, matrixCount, config.targets, config.sources, labelCount);
+
+    listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+    bzero_item(address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(config.port);
+    if ((bind(listenSocket, (struct sockaddr*)&address, sizeof(address)) == SOCKET_ERROR)
+     || (listen(listenSocket, PROVIDER_CLIENT_MAX) == SOCKET_ERROR))
+    {
+        fprintf(stderr, "listen error, port = %d\n", config.port);
+        closesocket(listenSocket);
+        return 1;
+    }
+    printf("listening on port %d\n", config.port);
+    fflush(stdout);
+
+    unsigned long long startTime = monotonicMilliseconds();
+    unsigned long long lastTick = startTime;
+    unsigned long long lastReport = startTime;
+    for (;;)
+    {
+        fd_set fdset;
+        SOCKET maxSocket = listenSocket;
+        struct timeval timeout = { 0, PROVIDER_TICK_MSEC * 1000 };
+
+        FD_ZERO(&fdset);
+        FD_SET(listenSocket, &fdset);
+        for (int i = 0; i < PROVIDER_CLIENT_MAX; ++i)
+        {
+            if (!clients[i].pReader)
+                continue;
+            FD_SET(clients[i].sock, &fdset);
+            if (clients[i].sock > maxSocket)
+                maxSocket = clients[i].sock;
+        }
+
+        int fdsReady = select((int)(maxSocket + 1), &fdset, NULL, NULL, &timeout);
+        if (fdsReady > 0)
+        {
+            if (FD_ISSET(listenSocket, &fdset))
+            {
+                SOCKET sock = accept(listenSocket, NULL, NULL);
+                if (sock != (SOCKET)SOCKET_ERROR)
+                    acceptClient(sock);
+            }
+            for (int i = 0; i < PROVIDER_CLIENT_MAX; ++i)
+            {
+                ProviderClient* pClient = &clients[i];
+                if (!pClient->pReader || !FD_ISSET(pClient->sock, &fdset))
+                    continue;
+
+                int read = recv(pClient->sock, (char*)buffer, sizeof(buffer), 0);
+                if (read > 0)
+                {
+                    statistics.rxBytes += read;
+                    glowReader_readBytes(pClient->pReader, buffer, read);
+                }
+                else
+                {
+                    closeClient(pClient);
+                }
+            }
+        }
+
+        unsigned long long now = monotonicMilliseconds();
+        if (now - lastTick >= PROVIDER_TICK_MSEC)
+        {
+            generateStorm(debts, now - lastTick);
+            lastTick = now;
+        }
+
+        // 周期内の応答・通知をまとめて送信
+        for (int i = 0; i < PROVIDER_CLIENT_MAX; ++i)
+        {
+            if (clients[i].pReader)
+                client_flush(&clients[i]);
+        }
+
+        if (now - lastReport >= PROVIDER_REPORT_MSEC)
+        {
+            reportStatistics(now - lastReport);
+            lastReport = now;
+        }
+        if ((config.duration > 0) && (now - startTime >= (unsigned long long)config.duration * 1000ull))
+            break;
+    }
+
+    for (int i = 0; i < PROVIDER_CLIENT_MAX; ++i)
+    {
+        if (clients[i].pReader)
+            closeClient(&clients[i]);
+    }
+    closesocket(listenSocket);
+    element_free(&root);
+    free(ppParameters);
+    free(ppLabels);
+    free(ppMatrices);
+
+#ifdef WIN32
+    WSACleanup();
+#endif
+    return 0;
+}
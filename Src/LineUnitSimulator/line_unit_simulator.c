@@ -0,0 +1,1064 @@
+﻿/*
+   LINE UNIT panel simulator
+
+   HWIF ポートへ接続し、LINE UNIT パネルとして FORA 形式のスイッチ・フェーダー操作を送信する
+   プロトコル変換の負荷・耐久確認用（Ember+ 側は EmberProvider と組み合わせる想定）
+
+   - スクリプトまたはランダムで PGM/PST/XPT/CUT/AUTO 押下、長押し、フェーダー操作を指定レートで発生させる
+   - 返送される LED/タリー フレームを検査し、押下からタリー点灯までの時間を計測する
+*/
+
+#include "SocketEx.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef WIN32
+#define SIMULATOR_SEND_FLAGS 0
+#else
+#include <sys/select.h>
+#include <sys/time.h>
+#include <netinet/tcp.h>
+#define SIMULATOR_SEND_FLAGS MSG_NOSIGNAL
+#define INVALID_SOCKET (-1)
+#endif
+
+
+// ====================================================================
+//
+// definitions
+//
+// ====================================================================
+
+/// <summary>接続先ポート既定値（HWIF 既定ポート）</summary>
+#define SIMULATOR_PORT_DEF          5193
+/// <summary>FORA ヘッダ長（ヘッダ文字列 + バイトカウント）</summary>
+#define FORA_HEADER_SIZE            6
+/// <summary>FORA フレーム長上限（破損判定用）</summary>
+#define FORA_FRAME_MAX              64
+/// <summary>受信バッファ</summary>
+#define SIMULATOR_RX_BUFFER_SIZE    4096
+/// <summary>送信予約上限</summary>
+#define SIMULATOR_SCHEDULE_MAX      4096
+/// <summary>タリー待ち上限</summary>
+#define SIMULATOR_PENDING_MAX       1024
+/// <summary>送信・検査周期上限（msec）</summary>
+#define SIMULATOR_TICK_MSEC         5
+/// <summary>統計出力周期（msec）</summary>
+#define SIMULATOR_REPORT_MSEC       5000
+/// <summary>長押し中の継続通知間隔（msec）</summary>
+#define SIMULATOR_REPEAT_MSEC       100
+/// <summary>フェーダー操作の送信間隔（msec）</summary>
+#define SIMULATOR_FADER_STEP_MSEC   20
+/// <summary>スクリプト行数上限</summary>
+#define SIMULATOR_SCRIPT_MAX        4096
+
+/// <summary>FORA コマンド番号</summary>
+#define FORA_COMMAND_SWITCH         0
+#define FORA_COMMAND_SWITCH_LED     1
+#define FORA_COMMAND_FADER_LED      2
+#define FORA_COMMAND_FADER          3
+#define FORA_COMMAND_PALETTE        8
+
+/// <summary>スイッチ状態</summary>
+#define SWITCH_RELEASE              0
+#define SWITCH_PRESS                1
+#define SWITCH_REPEAT               2
+
+/// <summary>スイッチ番号（LineUnitCommand の割り当て）</summary>
+#define SWITCH_PGM_TOP              0
+#define SWITCH_PST_TOP              45
+#define SWITCH_XPT_TOP              90
+#define SWITCH_XPT2_TOP             135
+#define SWITCH_ROW_COUNT            25
+/// <summary>XPT 列の段数（上段・下段で 1 つのパス、下段は値 26 から）</summary>
+#define SWITCH_XPT_ROWS             2
+#define SWITCH_CUT                  210
+#define SWITCH_AUTO                 211
+
+/// <summary>タリー点灯パレット（__EmberCommandConverter の割り当て）</summary>
+#define PALETTE_PGM                 1
+#define PALETTE_PST                 2
+#define PALETTE_XPT                 3
+#define PALETTE_TRANS_PRESS         3
+#define PALETTE_TRANS_RELEASE       6
+
+/// <summary>照合値指定なし</summary>
+#define EXPECT_ANY                  (-1)
+
+/// <summary>
+/// 操作種別
+/// </summary>
+typedef enum tagActionKind
+{
+    ActionKind_Pgm = 0,
+    ActionKind_Pst,
+    ActionKind_Xpt,
+    ActionKind_Cut,
+    ActionKind_Auto,
+    ActionKind_Long,
+    ActionKind_Fader,
+    ActionKind_Wait,
+
+    ActionKind_Count,
+} ActionKind;
+
+static const char* ActionKindNames[ActionKind_Count] =
+{
+    "pgm", "pst", "xpt", "cut", "auto", "long", "fader", "wait",
+};
+
+/// <summary>
+/// 操作（スクリプト 1 行）
+/// </summary>
+typedef struct tagAction
+{
+    ActionKind kind;
+    int args[3];
+} Action;
+
+/// <summary>
+/// 送信予約フレーム
+/// </summary>
+/// <remarks>
+/// 送信時に期待するタリー（expectCommand >= 0）を待ち行列へ登録する
+/// </remarks>
+typedef struct tagScheduledFrame
+{
+    unsigned long long due;
+    unsigned char frame[12];
+    int length;
+    int expectCommand;
+    int expectNumber;
+    int expectValue;
+} ScheduledFrame;
+
+/// <summary>
+/// タリー待ち
+/// </summary>
+typedef struct tagPendingTally
+{
+    unsigned long long sent;
+    int command;
+    int number;
+    int value;
+} PendingTally;
+
+/// <summary>
+/// 起動設定
+/// </summary>
+typedef struct tagSimulatorConfig
+{
+    const char* pHost;
+    unsigned short port;
+    const char* pScriptPath;
+    bool isLoop;
+    double rate;
+    unsigned int kindMask;
+    int holdMsec;
+    int longMsec;
+    int faderMsec;
+    int timeoutMsec;
+    int duration;
+    unsigned int seed;
+} SimulatorConfig;
+
+/// <summary>
+/// 統計
+/// </summary>
+typedef struct tagSimulatorStatistics
+{
+    unsigned long long actions;
+    unsigned long long txFrames;
+    unsigned long long txBytes;
+    unsigned long long rxFrames;
+    unsigned long long rxBytes;
+    unsigned long long rxCommands[16];
+    unsigned long long frameErrors;
+    unsigned long long matched;
+    unsigned long long timeouts;
+    unsigned long long dropped;
+} SimulatorStatistics;
+
+
+// ====================================================================
+//
+// globals
+//
+// ====================================================================
+
+static SimulatorConfig config;
+static SimulatorStatistics statistics;
+
+static ScheduledFrame schedule[SIMULATOR_SCHEDULE_MAX];
+static int scheduleCount = 0;
+static PendingTally pendings[SIMULATOR_PENDING_MAX];
+static int pendingCount = 0;
+
+static Action script[SIMULATOR_SCRIPT_MAX];
+static int scriptCount = 0;
+
+/// <summary>押下→タリー時間（usec）</summary>
+static uint32_t* pLatencies = NULL;
+static size_t latencyCount = 0;
+static size_t latencyCapacity = 0;
+
+/// <summary>直近フェーダー送信値（変換後 0～100）</summary>
+static int lastFaderPercent = -1;
+
+static unsigned int randomState = 1;
+
+
+// ====================================================================
+//
+// utils
+//
+// ====================================================================
+
+/// <summary>単調増加時刻（usec）</summary>
+/// <returns></returns>
+static unsigned long long monotonicMicroseconds()
+{
+#ifdef WIN32
+    static LARGE_INTEGER frequency = { 0 };
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (unsigned long long)(counter.QuadPart * 1000000.0 / frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000ull + (unsigned long long)ts.tv_nsec / 1000ull;
+#endif
+}
+
+/// <summary>擬似乱数（xorshift、シード指定で再現可能）</summary>
+/// <param name="range"></param>
+/// <returns>0 以上 range 未満</returns>
+static int nextRandom(int range)
+{
+    unsigned int x = randomState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    randomState = x;
+    return (range > 0) ? (int)(x % (unsigned int)range) : 0;
+}
+
+/// <summary>操作種別名から種別取得</summary>
+/// <param name="pName"></param>
+/// <returns>該当なしは ActionKind_Count</returns>
+static ActionKind findActionKind(const char* pName)
+{
+    for (int i = 0; i < ActionKind_Count; ++i)
+    {
+        if (strcmp(ActionKindNames[i], pName) == 0)
+            return (ActionKind)i;
+    }
+    return ActionKind_Count;
+}
+
+/// <summary>LINE UNIT 値（0～65535）から ILPS 値（0～100）への変換（LineUnitCommand と同じ丸め）</summary>
+/// <param name="faderValue"></param>
+/// <returns></returns>
+static int faderPercent(unsigned int faderValue)
+{
+    return (int)(((double)faderValue / 65535) * 100);
+}
+
+/// <summary>ILPS 値から LINE UNIT 値への変換（__EmberCommandConverter と同じ丸め）</summary>
+/// <param name="percent"></param>
+/// <returns></returns>
+static int faderValueFromPercent(int percent)
+{
+    return (int)((double)percent * 65535 / 100);
+}
+
+
+// ====================================================================
+//
+// schedule
+//
+// ====================================================================
+
+/// <summary>送信予約（時刻順に挿入）</summary>
+/// <param name="due"></param>
+/// <param name="pFrame"></param>
+/// <param name="length"></param>
+/// <param name="expectCommand">期待タリーのコマンド番号（照合なしは EXPECT_ANY）</param>
+/// <param name="expectNumber"></param>
+/// <param name="expectValue"></param>
+static void scheduleFrame(unsigned long long due, const unsigned char* pFrame, int length, int expectCommand, int expectNumber, int expectValue)
+{
+    if (scheduleCount >= SIMULATOR_SCHEDULE_MAX)
+    {
+        statistics.dropped++;
+        return;
+    }
+
+    int index = scheduleCount;
+    while ((index > 0) && (schedule[index - 1].due > due))
+    {
+        schedule[index] = schedule[index - 1];
+        --index;
+    }
+
+    ScheduledFrame* pScheduled = &schedule[index];
+    pScheduled->due = due;
+    memcpy(pScheduled->frame, pFrame, length);
+    pScheduled->length = length;
+    pScheduled->expectCommand = expectCommand;
+    pScheduled->expectNumber = expectNumber;
+    pScheduled->expectValue = expectValue;
+    scheduleCount++;
+}
+
+/// <summary>スイッチフレーム予約</summary>
+/// <param name="due"></param>
+/// <param name="number">スイッチ番号</param>
+/// <param name="status">スイッチ状態</param>
+/// <param name="palette">期待タリーのパレット（照合なしは EXPECT_ANY）</param>
+static void scheduleSwitch(unsigned long long due, int number, int status, int palette)
+{
+    unsigned char frame[10] = { 'F', 'O', 'R', 'A', 0x00, 0x04, FORA_COMMAND_SWITCH,
+                                (unsigned char)((number >> 8) & 0xff), (unsigned char)(number & 0xff), (unsigned char)status };
+    scheduleFrame(due, frame, sizeof(frame),
+                  (palette != EXPECT_ANY) ? FORA_COMMAND_SWITCH_LED : EXPECT_ANY, number, palette);
+}
+
+/// <summary>フェーダーフレーム予約</summary>
+/// <param name="due"></param>
+/// <param name="faderValue">0～65535</param>
+/// <remarks>
+/// 照合値は送信時に決める（addPending）
+/// </remarks>
+static void scheduleFader(unsigned long long due, unsigned int faderValue)
+{
+    unsigned char frame[11] = { 'F', 'O', 'R', 'A', 0x00, 0x05, FORA_COMMAND_FADER, 0x00, 0x00,
+                                (unsigned char)((faderValue >> 8) & 0xff), (unsigned char)(faderValue & 0xff) };
+    scheduleFrame(due, frame, sizeof(frame), FORA_COMMAND_FADER, 0, EXPECT_ANY);
+}
+
+/// <summary>XPT ボタン番号からスイッチ番号への変換</summary>
+/// <param name="button">ボタン番号（1-25 は上段、26-50 は下段）</param>
+/// <returns></returns>
+static int xptSwitch(int button)
+{
+    return (button <= SWITCH_ROW_COUNT) ? (SWITCH_XPT_TOP + button) : (SWITCH_XPT2_TOP + button - SWITCH_ROW_COUNT);
+}
+
+/// <summary>操作をフレームへ展開して予約</summary>
+/// <param name="pAction"></param>
+/// <param name="start">開始時刻（usec）</param>
+/// <returns>操作の所要時間（usec）</returns>
+static unsigned long long scheduleAction(const Action* pAction, unsigned long long start)
+{
+    unsigned long long hold = (unsigned long long)config.holdMsec * 1000ull;
+
+    statistics.actions++;
+    switch (pAction->kind)
+    {
+    case ActionKind_Pgm:
+        scheduleSwitch(start, SWITCH_PGM_TOP + pAction->args[0], SWITCH_PRESS, PALETTE_PGM);
+        scheduleSwitch(start + hold, SWITCH_PGM_TOP + pAction->args[0], SWITCH_RELEASE, EXPECT_ANY);
+        return hold;
+
+    case ActionKind_Pst:
+        scheduleSwitch(start, SWITCH_PST_TOP + pAction->args[0], SWITCH_PRESS, PALETTE_PST);
+        scheduleSwitch(start + hold, SWITCH_PST_TOP + pAction->args[0], SWITCH_RELEASE, EXPECT_ANY);
+        return hold;
+
+    case ActionKind_Xpt:
+        scheduleSwitch(start, xptSwitch(pAction->args[0]), SWITCH_PRESS, PALETTE_XPT);
+        scheduleSwitch(start + hold, xptSwitch(pAction->args[0]), SWITCH_RELEASE, EXPECT_ANY);
+        return hold;
+
+    case ActionKind_Cut:
+    case ActionKind_Auto:
+    {
+        // 押下で点灯、離した時点でトランジション実行・微灯
+        int number = (pAction->kind == ActionKind_Cut) ? SWITCH_CUT : SWITCH_AUTO;
+        scheduleSwitch(start, number, SWITCH_PRESS, PALETTE_TRANS_PRESS);
+        scheduleSwitch(start + hold, number, SWITCH_RELEASE, PALETTE_TRANS_RELEASE);
+        return hold;
+    }
+
+    case ActionKind_Long:
+    {
+        // 押下後、離すまで継続通知（継続通知はパネル状態次第で無視されるため照合しない）
+        unsigned long long duration = (unsigned long long)pAction->args[1] * 1000ull;
+        int number = SWITCH_PGM_TOP + pAction->args[0];
+        scheduleSwitch(start, number, SWITCH_PRESS, PALETTE_PGM);
+        for (unsigned long long elapsed = SIMULATOR_REPEAT_MSEC * 1000ull; elapsed < duration; elapsed += SIMULATOR_REPEAT_MSEC * 1000ull)
+            scheduleSwitch(start + elapsed, number, SWITCH_REPEAT, EXPECT_ANY);
+        scheduleSwitch(start + duration, number, SWITCH_RELEASE, EXPECT_ANY);
+        return duration;
+    }
+
+    case ActionKind_Fader:
+    {
+        int from = pAction->args[0];
+        int to = pAction->args[1];
+        unsigned long long duration = (unsigned long long)pAction->args[2] * 1000ull;
+        int steps = (int)(duration / (SIMULATOR_FADER_STEP_MSEC * 1000ull));
+        if (steps < 1)
+            steps = 1;
+        for (int i = 0; i <= steps; ++i)
+        {
+            unsigned int value = (unsigned int)(from + (double)(to - from) * i / steps);
+            scheduleFader(start + duration * i / steps, value);
+        }
+        return duration;
+    }
+
+    case ActionKind_Wait:
+        return (unsigned long long)pAction->args[0] * 1000ull;
+
+    default:
+        return 0;
+    }
+}
+
+/// <summary>ランダム操作生成</summary>
+/// <param name="pAction"></param>
+static void randomAction(Action* pAction)
+{
+    int kinds[ActionKind_Count];
+    int kindCount = 0;
+
+    for (int i = 0; i < ActionKind_Wait; ++i)
+    {
+        if (config.kindMask & (1u << i))
+            kinds[kindCount++] = i;
+    }
+
+    memset(pAction, 0, sizeof(Action));
+    pAction->kind = (kindCount > 0) ? (ActionKind)kinds[nextRandom(kindCount)] : ActionKind_Pgm;
+    switch (pAction->kind)
+    {
+    case ActionKind_Long:
+        pAction->args[0] = 1 + nextRandom(SWITCH_ROW_COUNT);
+        pAction->args[1] = config.longMsec;
+        break;
+    case ActionKind_Fader:
+        pAction->args[0] = nextRandom(65536);
+        pAction->args[1] = nextRandom(65536);
+        pAction->args[2] = config.faderMsec;
+        break;
+    case ActionKind_Xpt:
+        pAction->args[0] = 1 + nextRandom(SWITCH_ROW_COUNT * SWITCH_XPT_ROWS);
+        break;
+    default:
+        pAction->args[0] = 1 + nextRandom(SWITCH_ROW_COUNT);
+        break;
+    }
+}
+
+
+// ====================================================================
+//
+// tally
+//
+// ====================================================================
+
+/// <summary>期待タリー登録</summary>
+/// <param name="pScheduled"></param>
+/// <param name="sent"></param>
+static void addPending(const ScheduledFrame* pScheduled, unsigned long long sent)
+{
+    int value = pScheduled->expectValue;
+
+    if (pScheduled->expectCommand == EXPECT_ANY)
+        return;
+    if (pScheduled->expectCommand == FORA_COMMAND_FADER)
+    {
+        // ILPS 値が変化する場合のみ Ember へ送信されるため、その場合のみ返送を照合する
+        int percent = faderPercent(((unsigned int)pScheduled->frame[9] << 8) + pScheduled->frame[10]);
+        bool isChanged = (percent != lastFaderPercent);
+        lastFaderPercent = percent;
+        if (!isChanged)
+            return;
+        value = faderValueFromPercent(percent);
+    }
+    if (pendingCount >= SIMULATOR_PENDING_MAX)
+    {
+        statistics.dropped++;
+        return;
+    }
+
+    PendingTally* pPending = &pendings[pendingCount++];
+    pPending->sent = sent;
+    pPending->command = pScheduled->expectCommand;
+    pPending->number = pScheduled->expectNumber;
+    pPending->value = value;
+}
+
+/// <summary>計測値追加</summary>
+/// <param name="latency">usec</param>
+static void addLatency(unsigned long long latency)
+{
+    if (latencyCount >= latencyCapacity)
+    {
+        size_t capacity = (latencyCapacity > 0) ? latencyCapacity * 2 : 1024;
+        uint32_t* pBuffer = (uint32_t*)realloc(pLatencies, sizeof(uint32_t) * capacity);
+        if (!pBuffer)
+            return;
+        pLatencies = pBuffer;
+        latencyCapacity = capacity;
+    }
+    pLatencies[latencyCount++] = (latency > UINT32_MAX) ? UINT32_MAX : (uint32_t)latency;
+}
+
+/// <summary>受信フレームと期待タリーの照合（古いものから）</summary>
+/// <param name="command"></param>
+/// <param name="number"></param>
+/// <param name="value"></param>
+/// <param name="received"></param>
+static void matchPending(int command, int number, int value, unsigned long long received)
+{
+    for (int i = 0; i < pendingCount; ++i)
+    {
+        PendingTally* pPending = &pendings[i];
+        if ((pPending->command != command)
+         || (pPending->number != number)
+         || ((pPending->value != EXPECT_ANY) && (pPending->value != value)))
+            continue;
+
+        addLatency(received - pPending->sent);
+        statistics.matched++;
+        memmove(&pendings[i], &pendings[i + 1], sizeof(PendingTally) * (pendingCount - i - 1));
+        pendingCount--;
+        return;
+    }
+}
+
+/// <summary>期限切れのタリー待ちを破棄</summary>
+/// <param name="now"></param>
+static void expirePending(unsigned long long now)
+{
+    unsigned long long timeout = (unsigned long long)config.timeoutMsec * 1000ull;
+    int count = 0;
+
+    for (int i = 0; i < pendingCount; ++i)
+    {
+        if (now - pendings[i].sent >= timeout)
+        {
+            statistics.timeouts++;
+            continue;
+        }
+        pendings[count++] = pendings[i];
+    }
+    pendingCount = count;
+}
+
+/// <summary>受信フレーム解析</summary>
+/// <param name="pBuffer">受信済データ</param>
+/// <param name="pLength">受信済データ長（解析済分を除いて更新）</param>
+/// <param name="received"></param>
+static void parseFrames(unsigned char* pBuffer, int* pLength, unsigned long long received)
+{
+    int position = 0;
+
+    while (*pLength - position >= FORA_HEADER_SIZE)
+    {
+        unsigned char* pFrame = pBuffer + position;
+        if (memcmp(pFrame, "FORA", 4) != 0)
+        {
+            // ヘッダ不一致は 1 バイトずつ読み飛ばして再同期
+            statistics.frameErrors++;
+            position++;
+            continue;
+        }
+
+        int byteCount = (pFrame[4] << 8) + pFrame[5];
+        if ((byteCount < 1) || (FORA_HEADER_SIZE + byteCount > FORA_FRAME_MAX))
+        {
+            statistics.frameErrors++;
+            position++;
+            continue;
+        }
+        if (*pLength - position < FORA_HEADER_SIZE + byteCount)
+            break;
+
+        int command = pFrame[6];
+        statistics.rxFrames++;
+        statistics.rxCommands[command & 0x0f]++;
+        switch (command)
+        {
+        case FORA_COMMAND_SWITCH_LED:
+            if (byteCount == 4)
+                matchPending(command, (pFrame[7] << 8) + pFrame[8], pFrame[9], received);
+            else
+                statistics.frameErrors++;
+            break;
+        case FORA_COMMAND_FADER:
+            // 状態要求（byteCount 3）は照合対象外
+            if (byteCount == 5)
+                matchPending(command, (pFrame[7] << 8) + pFrame[8], (pFrame[9] << 8) + pFrame[10], received);
+            else if (byteCount != 3)
+                statistics.frameErrors++;
+            break;
+        default:
+            break;
+        }
+        position += FORA_HEADER_SIZE + byteCount;
+    }
+
+    if (position > 0)
+    {
+        memmove(pBuffer, pBuffer + position, *pLength - position);
+        *pLength -= position;
+    }
+}
+
+
+// ====================================================================
+//
+// script
+//
+// ====================================================================
+
+/// <summary>スクリプト読み込み</summary>
+/// <param name="pPath"></param>
+/// <returns></returns>
+/// <remarks>
+/// 1 行 1 操作、# 以降はコメント
+///   pgm|pst &lt;1-25&gt;
+///   xpt &lt;1-50&gt;（26-50 は下段）
+///   cut | auto
+///   long &lt;1-25&gt; &lt;msec&gt;
+///   fader &lt;from 0-65535&gt; &lt;to 0-65535&gt; &lt;msec&gt;
+///   wait &lt;msec&gt;
+/// </remarks>
+static bool loadScript(const char* pPath)
+{
+    char line[256];
+    int lineNumber = 0;
+    FILE* pFile = fopen(pPath, "r");
+    if (!pFile)
+    {
+        fprintf(stderr, "script open error, path = %s\n", pPath);
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), pFile) && (scriptCount < SIMULATOR_SCRIPT_MAX))
+    {
+        char name[16] = { 0 };
+        Action* pAction = &script[scriptCount];
+        char* pComment = strchr(line, '#');
+
+        lineNumber++;
+        if (pComment)
+            *pComment = '\0';
+        memset(pAction, 0, sizeof(Action));
+        int fields = sscanf(line, "%15s %d %d %d", name, &pAction->args[0], &pAction->args[1], &pAction->args[2]);
+        if (fields <= 0)
+            continue;
+
+        pAction->kind = findActionKind(name);
+        bool isValid;
+        switch (pAction->kind)
+        {
+        case ActionKind_Pgm:
+        case ActionKind_Pst:
+            isValid = (fields == 2) && (pAction->args[0] >= 1) && (pAction->args[0] <= SWITCH_ROW_COUNT);
+            break;
+        case ActionKind_Xpt:
+            isValid = (fields == 2) && (pAction->args[0] >= 1) && (pAction->args[0] <= SWITCH_ROW_COUNT * SWITCH_XPT_ROWS);
+            break;
+        case ActionKind_Cut:
+        case ActionKind_Auto:
+            isValid = (fields == 1);
+            break;
+        case ActionKind_Long:
+            isValid = (fields == 3) && (pAction->args[0] >= 1) && (pAction->args[0] <= SWITCH_ROW_COUNT) && (pAction->args[1] > 0);
+            break;
+        case ActionKind_Fader:
+            isValid = (fields == 4) && (pAction->args[0] >= 0) && (pAction->args[0] <= 65535)
+                   && (pAction->args[1] >= 0) && (pAction->args[1] <= 65535) && (pAction->args[2] >= 0);
+            break;
+        case ActionKind_Wait:
+            isValid = (fields == 2) && (pAction->args[0] >= 0);
+            break;
+        default:
+            isValid = false;
+            break;
+        }
+        if (!isValid)
+        {
+            fprintf(stderr, "script error, line %d : %s", lineNumber, line);
+            fclose(pFile);
+            return false;
+        }
+        scriptCount++;
+    }
+
+    fclose(pFile);
+    return true;
+}
+
+
+// ====================================================================
+//
+// report
+//
+// ====================================================================
+
+static int compareLatency(const void* pLeft, const void* pRight)
+{
+    uint32_t left = *(const uint32_t*)pLeft;
+    uint32_t right = *(const uint32_t*)pRight;
+    return (left > right) - (left < right);
+}
+
+/// <summary>統計出力</summary>
+/// <param name="elapsed">計測開始からの経過（usec）</param>
+/// <param name="isFinal">終了時の集計</param>
+static void reportStatistics(unsigned long long elapsed, bool isFinal)
+{
+    double seconds = (elapsed > 0) ? elapsed / 1000000.0 : 1.0;
+    unsigned long long total = 0;
+    uint32_t p50 = 0, p99 = 0, max = 0;
+
+    if (latencyCount > 0)
+    {
+        qsort(pLatencies, latencyCount, sizeof(uint32_t), compareLatency);
+        for (size_t i = 0; i < latencyCount; ++i)
+            total += pLatencies[i];
+        p50 = pLatencies[latencyCount * 50 / 100];
+        p99 = pLatencies[latencyCount * 99 / 100];
+        max = pLatencies[latencyCount - 1];
+    }
+
+    printf("%s actions = %llu (%.1f/s), tx frames = %llu, rx frames = %llu (led %llu, fader %llu), "
+           "tally matched = %llu, pending = %d, timeouts = %llu, frame errors = %llu, dropped = %llu, "
+           "latency avg/p50/p99/max = %.0f/%u/%u/%u usec\n",
+           isFinal ? "[result]" : "[status]",
+           statistics.actions, statistics.actions / seconds,
+           statistics.txFrames, statistics.rxFrames,
+           statistics.rxCommands[FORA_COMMAND_SWITCH_LED], statistics.rxCommands[FORA_COMMAND_FADER],
+           statistics.matched, pendingCount, statistics.timeouts, statistics.frameErrors, statistics.dropped,
+           (latencyCount > 0) ? (double)total / latencyCount : 0.0, p50, p99, max);
+    fflush(stdout);
+}
+
+
+// ====================================================================
+//
+// entry point
+//
+// ====================================================================
+
+/// <summary>使用方法出力</summary>
+/// <param name="pName"></param>
+static void printUsage(const char* pName)
+{
+    printf("usage: %s [options]\n", pName);
+    printf("  -host <addr>       HWIF address (default 127.0.0.1)\n");
+    printf("  -port <n>          HWIF port (default %d)\n", SIMULATOR_PORT_DEF);
+    printf("  -script <path>     run actions from script file\n");
+    printf("  -loop <0|1>        repeat script (default 0)\n");
+    printf("  -rate <n>          random actions per second (default 10, used without -script)\n");
+    printf("  -kinds <list>      random action kinds, comma separated (default pgm,pst,xpt)\n");
+    printf("                     pgm,pst,xpt,cut,auto,long,fader\n");
+    printf("  -hold <msec>       switch hold time (default 50)\n");
+    printf("  -long <msec>       long press time (default 1000)\n");
+    printf("  -sweep <msec>      fader sweep time (default 500)\n");
+    printf("  -timeout <msec>    tally timeout (default 2000)\n");
+    printf("  -duration <sec>    exit after seconds (default 0 = until script end / forever)\n");
+    printf("  -seed <n>          random seed (default 1)\n");
+}
+
+/// <summary>操作種別リスト解析</summary>
+/// <param name="pList"></param>
+/// <returns>種別ビット（不正時は 0）</returns>
+static unsigned int parseKinds(const char* pList)
+{
+    char buffer[128];
+    unsigned int mask = 0;
+
+    snprintf(buffer, sizeof(buffer), "%s", pList);
+    for (char* pToken = strtok(buffer, ","); pToken; pToken = strtok(NULL, ","))
+    {
+        ActionKind kind = findActionKind(pToken);
+        if ((kind == ActionKind_Count) || (kind == ActionKind_Wait))
+            return 0;
+        mask |= 1u << kind;
+    }
+    return mask;
+}
+
+/// <summary>起動引数解析</summary>
+/// <param name="argc"></param>
+/// <param name="argv"></param>
+/// <returns></returns>
+static bool parseArguments(int argc, char** argv)
+{
+    config.pHost = "127.0.0.1";
+    config.port = SIMULATOR_PORT_DEF;
+    config.rate = 10.0;
+    config.kindMask = (1u << ActionKind_Pgm) | (1u << ActionKind_Pst) | (1u << ActionKind_Xpt);
+    config.holdMsec = 50;
+    config.longMsec = 1000;
+    config.faderMsec = 500;
+    config.timeoutMsec = 2000;
+    config.seed = 1;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* pKey = argv[i];
+        const char* pValue = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (!pValue)
+            return false;
+
+        if (strcmp(pKey, "-host") == 0)
+            config.pHost = pValue;
+        else if (strcmp(pKey, "-port") == 0)
+            config.port = (unsigned short)atoi(pValue);
+        else if (strcmp(pKey, "-script") == 0)
+            config.pScriptPath = pValue;
+        else if (strcmp(pKey, "-loop") == 0)
+            config.isLoop = (atoi(pValue) != 0);
+        else if (strcmp(pKey, "-rate") == 0)
+            config.rate = atof(pValue);
+        else if (strcmp(pKey, "-kinds") == 0)
+            config.kindMask = parseKinds(pValue);
+        else if (strcmp(pKey, "-hold") == 0)
+            config.holdMsec = atoi(pValue);
+        else if (strcmp(pKey, "-long") == 0)
+            config.longMsec = atoi(pValue);
+        else if (strcmp(pKey, "-sweep") == 0)
+            config.faderMsec = atoi(pValue);
+        else if (strcmp(pKey, "-timeout") == 0)
+            config.timeoutMsec = atoi(pValue);
+        else if (strcmp(pKey, "-duration") == 0)
+            config.duration = atoi(pValue);
+        else if (strcmp(pKey, "-seed") == 0)
+            config.seed = (unsigned int)strtoul(pValue, NULL, 10);
+        else
+            return false;
+        ++i;
+    }
+
+    if ((config.port == 0) || (config.kindMask == 0) || (config.rate <= 0.0)
+     || (config.holdMsec < 0) || (config.longMsec <= 0) || (config.faderMsec < 0) || (config.timeoutMsec <= 0))
+        return false;
+
+    randomState = (config.seed != 0) ? config.seed : 1;
+    return true;
+}
+
+/// <summary>HWIF 接続</summary>
+/// <returns>接続失敗時は INVALID_SOCKET</returns>
+static SOCKET connectHwif()
+{
+    struct sockaddr_in address;
+    SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == INVALID_SOCKET)
+        return INVALID_SOCKET;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(config.port);
+    if (inet_pton(AF_INET, config.pHost, &address.sin_addr) != 1)
+    {
+        struct hostent* pHost = gethostbyname(config.pHost);
+        if (!pHost || (pHost->h_addrtype != AF_INET))
+        {
+            closesocket(sock);
+            return INVALID_SOCKET;
+        }
+        memcpy(&address.sin_addr, pHost->h_addr_list[0], sizeof(address.sin_addr));
+    }
+
+    if (connect(sock, (struct sockaddr*)&address, sizeof(address)) == SOCKET_ERROR)
+    {
+        closesocket(sock);
+        return INVALID_SOCKET;
+    }
+
+    // 1 フレームずつ即時送信する（LineUnitCommand は受信単位で先頭フレームのみ処理するため）
+    int noDelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+    return sock;
+}
+
+int main(int argc, char** argv)
+{
+    SOCKET sock;
+    unsigned char rxBuffer[SIMULATOR_RX_BUFFER_SIZE];
+    int rxLength = 0;
+    int scriptIndex = 0;
+    bool isConnected = true;
+    bool isDraining = false;
+    unsigned long long drainStart = 0;
+
+    if (!parseArguments(argc, argv))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (config.pScriptPath && !loadScript(config.pScriptPath))
+        return 1;
+
+#ifdef WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    {
+        fprintf(stderr, "error at WSAStartup\n");
+        return 1;
+    }
+#endif
+
+    // 変換側の待ち受け開始まで接続を繰り返す
+    unsigned long long connectStart = monotonicMicroseconds();
+    while ((sock = connectHwif()) == INVALID_SOCKET)
+    {
+        if ((config.duration > 0) && (monotonicMicroseconds() - connectStart >= (unsigned long long)config.duration * 1000000ull))
+        {
+            fprintf(stderr, "connect error, %s:%d\n", config.pHost, config.port);
+            return 1;
+        }
+#ifdef WIN32
+        Sleep(500);
+#else
+        struct timespec wait = { 0, 500 * 1000 * 1000 };
+        nanosleep(&wait, NULL);
+#endif
+    }
+    printf("connected to %s:%d\n", config.pHost, config.port);
+    fflush(stdout);
+
+    unsigned long long startTime = monotonicMicroseconds();
+    unsigned long long nextAction = startTime;
+    unsigned long long lastReport = startTime;
+    for (;;)
+    {
+        unsigned long long now = monotonicMicroseconds();
+
+        // 操作を予約（スクリプトは前の操作の終了後、ランダムは指定レート）
+        if (!isDraining && config.pScriptPath)
+        {
+            while ((now >= nextAction) && (scriptIndex < scriptCount))
+            {
+                nextAction += scheduleAction(&script[scriptIndex++], nextAction);
+                if ((scriptIndex >= scriptCount) && config.isLoop)
+                    scriptIndex = 0;
+            }
+        }
+        else if (!isDraining)
+        {
+            unsigned long long interval = (unsigned long long)(1000000.0 / config.rate);
+            while (now >= nextAction)
+            {
+                Action action;
+                randomAction(&action);
+                scheduleAction(&action, nextAction);
+                nextAction += (interval > 0) ? interval : 1;
+            }
+        }
+
+        // 期限の来たフレームを送信
+        int sentCount = 0;
+        while ((sentCount < scheduleCount) && (schedule[sentCount].due <= now))
+        {
+            ScheduledFrame* pScheduled = &schedule[sentCount++];
+            int sendlen = send(sock, (const char*)pScheduled->frame, pScheduled->length, SIMULATOR_SEND_FLAGS);
+            if (sendlen <= 0)
+            {
+                isConnected = false;
+                break;
+            }
+            statistics.txFrames++;
+            statistics.txBytes += sendlen;
+            addPending(pScheduled, monotonicMicroseconds());
+        }
+        if (sentCount > 0)
+        {
+            memmove(&schedule[0], &schedule[sentCount], sizeof(ScheduledFrame) * (scheduleCount - sentCount));
+            scheduleCount -= sentCount;
+        }
+        if (!isConnected)
+            break;
+
+        // 次の送信予定まで受信待ち
+        unsigned long long wait = SIMULATOR_TICK_MSEC * 1000ull;
+        if ((scheduleCount > 0) && (schedule[0].due > now) && (schedule[0].due - now < wait))
+            wait = schedule[0].due - now;
+        else if ((scheduleCount > 0) && (schedule[0].due <= now))
+            wait = 0;
+
+        fd_set fdset;
+        struct timeval timeout = { 0, (long)wait };
+        FD_ZERO(&fdset);
+        FD_SET(sock, &fdset);
+        int fdsReady = select((int)(sock + 1), &fdset, NULL, NULL, &timeout);
+        if ((fdsReady > 0) && FD_ISSET(sock, &fdset))
+        {
+            int read = recv(sock, (char*)rxBuffer + rxLength, sizeof(rxBuffer) - rxLength, 0);
+            if (read <= 0)
+            {
+                isConnected = false;
+                break;
+            }
+            statistics.rxBytes += read;
+            rxLength += read;
+            parseFrames(rxBuffer, &rxLength, monotonicMicroseconds());
+            if (rxLength >= (int)sizeof(rxBuffer))
+            {
+                // 解析できないまま満杯（通常は発生しない）
+                statistics.frameErrors++;
+                rxLength = 0;
+            }
+        }
+        else if (fdsReady < 0)
+        {
+            isConnected = false;
+            break;
+        }
+
+        now = monotonicMicroseconds();
+        expirePending(now);
+
+        if (now - lastReport >= SIMULATOR_REPORT_MSEC * 1000ull)
+        {
+            reportStatistics(now - startTime, false);
+            lastReport = now;
+        }
+
+        // 指定時間経過後は未送信分を破棄し、送信済の期待タリーを待ってから終了
+        if (!isDraining && (config.duration > 0) && (now - startTime >= (unsigned long long)config.duration * 1000000ull))
+        {
+            isDraining = true;
+            drainStart = now;
+            scheduleCount = 0;
+        }
+        if (isDraining
+         && ((pendingCount == 0) || (now - drainStart >= (unsigned long long)config.timeoutMsec * 1000ull)))
+            break;
+        if (config.pScriptPath && !config.isLoop
+         && (scriptIndex >= scriptCount) && (scheduleCount == 0) && (pendingCount == 0))
+            break;
+    }
+
+    // 送信済の期待タリーは終了時点で未着として集計
+    if (!isConnected)
+        fprintf(stderr, "HWIF connection lost.\n");
+    statistics.timeouts += pendingCount;
+    pendingCount = 0;
+    reportStatistics(monotonicMicroseconds() - startTime, true);
+
+    closesocket(sock);
+    free(pLatencies);
+
+#ifdef WIN32
+    WSACleanup();
+#endif
+
+    // 接続断・タリー未着・フレーム異常があれば失敗とする
+    return (isConnected && (statistics.timeouts == 0) && (statistics.frameErrors == 0)) ? 0 : 2;
+}
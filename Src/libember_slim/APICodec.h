@@ -0,0 +1,228 @@
+﻿#pragma once
+// APIFormat.h の固定長メッセージの符号化・復号（ヘッダのみ）
+// len / command などの ASCII 10 進数フィールドは分岐なしで復号する
+// 受信バッファ上のメッセージはコピーせず、検証後に型付きで参照する
+// 各メッセージの配置（len, command, endcode の位置と本体長）はコンパイル時に検証する
+
+#include "APIFormat.h"
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace apiformat
+{
+	// ====================================================================
+	// ASCII 10 進数
+	// ====================================================================
+
+	/// <summary>ASCII 数値（復号結果）</summary>
+	struct AsciiNumber
+	{
+		/// <summary>値</summary>
+		int32_t m_nValue;
+		/// <summary>全桁が数字（符号）として妥当</summary>
+		bool m_bValid;
+	};
+
+	/// <summary>ASCII 10 進数復号</summary>
+	/// <param name="p">先頭（N 桁）</param>
+	/// <returns></returns>
+	/// <remarks>数字以外を含む場合も全桁を演算し、妥当性のみ落とす（分岐なし）</remarks>
+	template<size_t N>
+	constexpr AsciiNumber ParseDecimal(const uint8_t* p)
+	{
+		static_assert((N > 0) && (N <= 9), "ParseDecimal supports 1 to 9 digits");
+		uint32_t value = 0;
+		uint32_t invalid = 0;
+		for (size_t i = 0; i < N; ++i)
+		{
+			uint32_t digit = (uint32_t)p[i] - (uint32_t)'0';
+			invalid |= (uint32_t)(digit > 9);
+			value = value * 10 + digit;
+		}
+		return { (int32_t)value, invalid == 0 };
+	}
+	/// <summary>符号付 ASCII 10 進数復号</summary>
+	/// <param name="p">先頭（符号 1 桁 + 数字 N - 1 桁）</param>
+	/// <returns></returns>
+	/// <remarks>符号は '+' / '-'、0 は "0000" のように符号なしも可（分岐なし）</remarks>
+	template<size_t N>
+	constexpr AsciiNumber ParseSignedDecimal(const uint8_t* p)
+	{
+		static_assert(N > 1, "ParseSignedDecimal needs a sign and at least one digit");
+		uint32_t minus = (uint32_t)(p[0] == '-');
+		uint32_t sign = (uint32_t)(p[0] == '+') | minus | (uint32_t)(p[0] == '0');
+		AsciiNumber digits = ParseDecimal<N - 1>(p + 1);
+		int32_t mask = -(int32_t)minus;
+		return { (digits.m_nValue ^ mask) - mask, (sign & (uint32_t)digits.m_bValid) != 0 };
+	}
+	/// <summary>ASCII 10 進数符号化（N 桁に満たない上位は '0'、超える分は切り捨て）</summary>
+	/// <param name="p">先頭（N 桁）</param>
+	/// <param name="value"></param>
+	template<size_t N>
+	constexpr void FormatDecimal(uint8_t* p, uint32_t value)
+	{
+		for (size_t i = N; i > 0; --i)
+		{
+			p[i - 1] = (uint8_t)('0' + (value % 10));
+			value /= 10;
+		}
+	}
+
+
+	// ====================================================================
+	// 固定長メッセージ
+	// ====================================================================
+
+	/// <summary>メッセージ種別（コマンド番号）</summary>
+	/// <remarks>対応するメッセージのみ特殊化する（未対応の型は参照時にコンパイルエラー）</remarks>
+	template<typename T>
+	struct MessageTraits;
+	/// <summary>メッセージ種別（基底）</summary>
+	template<COMMAND C>
+	struct FixedMessage
+	{
+		/// <summary>コマンド番号</summary>
+		static constexpr COMMAND Command = C;
+	};
+	template<> struct MessageTraits<structBASICSTATUS_REQ> : FixedMessage<basicStatusAsk> {};
+	template<> struct MessageTraits<structBASICSTATUS_ANS> : FixedMessage<basicStatusAns> {};
+	template<> struct MessageTraits<structSTATUS_ANS> : FixedMessage<normalStatusAns> {};
+	template<> struct MessageTraits<structBRIGHTNESS> : FixedMessage<BrightnessLevelSet> {};
+	template<> struct MessageTraits<structBITMAP> : FixedMessage<BitmapDataSet> {};
+	template<> struct MessageTraits<structIPADDRESS> : FixedMessage<IPAddressSet> {};
+	template<> struct MessageTraits<structSTATUS_LED> : FixedMessage<statusLEDSet> {};
+	template<> struct MessageTraits<structBUZZERREQ> : FixedMessage<buzzerSet> {};
+	template<> struct MessageTraits<structDEBUGLED> : FixedMessage<DebugLEDSet> {};
+	template<> struct MessageTraits<structRTCDATE_ANS> : FixedMessage<RTCDateTimeAns> {};
+	template<> struct MessageTraits<structIPADDRESS_ANS> : FixedMessage<IPAddressAns> {};
+	template<> struct MessageTraits<structBUTTON_18D> : FixedMessage<button_notify> {};
+	template<> struct MessageTraits<structBUTTON_39D> : FixedMessage<button_notify> {};
+	template<> struct MessageTraits<structBUTTON_40RU> : FixedMessage<button_notify> {};
+	template<> struct MessageTraits<structROTARY> : FixedMessage<rotally_notify> {};
+
+	/// <summary>メッセージ配置</summary>
+	/// <remarks>
+	/// len はコマンドから終端コードの手前までのバイト数
+	/// </remarks>
+	template<typename T>
+	struct MessageLayout
+	{
+		static_assert(std::is_standard_layout<T>::value && std::is_trivially_copyable<T>::value, "message must be a packed POD");
+		static_assert((offsetof(T, len) == 0) && (sizeof(T::len) == 4), "len must be the leading 4 ASCII digits");
+		static_assert((offsetof(T, command) == 4) && (sizeof(T::command) == 4), "command must follow len as 4 ASCII digits");
+		static_assert(offsetof(T, endcode) == sizeof(T) - 1, "endcode must be the last byte");
+
+		/// <summary>メッセージ長</summary>
+		static constexpr size_t Size = sizeof(T);
+		/// <summary>len の値</summary>
+		static constexpr uint32_t BodyLength = (uint32_t)(sizeof(T) - sizeof(T::len) - sizeof(T::endcode));
+		static_assert(BodyLength <= 9999, "len exceeds 4 digits");
+	};
+
+	/// <summary>len 復号</summary>
+	/// <param name="pBuffer">メッセージ先頭（4 バイト以上）</param>
+	/// <returns></returns>
+	inline AsciiNumber PeekLength(const void* pBuffer) { return ParseDecimal<4>((const uint8_t*)pBuffer); }
+	/// <summary>command 復号</summary>
+	/// <param name="pBuffer">メッセージ先頭（8 バイト以上）</param>
+	/// <returns></returns>
+	inline AsciiNumber PeekCommand(const void* pBuffer) { return ParseDecimal<4>((const uint8_t*)pBuffer + 4); }
+
+	/// <summary>
+	/// メッセージ参照
+	/// </summary>
+	/// <remarks>
+	/// 受信バッファ上のメッセージをコピーせずに参照する（バッファの寿命は呼び出し側で保証）
+	/// 長さ・len・command・終端コードのいずれかが不一致の場合は無効
+	/// </remarks>
+	template<typename T>
+	class MessageView
+	{
+	public:
+		/// <summary>
+		/// コンストラクタ
+		/// </summary>
+		/// <param name="pBuffer">メッセージ先頭</param>
+		/// <param name="length">バッファ長</param>
+		MessageView(const void* pBuffer, size_t length) :
+			m_pMessage(Validate(pBuffer, length) ? (const T*)pBuffer : nullptr)
+		{
+		}
+
+		/// <summary>有効</summary>
+		/// <returns></returns>
+		bool Valid() const { return m_pMessage != nullptr; }
+		/// <summary>メッセージ</summary>
+		/// <returns>無効時は nullptr</returns>
+		const T* Get() const { return m_pMessage; }
+		/// <summary>メッセージ</summary>
+		/// <returns></returns>
+		const T* operator->() const { return m_pMessage; }
+		/// <summary>メッセージ</summary>
+		/// <returns></returns>
+		const T& operator*() const { return *m_pMessage; }
+
+		/// <summary>メッセージ検証</summary>
+		/// <param name="pBuffer">メッセージ先頭</param>
+		/// <param name="length">バッファ長</param>
+		/// <returns></returns>
+		static bool Validate(const void* pBuffer, size_t length)
+		{
+			if (!pBuffer || (length < MessageLayout<T>::Size))
+				return false;
+			const uint8_t* p = (const uint8_t*)pBuffer;
+			AsciiNumber len = PeekLength(p);
+			AsciiNumber command = PeekCommand(p);
+			return (len.m_bValid & command.m_bValid
+				  & ((uint32_t)len.m_nValue == MessageLayout<T>::BodyLength)
+				  & (command.m_nValue == (int32_t)MessageTraits<T>::Command)
+				  & (p[MessageLayout<T>::Size - 1] == (uint8_t)ENDCODE)) != 0;
+		}
+
+	private:
+		/// <summary>メッセージ</summary>
+		const T* m_pMessage;
+	};
+
+	/// <summary>送信メッセージ初期化（len, command, 終端コードを設定）</summary>
+	/// <param name="message"></param>
+	template<typename T>
+	inline void InitMessage(T& message)
+	{
+		FormatDecimal<4>((uint8_t*)&message.len, MessageLayout<T>::BodyLength);
+		FormatDecimal<4>((uint8_t*)&message.command, (uint32_t)MessageTraits<T>::Command);
+		message.endcode = (uint8_t)ENDCODE;
+	}
+
+
+	// ====================================================================
+	// メッセージ個別
+	// ====================================================================
+
+	/// <summary>ボタン押下通知のボタン状態位置（機種によらず共通）</summary>
+	constexpr size_t ButtonsOffset = offsetof(structBUTTON_18D, btns);
+	static_assert((offsetof(structBUTTON_39D, btns) == ButtonsOffset) && (offsetof(structBUTTON_40RU, btns) == ButtonsOffset), "button layouts differ");
+	static_assert((offsetof(structBUTTON_18D, setup_sw) == ButtonsOffset - 1) && (offsetof(structBUTTON_39D, setup_sw) == ButtonsOffset - 1)
+			   && (offsetof(structBUTTON_40RU, setup_sw) == ButtonsOffset - 1), "setup_sw must precede btns");
+	/// <summary>ボタン押下通知のボタン数</summary>
+	/// <param name="length">メッセージ長</param>
+	/// <returns></returns>
+	constexpr int ButtonCount(size_t length) { return (length > ButtonsOffset) ? (int)(length - ButtonsOffset - sizeof(uint8_t)) : 0; }
+	static_assert(ButtonCount(sizeof(structBUTTON_18D)) == BTNCNT_18D, "18D button count");
+	static_assert(ButtonCount(sizeof(structBUTTON_39D)) == BTNCNT_39D, "39D button count");
+	static_assert(ButtonCount(sizeof(structBUTTON_40RU)) == BTNCNT_40RU, "40RU button count");
+
+	/// <summary>ロータリー操作量（-128～+127、不正時は 0）</summary>
+	/// <param name="rotary"></param>
+	/// <returns></returns>
+	inline int32_t RotaryValue(const structROTARY& rotary)
+	{
+		AsciiNumber value = ParseSignedDecimal<sizeof(rotary.value)>((const uint8_t*)&rotary.value);
+		return value.m_nValue & -(int32_t)value.m_bValid;
+	}
+	/// <summary>ロータリー押下</summary>
+	/// <param name="rotary"></param>
+	/// <returns></returns>
+	inline bool RotaryPushed(const structROTARY& rotary) { return rotary.pushed == '1'; }
+}
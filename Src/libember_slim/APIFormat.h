@@ -12,6 +12,8 @@
 #define OLEDCNT_18D		BTNCNT_18D						// 18D の OLED 数
 #define OLEDCNT_39D		LED_OFFSET_39D					// 39D の OLED 数
 #define DEVCNT_MAX		BTNCNT_39D						// ボタン定義数最大
+#define BUTTONLED_COUNT_MAX	(40)						// ボタンLED設定要求(2001)の 1 メッセージあたり最大数
+#define OLED_COUNT_MAX		(45)						// OLED表示要求(2002)の 1 メッセージあたり最大数
 
 #pragma pack (1)
 enum COMMAND {
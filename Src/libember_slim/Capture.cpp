@@ -0,0 +1,369 @@
+﻿#include "Capture.h"
+#include "Output.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+using namespace utilities;
+
+#undef min
+#undef max
+
+
+/// <summary>
+/// 数値をリトルエンディアンで書き出し
+/// </summary>
+/// <param name="pBuffer"></param>
+/// <param name="value"></param>
+/// <param name="size"></param>
+static void PutLittleEndian(unsigned char* pBuffer, uint64_t value, size_t size)
+{
+	for (size_t i = 0; i < size; ++i)
+		pBuffer[i] = (unsigned char)((value >> (i * 8)) & 0xff);
+}
+/// <summary>
+/// リトルエンディアンの数値を読み出し
+/// </summary>
+/// <param name="pBuffer"></param>
+/// <param name="size"></param>
+/// <returns></returns>
+static uint64_t GetLittleEndian(const unsigned char* pBuffer, size_t size)
+{
+	uint64_t value = 0;
+	for (size_t i = 0; i < size; ++i)
+		value |= (uint64_t)pBuffer[i] << (i * 8);
+	return value;
+}
+
+
+/// <summary>
+/// コンストラクタ
+/// </summary>
+CCapture::CCapture() :
+	m_mtxRecord(),
+	m_ofsRecord(),
+	m_tpStart(),
+	m_tpFlush(),
+	m_bRecording(false),
+	m_vReplayRecords(),
+	m_bReplaying(false)
+{
+}
+
+/// <summary>
+/// デストラクタ
+/// </summary>
+CCapture::~CCapture()
+{
+	Close();
+}
+
+/// <summary>記録開始</summary>
+/// <param name="sPath"></param>
+/// <returns></returns>
+bool CCapture::Open(const std::string& sPath)
+{
+	bool res = false;
+	try
+	{
+		Close();
+
+		std::lock_guard<std::mutex> lock(m_mtxRecord);
+		if (sPath.empty() || m_bReplaying)
+			return res;
+
+		m_ofsRecord.open(sPath, std::ios::binary | std::ios::out | std::ios::trunc);
+		if (!m_ofsRecord.is_open())
+		{
+			ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "capture open error, %s\n", sPath.c_str());
+			return res;
+		}
+
+		unsigned char header[CAPTURE_FILE_HEADER_SIZE] = { 0 };
+		memcpy(header, CAPTURE_FILE_MAGIC, 4);
+		PutLittleEndian(&header[4], CAPTURE_FILE_VERSION, 2);
+		m_ofsRecord.write((const char*)header, sizeof(header));
+
+		m_tpStart = m_tpFlush = std::chrono::steady_clock::now();
+		m_bRecording = res = m_ofsRecord.good();
+		Trace(__FILE__, __LINE__, __FUNCTION__, "capture started, %s\n", sPath.c_str());
+	}
+	catch (const std::exception ex)
+	{
+		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
+	}
+
+	return res;
+}
+/// <summary>記録終了</summary>
+void CCapture::Close()
+{
+	try
+	{
+		std::lock_guard<std::mutex> lock(m_mtxRecord);
+		m_bRecording = false;
+		if (m_ofsRecord.is_open())
+		{
+			m_ofsRecord.flush();
+			m_ofsRecord.close();
+		}
+	}
+	catch (const std::exception ex)
+	{
+		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
+	}
+}
+/// <summary>記録</summary>
+/// <param name="eSocketId"></param>
+/// <param name="eDirection"></param>
+/// <param name="pData"></param>
+/// <param name="nLength"></param>
+/// <remarks>
+/// 送受信スレッドから呼び出されるためロック内で時刻取得と書き出しを行い
+/// ファイル上の順序と時刻の単調性を保つ
+/// </remarks>
+void CCapture::Record(ClientSocketId eSocketId, CaptureDirection eDirection, const void* pData, int nLength)
+{
+	if (!m_bRecording || !pData || (nLength <= 0))
+		return;
+
+	try
+	{
+		std::lock_guard<std::mutex> lock(m_mtxRecord);
+		if (!m_bRecording)
+			return;
+
+		auto tpNow = std::chrono::steady_clock::now();
+		auto nTimestamp = std::chrono::duration_cast<std::chrono::microseconds>(tpNow - m_tpStart).count();
+
+		unsigned char header[CAPTURE_RECORD_HEADER_SIZE] = { 0 };
+		PutLittleEndian(&header[0], (uint64_t)nTimestamp, 8);
+		header[8] = (unsigned char)eSocketId;
+		header[9] = (unsigned char)eDirection;
+		PutLittleEndian(&header[10], (uint64_t)nLength, 4);
+		m_ofsRecord.write((const char*)header, sizeof(header));
+		m_ofsRecord.write((const char*)pData, nLength);
+
+		if ((tpNow - m_tpFlush) >= std::chrono::milliseconds(CAPTURE_FLUSH_MSEC))
+		{
+			m_ofsRecord.flush();
+			m_tpFlush = tpNow;
+		}
+
+		if (!m_ofsRecord.good())
+		{
+			ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "capture write error, stop recording.\n");
+			m_bRecording = false;
+			m_ofsRecord.close();
+		}
+	}
+	catch (const std::exception ex)
+	{
+		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
+	}
+}
+
+/// <summary>キャプチャファイル読み込み</summary>
+/// <param name="sPath"></param>
+/// <param name="vRecords"></param>
+/// <returns></returns>
+bool CCapture::Load(const std::string& sPath, std::vector<CaptureRecord>& vRecords)
+{
+	bool res = false;
+	vRecords.clear();
+	try
+	{
+		std::ifstream ifs(sPath, std::ios::binary | std::ios::in);
+		if (!ifs.is_open())
+		{
+			ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "capture open error, %s\n", sPath.c_str());
+			return res;
+		}
+
+		unsigned char header[CAPTURE_FILE_HEADER_SIZE] = { 0 };
+		if (!ifs.read((char*)header, sizeof(header))
+		 || (memcmp(header, CAPTURE_FILE_MAGIC, 4) != 0)
+		 || (GetLittleEndian(&header[4], 2) != CAPTURE_FILE_VERSION))
+		{
+			ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "capture format error, %s\n", sPath.c_str());
+			return res;
+		}
+
+		unsigned char record[CAPTURE_RECORD_HEADER_SIZE] = { 0 };
+		while (ifs.read((char*)record, sizeof(record)))
+		{
+			CaptureRecord sRecord;
+			sRecord.m_nTimestamp = GetLittleEndian(&record[0], 8);
+			sRecord.m_eSocketId = (ClientSocketId)record[8];
+			sRecord.m_eDirection = (CaptureDirection)record[9];
+			auto nLength = (size_t)GetLittleEndian(&record[10], 4);
+			if (nLength > CAPTURE_RECORD_MAX_LENGTH)
+			{
+				ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "capture record error, length = %zu\n", nLength);
+				break;
+			}
+			sRecord.m_vData.resize(nLength);
+			if ((nLength > 0) && !ifs.read((char*)sRecord.m_vData.data(), nLength))
+			{
+				// 記録中断による末尾欠けは読めた分までとする
+				break;
+			}
+			vRecords.push_back(std::move(sRecord));
+		}
+
+		res = true;
+		Trace(__FILE__, __LINE__, __FUNCTION__, "capture loaded, %s, records = %zu\n", sPath.c_str(), vRecords.size());
+	}
+	catch (const std::exception ex)
+	{
+		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
+	}
+
+	return res;
+}
+
+/// <summary>リプレイ準備（キャプチャファイル読み込み）</summary>
+/// <param name="sPath"></param>
+/// <returns></returns>
+/// <remarks>
+/// リプレイ中は Ember コンシューマが接続せず、送信も抑止される
+/// コンシューマ生成前に呼び出す
+/// </remarks>
+bool CCapture::LoadReplay(const std::string& sPath)
+{
+	Close();
+	m_bReplaying = Load(sPath, m_vReplayRecords) && !m_vReplayRecords.empty();
+	return m_bReplaying;
+}
+/// <summary>リプレイ</summary>
+/// <param name="bRealtime">記録時の間隔で投入（false 時は待機なし）</param>
+/// <param name="fnReceived">受信記録の投入先</param>
+/// <returns>投入イベント数</returns>
+size_t CCapture::Replay(bool bRealtime, const std::function<void(const CaptureRecord&)>& fnReceived)
+{
+	size_t nEvents = 0;
+	if (!m_bReplaying || !fnReceived)
+		return nEvents;
+
+	ReplayStatistics aStatistics[(int)ClientSocketId::SOCK_COUNT];
+	try
+	{
+		Guidance("replay start, records = %zu, %s\n", m_vReplayRecords.size(), bRealtime ? "realtime" : "max speed");
+
+		auto tpStart = std::chrono::steady_clock::now();
+		for (const auto& sRecord : m_vReplayRecords)
+		{
+			if (!IsRange((int)sRecord.m_eSocketId, 0, (int)ClientSocketId::SOCK_COUNT - 1))
+				continue;
+
+			auto& sStatistics = aStatistics[(int)sRecord.m_eSocketId];
+			// 送信記録は受信の投入で再生成されるため集計のみ
+			if (sRecord.m_eDirection != CaptureDirection::CAPTURE_RECV)
+			{
+				sStatistics.m_nSkipped++;
+				continue;
+			}
+
+			if (bRealtime)
+				std::this_thread::sleep_until(tpStart + std::chrono::microseconds(sRecord.m_nTimestamp));
+
+			auto tpEvent = std::chrono::steady_clock::now();
+			fnReceived(sRecord);
+			auto nLatency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - tpEvent).count();
+
+			sStatistics.m_nEvents++;
+			sStatistics.m_nBytes += sRecord.m_vData.size();
+			sStatistics.m_vLatencies.push_back((uint32_t)std::min<long long>(nLatency, UINT32_MAX));
+			nEvents++;
+		}
+		auto nElapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - tpStart).count();
+
+		ReportStatistics(aStatistics, (uint64_t)nElapsed);
+	}
+	catch (const std::exception ex)
+	{
+		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
+	}
+
+	m_vReplayRecords.clear();
+	m_bReplaying = false;
+
+	return nEvents;
+}
+/// <summary>リプレイ集計出力</summary>
+/// <param name="aStatistics"></param>
+/// <param name="nElapsed">所要時間（usec）</param>
+void CCapture::ReportStatistics(const ReplayStatistics* aStatistics, uint64_t nElapsed)
+{
+	static const char* aSocketNames[(int)ClientSocketId::SOCK_COUNT] = { "HWIF", "NMOS-Ember", "MV-Ember" };
+
+	size_t nEvents = 0;
+	size_t nBytes = 0;
+	double dSeconds = (nElapsed > 0) ? (double)nElapsed / 1000000.0 : 0.0;
+
+	for (int i = 0; i < (int)ClientSocketId::SOCK_COUNT; ++i)
+	{
+		const auto& sStatistics = aStatistics[i];
+		if ((sStatistics.m_nEvents == 0) && (sStatistics.m_nSkipped == 0))
+			continue;
+
+		nEvents += sStatistics.m_nEvents;
+		nBytes += sStatistics.m_nBytes;
+
+		// 処理時間は昇順に並べて百分位を取る
+		std::vector<uint32_t> vLatencies(sStatistics.m_vLatencies);
+		std::sort(vLatencies.begin(), vLatencies.end());
+		uint64_t nTotal = 0;
+		for (auto nLatency : vLatencies)
+			nTotal += nLatency;
+		auto fnPercentile = [&vLatencies](size_t nPercent) -> uint32_t
+		{
+			return vLatencies.empty() ? 0 : vLatencies[std::min(vLatencies.size() - 1, vLatencies.size() * nPercent / 100)];
+		};
+
+		Guidance("replay %-10s : events = %zu, bytes = %zu, skipped(send) = %zu\n",
+				 aSocketNames[i], sStatistics.m_nEvents, sStatistics.m_nBytes, sStatistics.m_nSkipped);
+		Guidance("replay %-10s : latency usec avg = %.1f, p50 = %u, p99 = %u, max = %u\n",
+				 aSocketNames[i],
+				 vLatencies.empty() ? 0.0 : (double)nTotal / vLatencies.size(),
+				 fnPercentile(50), fnPercentile(99),
+				 vLatencies.empty() ? 0 : vLatencies.back());
+	}
+
+	Guidance("replay total      : events = %zu, bytes = %zu, elapsed = %.3f sec, %.1f events/sec, %.1f KB/sec\n",
+			 nEvents, nBytes, dSeconds,
+			 (dSeconds > 0.0) ? nEvents / dSeconds : 0.0,
+			 (dSeconds > 0.0) ? nBytes / dSeconds / 1024.0 : 0.0);
+}
+
+/// <summary>
+/// 単一インスタンス（実体）
+/// </summary>
+std::unique_ptr<CCapture> CCapture::m_pInstance{};
+/// <summary>
+/// インスタンス取得
+/// </summary>
+/// <returns></returns>
+CCapture* CCapture::GetInstance()
+{
+	if (!m_pInstance)
+		m_pInstance.reset(new CCapture());
+	return m_pInstance.get();
+}
+
+
+// ====================================================================
+// for consumer capture
+// ====================================================================
+
+/// <summary>コンシューマ送受信記録</summary>
+/// <param name="socketId"></param>
+/// <param name="isSend"></param>
+/// <param name="pData"></param>
+/// <param name="length"></param>
+extern "C" void __CaptureTraffic(short socketId, bool isSend, const void* pData, int length)
+{
+	auto pCapture = CCapture::GetInstance();
+	if (pCapture && pCapture->Recording())
+		pCapture->Record((ClientSocketId)socketId, isSend ? CaptureDirection::CAPTURE_SEND : CaptureDirection::CAPTURE_RECV, pData, length);
+}
@@ -0,0 +1,200 @@
+﻿#pragma once
+
+#include "Utilities.h"
+#include "ClientConfig.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+// ====================================================================
+// キャプチャファイル書式
+// ====================================================================
+// ファイルヘッダ : マジック(4) + 版数(2) + 予約(2)
+// レコード       : 経過時間usec(8) + ソケット識別(1) + 方向(1) + データ長(4) + データ
+// 数値はリトルエンディアン、経過時間は記録開始からの単調増加時刻
+/// <summary>キャプチャファイルマジック</summary>
+#define CAPTURE_FILE_MAGIC			"LUCP"
+/// <summary>キャプチャファイル版数</summary>
+#define CAPTURE_FILE_VERSION		1
+/// <summary>キャプチャファイルヘッダ長</summary>
+#define CAPTURE_FILE_HEADER_SIZE	8
+/// <summary>キャプチャレコードヘッダ長</summary>
+#define CAPTURE_RECORD_HEADER_SIZE	14
+/// <summary>キャプチャレコードデータ長上限（破損判定用）</summary>
+#define CAPTURE_RECORD_MAX_LENGTH	(1024 * 1024)
+/// <summary>キャプチャファイルフラッシュ間隔（msec）</summary>
+#define CAPTURE_FLUSH_MSEC			1000
+
+
+// ====================================================================
+
+/// <summary>
+/// キャプチャ方向
+/// </summary>
+enum class CaptureDirection : uint8_t
+{
+	/// <summary>受信</summary>
+	CAPTURE_RECV = 0,
+	/// <summary>送信</summary>
+	CAPTURE_SEND,
+
+
+	/// <summary>方向数</summary>
+	CAPTURE_COUNT,
+	/// <summary>不定</summary>
+	CAPTURE_UNKNOWN = INT8_MAX,
+};
+
+/// <summary>
+/// キャプチャレコード
+/// </summary>
+class CaptureRecord
+{
+public:
+	/// <summary>
+	/// コンストラクタ
+	/// </summary>
+	CaptureRecord() :
+		m_nTimestamp(0),
+		m_eSocketId(ClientSocketId::SOCK_UNKNOWN),
+		m_eDirection(CaptureDirection::CAPTURE_UNKNOWN),
+		m_vData()
+	{
+	}
+
+	/// <summary>記録開始からの経過時間（usec）</summary>
+	uint64_t m_nTimestamp;
+	/// <summary>ソケット識別</summary>
+	ClientSocketId m_eSocketId;
+	/// <summary>方向</summary>
+	CaptureDirection m_eDirection;
+	/// <summary>データ</summary>
+	std::vector<unsigned char> m_vData;
+};
+
+/// <summary>
+/// リプレイ集計（ソケット識別単位）
+/// </summary>
+class ReplayStatistics
+{
+public:
+	/// <summary>
+	/// コンストラクタ
+	/// </summary>
+	ReplayStatistics() :
+		m_nEvents(0),
+		m_nBytes(0),
+		m_nSkipped(0),
+		m_vLatencies()
+	{
+	}
+
+	/// <summary>投入イベント数</summary>
+	size_t m_nEvents;
+	/// <summary>投入バイト数</summary>
+	size_t m_nBytes;
+	/// <summary>送信記録（再生対象外）数</summary>
+	size_t m_nSkipped;
+	/// <summary>イベント処理時間（usec）</summary>
+	std::vector<uint32_t> m_vLatencies;
+};
+
+
+// ====================================================================
+
+/// <summary>
+/// CCapture
+/// ソケット送受信キャプチャクラス
+/// </summary>
+/// <remarks>
+/// シングルトン使用想定
+/// 記録は HWIF/Ember 各ソケットの送受信箇所から呼び出す
+/// リプレイは受信記録のみを投入し、送信は抑止する
+/// </remarks>
+class CCapture
+{
+public:
+	/// <summary>
+	/// コンストラクタ
+	/// </summary>
+	CCapture();
+
+	/// <summary>
+	/// デストラクタ
+	/// </summary>
+	~CCapture();
+
+	/// <summary>記録開始</summary>
+	/// <param name="sPath"></param>
+	/// <returns></returns>
+	bool Open(const std::string& sPath);
+	/// <summary>記録終了</summary>
+	void Close();
+	/// <summary>記録中</summary>
+	/// <returns></returns>
+	bool Recording() { return m_bRecording; }
+	/// <summary>記録</summary>
+	/// <param name="eSocketId"></param>
+	/// <param name="eDirection"></param>
+	/// <param name="pData"></param>
+	/// <param name="nLength"></param>
+	void Record(ClientSocketId eSocketId, CaptureDirection eDirection, const void* pData, int nLength);
+
+	/// <summary>リプレイ準備（キャプチャファイル読み込み）</summary>
+	/// <param name="sPath"></param>
+	/// <returns></returns>
+	bool LoadReplay(const std::string& sPath);
+	/// <summary>リプレイ中</summary>
+	/// <returns></returns>
+	bool Replaying() { return m_bReplaying; }
+	/// <summary>リプレイ</summary>
+	/// <param name="bRealtime">記録時の間隔で投入（false 時は待機なし）</param>
+	/// <param name="fnReceived">受信記録の投入先</param>
+	/// <returns>投入イベント数</returns>
+	size_t Replay(bool bRealtime, const std::function<void(const CaptureRecord&)>& fnReceived);
+
+	/// <summary>キャプチャファイル読み込み</summary>
+	/// <param name="sPath"></param>
+	/// <param name="vRecords"></param>
+	/// <returns></returns>
+	static bool Load(const std::string& sPath, std::vector<CaptureRecord>& vRecords);
+
+	/// <summary>
+	/// インスタンス取得
+	/// </summary>
+	/// <returns></returns>
+	static CCapture* GetInstance();
+
+private:
+	/// <summary>リプレイ集計出力</summary>
+	/// <param name="aStatistics"></param>
+	/// <param name="nElapsed">所要時間（usec）</param>
+	static void ReportStatistics(const ReplayStatistics* aStatistics, uint64_t nElapsed);
+
+	/// <summary></summary>
+	std::mutex m_mtxRecord;
+	/// <summary>記録先</summary>
+	std::ofstream m_ofsRecord;
+	/// <summary>記録開始時刻</summary>
+	std::chrono::steady_clock::time_point m_tpStart;
+	/// <summary>直近フラッシュ時刻</summary>
+	std::chrono::steady_clock::time_point m_tpFlush;
+	/// <summary>記録中（Record の排他前の判定で他スレッドから参照する）</summary>
+	std::atomic<bool> m_bRecording;
+
+	/// <summary>リプレイ対象</summary>
+	std::vector<CaptureRecord> m_vReplayRecords;
+	/// <summary>リプレイ中</summary>
+	bool m_bReplaying;
+
+	/// <summary>
+	/// 単一インスタンス（宣言）
+	/// </summary>
+	static std::unique_ptr<CCapture> m_pInstance;
+};
@@ -5,13 +5,18 @@
 #include "Utilities.h"
 #include "EmberConsumer.h"
 #include "EmberInfo.h"
+#include "Capture.h"
+#include "LineUnitMap.h"
+#include "LineUnitPanel.h"
 #include <iostream>
 #include <string>
 #include <sstream>
 #include <vector>
 #include <memory>
 #include <mutex>
+#if defined WIN32
 #include <process.h>
+#endif
 
 #define BUFFERSIZE 512
 #define PROTOPORT 5193 // Default port number
@@ -22,10 +27,10 @@ std::string ExecutableFilePath = ""; //
 int ProcessId = 0;
 int testcnt = 0;
 
-int before_send_val = 0;
-bool longPushFlag = false;
-
-SOCKET ActiveClientSock = 0;
+/// <summary>LINE UNIT \Ԃ̔riʒml̍XVƈđMAڑ̏\j</summary>
+static std::mutex m_mtxLineUnitState;
+/// <summary>LINE UNIT \ԁiΉ\̃O[vPʂ̍ŐVʒmlAl^̂݁j</summary>
+static std::unordered_map<int, GlowValue> m_mpLineUnitValues;
 
 void ClearWinSock() {
 #if defined WIN32
@@ -33,10 +38,127 @@ void ClearWinSock() {
 #endif
 }
 
+/// <summary>LINE UNIT Mt[ǉ</summary>
+/// <param name="vFrames">Mt[iAj</param>
+/// <param name="pFrame"></param>
+/// <param name="length"></param>
+static void AppendLineUnitFrame(std::vector<char>& vFrames, const char* pFrame, int length)
+{
+	vFrames.insert(vFrames.end(), pFrame, pFrame + length);
+}
+
+/// <summary>LINE UNIT LED ݒt[ǉ</summary>
+/// <param name="vFrames">Mt[iAj</param>
+/// <param name="command">R}hԍi0x01:XCb` LED, 0x02:LEDj</param>
+/// <param name="nSwitch">XCb`iLEDjԍ</param>
+/// <param name="nPalette">pbg</param>
+static void AppendLineUnitLed(std::vector<char>& vFrames, char command, int nSwitch, char nPalette)
+{
+	char cmd[10] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x04, command, (char)((nSwitch >> 8) & 0xff), (char)(nSwitch & 0xff), nPalette };
+	AppendLineUnitFrame(vFrames, cmd, sizeof(cmd));
+}
+
+/// <summary>LINE UNIT O[v\Ԃ̃t[ǉ</summary>
+/// <param name="vFrames">Mt[iAj</param>
+/// <param name="group">Ή\̃O[v</param>
+/// <param name="value">ʒml</param>
+/// <returns>_XCb`ԍilÎ݁AΉȂ 0j</returns>
+static int AppendLineUnitState(std::vector<char>& vFrames, const LineUnitGroup& group, const GlowValue& value)
+{
+	int btn_num = 0;
+	switch (group.m_eAction)
+	{
+	case LineUnitAction::ACTION_SELECT:
+		//lɑΉXCb`_AO[v̑XCb`
+		if (value.flag == GlowParameterType::GlowParameterType_Integer)
+		{
+			//Ôint^`FbNĂ瑗M
+			btn_num = group.ValueSwitch(value.choice.integer);
+			if (btn_num != 0)
+				AppendLineUnitLed(vFrames, 0x01, btn_num, group.m_nOnPalette);
+			for (auto nSwitch : group.m_vSwitches)
+			{
+				if (btn_num != nSwitch)
+					AppendLineUnitLed(vFrames, 0x01, nSwitch, group.m_nOffPalette);
+			}
+		}
+		break;
+
+	case LineUnitAction::ACTION_FADER:
+		//tF[_[
+		if (value.flag == GlowParameterType::GlowParameterType_Real)
+		{
+			//Ôint^`FbNĂ瑗M
+			int ember_val = (int)value.choice.real;
+
+			//ILPS(0`100) -> LINE UNIT(0`65535)
+			int fader_val = (double)ember_val * 65535 / 100;
+
+			//tF[_[Ԑݒ
+			char cmd[11] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x05, 0x03, (char)((group.m_nFader >> 8) & 0xff), (char)(group.m_nFader & 0xff), (char)((fader_val >> 8) & 0xff), (char)(fader_val & 0xff) };
+			AppendLineUnitFrame(vFrames, cmd, sizeof(cmd));
+
+			//tF[_[LED_ݒ
+			//ILPS(0`100) -> LED
+			int led_count = (int)group.m_vSwitches.size();
+			int led_num_max = (double)ember_val / 100 * led_count;
+			for (int i = led_count; i > 0; i--)
+			{
+				int led_num = group.m_vSwitches[i - 1];
+				AppendLineUnitLed(vFrames, 0x02, led_num, (i <= led_num_max) ? group.m_nOnPalette : group.m_nOffPalette);
+			}
+		}
+		break;
+
+	default:
+		break;
+	}
+	return btn_num;
+}
+
+/// <summary>LINE UNIT XCb` LED ݒ</summary>
+/// <param name="panel">Mpl</param>
+/// <param name="nSwitch">XCb`ԍ</param>
+/// <param name="nPalette">pbg</param>
+static void SendLineUnitLed(CLineUnitPanel& panel, int nSwitch, char nPalette)
+{
+	char cmd[10] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x04, 0x01, (char)((nSwitch >> 8) & 0xff), (char)(nSwitch & 0xff), nPalette };
+	panel.Send(cmd, sizeof(cmd));
+}
+
+/// <summary>Ember+ p[^ݒv</summary>
+/// <param name="sPath"></param>
+/// <param name="value">ݒlil^̂݁j</param>
+static void SetEmberParameter(const std::string& sPath, const GlowValue& value)
+{
+	if (!m_pNmosEmberConsumer)
+		return;
+
+	RequestId requestId = { 0 };
+	EmberPathPtr pPath;
+	int len = (int)m_pNmosEmberConsumer->GetNodePath(sPath, pPath);
+
+	GlowParameter parameter;
+	bzero_item(parameter);
+	parameter.value = value;
+	// p[^ݒ͑MɎQƂȂ߁AMɔj
+	EmberContentPtr pRequest(m_pNmosEmberConsumer->CreateSetParameterRequest(&requestId, pPath.get(), len, parameter));
+	Call_handleInput(&m_pNmosEmberConsumer->m_sRemoteContent, pRequest.get());
+}
+
 /// <summary>LINE UNIT</summary>
+/// <param name="panel">pl</param>
 /// <returns></returns>
-void UnitInitialize(SOCKET sock)
+/// <remarks>
+/// pbgƁA擾ς̒ʒmlɂ^[EtF[_[Ԃ 1 ̑Mɂ܂Ƃ߂
+/// ʒml擾̃O[v͏Aȍ~̒ʒmōXV
+/// ʒmɂđMƔrA\ォ͂ʒm㏑Ȃ悤ɂ
+/// </remarks>
+void UnitInitialize(CLineUnitPanel& panel)
 {
+	std::vector<char> vFrames{};
+	vFrames.reserve(1024);
+
 	//pbgF̏ݒ
 	const char* SendPalette1Data = "\x46\x4F\x52\x41\x00\x06\x08\x00\x00\x00\x00\x03";
 	const char* SendPalette2Data = "\x46\x4F\x52\x41\x00\x06\x08\x00\x01\x00\x05\x03";
@@ -45,51 +167,47 @@ void UnitInitialize(SOCKET sock)
 	const char* SendPalette5Data = "\x46\x4F\x52\x41\x00\x06\x08\x00\x04\x00\x01\x03";
 	const char* SendPalette6Data = "\x46\x4F\x52\x41\x00\x06\x08\x00\x05\x04\x01\x03";
 	const char* SendPalette7Data = "\x46\x4F\x52\x41\x00\x06\x08\x00\x06\x01\x01\x03";
-	send(sock, SendPalette1Data, 12, 0);
-	send(sock, SendPalette2Data, 12, 0);
-	send(sock, SendPalette3Data, 12, 0);
-	send(sock, SendPalette4Data, 12, 0);
-	send(sock, SendPalette5Data, 12, 0);
-	send(sock, SendPalette6Data, 12, 0);
-	send(sock, SendPalette7Data, 12, 0);
-
-	//_ԂNA
-	//PGM񐧌
-	for (int i = 1; i < 26; i++)
-	{
-		char cmd[10] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x04, 0x01, (i >> 8) & 0xff, i & 0xff, 0 };
-		send(sock, cmd, sizeof(cmd), 0);
-	}
-	//PST񐧌
-	for (int i = 46; i < 71; i++)
-	{
-		char cmd[10] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x04, 0x01, (i >> 8) & 0xff, i & 0xff, 0 };
-		send(sock, cmd, sizeof(cmd), 0);
-	}
-	//XPT񐧌
-	for (int i = 91; i < 116; i++)
+	AppendLineUnitFrame(vFrames, SendPalette1Data, 12);
+	AppendLineUnitFrame(vFrames, SendPalette2Data, 12);
+	AppendLineUnitFrame(vFrames, SendPalette3Data, 12);
+	AppendLineUnitFrame(vFrames, SendPalette4Data, 12);
+	AppendLineUnitFrame(vFrames, SendPalette5Data, 12);
+	AppendLineUnitFrame(vFrames, SendPalette6Data, 12);
+	AppendLineUnitFrame(vFrames, SendPalette7Data, 12);
+
+	auto lock = std::unique_lock<std::mutex>(m_mtxLineUnitState);
+
+	//擾ς̒ʒmlœ_ԂݒA擾͓_ԂNAiΉ\̒lIXCb`j
+	const auto& vGroups = CLineUnitMap::GetInstance()->Groups();
+	for (size_t i = 0; i < vGroups.size(); ++i)
 	{
-		char cmd[10] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x04, 0x01, (i >> 8) & 0xff, i & 0xff, 0 };
-		send(sock, cmd, sizeof(cmd), 0);
-	}
-	for (int i = 136; i < 161; i++)
-	{
-		char cmd[10] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x04, 0x01, (i >> 8) & 0xff, i & 0xff, 0 };
-		send(sock, cmd, sizeof(cmd), 0);
+		const auto& group = vGroups[i];
+		auto itr = m_mpLineUnitValues.find((int)i);
+		if (itr != m_mpLineUnitValues.end())
+		{
+			AppendLineUnitState(vFrames, group, (*itr).second);
+			if (group.m_eAction == LineUnitAction::ACTION_FADER)
+				panel.m_nFaderValue = (int)(*itr).second.choice.real;
+			continue;
+		}
+		if (group.m_eAction != LineUnitAction::ACTION_SELECT)
+			continue;
+		for (auto nSwitch : group.m_vSwitches)
+			AppendLineUnitLed(vFrames, 0x01, nSwitch, 0);
 	}
 
+	//܂Ƃ߂đM
+	panel.BringUp(std::make_shared<const std::vector<char>>(std::move(vFrames)));
 }
 
 /// <summary>LINE UNIT->Ember+vgRւ̕ϊ</summary>
+/// <param name="panel">Mpli{^ԁEʂ̉j</param>
+/// <param name="recvBuffer">Mt[</param>
 /// <returns></returns>
-void LineUnitCommand(SOCKET sock, char* recvBuffer)
+void LineUnitCommand(CLineUnitPanel& panel, char* recvBuffer)
 {
 	unsigned char* u_recvBuffer = (unsigned char*)recvBuffer;
-
-	GlowValue* pValue = nullptr;
-	GlowParameter* pParameter = nullptr;
-	RequestId requestId = { 0 };
-	berint* pPath = nullptr;
+	CLineUnitMap* pMap = CLineUnitMap::GetInstance();
 
 	//R}hԍȍ~̃f[^oCgJEg擾
 	int ByteCount = (u_recvBuffer[4] << 8) + u_recvBuffer[5];
@@ -111,131 +229,66 @@ void LineUnitCommand(SOCKET sock, char* recvBuffer)
 			//XCb`
 			int status = u_recvBuffer[9];
 
-			//ILPSM
-			std::string Value_btn = "";
-			std::string Value_tally = "";
-			std::string Path_btn = "";
-			std::string Path_tally = "";
-			char bright;
+			//Ή\XCb`擾iȂ͖j
+			const LineUnitSwitch* pSwitch = pMap->Switch(num);
+			if (!pSwitch)
+				break;
+			const LineUnitGroup* pGroup = pMap->Group(pSwitch->m_nGroup);
 
 			if (status == 0)
 			{
-				if (num > 0 && num <= 25)
+				if (pGroup->m_bReleaseQuery)
 				{
-					for (int i = 1; i < 26; i++)
+					//O[vXCb`̏Ԃv
+					std::vector<char> vFrames{};
+					for (auto nSwitch : pGroup->m_vSwitches)
 					{
-						char cmd[9] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x03, 0x00, (i >> 8) & 0xff, i & 0xff};
-						send(sock, cmd, sizeof(cmd), 0);
+						char cmd[9] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x03, 0x00, (char)((nSwitch >> 8) & 0xff), (char)(nSwitch & 0xff) };
+						AppendLineUnitFrame(vFrames, cmd, sizeof(cmd));
 					}
+					panel.Send(std::make_shared<const std::vector<char>>(std::move(vFrames)));
 
-					longPushFlag = true;
+					panel.m_bLongPush = true;
 				}
-				else if (num == 210 || num == 211)
+				else if (pSwitch->m_eAction == LineUnitAction::ACTION_INVOKE)
 				{
-					//CUT or AUTOgWV
-					//{^痣^C~OŃgWVs
-					if (num == 210) Path_btn = "/root/suite/s-1/switcher/n-1/abTrans/n-#/trans/cut";
-					else Path_btn = "/root/suite/s-1/switcher/n-1/abTrans/n-#/trans/auto";
-					Value_btn = "0";
-
-					//CUT,AUTO{^͔
-					char cmd[10] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x04, 0x01, recvBuffer[7], recvBuffer[8], 6 };
-					send(sock, cmd, sizeof(cmd), 0);
-
-					int len = (int)m_pNmosEmberConsumer->GetNodePath(Path_btn, &pPath);
-					GlowInvocation* pInvocation = newobj(GlowInvocation);
-					bzero_item(*pInvocation);
-					Call_handleInput(m_pNmosEmberConsumer->CreateInvokeRequest(&requestId, pPath, len, *pInvocation));
-
-					glowInvocation_free(pInvocation);
+					//{^痣^C~OŊ֐sA{^͏pbgij
+					SendLineUnitLed(panel, num, pGroup->m_nOffPalette);
+
+					if (m_pNmosEmberConsumer)
+					{
+						RequestId requestId = { 0 };
+						EmberPathPtr pPath;
+						int len = (int)m_pNmosEmberConsumer->GetNodePath(pGroup->m_sPath, pPath);
+						GlowInvocation invocation;
+						bzero_item(invocation);
+						// ֐s͌ʎM܂őMvƂĎQƂ邽߁AvL[oRƂj̓L[ɔC
+						m_pNmosEmberConsumer->AddConsumerRequest(m_pNmosEmberConsumer->CreateInvokeRequest(&requestId, pPath.get(), len, invocation));
+					}
 				}
 			}
 			else
 			{
-				if (status == 2 && !longPushFlag)
+				if (status == 2 && !panel.m_bLongPush)
 					break;
 
-				if (num > 0 && num <= 25)
+				if (pSwitch->m_eAction == LineUnitAction::ACTION_SELECT)
 				{
-					//PGM񐧌
-					Path_btn = "/root/suite/s-1/switcher/n-1/abTrans/n-#/sw/t/btn";
-					Path_tally = "/root/suite/s-1/switcher/n-1/abTrans/n-#/sw/t/tally";
-					Value_btn = std::to_string(num);
-					Value_tally = "0";
-					int len_btn = (int)m_pNmosEmberConsumer->GetNodePath(Path_btn, &pPath);
-
-					pValue = m_pNmosEmberConsumer->CreateGlowValue(GlowParameterType::GlowParameterType_Integer, Value_btn);
-					if (pValue)
-					{
-						pParameter = newobj(GlowParameter);
-						bzero_item(*pParameter);
-						glowValue_copyFrom(&pParameter->value, pValue);
-						Call_handleInput(m_pNmosEmberConsumer->CreateSetParameterRequest(&requestId, pPath, len_btn, *pParameter));
-
-						glowParameter_free(pParameter);
-						pParameter = nullptr;
-						freeMemory(pValue);
-						pValue = nullptr;
-					}
-					longPushFlag = false;
+					//XCb`ɑΉlݒ
+					GlowValue value;
+					bzero_item(value);
+					value.flag = GlowParameterType::GlowParameterType_Integer;
+					value.choice.integer = pSwitch->m_nValue;
+					SetEmberParameter(pGroup->m_sPath, value);
+
+					if (pGroup->m_bReleaseQuery)
+						panel.m_bLongPush = false;
 				}
-				else if (num > 45 && num <= 70)
+				else if (pSwitch->m_eAction == LineUnitAction::ACTION_INVOKE)
 				{
-					//PST񐧌
-					Path_btn = "/root/suite/s-1/switcher/n-1/abTrans/n-#/sw/b/btn";
-					Path_tally = "/root/suite/s-1/switcher/n-1/abTrans/n-#/sw/b/tally";
-					Value_btn = std::to_string(num - 45);
-					Value_tally = "1";
-					int len_btn = (int)m_pNmosEmberConsumer->GetNodePath(Path_btn, &pPath);
-
-					pValue = m_pNmosEmberConsumer->CreateGlowValue(GlowParameterType::GlowParameterType_Integer, Value_btn);
-					if (pValue)
-					{
-						pParameter = newobj(GlowParameter);
-						bzero_item(*pParameter);
-						glowValue_copyFrom(&pParameter->value, pValue);
-						Call_handleInput(m_pNmosEmberConsumer->CreateSetParameterRequest(&requestId, pPath, len_btn, *pParameter));
-
-						glowParameter_free(pParameter);
-						pParameter = nullptr;
-						freeMemory(pValue);
-						pValue = nullptr;
-					}
-				}
-				else if ((num > 90 && num <= 115) || (num > 135 && num <= 160))
-				{
-					//XPT
-					Path_btn = "/root/suite/s-1/switcher/n-1/xptSw/n-#/sw/btn";
-					Path_tally = "/root/suite/s-1/switcher/n-1/xptSw/n-#/sw/tally";
-					if (num > 90 && num <= 115) Value_btn = std::to_string(num - 90);
-					else Value_btn = std::to_string(num - (135 + 25));
-					Value_tally = "0";
-
-					int len_btn = (int)m_pNmosEmberConsumer->GetNodePath(Path_btn, &pPath);
-
-					pValue = m_pNmosEmberConsumer->CreateGlowValue(GlowParameterType::GlowParameterType_Integer, Value_btn);
-					if (pValue)
-					{
-						pParameter = newobj(GlowParameter);
-						bzero_item(*pParameter);
-						glowValue_copyFrom(&pParameter->value, pValue);
-						Call_handleInput(m_pNmosEmberConsumer->CreateSetParameterRequest(&requestId, pPath, len_btn, *pParameter));
-
-						glowParameter_free(pParameter);
-						pParameter = nullptr;
-						freeMemory(pValue);
-						pValue = nullptr;
-					}
-				}
-				else if (num == 210 || num == 211)
-				{
-					//CUT or AUTOgWV
 					//̓{^̓_̂ݎs
-					bright = 3;
-					char cmd[10] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x04, 0x01, recvBuffer[7], recvBuffer[8], bright };
-					send(sock, cmd, sizeof(cmd), 0);
+					SendLineUnitLed(panel, num, pGroup->m_nOnPalette);
 				}
-
 			}
 
 		}
@@ -250,7 +303,12 @@ void LineUnitCommand(SOCKET sock, char* recvBuffer)
 		if (ByteCount == 5)
 		{
 			//ݒR}h
-			GlowParameterType type = GlowParameterType::GlowParameterType_Real;
+			//tF[_[ԍ
+			int num = (u_recvBuffer[7] << 8) + u_recvBuffer[8];
+			const LineUnitGroup* pGroup = pMap->Fader(num);
+			if (!pGroup)
+				break;
+
 			unsigned int fader_val = ((unsigned char)recvBuffer[9] << 8) + (unsigned char)recvBuffer[10];
 
 			Trace(__FILE__, __LINE__, __FUNCTION__, "fader_val = %d\n", fader_val);
@@ -260,27 +318,15 @@ void LineUnitCommand(SOCKET sock, char* recvBuffer)
 
 			Trace(__FILE__, __LINE__, __FUNCTION__, "send_val = %d\n", send_val);
 
-			std::string Path = "/root/suite/s-1/switcher/n-1/scene/n-#/nextTrans/fader";
-			std::string Val;
-			Val = std::to_string(send_val);
-
-			if (before_send_val != send_val)
+			if (panel.m_nFaderValue != send_val)
 			{
-				int len_btn = (int)m_pNmosEmberConsumer->GetNodePath(Path, &pPath);
-				pValue = m_pNmosEmberConsumer->CreateGlowValue(type, Val);
-				if (pValue)
-				{
-					pParameter = newobj(GlowParameter);
-					bzero_item(*pParameter);
-					glowValue_copyFrom(&pParameter->value, pValue);
-					Call_handleInput(m_pNmosEmberConsumer->CreateSetParameterRequest(&requestId, pPath, len_btn, *pParameter));
-				}
-				before_send_val = send_val;
+				GlowValue value;
+				bzero_item(value);
+				value.flag = GlowParameterType::GlowParameterType_Real;
+				value.choice.real = send_val;
+				SetEmberParameter(pGroup->m_sPath, value);
 
-				glowParameter_free(pParameter);
-				pParameter = nullptr;
-				freeMemory(pValue);
-				pValue = nullptr;
+				panel.m_nFaderValue = send_val;
 			}
 
 		}
@@ -292,164 +338,88 @@ void LineUnitCommand(SOCKET sock, char* recvBuffer)
 }
 
 /// <summary>Ember+->LINE UNITvgRւ̕ϊ</summary>
-/// <returns></returns>
-extern "C" void __EmberCommandConverter(EmberContent* pResult)
+/// <param name="dispatchKey">U蕪ʁiΉ\̃O[vj</param>
+/// <param name="pParameter">ʒmp[^ic[֔fς̃CX^Xj</param>
+/// <remarks>
+/// RV[}lpX̐U蕪\őΏۂ𔻒肵Ao^pX̒ʒm̂݌Ăяo
+/// Mt[ 1 xAڑ̑Spl֋LđM
+/// ʒml̓O[vPʂɕێAȍ~ɐڑpl̏\Ɏgp
+/// </remarks>
+extern "C" void __EmberCommandConverter(int dispatchKey, const GlowParameter* pParameter)
 {
-	Trace(__FILE__, __LINE__, __FUNCTION__, "Command Create Start.\n");
-	Trace(__FILE__, __LINE__, __FUNCTION__, "length = %d.\n", pResult->pathLength);
+	Trace(__FILE__, __LINE__, __FUNCTION__, "Command Create Start, dispatch = %d.\n", dispatchKey);
+
+	const LineUnitGroup* pGroup = CLineUnitMap::GetInstance()->Group(dispatchKey);
+	if (!pParameter || !pGroup)
+		return;
+
+	std::vector<char> vFrames{};
+	vFrames.reserve((pGroup->m_vSwitches.size() + 1) * 11);
+
+	int nSwitch = AppendLineUnitState(vFrames, *pGroup, pParameter->value);
+	Trace(__FILE__, __LINE__, __FUNCTION__, "Command Create End, dispatch = %d, switch = %d.\n", dispatchKey, nSwitch);
+	if (vFrames.empty())
+		return;
+
+	auto lock = std::unique_lock<std::mutex>(m_mtxLineUnitState);
+	m_mpLineUnitValues[dispatchKey] = pParameter->value;
+	CLineUnitPanels::GetInstance()->Broadcast(std::make_shared<const std::vector<char>>(std::move(vFrames)));
+}
 
-	if (pResult && (pResult->pathLength > 0))
+/// <summary>Lv`̃vC</summary>
+/// <param name="bRealtime">L^̊Ԋuœ</param>
+/// <remarks>
+/// ML^ HWIF  LineUnitCommandAEmber ͊eRV[}̎M֓
+/// </remarks>
+static void ReplayCapture(bool bRealtime)
+{
+	// HWIF ̎ML^͒Ppl̎MƂĈiM̓vĈߗ}~j
+	CLineUnitPanel replayPanel(0, 0, "replay");
+	CCapture::GetInstance()->Replay(bRealtime, [&replayPanel](const CaptureRecord& sRecord)
 	{
-		pstr pathName = convertPath2String(m_pNmosEmberConsumer->m_sRemoteContent.pTopNode, pResult->pPath, pResult->pathLength);
-		Trace(__FILE__, __LINE__, __FUNCTION__, "Path = %s.\n", pathName);
-		if (pathName)
+		switch (sRecord.m_eSocketId)
 		{
-			//ЂƂ܂stringɃLXg
-			std::string strPath = pathName;
-
-			//tB^[ɏ
-			if (strPath.rfind("abTrans") != std::string::npos)
-			{
-				if (strPath.rfind("/sw/t/btn") != std::string::npos)
-				{
-					//PGM񐧌
-					if (pResult->parameter.value.flag == GlowParameterType::GlowParameterType_Integer)
-					{
-						//Ôint^`FbNĂ瑗M
-						int btn_num = (int)(pResult->parameter.value.choice.integer);
-						char cmd[10] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x04, 0x01, (btn_num >> 8) & 0xff, btn_num & 0xff, 1 };
-						m_pNmosEmberConsumer->end = clock();
-						m_pNmosEmberConsumer->ProcessTimeDisp();
-						send(ActiveClientSock, cmd, sizeof(cmd), 0);
-						for (int i = 1; i < 26; i++)
-						{
-							if (btn_num != i)
-							{
-								char cmd[10] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x04, 0x01, (i >> 8) & 0xff, i & 0xff, 4 };
-								send(ActiveClientSock, cmd, sizeof(cmd), 0);
-							}
-						}
-					}
-				}
-				else if (strPath.rfind("/sw/b/btn") != std::string::npos)
-				{
-					//PST񐧌
-					if (pResult->parameter.value.flag == GlowParameterType::GlowParameterType_Integer)
-					{
-						//Ôint^`FbNĂ瑗M
-						int btn_num = (int)(pResult->parameter.value.choice.integer) + 45;
-						char cmd[10] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x04, 0x01, (btn_num >> 8) & 0xff, btn_num & 0xff, 2 };
-						send(ActiveClientSock, cmd, sizeof(cmd), 0);
-						for (int i = 46; i < 71; i++)
-						{
-							if (btn_num != i)
-							{
-								char cmd[10] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x04, 0x01, (i >> 8) & 0xff, i & 0xff, 5 };
-								send(ActiveClientSock, cmd, sizeof(cmd), 0);
-							}
-						}
-					}
-				}
-			}
-			else if (strPath.rfind("xptSw") != std::string::npos)
+		case ClientSocketId::SOCK_HWIF:
+			if (m_pNmosEmberConsumer)
 			{
-				if (strPath.rfind("/sw/btn") != std::string::npos)
+				replayPanel.Receive((const char*)sRecord.m_vData.data(), (int)sRecord.m_vData.size(), [&replayPanel](char* pFrame, int length)
 				{
-					//XPT
-					if (pResult->parameter.value.flag == GlowParameterType::GlowParameterType_Integer)
-					{
-						//Ôint^`FbNĂ瑗M
-						int btn_num = 0;
-						if (pResult->parameter.value.choice.integer < 26)
-							btn_num = (int)(pResult->parameter.value.choice.integer) + 90;
-						else
-							btn_num = (int)(pResult->parameter.value.choice.integer) + 135;
-
-						char cmd[10] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x04, 0x01, (btn_num >> 8) & 0xff, btn_num & 0xff, 3 };
-						send(ActiveClientSock, cmd, sizeof(cmd), 0);
-						for (int i = 91; i < 116; i++)
-						{
-							if (btn_num != i)
-							{
-								char cmd[10] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x04, 0x01, (i >> 8) & 0xff, i & 0xff, 6 };
-								send(ActiveClientSock, cmd, sizeof(cmd), 0);
-							}
-						}
-						for (int i = 136; i < 161; i++)
-						{
-							if (btn_num != i)
-							{
-								char cmd[10] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x04, 0x01, (i >> 8) & 0xff, i & 0xff, 6 };
-								send(ActiveClientSock, cmd, sizeof(cmd), 0);
-							}
-						}
-					}
-				}
+					LineUnitCommand(replayPanel, pFrame);
+				});
 			}
-			else if (strPath.rfind("scene") != std::string::npos)
-			{
-				if (strPath.rfind("/nextTrans/fader") != std::string::npos)
-				{
-					//tF[_[
-					if (pResult->parameter.value.flag == GlowParameterType::GlowParameterType_Real)
-					{
-						//Ôint^`FbNĂ瑗M
-						int ember_val = (int)pResult->parameter.value.choice.real;
-
-						//ILPS(0`100) -> LINE UNIT(0`65535)
-						int fader_val = (double)ember_val * 65535 / 100;
-
-						//tF[_[Ԑݒ
-						char cmd[11] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x05, 0x03, 0x00, 0x00, (fader_val >> 8) & 0xff, fader_val & 0xff };
-						send(ActiveClientSock, cmd, sizeof(cmd), 0);
-
-						//tF[_[LED_ݒ
-						//ILPS(0`100) -> LED_MAX(30)
-						int led_num_max = (double)ember_val / 100 * 30;
-						for (int i = 30; i > 0; i--)
-						{
-							int led_num = 246 - i + 1;
-							if (i <= led_num_max)
-							{
-								char cmd[10] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x04, 0x02, (led_num >> 8) & 0xff, led_num & 0xff, 0x02 };
-								send(ActiveClientSock, cmd, sizeof(cmd), 0);
-							}
-							else
-							{
-								char cmd[10] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x04, 0x02, (led_num >> 8) & 0xff, led_num & 0xff, 0x00 };
-								send(ActiveClientSock, cmd, sizeof(cmd), 0);
-							}
-						}
-					}
-				}
-			}
-
-			freeMemory(pResult);
-			freeMemory(pathName);
+			break;
+		case ClientSocketId::SOCK_NMOS_EMBER:
+			if (m_pNmosEmberConsumer)
+				m_pNmosEmberConsumer->Replay(sRecord.m_vData.data(), (int)sRecord.m_vData.size());
+			break;
+		case ClientSocketId::SOCK_MV_EMBER:
+			if (m_pMVEmberConsumer)
+				m_pMVEmberConsumer->Replay(sRecord.m_vData.data(), (int)sRecord.m_vData.size());
+			break;
+		default:
+			break;
 		}
-	}
+	});
 }
 
 
 DLLAPI int main()
 {
 	SOCKET socketHandle = 0;
-	SOCKET clientHandle = 0;
 	struct sockaddr_in sad { 0 };
 	struct sockaddr_in cad { 0 };
 	fd_set fdset = { 0 };
+	fd_set wfdset = { 0 };
 	int fdsReady = 0;
-	bool connected = false;
-	bool firstSended = false;
+	bool listening = false;
 	struct timeval timeout = { 0, 16 * 1000 }; // 16 milliseconds timeout for select()
 
-	char str[1] = "";
 	int cnt = 0;
 	char recvBuffer[4096];
-	int flag = 0;
 	char cmd[10] = { 0x46, 0x4f, 0x52, 0x41, 0x00, 0x03, 0x03, 0x00, 0x00 };
-
-	char HeaderChar[4] = { '\x46', '\x4F', '\x52', '\x41' };
+	// Mԗv͑SplŋL
+	const LineUnitFrames pStatusRequest = std::make_shared<const std::vector<char>>(cmd, cmd + sizeof(cmd));
+	CLineUnitPanels* pPanels = CLineUnitPanels::GetInstance();
 
 	//vZXID擾
 #if defined WIN32
@@ -479,33 +449,82 @@ DLLAPI int main()
 	Trace(__FILE__, __LINE__, __FUNCTION__, "StartupDeviceContentsPath : %s\n", _ClientConfig->StartupDeviceContentsPath().c_str());
 	Trace(__FILE__, __LINE__, __FUNCTION__, "           LogFileEnabled : %d\n", _ClientConfig->LogFileEnabled());
 	Trace(__FILE__, __LINE__, __FUNCTION__, "     SocketReconnectDelay : %d\n", _ClientConfig->SocketReconnectDelay());
+	Trace(__FILE__, __LINE__, __FUNCTION__, "     SocketConnectTimeout : %d\n", _ClientConfig->SocketConnectTimeout());
 	Trace(__FILE__, __LINE__, __FUNCTION__, "          MainThreadDelay : %d\n", _ClientConfig->MainThreadDelay());
 	Trace(__FILE__, __LINE__, __FUNCTION__, "         EmberThreadDelay : %d\n", _ClientConfig->EmberThreadDelay());
+	Trace(__FILE__, __LINE__, __FUNCTION__, "   EmberKeepAliveInterval : %d\n", _ClientConfig->EmberKeepAliveInterval());
+	Trace(__FILE__, __LINE__, __FUNCTION__, "    EmberKeepAliveTimeout : %d\n", _ClientConfig->EmberKeepAliveTimeout());
 	Trace(__FILE__, __LINE__, __FUNCTION__, "               HwifIpAddr : %s\n", _ClientConfig->HwifIpAddr().c_str());
 	Trace(__FILE__, __LINE__, __FUNCTION__, "                 HwifPort : %d\n", _ClientConfig->HwifPort());
 	Trace(__FILE__, __LINE__, __FUNCTION__, "              HwifEnabled : %d\n", _ClientConfig->HwifEnabled());
+	Trace(__FILE__, __LINE__, __FUNCTION__, "          LineUnitMapPath : %s\n", _ClientConfig->LineUnitMapPath().c_str());
 	Trace(__FILE__, __LINE__, __FUNCTION__, "          NmosEmberIpAddr : %s\n", _ClientConfig->NmosEmberIpAddr().c_str());
 	Trace(__FILE__, __LINE__, __FUNCTION__, "            NmosEmberPort : %d\n", _ClientConfig->NmosEmberPort());
 	Trace(__FILE__, __LINE__, __FUNCTION__, "         NmosEmberEnabled : %d\n", _ClientConfig->NmosEmberEnabled());
+	Trace(__FILE__, __LINE__, __FUNCTION__, " NmosEmberSecondaryIpAddr : %s\n", _ClientConfig->NmosEmberSecondaryIpAddr().c_str());
+	Trace(__FILE__, __LINE__, __FUNCTION__, "   NmosEmberSecondaryPort : %d\n", _ClientConfig->NmosEmberSecondaryPort());
 	Trace(__FILE__, __LINE__, __FUNCTION__, "            MvEmberIpAddr : %s\n", _ClientConfig->MvEmberIpAddr().c_str());
 	Trace(__FILE__, __LINE__, __FUNCTION__, "              MvEmberPort : %d\n", _ClientConfig->MvEmberPort());
 	Trace(__FILE__, __LINE__, __FUNCTION__, "           MvEmberEnabled : %d\n", _ClientConfig->MvEmberEnabled());
+	Trace(__FILE__, __LINE__, __FUNCTION__, "   MvEmberSecondaryIpAddr : %s\n", _ClientConfig->MvEmberSecondaryIpAddr().c_str());
+	Trace(__FILE__, __LINE__, __FUNCTION__, "     MvEmberSecondaryPort : %d\n", _ClientConfig->MvEmberSecondaryPort());
 
 	Trace(__FILE__, __LINE__, __FUNCTION__, "start.\n");
 
+	// MLv`ivCw莞͋L^Ȃj
+	// vC̓RV[}Oɓǂݍ݁ARV[}̐ڑ}~
+	CCapture* pCapture = CCapture::GetInstance();
+	bool isReplay = !_ClientConfig->CaptureReplayPath().empty() && pCapture->LoadReplay(_ClientConfig->CaptureReplayPath());
+	if (!isReplay && !_ClientConfig->CaptureRecordPath().empty())
+		pCapture->Open(_ClientConfig->CaptureRecordPath());
+
+	// LINE UNIT Ή\it@Cꍇ͊\j
+	CLineUnitMap* pLineUnitMap = CLineUnitMap::GetInstance();
+	pLineUnitMap->Load(_ClientConfig->LineUnitMapPath());
+
 	// Ember RV[}@\̏
 	m_pNmosEmberConsumer = _ClientConfig->NmosEmberEnabled() ? new CNmosEmberConsumer() : nullptr;
+	// LINE UNIT Ή\QƂpXwǂAp[^ʒmO[vŐU蕪
+	if (m_pNmosEmberConsumer)
+	{
+		std::set<std::string> stPaths{};
+		std::unordered_map<std::string, int> mpDispatch{};
+		const auto& vGroups = pLineUnitMap->Groups();
+		for (size_t i = 0; i < vGroups.size(); ++i)
+		{
+			if (vGroups[i].m_eAction == LineUnitAction::ACTION_INVOKE)
+				continue;
+			stPaths.insert(vGroups[i].m_sPath);
+			mpDispatch[vGroups[i].m_sPath] = (int)i;
+		}
+		m_pNmosEmberConsumer->SetSubscriptions(SubscriptionOwner::OWNER_LINE_UNIT, stPaths);
+		m_pNmosEmberConsumer->SetParameterDispatch(mpDispatch);
+	}
+	// MV ͐ڑPʂ̃ZbV NMOS ƕsē삷
+	m_pMVEmberConsumer = _ClientConfig->MvEmberEnabled() ? new CMvEmberConsumer() : nullptr;
 
-	SOCKET sock = m_pNmosEmberConsumer->m_sRemoteContent.hSocket;
+	if (isReplay)
+	{
+		// vC LINE UNIT ҂󂯂ɏI
+		ReplayCapture(_ClientConfig->CaptureReplayRealtime());
+		if (m_pNmosEmberConsumer)
+			m_pNmosEmberConsumer->CancelRequest();
+		if (m_pMVEmberConsumer)
+			m_pMVEmberConsumer->CancelRequest();
+		ClearWinSock();
+		return (0);
+	}
 
-	auto reconnDelay = std::chrono::milliseconds(_ClientConfig->SocketReconnectDelay());
+	// ҂󂯂̍Đ͎sԂ̂ݑ҂{i SocketReconnectDelayj
+	dword listenBackoff = RECONNECT_BACKOFF_INITIAL_MSEC;
+	unsigned int listenSeed = (unsigned int)time(nullptr);
 	auto emptyDelay = std::chrono::milliseconds(_ClientConfig->MainThreadDelay());
 
 	for (;;)
 	{
 		//main roop 3355OȔ
-		// ڑȂT[o[
-		if (!connected)
+		// ҂󂯂ĂȂ΃T[o[
+		if (!listening)
 		{
 			// nhȂ΍Đ
 			if (socketHandle == 0)
@@ -522,42 +541,29 @@ DLLAPI int main()
 			//sad.sin_family = AF_INET;
 			//sad.sin_port = htons(53278);
 			sad.sin_addr.s_addr = INADDR_ANY;
+#if !defined WIN32
+			// ؒfplڑ TIME_WAIT Đł悤ɂ
+			int reuse = 1;
+			setsockopt(socketHandle, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+#endif
 
 			if (bind(socketHandle, (struct sockaddr*)&sad, sizeof(sad)) < 0)
 			{
 				ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "socket can not bind.\n");
 				return 0;
 			}
-			if (listen(socketHandle, 5) < 0) {
+			if (listen(socketHandle, LINE_UNIT_PANEL_MAX) < 0) {
 				ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "socket listen failed.\n");
 				return 0;
 			}
-
-			int cadlen = sizeof(cad);
-			if ((clientHandle = accept(socketHandle, (struct sockaddr*)&cad, (socklen_t*)&cadlen)) < 0)
-			{
-				ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "socket accepted failed.\n");
-				return 0;
-			}
-
-			// ڑ珉ݒv
-			ActiveClientSock = clientHandle;
-			connected = true;
-			firstSended = false;
-			continue;
+			listening = true;
 		}
 
-		if (!firstSended)
-		{
-			//LINE UNIT̏ݒ
-			UnitInitialize(clientHandle);
-			Trace(__FILE__, __LINE__, __FUNCTION__, "complete first send.\n");
-			firstSended = true;
-		}
+		auto vPanels = pPanels->Panels();
 
 		if (cnt == 1)
 		{
-			send(clientHandle, cmd, sizeof(cmd), 0);
+			pPanels->Broadcast(pStatusRequest);
 			cnt = 0;
 		}
 		else
@@ -565,51 +571,89 @@ DLLAPI int main()
 			cnt++;
 		}
 
-		// MAҋ@Ƀ[v
+		// ҂󂯁ESpl̎MƁAM҂̂pl̑M\҂
 		FD_ZERO(&fdset);
-		FD_SET(clientHandle, &fdset);
-		fdsReady = select((int)(clientHandle + 1), &fdset, NULL, NULL, &timeout);
-		if (fdsReady == 1) // socket is ready to read
+		FD_ZERO(&wfdset);
+		FD_SET(socketHandle, &fdset);
+		SOCKET maxHandle = socketHandle;
+		for (auto& pPanel : vPanels)
+		{
+			SOCKET clientHandle = pPanel->Socket();
+			FD_SET(clientHandle, &fdset);
+			if (pPanel->Pending())
+				FD_SET(clientHandle, &wfdset);
+			if (maxHandle < clientHandle)
+				maxHandle = clientHandle;
+		}
+		fdsReady = select((int)(maxHandle + 1), &fdset, &wfdset, NULL, &timeout);
+		if (fdsReady > 0)
 		{
-			if (FD_ISSET(clientHandle, &fdset))
+			// VKplڑ
+			if (FD_ISSET(socketHandle, &fdset))
+			{
+				int cadlen = sizeof(cad);
+				SOCKET clientHandle = accept(socketHandle, (struct sockaddr*)&cad, (socklen_t*)&cadlen);
+				if (clientHandle < 0)
+				{
+					ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "socket accepted failed.\n");
+				}
+				else
+				{
+					auto pPanel = pPanels->Add(clientHandle, cad);
+					if (!pPanel)
+					{
+						// ߂͎󂯕tȂ
+						closesocket(clientHandle);
+					}
+					else
+					{
+						//LINE UNIT̏ݒi󂯕tɌ݂̕\Ԃ܂Ƃ߂đMj
+						UnitInitialize(*pPanel);
+						pPanel->m_bInitialized = true;
+						Trace(__FILE__, __LINE__, __FUNCTION__, "complete first send, panel %d.\n", pPanel->Id());
+					}
+				}
+			}
+
+			for (auto& pPanel : vPanels)
 			{
+				SOCKET clientHandle = pPanel->Socket();
+
+				// M҂̏o
+				if (FD_ISSET(clientHandle, &wfdset) && !pPanel->Flush())
+				{
+					Trace(__FILE__, __LINE__, __FUNCTION__, "send failed, panel %d lost connection.\n", pPanel->Id());
+					pPanels->Remove(pPanel);
+					continue;
+				}
+				if (!FD_ISSET(clientHandle, &fdset))
+					continue;
+
 				//LINE UNITR}hM
 				int recvLength = recv(clientHandle, (char*)&recvBuffer, sizeof(recvBuffer), 0);
-
 				if (recvLength > 0)
 				{
-					//wb_[
-					for (int i = 0; i < strlen(HeaderChar); i++)
+					if (pCapture->Recording())
+						pCapture->Record(ClientSocketId::SOCK_HWIF, CaptureDirection::CAPTURE_RECV, recvBuffer, recvLength);
+
+					//wb_[ʂAt[Pʂŏ
+					Trace(__FILE__, __LINE__, __FUNCTION__, "Data received, panel %d.\n", pPanel->Id());
+					pPanel->Receive(recvBuffer, recvLength, [&pPanel](char* pFrame, int length)
 					{
-						if (recvBuffer[i] != HeaderChar[i])
-						{
-							//wb_[قȂΎ̃[vJn
-							continue;
-						}
-					}
-					//R}hԍȍ~̃f[^oCgJEg擾
-					Trace(__FILE__, __LINE__, __FUNCTION__, "Data received..\n");
-					m_pNmosEmberConsumer->start = clock();
-					LineUnitCommand(clientHandle, recvBuffer);
+						LineUnitCommand(*pPanel, pFrame);
+					});
+				}
+				else if ((recvLength < 0) && SocketWouldBlock())
+				{
+					continue;
 				}
 				else
 				{
 					//ؒfꂽ
-					Trace(__FILE__, __LINE__, __FUNCTION__, "recv == 0, LINE UNIT lost connection.\n");
+					Trace(__FILE__, __LINE__, __FUNCTION__, "recv <= 0, panel %d lost connection.\n", pPanel->Id());
 
 					// \PbgnĥĂ
-					try
-					{
-						closesocket(clientHandle);
-					}
-					catch (...) {}
-					clientHandle = 0;
-
-					// ҋ@Đڑ
-					connected = false;
-					firstSended = false;
-					std::this_thread::sleep_for(reconnDelay);
-					continue;
+					pPanels->Remove(pPanel);
 				}
 			}
 		}
@@ -618,7 +662,8 @@ DLLAPI int main()
 			//ؒfꂽ
 			Trace(__FILE__, __LINE__, __FUNCTION__, "fdsReady < 0, lost connection.\n");
 
-			// \PbgnĥĂ
+			// SplƑ҂󂯃\PbĝĂ
+			pPanels->Clear();
 			try
 			{
 				closesocket(socketHandle);
@@ -626,12 +671,15 @@ DLLAPI int main()
 			catch (...) {}
 			socketHandle = 0;
 
-			// ҋ@Đڑ
-			connected = false;
-			firstSended = false;
-			std::this_thread::sleep_for(reconnDelay);
+			// ҋ@Đ
+			listening = false;
+			std::this_thread::sleep_for(std::chrono::milliseconds(nextReconnectDelay(&listenBackoff, _ClientConfig->SocketReconnectDelay(), &listenSeed)));
 			continue;
 		}
+		listenBackoff = RECONNECT_BACKOFF_INITIAL_MSEC;
+
+		// plPʂ̑M҂
+		pPanels->Report(false);
 
 		std::this_thread::sleep_for(emptyDelay);
 	}
@@ -641,6 +689,12 @@ DLLAPI int main()
 	{
 		m_pNmosEmberConsumer->CancelRequest();
 	}
+	if (m_pMVEmberConsumer)
+	{
+		m_pMVEmberConsumer->CancelRequest();
+	}
+	pPanels->Report(true);
+	pPanels->Clear();
 	if (socketHandle != 0)
 	{
 		try
@@ -649,6 +703,7 @@ DLLAPI int main()
 		}
 		catch (...) {}
 	}
+	pCapture->Close();
 
 	//winsockI
 	ClearWinSock();
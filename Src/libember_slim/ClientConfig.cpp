@@ -27,14 +27,18 @@ CClientConfig::CClientConfig() :
 	m_bDebugOmitSetOLEDStatus(false),
 
 	m_nSocketReconnectDelay(SOCKET_RECONN_DELAY_DEF),
+	m_nSocketConnectTimeout(SOCKET_CONNECT_TIMEOUT_DEF),
 	m_nMainThreadDelay(THREAD_DELAY_DEF),
 	m_nEmberThreadDelay(THREAD_DELAY_DEF),
+	m_nEmberKeepAliveInterval(EMBER_KEEPALIVE_INTERVAL_DEF),
+	m_nEmberKeepAliveTimeout(EMBER_KEEPALIVE_TIMEOUT_DEF),
 
 	//m_sHwifIpAddr("127.0.0.1"),
 	//m_nHwifPort(PROTOPORT_HWIF),
 	m_sHwifIpAddr("192.168.1.237"),
 	m_nHwifPort(53278),
 	m_bHwifEnabled(true),
+	m_sLineUnitMapPath(getAppDataPath() + LINE_UNIT_MAP_PATH),
 
 	//m_sNmosEmberIpAddr("127.0.0.1"),
 	//m_nNmosEmberPort(PROTOPORT_NMOS_EMBER),
@@ -43,11 +47,24 @@ CClientConfig::CClientConfig() :
 	m_nNmosEmberPort(50005),
 	m_bNmosEmberEnabled(true),
 	m_bNmosEmberUseMatrixLabels(true),
+	m_bNmosEmberUseTreeSnapshot(true),
+	m_sNmosEmberSnapshotPath(getAppDataPath() + NMOS_EMBER_SNAPSHOT_PATH),
+	m_sNmosEmberSecondaryIpAddr(""),
+	m_nNmosEmberSecondaryPort(PROTOPORT_NMOS_EMBER),
 
 	m_sMvEmberIpAddr("127.0.0.1"),
 	m_nMvEmberPort(PROTOPORT_MV_EMBER),
 	m_bMvEmberEnabled(false),
 	m_bMvEmberUseMatrixLabels(true),
+	m_bMvEmberUseTreeSnapshot(true),
+	m_sMvEmberSnapshotPath(getAppDataPath() + MV_EMBER_SNAPSHOT_PATH),
+	m_sMvEmberSecondaryIpAddr(""),
+	m_nMvEmberSecondaryPort(PROTOPORT_MV_EMBER),
+
+	m_bCaptureRecord(false),
+	m_bCaptureReplay(false),
+	m_bCaptureReplayRealtime(true),
+	m_sCapturePath(getAppDataPath() + CAPTURE_FILE_PATH),
 
 	m_sFileImportBackupDirectory(""),
 	m_sFileImportDirectory(""),
@@ -239,21 +256,39 @@ void CClientConfig::Initialize()
 			if ((CommGetIniFileData(m_vConfLines, INI_SEC_COMMON, INI_KEY_RECONN_DELAY, tmp) == 0) && !tmp.empty())
 			{
 				int num = 0;
-				if (ToNumber(tmp, num) && (m_nSocketReconnectDelay != num) && IsRange(num, SOCKET_RECONN_DELAY_MIN, SOCKET_RECONN_DELAY_MAX))
+				if (ToNumber(tmp, num) && IsRange(num, SOCKET_RECONN_DELAY_MIN, SOCKET_RECONN_DELAY_MAX) && (m_nSocketReconnectDelay != (unsigned)num))
 					m_nSocketReconnectDelay = (unsigned)num;
 			}
+			if ((CommGetIniFileData(m_vConfLines, INI_SEC_COMMON, INI_KEY_CONNECT_TIMEOUT, tmp) == 0) && !tmp.empty())
+			{
+				int num = 0;
+				if (ToNumber(tmp, num) && IsRange(num, SOCKET_CONNECT_TIMEOUT_MIN, SOCKET_CONNECT_TIMEOUT_MAX) && (m_nSocketConnectTimeout != (unsigned)num))
+					m_nSocketConnectTimeout = (unsigned)num;
+			}
 			if ((CommGetIniFileData(m_vConfLines, INI_SEC_COMMON, INI_KEY_MTHREAD_DELAY, tmp) == 0) && !tmp.empty())
 			{
 				int num = 0;
-				if (ToNumber(tmp, num) && (m_nMainThreadDelay != num) && IsRange(num, THREAD_DELAY_MIN, THREAD_DELAY_MAX))
+				if (ToNumber(tmp, num) && IsRange(num, THREAD_DELAY_MIN, THREAD_DELAY_MAX) && (m_nMainThreadDelay != (unsigned)num))
 					m_nMainThreadDelay = (unsigned)num;
 			}
 			if ((CommGetIniFileData(m_vConfLines, INI_SEC_COMMON, INI_KEY_ETHREAD_DELAY, tmp) == 0) && !tmp.empty())
 			{
 				int num = 0;
-				if (ToNumber(tmp, num) && (m_nEmberThreadDelay != num) && IsRange(num, THREAD_DELAY_MIN, THREAD_DELAY_MAX))
+				if (ToNumber(tmp, num) && IsRange(num, THREAD_DELAY_MIN, THREAD_DELAY_MAX) && (m_nEmberThreadDelay != (unsigned)num))
 					m_nEmberThreadDelay = (unsigned)num;
 			}
+			if ((CommGetIniFileData(m_vConfLines, INI_SEC_COMMON, INI_KEY_KEEPALIVE_INTERVAL, tmp) == 0) && !tmp.empty())
+			{
+				int num = 0;
+				if (ToNumber(tmp, num) && IsRange(num, EMBER_KEEPALIVE_INTERVAL_MIN, EMBER_KEEPALIVE_INTERVAL_MAX) && (m_nEmberKeepAliveInterval != (unsigned)num))
+					m_nEmberKeepAliveInterval = (unsigned)num;
+			}
+			if ((CommGetIniFileData(m_vConfLines, INI_SEC_COMMON, INI_KEY_KEEPALIVE_TIMEOUT, tmp) == 0) && !tmp.empty())
+			{
+				int num = 0;
+				if (ToNumber(tmp, num) && IsRange(num, EMBER_KEEPALIVE_TIMEOUT_MIN, EMBER_KEEPALIVE_TIMEOUT_MAX) && (m_nEmberKeepAliveTimeout != (unsigned)num))
+					m_nEmberKeepAliveTimeout = (unsigned)num;
+			}
 
 			if ((CommGetIniFileData(m_vConfLines, INI_SEC_HWIF, INI_KEY_IPADDR, tmp) == 0) && !tmp.empty())
 			{
@@ -279,6 +314,11 @@ void CClientConfig::Initialize()
 				ToBool(tmp, ena);
 			}
 			m_bHwifEnabled = IsIPv4(m_sHwifIpAddr) && (m_nHwifPort != 0) && ena;
+			if ((CommGetIniFileData(m_vConfLines, INI_SEC_HWIF, INI_KEY_MAP_PATH, tmp) == 0) && !tmp.empty())
+			{
+				if (m_sLineUnitMapPath != tmp)
+					m_sLineUnitMapPath = tmp;
+			}
 
 			if ((CommGetIniFileData(m_vConfLines, INI_SEC_NMOS_EMBER, INI_KEY_IPADDR, tmp) == 0) && !tmp.empty())
 			{
@@ -303,6 +343,22 @@ void CClientConfig::Initialize()
 				ena = false;
 				m_bNmosEmberUseMatrixLabels = ToBool(tmp, ena) ? ena : true;
 			}
+			if ((CommGetIniFileData(m_vConfLines, INI_SEC_NMOS_EMBER, INI_KEY_TREE_SNAPSHOT, tmp) == 0) && !tmp.empty())
+			{
+				ena = false;
+				m_bNmosEmberUseTreeSnapshot = ToBool(tmp, ena) ? ena : true;
+			}
+			if ((CommGetIniFileData(m_vConfLines, INI_SEC_NMOS_EMBER, INI_KEY_SECONDARY_IPADDR, tmp) == 0) && !tmp.empty())
+			{
+				if (IsIPv4(tmp))
+					m_sNmosEmberSecondaryIpAddr = tmp;
+			}
+			if ((CommGetIniFileData(m_vConfLines, INI_SEC_NMOS_EMBER, INI_KEY_SECONDARY_PORT, tmp) == 0) && !tmp.empty())
+			{
+				unsigned short num = 0;
+				if (ToNumber(tmp, num) && (num != 0) && (m_nNmosEmberSecondaryPort != num))
+					m_nNmosEmberSecondaryPort = num;
+			}
 
 			if ((CommGetIniFileData(m_vConfLines, INI_SEC_MV_EMBER, INI_KEY_IPADDR, tmp) == 0) && !tmp.empty())
 			{
@@ -327,6 +383,45 @@ void CClientConfig::Initialize()
 				ena = false;
 				m_bMvEmberUseMatrixLabels = ToBool(tmp, ena) ? ena : true;
 			}
+			if ((CommGetIniFileData(m_vConfLines, INI_SEC_MV_EMBER, INI_KEY_TREE_SNAPSHOT, tmp) == 0) && !tmp.empty())
+			{
+				ena = false;
+				m_bMvEmberUseTreeSnapshot = ToBool(tmp, ena) ? ena : true;
+			}
+			if ((CommGetIniFileData(m_vConfLines, INI_SEC_MV_EMBER, INI_KEY_SECONDARY_IPADDR, tmp) == 0) && !tmp.empty())
+			{
+				if (IsIPv4(tmp))
+					m_sMvEmberSecondaryIpAddr = tmp;
+			}
+			if ((CommGetIniFileData(m_vConfLines, INI_SEC_MV_EMBER, INI_KEY_SECONDARY_PORT, tmp) == 0) && !tmp.empty())
+			{
+				unsigned short num = 0;
+				if (ToNumber(tmp, num) && (num != 0) && (m_nMvEmberSecondaryPort != num))
+					m_nMvEmberSecondaryPort = num;
+			}
+
+			if ((CommGetIniFileData(m_vConfLines, INI_SEC_CAPTURE, INI_KEY_CAPTURE_RECORD, tmp) == 0) && !tmp.empty())
+			{
+				ena = false;
+				if (ToBool(tmp, ena))
+					m_bCaptureRecord = ena;
+			}
+			if ((CommGetIniFileData(m_vConfLines, INI_SEC_CAPTURE, INI_KEY_CAPTURE_REPLAY, tmp) == 0) && !tmp.empty())
+			{
+				ena = false;
+				if (ToBool(tmp, ena))
+					m_bCaptureReplay = ena;
+			}
+			if ((CommGetIniFileData(m_vConfLines, INI_SEC_CAPTURE, INI_KEY_REPLAY_REALTIME, tmp) == 0) && !tmp.empty())
+			{
+				ena = false;
+				m_bCaptureReplayRealtime = ToBool(tmp, ena) ? ena : true;
+			}
+			if ((CommGetIniFileData(m_vConfLines, INI_SEC_CAPTURE, INI_KEY_FILE_PATH, tmp) == 0) && !tmp.empty())
+			{
+				if (m_sCapturePath != tmp)
+					m_sCapturePath = tmp;
+			}
 
 			if ((CommGetIniFileData(m_vConfLines, INI_SEC_FILE_IMPORT, INI_KEY_DIRECTORY, tmp) == 0) && !tmp.empty())
 			{
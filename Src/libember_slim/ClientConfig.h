@@ -73,6 +73,26 @@ inline bool IsEmberId(ClientSocketId value) { return IsNmosEmber(value) || IsMvE
 /// <summary>ソケット再接続時ディレイ最大値</summary>
 #define SOCKET_RECONN_DELAY_MAX	10000
 
+/// <summary>ソケット接続待ち上限デフォルト</summary>
+#define SOCKET_CONNECT_TIMEOUT_DEF	3000
+/// <summary>ソケット接続待ち上限最小値</summary>
+#define SOCKET_CONNECT_TIMEOUT_MIN	100
+/// <summary>ソケット接続待ち上限最大値</summary>
+#define SOCKET_CONNECT_TIMEOUT_MAX	30000
+
+/// <summary>Ember キープアライブ送信間隔デフォルト</summary>
+#define EMBER_KEEPALIVE_INTERVAL_DEF	2000
+/// <summary>Ember キープアライブ送信間隔最小値</summary>
+#define EMBER_KEEPALIVE_INTERVAL_MIN	500
+/// <summary>Ember キープアライブ送信間隔最大値</summary>
+#define EMBER_KEEPALIVE_INTERVAL_MAX	60000
+/// <summary>Ember キープアライブ応答待ち上限デフォルト</summary>
+#define EMBER_KEEPALIVE_TIMEOUT_DEF		3000
+/// <summary>Ember キープアライブ応答待ち上限最小値</summary>
+#define EMBER_KEEPALIVE_TIMEOUT_MIN		500
+/// <summary>Ember キープアライブ応答待ち上限最大値</summary>
+#define EMBER_KEEPALIVE_TIMEOUT_MAX		60000
+
 /// <summary>スレッドディレイデフォルト</summary>
 #define THREAD_DELAY_DEF		20
 /// <summary>スレッドディレイ最小値</summary>
@@ -96,6 +116,8 @@ inline bool IsEmberId(ClientSocketId value) { return IsNmosEmber(value) || IsMvE
 #define INI_SEC_MV_EMBER		"MvEmber"
 /// <summary>Client用設定ファイルセクション：ファイルインポート</summary>
 #define INI_SEC_FILE_IMPORT		"FileImport"
+/// <summary>Client用設定ファイルセクション：送受信キャプチャ</summary>
+#define INI_SEC_CAPTURE			"Capture"
 
 /// <summary>Client用設定ファイルキー：ログファイル出力有無効</summary>
 #define INI_KEY_LOG_FILE		"OutputLogFile"
@@ -104,12 +126,18 @@ inline bool IsEmberId(ClientSocketId value) { return IsNmosEmber(value) || IsMvE
 /// <summary>Client用設定ファイルキー：ファイル書式マルチバイト指定</summary>
 #define INI_KEY_MB_FORMAT		"MultibyteFormat"
 
-/// <summary>Client用設定ファイルキー：ソケット再接続時ディレイ</summary>
+/// <summary>Client用設定ファイルキー：ソケット再接続時ディレイ（再接続待ちの上限）</summary>
 #define INI_KEY_RECONN_DELAY	"SocketReconnectDelay"
+/// <summary>Client用設定ファイルキー：ソケット接続待ち上限</summary>
+#define INI_KEY_CONNECT_TIMEOUT	"SocketConnectTimeout"
 /// <summary>Client用設定ファイルキー：メインスレッドディレイ</summary>
 #define INI_KEY_MTHREAD_DELAY	"MainThreadDelay"
 /// <summary>Client用設定ファイルキー：Ember監視スレッドディレイ</summary>
 #define INI_KEY_ETHREAD_DELAY	"EmberThreadDelay"
+/// <summary>Client用設定ファイルキー：Ember キープアライブ送信間隔</summary>
+#define INI_KEY_KEEPALIVE_INTERVAL	"EmberKeepAliveInterval"
+/// <summary>Client用設定ファイルキー：Ember キープアライブ応答待ち上限</summary>
+#define INI_KEY_KEEPALIVE_TIMEOUT	"EmberKeepAliveTimeout"
 
 /// <summary>Client用設定ファイルキー：IPアドレス（ホスト）</summary>
 #define INI_KEY_IPADDR			"IpAddr"
@@ -117,13 +145,30 @@ inline bool IsEmberId(ClientSocketId value) { return IsNmosEmber(value) || IsMvE
 #define INI_KEY_PORT			"Port"
 /// <summary>Client用設定ファイルキー：TCP/IP接続有無効</summary>
 #define INI_KEY_ENABLE			"Enable"
+/// <summary>Client用設定ファイルキー：副IPアドレス（プロバイダ冗長時）</summary>
+#define INI_KEY_SECONDARY_IPADDR	"SecondaryIpAddr"
+/// <summary>Client用設定ファイルキー：副ポート番号（プロバイダ冗長時）</summary>
+#define INI_KEY_SECONDARY_PORT	"SecondaryPort"
 
 /// <summary>Client用設定ファイルキー：マトリックスラベル使用有無</summary>
 #define INI_KEY_MATRIX_LABELS	"UseMatrixLabels"
+/// <summary>Client用設定ファイルキー：ツリースナップショット使用有無</summary>
+#define INI_KEY_TREE_SNAPSHOT	"UseTreeSnapshot"
 
 /// <summary>Client用設定ファイルキー：ディレクトリ</summary>
 #define INI_KEY_DIRECTORY		"Directory"
 
+/// <summary>Client用設定ファイルキー：キャプチャ記録有無</summary>
+#define INI_KEY_CAPTURE_RECORD	"Record"
+/// <summary>Client用設定ファイルキー：キャプチャリプレイ有無</summary>
+#define INI_KEY_CAPTURE_REPLAY	"Replay"
+/// <summary>Client用設定ファイルキー：リプレイを記録時の間隔で実施</summary>
+#define INI_KEY_REPLAY_REALTIME	"ReplayRealtime"
+/// <summary>Client用設定ファイルキー：ファイルパス</summary>
+#define INI_KEY_FILE_PATH		"Path"
+/// <summary>Client用設定ファイルキー：LINE UNIT 対応表ファイルパス</summary>
+#define INI_KEY_MAP_PATH		"MapPath"
+
 
 // ====================================================================
 // データファイル用識別
@@ -134,6 +179,14 @@ inline bool IsEmberId(ClientSocketId value) { return IsNmosEmber(value) || IsMvE
 #define DEV_CONTS_STARTUP_PATH	"./startup.csv"
 /// <summary>デバイスインヒビット状態ファイル</summary>
 #define DEV_CONTS_INHIBIT_PATH	"./inhibits.dat"
+/// <summary>ツリースナップショットファイル：NMOS-Ember プロバイダ</summary>
+#define NMOS_EMBER_SNAPSHOT_PATH	"./nmos_ember.snapshot"
+/// <summary>ツリースナップショットファイル：MV-Ember プロバイダ</summary>
+#define MV_EMBER_SNAPSHOT_PATH	"./mv_ember.snapshot"
+/// <summary>送受信キャプチャファイル</summary>
+#define CAPTURE_FILE_PATH		"./capture.lucp"
+/// <summary>LINE UNIT 対応表ファイル</summary>
+#define LINE_UNIT_MAP_PATH		"./lineunit_map.csv"
 
 /// <summary>ログファイル出力ディレクトリ名</summary>
 #define OUTPUT_LOG_DIRECTORY	"log"
@@ -186,22 +239,43 @@ public:
 	bool DebugOmitSetOLEDStatus() { return m_bDebugOmitSetOLEDStatus; }
 
 	unsigned int SocketReconnectDelay() { return m_nSocketReconnectDelay; }
+	unsigned int SocketConnectTimeout() { return m_nSocketConnectTimeout; }
 	unsigned int MainThreadDelay() { return m_nMainThreadDelay; }
 	unsigned int EmberThreadDelay() { return m_nEmberThreadDelay; }
+	unsigned int EmberKeepAliveInterval() { return m_nEmberKeepAliveInterval; }
+	unsigned int EmberKeepAliveTimeout() { return m_nEmberKeepAliveTimeout; }
 
 	std::string HwifIpAddr() { return m_sHwifIpAddr; }
 	unsigned short HwifPort() { return m_nHwifPort; }
 	bool HwifEnabled() { return m_bHwifEnabled; }
+	/// <summary>LINE UNIT 対応表ファイル</summary>
+	std::string LineUnitMapPath() { return m_sLineUnitMapPath; }
 
 	std::string NmosEmberIpAddr() { return m_sNmosEmberIpAddr; }
 	unsigned short NmosEmberPort() { return m_nNmosEmberPort; }
 	bool NmosEmberEnabled() { return m_bNmosEmberEnabled; }
 	bool NmosEmberUseMatrixLabels() { return m_bNmosEmberUseMatrixLabels; }
+	/// <summary>副IPアドレス（未使用時は空）</summary>
+	std::string NmosEmberSecondaryIpAddr() { return m_sNmosEmberSecondaryIpAddr; }
+	unsigned short NmosEmberSecondaryPort() { return m_nNmosEmberSecondaryPort; }
+	/// <summary>ツリースナップショットファイル（未使用時は空）</summary>
+	std::string NmosEmberSnapshotPath() { return m_bNmosEmberUseTreeSnapshot ? m_sNmosEmberSnapshotPath : std::string(); }
 
 	std::string MvEmberIpAddr() { return m_sMvEmberIpAddr; }
 	unsigned short MvEmberPort() { return m_nMvEmberPort; }
 	bool MvEmberEnabled() { return m_bMvEmberEnabled; }
 	bool MvEmberUseMatrixLabels() { return m_bMvEmberUseMatrixLabels; }
+	/// <summary>副IPアドレス（未使用時は空）</summary>
+	std::string MvEmberSecondaryIpAddr() { return m_sMvEmberSecondaryIpAddr; }
+	unsigned short MvEmberSecondaryPort() { return m_nMvEmberSecondaryPort; }
+	/// <summary>ツリースナップショットファイル（未使用時は空）</summary>
+	std::string MvEmberSnapshotPath() { return m_bMvEmberUseTreeSnapshot ? m_sMvEmberSnapshotPath : std::string(); }
+
+	/// <summary>キャプチャ記録ファイル（未使用時は空）</summary>
+	std::string CaptureRecordPath() { return (m_bCaptureRecord && !m_bCaptureReplay) ? m_sCapturePath : std::string(); }
+	/// <summary>キャプチャリプレイファイル（未使用時は空）</summary>
+	std::string CaptureReplayPath() { return m_bCaptureReplay ? m_sCapturePath : std::string(); }
+	bool CaptureReplayRealtime() { return m_bCaptureReplayRealtime; }
 
 	bool Enabled(ClientSocketId id)
 	{
@@ -241,6 +315,16 @@ public:
 	/// <returns></returns>
 	inline bool CreateMvEmberSocket(SOCKET& sock, struct sockaddr_in& address)
 	{ return MvEmberEnabled() ? utilities::CreateSocketHandle(m_sMvEmberIpAddr, m_nMvEmberPort, sock, address) : false; }
+	/// <summary>NMOS-Ember プロバイダ副接続先生成</summary>
+	/// <param name="address">接続先（未使用時は 0 クリア）</param>
+	/// <returns></returns>
+	inline bool CreateNmosEmberSecondaryAddress(struct sockaddr_in& address)
+	{ return utilities::CreateSocketAddress(m_sNmosEmberSecondaryIpAddr, m_nNmosEmberSecondaryPort, address); }
+	/// <summary>MV-Ember プロバイダ副接続先生成</summary>
+	/// <param name="address">接続先（未使用時は 0 クリア）</param>
+	/// <returns></returns>
+	inline bool CreateMvEmberSecondaryAddress(struct sockaddr_in& address)
+	{ return utilities::CreateSocketAddress(m_sMvEmberSecondaryIpAddr, m_nMvEmberSecondaryPort, address); }
 
 	/// <summary>
 	/// インスタンス取得
@@ -276,6 +360,10 @@ private:
 	/// <summary>
 	/// メンバ初期化
 	/// </summary>
+	/// <remarks>
+	/// 現状はコンストラクタから呼び出していないため conf.ini は読み込まず、
+	/// 再接続ディレイ・接続待ち上限・キープアライブ間隔を含む各設定はデフォルト値で動作する
+	/// </remarks>
 	void Initialize();
 
 	std::string m_sPath;
@@ -294,22 +382,39 @@ private:
 	bool m_bDebugOmitSetOLEDStatus;
 
 	unsigned int m_nSocketReconnectDelay;
+	unsigned int m_nSocketConnectTimeout;
 	unsigned int m_nMainThreadDelay;
 	unsigned int m_nEmberThreadDelay;
+	unsigned int m_nEmberKeepAliveInterval;
+	unsigned int m_nEmberKeepAliveTimeout;
 
 	std::string m_sHwifIpAddr;
 	unsigned short m_nHwifPort;
 	bool m_bHwifEnabled;
+	std::string m_sLineUnitMapPath;
 
 	std::string m_sNmosEmberIpAddr;
 	unsigned short m_nNmosEmberPort;
 	bool m_bNmosEmberEnabled;
 	bool m_bNmosEmberUseMatrixLabels;
+	bool m_bNmosEmberUseTreeSnapshot;
+	std::string m_sNmosEmberSnapshotPath;
+	std::string m_sNmosEmberSecondaryIpAddr;
+	unsigned short m_nNmosEmberSecondaryPort;
 
 	std::string m_sMvEmberIpAddr;
 	unsigned short m_nMvEmberPort;
 	bool m_bMvEmberEnabled;
 	bool m_bMvEmberUseMatrixLabels;
+	bool m_bMvEmberUseTreeSnapshot;
+	std::string m_sMvEmberSnapshotPath;
+	std::string m_sMvEmberSecondaryIpAddr;
+	unsigned short m_nMvEmberSecondaryPort;
+
+	bool m_bCaptureRecord;
+	bool m_bCaptureReplay;
+	bool m_bCaptureReplayRealtime;
+	std::string m_sCapturePath;
 
 	std::string m_sFileImportBackupDirectory;
 	std::string m_sFileImportDirectory;
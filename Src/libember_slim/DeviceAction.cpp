@@ -3,18 +3,26 @@
 
 #include "DeviceAction.h"
 #include "DeviceContents.h"
+#include "APICodec.h"
 #include "Utilities.h"
 #include <cassert>
 #include <iterator>
 #include <sstream>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define _USE_SSE2_BUTTON_PACK
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 using namespace utilities;
 
+#undef min
+#undef max
 
-// ====================================================================
 
-/// <summary>長押し判定時間(秒)</summary>
-static const int64_t m_nLongPushDistSeconds = 3;
+// ====================================================================
 
 /// <summary>Lock All</summary>
 /// <remarks>次期対応予定</remarks>
@@ -50,6 +58,107 @@ void ClearButtonStatus()
 		m_aButtonStatus[i].Initialize();
 }
 
+/// <summary>ボタン押下ビット列型</summary>
+/// <remarks>DEVCNT_MAX ボタンまで 1ビット/ボタン</remarks>
+typedef uint64_t ButtonBits;
+static_assert(DEVCNT_MAX <= (int)(8 * sizeof(ButtonBits)), "DEVCNT_MAX exceeds ButtonBits width");
+
+/// <summary>
+/// ボタン押下状態のビット列変換
+/// </summary>
+/// <param name="pButtons">ボタン状態先頭（'0' / '1' の ASCII 並び）</param>
+/// <param name="cnt">ボタン数</param>
+/// <returns>押されているボタンのビットが立ったビット列</returns>
+/// <remarks>
+/// '0' および値の設定されていない 0 は押されていないと判断
+/// </remarks>
+static ButtonBits PackButtonBits(const char* pButtons, const int cnt)
+{
+	ButtonBits bits = 0;
+	int b = 0;
+#ifdef _USE_SSE2_BUTTON_PACK
+	// 16 ボタン単位で '0' / 0 と比較し、該当しないものを押下とする
+	const __m128i zeroChar = _mm_set1_epi8('0');
+	const __m128i nullChar = _mm_setzero_si128();
+	for (; (b + 16) <= cnt; b += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(pButtons + b));
+		__m128i off = _mm_or_si128(_mm_cmpeq_epi8(v, zeroChar), _mm_cmpeq_epi8(v, nullChar));
+		ButtonBits mask = (ButtonBits)(~_mm_movemask_epi8(off) & 0xFFFF);
+		bits |= mask << b;
+	}
+#endif
+	for (; b < cnt; ++b)
+	{
+		char sw = pButtons[b];
+		if ((sw != 0) && (sw != '0'))
+			bits |= (ButtonBits)1 << b;
+	}
+	return bits;
+}
+/// <summary>単一ビット判断</summary>
+/// <param name="bits"></param>
+/// <returns></returns>
+static inline bool IsSingleBit(const ButtonBits bits) { return (bits != 0) && ((bits & (bits - 1)) == 0); }
+/// <summary>
+/// 最下位ビット位置
+/// </summary>
+/// <param name="bits">0 以外</param>
+/// <returns></returns>
+static inline int LowestBitIndex(const ButtonBits bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctzll(bits);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index = 0;
+	_BitScanForward64(&index, bits);
+	return (int)index;
+#else
+	int index = 0;
+	for (ButtonBits v = bits; (v & 1) == 0; v >>= 1)
+		++index;
+	return index;
+#endif
+}
+
+/// <summary>
+/// 再描画対象ボタン
+/// </summary>
+/// <remarks>
+/// ページ替やマトリックス変更で内容が変わったボタンのみ立てる
+/// TakeDirtyButtons で取得時に落とす
+/// </remarks>
+static ButtonBits m_nDirtyButtons = 0;
+/// <summary>全ボタンのビット列</summary>
+/// <returns></returns>
+static ButtonBits AllButtonBits()
+{
+	int cnt = GetButtonCount();
+	if (cnt <= 0)
+		return 0;
+	return (cnt >= (int)(8 * sizeof(ButtonBits))) ? ~(ButtonBits)0 : (((ButtonBits)1 << cnt) - 1);
+}
+/// <summary>再描画対象追加</summary>
+/// <param name="bits"></param>
+static inline void MarkDirtyButtons(const ButtonBits bits) { m_nDirtyButtons |= bits; }
+/// <summary>
+/// 再描画対象ボタン取得
+/// </summary>
+/// <param name="vButtonIndexes">ボタンインデックス（昇順）</param>
+/// <returns>ボタン数</returns>
+int TakeDirtyButtons(std::vector<int>& vButtonIndexes)
+{
+	vButtonIndexes.clear();
+	ButtonBits bits = m_nDirtyButtons & AllButtonBits();
+	m_nDirtyButtons = 0;
+	while (bits != 0)
+	{
+		vButtonIndexes.push_back(LowestBitIndex(bits));
+		bits &= bits - 1;
+	}
+	return (int)vButtonIndexes.size();
+}
+
 /// <summary>
 /// ボタンインデックス妥当
 /// </summary>
@@ -95,43 +204,6 @@ static std::vector<XptValue*> m_vXpts{};
 static std::vector<int> m_vDestConnSrcs{};
 /// <summary>XPT マトリックスパス</summary>
 static std::string m_sMatrixPath{};
-/// <summary>XPT 設定用データ初期化</summary>
-static void ClearXptValue()
-{
-	while (!m_vXpts.empty())
-	{
-		auto itr = m_vXpts.begin();
-		if (!(*itr))
-			delete (*itr);
-		m_vXpts.erase(itr);
-	}
-	m_vDestConnSrcs.clear();
-	if (!m_sMatrixPath.empty())
-		m_sMatrixPath.clear();
-	m_sXptValue.Initialize();
-	m_bCanSetXpt = false;
-}
-/// <summary>XPT 設定用データ初期化</summary>
-/// <param name="path"></param>
-static void ClearXptValue(std::string path)
-{
-	ClearXptValue();
-	if (!path.empty())
-	{
-		m_sMatrixPath = path;
-		m_bCanSetXpt = true;
-	}
-}
-/// <summary>XPT 設定用ソースデータ初期化</summary>
-static void ClearXptSourcesValue()
-{
-	// 一旦すべて初期化しDest側は初期化前のデータを再設定する
-	std::string sPath = m_sMatrixPath;
-	XptValue value = m_sXptValue;
-	ClearXptValue(sPath);
-	m_sXptValue.m_nDestConnSignal = value.m_nDestConnSignal;
-	m_sXptValue.m_nDestConnCount = value.m_nDestConnCount;
-}
 
 /// <summary>XPT マトリックスパス取得</summary>
 /// <returns></returns>
@@ -195,6 +267,8 @@ void ClearBasicStatus()
 bool SetBasicStatus(const struct structBASICSTATUS_ANS& ans)
 {
 	memcpy(&m_BasicStatus, &ans, sizeof(struct structBASICSTATUS_ANS));
+	// 機種が変わり得るため表示はすべて送り直す
+	ClearButtonOutput();
 	return true;
 }
 
@@ -292,48 +366,63 @@ static void DisposeGroupPageContents()
 			DisposeGroupPageContent(g, p);
 }
 
+/// <summary>現行マトリックスパス取得</summary>
+/// <returns></returns>
+static std::string CurrentMatrixPath()
+{
+	return m_pDeviceContents->TakeButtonEnable()
+		 ? m_pDeviceContents->InnerMatrixPath()
+		 : m_pDeviceContents->MatrixPath();
+}
+/// <summary>現行マトリックスのラベル参照識別取得</summary>
+/// <returns></returns>
+static MatrixLabelsHandle CurrentMatrixLabels()
+{
+	return m_pNmosEmberConsumer->InternMatrixLabels(CurrentMatrixPath());
+}
 /// <summary>XPT ラベル設定</summary>
-/// <param name="content"></param>
+/// <param name="hMatrix">マトリックスラベル参照識別</param>
+/// <param name="eFunctionId"></param>
+/// <param name="nSignalNumber"></param>
+/// <param name="sDisplay">ラベル取得時のみ更新</param>
 /// <returns></returns>
 /// <remarks>
 /// マトリックス側にラベル情報を持っている場合優先して表示に使用する
 /// </remarks>
-static bool SetXptLabel(DeviceContent& content)
+static bool SetXptLabel(MatrixLabelsHandle hMatrix, FunctionId eFunctionId, berint nSignalNumber, std::string& sDisplay)
 {
 	bool bUpdate = false;
-	std::string sMatrixPath = m_pDeviceContents->TakeButtonEnable()
-							? m_pDeviceContents->InnerMatrixPath()
-							: m_pDeviceContents->MatrixPath();
-	if (sMatrixPath.empty()
-	 || !m_pNmosEmberConsumer->EnableMatrixLabels()
-	 || ((content.m_eFunctionId != FunctionId::FUNC_DEST)
-	  && (content.m_eFunctionId != FunctionId::FUNC_SRC)))
+	if ((hMatrix == MATRIX_LABELS_HANDLE_INVALID)
+	 || ((eFunctionId != FunctionId::FUNC_DEST)
+	  && (eFunctionId != FunctionId::FUNC_SRC)))
 		return bUpdate;
 
 	std::string sLabel = "";
-	berint nSignalNumber = (berint)content.GetConnSignal();
-	if (content.m_eFunctionId == FunctionId::FUNC_DEST)
-	{
-		if (m_pNmosEmberConsumer->GetTargetLabel(sMatrixPath, nSignalNumber, sLabel)
-		 && !sLabel.empty())
-		{
-			content.m_sDisplay = sLabel;
-			bUpdate = true;
-		}
-	}
-	else// if (content.m_eFunctionId == FunctionId::FUNC_SRC)
-	{
-		if (m_pNmosEmberConsumer->GetSourceLabel(sMatrixPath, nSignalNumber, sLabel)
-			&& !sLabel.empty())
-		{
-			content.m_sDisplay = sLabel;
-			bUpdate = true;
-		}
-	}
+	if (eFunctionId == FunctionId::FUNC_DEST)
+		bUpdate = m_pNmosEmberConsumer->GetTargetLabel(hMatrix, nSignalNumber, sLabel);
+	else// if (eFunctionId == FunctionId::FUNC_SRC)
+		bUpdate = m_pNmosEmberConsumer->GetSourceLabel(hMatrix, nSignalNumber, sLabel);
+	if (bUpdate)
+		sDisplay.swap(sLabel);
 
 	return bUpdate;
 }
 /// <summary>XPT ラベル設定</summary>
+/// <param name="content"></param>
+/// <returns></returns>
+/// <remarks>
+/// マトリックス側にラベル情報を持っている場合優先して表示に使用する
+/// </remarks>
+static bool SetXptLabel(DeviceContent& content)
+{
+	if (!m_pNmosEmberConsumer->EnableMatrixLabels()
+	 || ((content.m_eFunctionId != FunctionId::FUNC_DEST)
+	  && (content.m_eFunctionId != FunctionId::FUNC_SRC)))
+		return false;
+
+	return SetXptLabel(CurrentMatrixLabels(), content.m_eFunctionId, (berint)content.GetConnSignal(), content.m_sDisplay);
+}
+/// <summary>XPT ラベル設定</summary>
 /// <param name="status"></param>
 /// <returns></returns>
 /// <remarks>
@@ -341,38 +430,194 @@ static bool SetXptLabel(DeviceContent& content)
 /// </remarks>
 static bool SetXptLabel(ButtonStatus& status)
 {
-	bool bUpdate = false;
-	std::string sMatrixPath = m_pDeviceContents->TakeButtonEnable()
-							? m_pDeviceContents->InnerMatrixPath()
-							: m_pDeviceContents->MatrixPath();
-	if (sMatrixPath.empty()
-	 || !m_pNmosEmberConsumer->EnableMatrixLabels()
+	if (!m_pNmosEmberConsumer->EnableMatrixLabels()
 	 || ((status.m_eFunctionId != FunctionId::FUNC_DEST)
 	  && (status.m_eFunctionId != FunctionId::FUNC_SRC)))
-		return bUpdate;
+		return false;
 
-	std::string sLabel = "";
-	berint nSignalNumber = (berint)status.m_nConnSignal;
-	if (status.m_eFunctionId == FunctionId::FUNC_DEST)
+	return SetXptLabel(CurrentMatrixLabels(), status.m_eFunctionId, (berint)status.m_nConnSignal, status.m_sDisplay);
+}
+
+
+// ====================================================================
+
+/// <summary>逆引き対象マトリックス</summary>
+static MatrixLabelsHandle m_hIndexedMatrix = MATRIX_LABELS_HANDLE_INVALID;
+/// <summary>Target 番号→DEST ボタン</summary>
+static std::unordered_map<berint, ButtonBits> m_mpDestButtons{};
+/// <summary>Source 番号→SRC ボタン</summary>
+static std::unordered_map<berint, ButtonBits> m_mpSourceButtons{};
+/// <summary>パラメータパス→EmberValue ボタン</summary>
+static std::unordered_map<std::string, ButtonBits> m_mpParameterButtons{};
+/// <summary>各ボタンのパラメータパス（EmberValue 時のみ）</summary>
+static std::string m_aButtonParameterPath[DEVCNT_MAX]{};
+
+/// <summary>逆引き</summary>
+/// <param name="map"></param>
+/// <param name="key"></param>
+/// <returns>該当ボタンのビット列</returns>
+template<typename T>
+static ButtonBits FindButtons(const std::unordered_map<T, ButtonBits>& map, const T& key)
+{
+	auto itr = map.find(key);
+	return (itr != map.end()) ? (*itr).second : 0;
+}
+/// <summary>
+/// ボタン逆引き再構築
+/// </summary>
+/// <remarks>
+/// ページ読込時に現行配置のボタンから
+/// (マトリックス, Target/Source 番号) とパラメータパスの逆引きを作成する
+/// </remarks>
+static void RebuildButtonIndex()
+{
+	m_mpDestButtons.clear();
+	m_mpSourceButtons.clear();
+	m_mpParameterButtons.clear();
+	m_hIndexedMatrix = MATRIX_LABELS_HANDLE_INVALID;
+	if (!m_pNmosEmberConsumer)
+		return;
+	if (!IsValidDeviceContents())
 	{
-		if (m_pNmosEmberConsumer->GetTargetLabel(sMatrixPath, nSignalNumber, sLabel)
-		 && !sLabel.empty())
+		m_pNmosEmberConsumer->SetWatchedParameterPaths(std::set<std::string>());
+		m_pNmosEmberConsumer->SetSubscriptions(SubscriptionOwner::OWNER_PAGE, std::set<std::string>());
+		return;
+	}
+
+	m_hIndexedMatrix = CurrentMatrixLabels();
+	std::set<std::string> stPaths{};
+	int btnCnt = std::min(GetButtonCount(), DEVCNT_MAX);
+	for (int b = 0; b < btnCnt; ++b)
+	{
+		auto& status = m_aButtonStatus[b];
+		ButtonBits bit = (ButtonBits)1 << b;
+		if ((status.m_eFunctionId == FunctionId::FUNC_DEST)
+		 || (status.m_eFunctionId == FunctionId::FUNC_SRC))
+		{
+			if (status.m_nConnSignal < 0)
+				continue;
+			auto& map = (status.m_eFunctionId == FunctionId::FUNC_DEST) ? m_mpDestButtons : m_mpSourceButtons;
+			int nCount = std::max(status.m_nConnCount, 1);
+			for (int i = 0; i < nCount; ++i)
+				map[(berint)(status.m_nConnSignal + i)] |= bit;
+		}
+		else if ((status.m_eFunctionId == FunctionId::FUNC_EMBER_VALUE)
+			  && !m_aButtonParameterPath[b].empty())
 		{
-			status.m_sDisplay = sLabel;
-			bUpdate = true;
+			m_mpParameterButtons[m_aButtonParameterPath[b]] |= bit;
+			stPaths.insert(m_aButtonParameterPath[b]);
 		}
 	}
-	else// if (status.m_eFunctionId == FunctionId::FUNC_SRC)
+	m_pNmosEmberConsumer->SetWatchedParameterPaths(stPaths);
+
+	// 表示中ページが参照するパラメータとマトリックスのみ購読する（ページ替で移し替え）
+	auto sMatrixPath = CurrentMatrixPath();
+	if (!sMatrixPath.empty() && (!m_mpDestButtons.empty() || !m_mpSourceButtons.empty()))
+		stPaths.insert(sMatrixPath);
+	m_pNmosEmberConsumer->SetSubscriptions(SubscriptionOwner::OWNER_PAGE, stPaths);
+}
+/// <summary>XPT ラベル再設定</summary>
+/// <param name="bits">対象ボタン</param>
+/// <returns>表示が更新されたボタン</returns>
+static ButtonBits RefreshXptLabels(ButtonBits bits)
+{
+	ButtonBits updated = 0;
+	while (bits != 0)
+	{
+		int b = LowestBitIndex(bits);
+		bits &= bits - 1;
+
+		auto& status = m_aButtonStatus[b];
+		if (SetXptLabel(m_hIndexedMatrix, status.m_eFunctionId, (berint)status.m_nConnSignal, status.m_sDisplay))
+			updated |= (ButtonBits)1 << b;
+	}
+	return updated;
+}
+/// <summary>選択 Dest 接続 Src 再取得</summary>
+/// <remarks>
+/// 接続が外れた／付いた Src ボタンを再描画対象とする
+/// </remarks>
+static void RefreshDestConnSrcs()
+{
+	std::vector<int> vOldSrcs = m_vDestConnSrcs;
+	if (m_pNmosEmberConsumer)
+		m_pNmosEmberConsumer->GetSignalValues(m_sXptValue.m_nDestConnSignal, m_sXptValue.m_nDestConnCount, m_vDestConnSrcs);
+	else
+		m_vDestConnSrcs.clear();
+	for (auto nSrc : vOldSrcs)
+		MarkDirtyButtons(FindButtons(m_mpSourceButtons, (berint)nSrc));
+	for (auto nSrc : m_vDestConnSrcs)
+		MarkDirtyButtons(FindButtons(m_mpSourceButtons, (berint)nSrc));
+}
+/// <summary>XPT 選択中ボタン</summary>
+/// <param name="status"></param>
+/// <returns></returns>
+static bool IsSelectedXptButton(const ButtonStatus& status)
+{
+	return status.m_bCanUseXpt
+		&& (status.m_nConnSignal >= 0)
+		&& m_sXptValue.IsSame(status);
+}
+/// <summary>XPT 選択状態反映</summary>
+/// <remarks>
+/// 最終選択XPT に一致する DEST/SRC ボタンを選択中とし、選択状態が変わったボタンを再描画対象とする
+/// </remarks>
+static void RefreshXptSelection()
+{
+	int btnCnt = std::min(GetButtonCount(), DEVCNT_MAX);
+	for (int b = 0; b < btnCnt; ++b)
 	{
-		if (m_pNmosEmberConsumer->GetSourceLabel(sMatrixPath, nSignalNumber, sLabel)
-			&& !sLabel.empty())
+		auto& status = m_aButtonStatus[b];
+		char bSelected = IsSelectedXptButton(status) ? 1 : 0;
+		if (status.m_bSelected != bSelected)
 		{
-			status.m_sDisplay = sLabel;
-			bUpdate = true;
+			status.m_bSelected = bSelected;
+			MarkDirtyButtons((ButtonBits)1 << b);
 		}
 	}
-
-	return bUpdate;
+}
+/// <summary>XPT 設定用データ初期化</summary>
+/// <remarks>
+/// 選択解除と接続中 Src の消灯を再描画対象とする
+/// </remarks>
+static void ClearXptValue()
+{
+	while (!m_vXpts.empty())
+	{
+		auto itr = m_vXpts.begin();
+		if (!(*itr))
+			delete (*itr);
+		m_vXpts.erase(itr);
+	}
+	if (!m_sMatrixPath.empty())
+		m_sMatrixPath.clear();
+	m_sXptValue.Initialize();
+	m_bCanSetXpt = false;
+	RefreshDestConnSrcs();
+	RefreshXptSelection();
+}
+/// <summary>XPT 設定用データ初期化</summary>
+/// <param name="path"></param>
+static void ClearXptValue(std::string path)
+{
+	ClearXptValue();
+	if (!path.empty())
+	{
+		m_sMatrixPath = path;
+		m_bCanSetXpt = true;
+	}
+}
+/// <summary>XPT 設定用ソースデータ初期化</summary>
+static void ClearXptSourcesValue()
+{
+	// 一旦すべて初期化しDest側は初期化前のデータを再設定する
+	std::string sPath = m_sMatrixPath;
+	XptValue value = m_sXptValue;
+	ClearXptValue(sPath);
+	m_sXptValue.m_nDestConnSignal = value.m_nDestConnSignal;
+	m_sXptValue.m_nDestConnCount = value.m_nDestConnCount;
+	RefreshDestConnSrcs();
+	RefreshXptSelection();
 }
 
 /// <summary>
@@ -404,6 +649,10 @@ static std::vector<DeviceContent*>* LoadGroupPageContents(const char group, cons
 static int m_nLastMatrixNotifyCount = 0;
 /// <summary>マトリックス更新有無</summary>
 /// <returns></returns>
+/// <remarks>
+/// 変更履歴から該当ボタンのみ更新し再描画対象とする（TakeDirtyButtons で取得）
+/// 履歴欠落時や表示中マトリックスの切替時は現行配置すべてを更新する
+/// </remarks>
 bool IsUpdateMatrix()
 {
 	bool res = false;
@@ -413,21 +662,77 @@ bool IsUpdateMatrix()
 	{
 		m_nLastMatrixNotifyCount = nLastMatrixNotifyCount;
 
-		// シグナルを控え直す
-		m_pNmosEmberConsumer->GetSignalValues(m_sXptValue.m_nDestConnSignal, m_sXptValue.m_nDestConnCount, m_vDestConnSrcs);
+		std::vector<MatrixChange> vChanges{};
+		bool bAll = !m_pNmosEmberConsumer->TakeMatrixChanges(vChanges);
+		if (CurrentMatrixLabels() != m_hIndexedMatrix)
+		{
+			RebuildButtonIndex();
+			bAll = true;
+		}
+		bool bLabels = m_pNmosEmberConsumer->EnableMatrixLabels();
 
-		// 現行配置のみ情報更新
-		if (m_pNmosEmberConsumer->EnableMatrixLabels())
+		if (bAll)
 		{
-			int cnt = 0;
-			for (int i = 0; i < DEVCNT_MAX; ++i)
+			// シグナルを控え直す
+			m_pNmosEmberConsumer->GetSignalValues(m_sXptValue.m_nDestConnSignal, m_sXptValue.m_nDestConnCount, m_vDestConnSrcs);
+
+			// 現行配置のみ情報更新
+			ButtonBits bits = 0;
+			for (auto& pair : m_mpDestButtons)
+				bits |= pair.second;
+			for (auto& pair : m_mpSourceButtons)
+				bits |= pair.second;
+			for (auto& pair : m_mpParameterButtons)
+				bits |= pair.second;
+			if (bLabels)
+				RefreshXptLabels(bits);
+			MarkDirtyButtons(bits);
+		}
+		else
+		{
+			bool bDestConn = false;
+			for (auto& change : vChanges)
 			{
-				if ((m_aButtonStatus[i].m_eFunctionId != FunctionId::FUNC_DEST)
-				 && (m_aButtonStatus[i].m_eFunctionId != FunctionId::FUNC_SRC))
-					continue;
-				if (SetXptLabel(m_aButtonStatus[i]))
-					++cnt;
+				switch (change.m_eKind)
+				{
+				case MatrixChangeKind::CHANGE_PARAMETER:
+					MarkDirtyButtons(FindButtons(m_mpParameterButtons, change.m_sPath));
+					break;
+				case MatrixChangeKind::CHANGE_CONNECTION:
+					// 接続ソースの確認は最終接続通知マトリックスが対象のため、マトリックスに拘わらず選択 Dest 範囲か確認する
+					if ((m_sXptValue.m_nDestConnSignal >= 0)
+					 && IsRange((int)change.m_nNumber, m_sXptValue.m_nDestConnSignal, m_sXptValue.m_nDestConnSignal + std::max(m_sXptValue.m_nDestConnCount, 1) - 1))
+						bDestConn = true;
+					if (change.m_hMatrix == m_hIndexedMatrix)
+						MarkDirtyButtons(FindButtons(m_mpDestButtons, change.m_nNumber));
+					break;
+				case MatrixChangeKind::CHANGE_TARGET_LABEL:
+					if (bLabels && (change.m_hMatrix == m_hIndexedMatrix))
+						MarkDirtyButtons(RefreshXptLabels(FindButtons(m_mpDestButtons, change.m_nNumber)));
+					break;
+				case MatrixChangeKind::CHANGE_SOURCE_LABEL:
+					if (bLabels && (change.m_hMatrix == m_hIndexedMatrix))
+						MarkDirtyButtons(RefreshXptLabels(FindButtons(m_mpSourceButtons, change.m_nNumber)));
+					break;
+				case MatrixChangeKind::CHANGE_ALL:
+				default:
+					if (change.m_hMatrix == m_hIndexedMatrix)
+					{
+						ButtonBits bits = 0;
+						for (auto& pair : m_mpDestButtons)
+							bits |= pair.second;
+						for (auto& pair : m_mpSourceButtons)
+							bits |= pair.second;
+						if (bLabels)
+							RefreshXptLabels(bits);
+						MarkDirtyButtons(bits);
+						bDestConn = true;
+					}
+					break;
+				}
 			}
+			if (bDestConn)
+				RefreshDestConnSrcs();
 		}
 
 		res = true;
@@ -512,6 +817,7 @@ static int AddOrRemoveInhibitValue(const ButtonStatus& status)
 		// 対象ボタンのインヒビット設定を反転
 		char nInh = m_aButtonStatus[status.m_nButtonIndex].m_bInhibit;
 		m_aButtonStatus[status.m_nButtonIndex].m_bInhibit = (nInh == 0) ? 1 : 0;
+		MarkDirtyButtons((ButtonBits)1 << status.m_nButtonIndex);
 	}
 
 	return res;
@@ -746,6 +1052,10 @@ static bool SetButtonStatus(ButtonStatus& status, DeviceContent& content)
 						|| content.IsValidDest()
 						|| content.IsValidSource());
 	SetXptLabel(status);
+	status.m_bSelected = IsSelectedXptButton(status) ? 1 : 0;
+	m_aButtonParameterPath[nButtonIndex] = (content.m_eFunctionId == FunctionId::FUNC_EMBER_VALUE)
+										 ? content.m_sArg1
+										 : std::string();
 	if ((status.m_eFunctionId == FunctionId::FUNC_TAKE)
 	 && !m_pDeviceContents->TakeButtonEnable())
 	{
@@ -815,7 +1125,10 @@ int ResetButtonStatus(const char group, const char page, bool initialize)
 		{
 			// この時点で pCont->m_nButtonId > 0 は確定している
 			if (SetButtonStatus(m_aButtonStatus[pCont->m_nButtonId - 1], *pCont))
+			{
+				MarkDirtyButtons((ButtonBits)1 << (pCont->m_nButtonId - 1));
 				++asnCnt;
+			}
 			// pCont は m_pGroupPageContents の内容を指しているので delete の必要なし
 		}
 	}
@@ -825,6 +1138,8 @@ int ResetButtonStatus(const char group, const char page, bool initialize)
 	{
 		// カレントページを更新する
 		SetCurrentGroupPage(group, page);
+		// 逆引きを現行配置で作り直す
+		RebuildButtonIndex();
 	}
 	// グループ内でボタン割当が行われなかった場合
 	else
@@ -848,6 +1163,11 @@ static int ResetButtonStatus(bool setTopPageButtonStatus)
 	ClearButtonStatus();
 	ClearCurrentGroupPage();
 	DisposeGroupPageContents();
+	for (int i = 0; i < DEVCNT_MAX; ++i)
+		m_aButtonParameterPath[i].clear();
+	RebuildButtonIndex();
+	// 消去したボタンも再描画対象
+	MarkDirtyButtons(AllButtonBits());
 
 	// 返却はボタン割当数
 	int asnCnt = 0;
@@ -899,6 +1219,170 @@ bool GetButtonStatus(const int index, ButtonStatus& status)
 	return valid;
 }
 
+
+// ====================================================================
+
+/// <summary>ボタン LED 送信済内容（未送信は status = 0）</summary>
+static structBUTTONLED1 m_aSentButtonLed[DEVCNT_MAX]{};
+/// <summary>OLED 送信済内容（未送信は status = 0）</summary>
+static structOLED1 m_aSentOLed[DEVCNT_MAX]{};
+
+/// <summary>XPT 選択 Dest 接続中の Src ボタン</summary>
+/// <param name="status"></param>
+/// <returns></returns>
+static bool IsConnectedSourceButton(const ButtonStatus& status)
+{
+	if ((status.m_eFunctionId != FunctionId::FUNC_SRC) || (status.m_nConnSignal < 0))
+		return false;
+	int nCount = std::max(status.m_nConnCount, 1);
+	return std::any_of(m_vDestConnSrcs.cbegin(), m_vDestConnSrcs.cend(),
+					   [&status, nCount](int nSrc) { return IsRange(nSrc, status.m_nConnSignal, status.m_nConnSignal + nCount - 1); });
+}
+/// <summary>ボタン LED 表示内容</summary>
+/// <param name="status"></param>
+/// <param name="nLedNo">LED ボタン番号</param>
+/// <param name="led">表示内容（出力）</param>
+/// <remarks>
+/// 未割当は消灯、インヒビットは既定色の暗色、選択中・接続中 Src は既定色の明色、操作エラーは点滅
+/// </remarks>
+static void GetButtonLedOutput(const ButtonStatus& status, int nLedNo, structBUTTONLED1& led)
+{
+	apiformat::FormatDecimal<sizeof(led.buttonNo)>(led.buttonNo, (uint32_t)nLedNo);
+	if (status.m_eFunctionId == FunctionId::FUNC_NONE)
+	{
+		led.status = LED_MODE::off;
+		led.color = (uint8_t)BUTTONLED_COLOR::darkRed;
+		return;
+	}
+
+	int color = (uint8_t)status.m_nLedColor % 6;
+	if (status.m_bInhibit)
+		color %= 3;
+	else if (status.m_bSelected || IsConnectedSourceButton(status))
+		color = (color % 3) + 3;
+	led.status = status.m_bActionError ? LED_MODE::blink : LED_MODE::on;
+	led.color = (uint8_t)('0' + color);
+}
+#ifdef _OMIT_OLED_DETAIL
+/// <summary>OLED 表示内容</summary>
+/// <param name="status"></param>
+/// <param name="nOLedId">OLED 番号</param>
+/// <param name="oled">表示内容（出力）</param>
+/// <remarks>
+/// 未割当は黒の空白、選択中・接続中 Src は反転、操作エラーは点滅
+/// 表示文字列は 16 バイトで打ち切り、満たない分は空白で埋める
+/// </remarks>
+static void GetOLedOutput(const ButtonStatus& status, int nOLedId, structOLED1& oled)
+{
+	apiformat::FormatDecimal<sizeof(oled.oledId)>(oled.oledId, (uint32_t)nOLedId);
+	memset(oled.label, ' ', sizeof(oled.label));
+	if (status.m_eFunctionId == FunctionId::FUNC_NONE)
+	{
+		oled.status = (uint8_t)OLED_MODE::NORMAL;
+		oled.color = OLED_COLOR::black;
+		return;
+	}
+
+	oled.status = (uint8_t)(status.m_bActionError ? OLED_MODE::BLINK
+						  : (status.m_bSelected || IsConnectedSourceButton(status)) ? OLED_MODE::REVERSE
+						  : OLED_MODE::NORMAL);
+	oled.color = (uint8_t)('0' + ((uint8_t)status.m_nOLedColor % 8));
+	memcpy(oled.label, status.m_sDisplay.data(), std::min(status.m_sDisplay.size(), sizeof(oled.label)));
+}
+#endif
+/// <summary>件数付メッセージ追加（最大数ごとに分割）</summary>
+/// <param name="vMessages">送信メッセージ（連結して追加）</param>
+/// <param name="command">コマンド</param>
+/// <param name="vEntries">設定内容</param>
+/// <param name="nCountMax">1 メッセージあたり最大数</param>
+/// <returns>追加メッセージ数</returns>
+/// <remarks>
+/// len はコマンドから設定内容末尾までのバイト数（終端コードは含まない）
+/// </remarks>
+template<typename THeader, typename TEntry>
+static int AppendCountedMessages(std::vector<char>& vMessages, COMMAND command, const std::vector<TEntry>& vEntries, size_t nCountMax)
+{
+	int nMessages = 0;
+	for (size_t pos = 0; pos < vEntries.size(); pos += nCountMax)
+	{
+		size_t nCount = std::min(nCountMax, vEntries.size() - pos);
+		THeader header;
+		apiformat::FormatDecimal<sizeof(header.len)>((uint8_t*)&header.len, (uint32_t)(sizeof(THeader) - sizeof(header.len) + nCount * sizeof(TEntry)));
+		apiformat::FormatDecimal<sizeof(header.command)>((uint8_t*)&header.command, (uint32_t)command);
+		apiformat::FormatDecimal<sizeof(header.count)>(header.count, (uint32_t)nCount);
+
+		const char* pHeader = (const char*)&header;
+		const char* pEntries = (const char*)&vEntries[pos];
+		vMessages.insert(vMessages.end(), pHeader, pHeader + sizeof(THeader));
+		vMessages.insert(vMessages.end(), pEntries, pEntries + nCount * sizeof(TEntry));
+		vMessages.push_back(ENDCODE);
+		++nMessages;
+	}
+	return nMessages;
+}
+
+/// <summary>ボタン表示出力の送信済状態破棄</summary>
+void ClearButtonOutput()
+{
+	memset(m_aSentButtonLed, 0, sizeof(m_aSentButtonLed));
+	memset(m_aSentOLed, 0, sizeof(m_aSentOLed));
+	MarkDirtyButtons(AllButtonBits());
+}
+/// <summary>ボタン表示出力メッセージ生成</summary>
+/// <param name="vMessages">送信メッセージ（連結して追加）</param>
+/// <returns>生成メッセージ数</returns>
+/// <remarks>
+/// ページ替では対象ボタンが最大数以内のため LED・OLED それぞれ 1 メッセージに収まる
+/// </remarks>
+int ComposeButtonOutput(std::vector<char>& vMessages)
+{
+	std::vector<int> vButtonIndexes{};
+	if (TakeDirtyButtons(vButtonIndexes) <= 0)
+		return 0;
+
+	int nLedOffset = GetLEDButtonIdOffset();
+	int nLedCount = GetLEDButtonCount();
+	int nOLedCount = GetOLEDCount();
+	std::vector<structBUTTONLED1> vLeds{};
+	std::vector<structOLED1> vOLeds{};
+	vLeds.reserve(vButtonIndexes.size());
+	vOLeds.reserve(vButtonIndexes.size());
+	for (int b : vButtonIndexes)
+	{
+		const auto& status = m_aButtonStatus[b];
+
+		int nLedNo = b - nLedOffset;
+		if (IsRange(nLedNo, 0, nLedCount - 1))
+		{
+			structBUTTONLED1 led;
+			GetButtonLedOutput(status, nLedNo, led);
+			if (memcmp(&led, &m_aSentButtonLed[b], sizeof(led)) != 0)
+			{
+				m_aSentButtonLed[b] = led;
+				vLeds.push_back(led);
+			}
+		}
+#ifdef _OMIT_OLED_DETAIL
+		if (b < nOLedCount)
+		{
+			structOLED1 oled;
+			GetOLedOutput(status, b, oled);
+			if (memcmp(&oled, &m_aSentOLed[b], sizeof(oled)) != 0)
+			{
+				m_aSentOLed[b] = oled;
+				vOLeds.push_back(oled);
+			}
+		}
+#endif
+	}
+
+	return AppendCountedMessages<structBUTTONLED>(vMessages, COMMAND::buttunLEDSet, vLeds, BUTTONLED_COUNT_MAX)
+		 + AppendCountedMessages<structOLED>(vMessages, COMMAND::oledDisplaySet, vOLeds, OLED_COUNT_MAX);
+}
+
+
+// ====================================================================
+
 /// <summary>
 /// 操作要求
 /// </summary>
@@ -1266,7 +1750,8 @@ static void RequestButtonAction(int buttonIndex, ActionId& doneAction)
 					m_sXptValue.Set(status);
 					// 操作中にページ替えの可能性があるため
 					// ボタンインデックスではなくシグナルを控える
-					m_pNmosEmberConsumer->GetSignalValues(m_sXptValue.m_nDestConnSignal, m_sXptValue.m_nDestConnCount, m_vDestConnSrcs);
+					RefreshDestConnSrcs();
+					RefreshXptSelection();
 					Trace(__FILE__, __LINE__, __FUNCTION__, "buttonIndex = %d, function = %s, top signal = %d.\n",
 						buttonIndex, sFunc.c_str(), status.m_nConnSignal);
 				}
@@ -1292,8 +1777,9 @@ static void RequestButtonAction(int buttonIndex, ActionId& doneAction)
 						if (pCont->m_eFunctionId == FunctionId::FUNC_DEST)
 						{
 							// ボタンインデックスではなくシグナルを控える
-							m_pNmosEmberConsumer->GetSignalValues(m_sXptValue.m_nDestConnSignal, m_sXptValue.m_nDestConnCount, m_vDestConnSrcs);
+							RefreshDestConnSrcs();
 						}
+						RefreshXptSelection();
 
 						// どちらも設定されたら設定実績に控え直す
 						if (m_sXptValue.IsValid())
@@ -1355,7 +1841,8 @@ static void RequestButtonAction(int buttonIndex, ActionId& doneAction)
 						m_sXptValue.Set(status);
 						// 操作中にページ替えの可能性があるため
 						// ボタンインデックスではなくシグナルを控える
-						m_pNmosEmberConsumer->GetSignalValues(m_sXptValue.m_nDestConnSignal, m_sXptValue.m_nDestConnCount, m_vDestConnSrcs);
+						RefreshDestConnSrcs();
+						RefreshXptSelection();
 						Trace(__FILE__, __LINE__, __FUNCTION__, "buttonIndex = %d, function = %s, top signal = %d.\n",
 							buttonIndex, sFunc.c_str(), status.m_nConnSignal);
 
@@ -1368,6 +1855,7 @@ static void RequestButtonAction(int buttonIndex, ActionId& doneAction)
 					if (pCont->m_eFunctionId == FunctionId::FUNC_SRC)
 					{
 						m_sXptValue.Set(status);
+						RefreshXptSelection();
 						XptValue xptValue{};
 						GetXptSignals(xptValue);
 						Trace(__FILE__, __LINE__, __FUNCTION__, "buttonIndex = %d, function = %s, dest top signal = %d, src top signal = %d.\n",
@@ -1496,8 +1984,18 @@ static void RequestButtonAction(int buttonIndex, ActionId& doneAction)
 			}
 			break;
 
-		// 対応前
-		case FunctionId::FUNC_SALVO: break;
+		// Connections（サルボ）
+		case FunctionId::FUNC_SALVO:
+			if (pCont->IsValidSalvo())
+			{
+				std::vector<std::pair<int, int>> vXpts{};
+				pCont->SalvoXpts(vXpts);
+				int nId = m_pNmosEmberConsumer->AddSalvoRequest(&requestId, pCont->m_sArg1, vXpts);
+				// 要求が承認されたなら結果に拘らず音は鳴らす
+				if (nId > 0)
+					doneAction = ActionId::ACTION_ALARM;
+			}
+			break;
 		}
 	}
 
@@ -1558,17 +2056,8 @@ static bool _AnalyzeButtonAction(const void* pStatus, ActionId& doneAction)
 		//
 		// 操作ターゲットと値、操作を特定
 		//
-		/*** model
-		struct structBUTTON_40RU {
-			uint32_t	len;
-			uint32_t	command;
-			uint8_t		setup_sw;
-			uint8_t		btns[ボタン数];
-			uint8_t		endcode;
-		};
-		***/
-		int offset = (int)(2 * sizeof(uint32_t));
-		int cnt = (int)(((size_t)(len - offset) - (2 * sizeof(uint8_t))) / sizeof(uint8_t));
+		// ボタン状態の位置と数は機種共通の配置から得る（APICodec.h で検証済）
+		int cnt = apiformat::ButtonCount((size_t)len);
 		if (cnt <= 0)
 		{
 			Trace(__FILE__, __LINE__, __FUNCTION__, "exit(invalid length).\n");
@@ -1576,80 +2065,42 @@ static bool _AnalyzeButtonAction(const void* pStatus, ActionId& doneAction)
 		}
 
 		char* pTop = (char*)pStatus;
-		char sw = pTop[offset];
 
 #if true
-		// 押されていないボタン用
-		std::vector<int> lastUnPushedButtons;
-		lastUnPushedButtons.clear();
-		// 押されたままのボタン用
-		std::vector<int> lastPushedButtons;
-		lastPushedButtons.clear();
-		std::vector<int> pushedButtons;
-		pushedButtons.clear();
-		std::vector<int> changedButtons;
-		changedButtons.clear();
-
-		// 変化の確認
-		for (int b = 0; b < cnt; ++b)
-		{
-			int pos = (offset + 1) + b;
-
-			char lsw = ((char*)pLastStatus)[pos];
-			// 値の設定されていないデータ対策
-			if (lsw == 0)
-				lsw = '0';
-			if (lsw != '0')
-			{
-				// 確認用に控えておく
-				lastPushedButtons.push_back(b);
-			}
-			else
-			{
-				// 確認用に控えておく
-				lastUnPushedButtons.push_back(b);
-			}
-
-			char bsw = pTop[pos];
-			// 値の設定されていないデータ対策
-			if (bsw == 0)
-				bsw = '0';
-			// 押されているボタン
-			if (bsw != '0')
-			{
-				// 確認用に控えておく
-				pushedButtons.push_back(b);
-			}
+		if (cnt > DEVCNT_MAX)
+			cnt = DEVCNT_MAX;
 
-			// 変化があったボタン
-			if (bsw != lsw)
-			{
-				changedButtons.push_back(b);
+		// 押されているボタン（直近、今回）と変化があったボタンをビット列で得る
+		ButtonBits lastPushedBits = PackButtonBits((const char*)pLastStatus + apiformat::ButtonsOffset, cnt);
+		ButtonBits pushedBits = PackButtonBits(pTop + apiformat::ButtonsOffset, cnt);
+		ButtonBits changedBits = lastPushedBits ^ pushedBits;
 
-				m_aButtonStatus[b].m_bPushed = (bsw != '0') ? 1 : 0;
-				m_aButtonStatus[b].m_bLongPushed = 0;
-				m_aButtonStatus[b].m_tPassingTime = m_aButtonStatus[b].m_bPushed
-					? std::chrono::system_clock::now() + std::chrono::seconds(m_nLongPushDistSeconds)
-					: std::chrono::system_clock::time_point{};
-			}
+		// 変化があったボタン
+		// （長押しは LINE UNIT 側（パネル単位）で判定するため、ここでは押下状態のみ保持する）
+		for (ButtonBits bits = changedBits; bits != 0; bits &= (bits - 1))
+		{
+			int b = LowestBitIndex(bits);
+			m_aButtonStatus[b].m_bPushed = ((pushedBits >> b) & 1) ? 1 : 0;
 		}
 
 		// 単一ボタンが押された状態から離されたのであれば操作要求
 		ActionId eDoneAction = ActionId::ACTION_NONE;
-		//if ((changedButtons.size() == 1) && pushedButtons.empty() && (pTop[(offset + 1) + changedButtons[0]] == '0'))
-		if ((changedButtons.size() == 1) && (pushedButtons.size() == 1) && (pTop[(offset + 1) + changedButtons[0]] != '0'))
+		//if (IsSingleBit(changedBits) && (pushedBits == 0))
+		if (IsSingleBit(changedBits) && (changedBits == pushedBits))
 		{
-			m_aButtonStatus[changedButtons[0]].m_bActionError = 0;
-			RequestButtonAction(changedButtons[0], eDoneAction);
+			int b = LowestBitIndex(changedBits);
+			m_aButtonStatus[b].m_bActionError = 0;
+			RequestButtonAction(b, eDoneAction);
 			doneAction = eDoneAction;
 			if (doneAction == ActionId::ACTION_ERROR)
-				m_aButtonStatus[changedButtons[0]].m_bActionError = 1;
+				m_aButtonStatus[b].m_bActionError = 1;
+			MarkDirtyButtons((ButtonBits)1 << b);
 		}
 #else
 		// 新たに押されたものだけ拾う
 		for (int b = 0; b < cnt; ++b)
 		{
-			int pos = (offset + 1) + b;
+			int pos = (int)apiformat::ButtonsOffset + b;
 
 			char bsw = pTop[pos];
 			if (bsw && bsw != ((char*)pLastStatus)[pos])
@@ -1821,26 +2272,6 @@ static int m_nRotaryValue = 0;
 static int GetRotaryTarget() { return m_nRotaryTarget; }
 static int GetRotaryValue() { return m_nRotaryValue; }
 
-/// <summary>
-/// 符号付き整数取得
-/// </summary>
-/// <param name="srcptr"></param>
-/// <param name="offset"></param>
-/// <returns></returns>
-static int getSignedDWORD(char* srcptr, int offset)
-{
-	std::string str(&srcptr[offset], 4);
-	if (str[0] == '+') {
-		return atol(str.substr(1).c_str());
-	}
-	else if (str[0] == '-') {
-		return atol(str.substr(1).c_str()) * (-1);
-	}
-	else {
-		assert(str.compare("0000") == 0);
-		return 0;
-	}
-}
 /// <summary>
 /// 操作要求
 /// </summary>
@@ -2005,8 +2436,8 @@ static void RequestRotaryAction(int speed, bool pushed, ActionId& doneAction)
 bool AnalyzeRotaryAction(const struct structROTARY& status, ActionId& doneAction)
 {
 	Guidance("\n");
-	int speed = getSignedDWORD((char*)&status.value, 0);
-	bool pushed = status.pushed == '1';
+	int speed = apiformat::RotaryValue(status);
+	bool pushed = apiformat::RotaryPushed(status);
 	//Trace(__FILE__, __LINE__, __FUNCTION__, "start, speed = %d, pushed = %d.\n", speed, pushed);
 
 	doneAction = ActionId::ACTION_NONE;
@@ -1,7 +1,6 @@
 ﻿#pragma once
 
 #include "DeviceContents.h"
-#include <chrono>
 
 
 // ====================================================================
@@ -74,11 +73,8 @@ public:
 
 		m_cMode = '0';
 		m_bPushed = 0;
-		m_bLongPushed = 0;
 		m_bSelected = 0;
 		m_bActionError = 0;
-
-		m_tPassingTime = std::chrono::system_clock::time_point{};
 	}
 	void Initialize(char group, char page)
 	{
@@ -139,15 +135,10 @@ public:
 	char m_cMode;
 	/// <summary>押</summary>
 	char m_bPushed;
-	/// <summary>長押</summary>
-	char m_bLongPushed;
 	/// <summary>ユーザ選択</summary>
 	char m_bSelected;
 	/// <summary>ユーザ選択</summary>
 	char m_bActionError;
-
-	/// <summary>長押判断時刻</summary>
-	std::chrono::system_clock::time_point m_tPassingTime;
 };
 
 /// <summary>インヒビット設定値</summary>
@@ -312,6 +303,28 @@ extern void ClearButtonStatus();
 /// <summary>マトリックス更新有無</summary>
 /// <returns></returns>
 extern bool IsUpdateMatrix();
+/// <summary>再描画対象ボタン取得</summary>
+/// <param name="vButtonIndexes">ボタンインデックス（昇順）</param>
+/// <returns>ボタン数</returns>
+/// <remarks>
+/// 前回取得以降にページ替／マトリックス変更で内容が変わったボタンのみ返す
+/// </remarks>
+extern int TakeDirtyButtons(std::vector<int>& vButtonIndexes);
+
+
+// ====================================================================
+
+/// <summary>ボタン表示出力の送信済状態破棄</summary>
+/// <remarks>機種判定時・再接続時に呼び出し、次回の出力で全ボタンを送信する</remarks>
+extern void ClearButtonOutput();
+/// <summary>ボタン表示出力メッセージ生成</summary>
+/// <param name="vMessages">送信メッセージ（連結して追加）</param>
+/// <returns>生成メッセージ数</returns>
+/// <remarks>
+/// 再描画対象ボタンを取得し（TakeDirtyButtons）、送信済の内容と異なるものだけを
+/// ボタンLED設定要求(2001)／OLED表示要求(2002)へそれぞれ最大数まで詰めて生成する
+/// </remarks>
+extern int ComposeButtonOutput(std::vector<char>& vMessages);
 
 
 // ====================================================================
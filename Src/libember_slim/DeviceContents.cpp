@@ -74,7 +74,7 @@ bool IsValidFunctionId(FunctionId id)
 		|| (id == FunctionId::FUNC_SRC)
 		|| (id == FunctionId::FUNC_DEST)
 		|| (id == FunctionId::FUNC_TAKE)
-		//|| (id == FunctionId::FUNC_SALVO)
+		|| (id == FunctionId::FUNC_SALVO)
 		|| (id == FunctionId::FUNC_EMBER_FUNC)
 		|| (id == FunctionId::FUNC_EMBER_VALUE)
 		|| (id == FunctionId::FUNC_INHIBIT)
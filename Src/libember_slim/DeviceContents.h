@@ -384,6 +384,49 @@ public:
 
 		return (char)nPage;
 	}
+	/// <summary>サルボ接続組</summary>
+	/// <param name="vXpts">(ターゲット, ソース) の組</param>
+	/// <returns>組数</returns>
+	/// <remarks>
+	/// 引数-2にパイプ区切で "ターゲット:ソース" が設定されている想定
+	/// 解釈できない組は読み飛ばす
+	/// </remarks>
+	int SalvoXpts(std::vector<std::pair<int, int>>& vXpts)
+	{
+		vXpts.clear();
+		if (m_eFunctionId != FunctionId::FUNC_SALVO)
+			return 0;
+
+		const char delimiter = '|';
+		const std::string& sXpts = m_sArg2;
+		auto offset = std::string::size_type(0);
+		while (offset <= sXpts.size())
+		{
+			auto pos = sXpts.find(delimiter, offset);
+			std::string sXpt = (pos == std::string::npos) ? sXpts.substr(offset) : sXpts.substr(offset, pos - offset);
+			offset = (pos == std::string::npos) ? sXpts.size() + 1 : pos + 1;
+
+			auto sep = sXpt.find(':');
+			int nTarget = -1;
+			int nSource = -1;
+			if ((sep != std::string::npos)
+			 && utilities::ToNumber(utilities::Trim(sXpt.substr(0, sep)), nTarget) && (nTarget >= 0)
+			 && utilities::ToNumber(utilities::Trim(sXpt.substr(sep + 1)), nSource) && (nSource >= 0))
+				vXpts.push_back(std::make_pair(nTarget, nSource));
+		}
+
+		return (int)vXpts.size();
+	}
+	/// <summary>SALVO 有効</summary>
+	/// <returns></returns>
+	bool IsValidSalvo()
+	{
+		std::vector<std::pair<int, int>> vXpts{};
+		return (m_eFunctionId == FunctionId::FUNC_SALVO)
+			&& (m_sArg1.size() >= 4)
+			&& (m_sArg1[0] == '/')
+			&& (SalvoXpts(vXpts) > 0);
+	}
 
 	/// <summary>ボタン（デバイス識別）</summary>
 	int m_nButtonId;
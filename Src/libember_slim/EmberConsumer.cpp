@@ -1,7 +1,9 @@
 ﻿#include "ClientConfig.h"
 #include "EmberConsumer.h"
 #include "Utilities.h"
+#include "Capture.h"
 #include "ember_consumer.h"
+#include <algorithm>
 #include <cassert>
 #include <regex>
 
@@ -11,6 +13,117 @@ using namespace utilities;
 #undef max
 
 
+// ====================================================================
+/// <summary>全消去</summary>
+void MatrixLabelTable::Clear()
+{
+	if (!m_vSlots.empty())
+		m_vSlots.clear();
+	if (!m_mpOverflow.empty())
+		m_mpOverflow.clear();
+	m_nCount = 0;
+}
+/// <summary>領域予約</summary>
+/// <param name="count">シグナル数</param>
+/// <remarks>
+/// マトリックスの targetCount/sourceCount で事前に確保し、ラベル受信中の再確保を避ける
+/// </remarks>
+void MatrixLabelTable::Reserve(berint count)
+{
+	if (count <= 0)
+		return;
+	if (count > MATRIX_SIGNAL_TABLE_MAX)
+		count = MATRIX_SIGNAL_TABLE_MAX;
+	if ((size_t)count > m_vSlots.size())
+		m_vSlots.resize((size_t)count, Slot{});
+}
+/// <summary>ラベル取得</summary>
+/// <param name="number"></param>
+/// <param name="sLabel">登録時のみ設定する</param>
+/// <returns>登録有無</returns>
+bool MatrixLabelTable::Get(const berint number, std::string& sLabel) const
+{
+	if ((number >= 0) && ((size_t)number < m_vSlots.size()))
+	{
+		auto& slot = m_vSlots[(size_t)number];
+		if (!slot.bValid)
+			return false;
+		if (!slot.bOverflow)
+		{
+			sLabel.assign(slot.szLabel, slot.nLength);
+			return true;
+		}
+	}
+
+	auto itr = m_mpOverflow.find(number);
+	if (itr == m_mpOverflow.end())
+		return false;
+	sLabel = (*itr).second;
+	return true;
+}
+/// <summary>ラベル設定</summary>
+/// <param name="number"></param>
+/// <param name="pLabel"></param>
+/// <returns>追加または変更があった場合 true</returns>
+bool MatrixLabelTable::Set(const berint number, const char* pLabel)
+{
+	if (!pLabel)
+		pLabel = "";
+	size_t length = strlen(pLabel);
+
+	// 索引範囲外は枠を使用しない
+	if ((number < 0) || (number >= MATRIX_SIGNAL_TABLE_MAX))
+	{
+		auto itr = m_mpOverflow.find(number);
+		if (itr != m_mpOverflow.end())
+		{
+			if ((*itr).second == pLabel)
+				return false;
+			(*itr).second = pLabel;
+			return true;
+		}
+		m_mpOverflow.emplace(number, std::string(pLabel));
+		++m_nCount;
+		return true;
+	}
+
+	if ((size_t)number >= m_vSlots.size())
+		m_vSlots.resize((size_t)number + 1, Slot{});
+	auto& slot = m_vSlots[(size_t)number];
+	if (length < MATRIX_LABEL_SLOT_LENGTH)
+	{
+		if (slot.bValid && !slot.bOverflow
+		 && (slot.nLength == length) && !memcmp(slot.szLabel, pLabel, length))
+			return false;
+		if (slot.bOverflow)
+			m_mpOverflow.erase(number);
+		memcpy(slot.szLabel, pLabel, length);
+		slot.szLabel[length] = '\0';
+		slot.nLength = (unsigned char)length;
+		slot.bOverflow = false;
+	}
+	else
+	{
+		if (slot.bValid && slot.bOverflow)
+		{
+			auto itr = m_mpOverflow.find(number);
+			if ((itr != m_mpOverflow.end()) && ((*itr).second == pLabel))
+				return false;
+		}
+		m_mpOverflow[number] = pLabel;
+		slot.szLabel[0] = '\0';
+		slot.nLength = 0;
+		slot.bOverflow = true;
+	}
+	if (!slot.bValid)
+	{
+		slot.bValid = true;
+		++m_nCount;
+	}
+	return true;
+}
+
+
 // ====================================================================
 /// <summary>
 /// コンストラクタ
@@ -41,11 +154,11 @@ void MatrixLabels::Initialize()
 
 	memset(m_aTargetsLabelNodePath, 0, sizeof(m_aTargetsLabelNodePath));
 	m_nTargetsLabelNodePathLength = 0;
-	m_mpTargetLabels.clear();
+	m_aTargetLabels.Clear();
 
 	memset(m_aSourcesLabelNodePath, 0, sizeof(m_aSourcesLabelNodePath));
 	m_nSourcesLabelNodePathLength = 0;
-	m_mpSourceLabels.clear();
+	m_aSourceLabels.Clear();
 
 	m_bInitialized = true;
 }
@@ -114,111 +227,90 @@ void MatrixLabels::Initialize(Element* pRoot, const EmberContent* pContent)
 		return;
 	}
 
+	// 信号数分の枠を先に確保
+	m_aTargetLabels.Reserve(pMatrix->targetCount);
+	m_aSourceLabels.Reserve(pMatrix->sourceCount);
+
 	// 対象エレメント抽出
 	// マトリックスとパラメータの受信順によってはこの段階で取れない可能性あり
-	try
-	{
-		auto pTargetsLabelNodeElement = element_findDescendant(pRoot, m_aTargetsLabelNodePath, m_nTargetsLabelNodePathLength, NULL);
-		if (pTargetsLabelNodeElement)
-		{
-			// 子供のパラメータをすべて保持する
-			for (auto pNode = pTargetsLabelNodeElement->children.pHead; pNode != NULL; pNode = pNode->pNext)
-			{
-				auto pChild = (Element*)pNode->value;
-				if (!pChild
-				 || ((pChild->type != GlowElementType_Node) && (pChild->type != GlowElementType_Parameter)))
-					continue;
+	CollectLabels(pRoot, m_aTargetsLabelNodePath, m_nTargetsLabelNodePathLength, m_aTargetLabels);
+	CollectLabels(pRoot, m_aSourcesLabelNodePath, m_nSourcesLabelNodePathLength, m_aSourceLabels);
 
-				berint nNumber = pChild->number;
-				std::string sValue = std::string(pChild->glow.nodeId.pIdentifier);
+	m_bInitialized = true;
+}
 
-				if ((pChild->type == GlowElementType_Parameter)
-				 //&& (pChild->glow.parameter.type == GlowParameterType_String)	// InterBee用プロバイダでは設定なし
-				 && (pChild->glow.parameter.value.flag == GlowParameterType_String)
-				 && (pChild->glow.parameter.value.choice.pString != nullptr)
-				 && (strlen(pChild->glow.parameter.value.choice.pString) > 0))
-				{
-					sValue = std::string(pChild->glow.parameter.value.choice.pString);
-				}
-				m_mpTargetLabels.insert(std::pair(nNumber, sValue));
-			}
-		}
-	}
-	catch (const std::exception ex)
-	{
-		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
-		m_mpTargetLabels.clear();
-	}
+/// <summary>ラベルノード配下からラベル収集</summary>
+/// <param name="pRoot"></param>
+/// <param name="pPath">ラベルノードパス</param>
+/// <param name="pathLength"></param>
+/// <param name="table">格納先</param>
+/// <remarks>
+/// 呼び出し元でツリー排他を保持すること
+/// </remarks>
+void MatrixLabels::CollectLabels(Element* pRoot, const berint* pPath, int pathLength, MatrixLabelTable& table)
+{
 	try
 	{
-		auto pSourcesLabelNodeElement = element_findDescendant(pRoot, m_aSourcesLabelNodePath, m_nSourcesLabelNodePathLength, NULL);
-		if (pSourcesLabelNodeElement)
+		auto pLabelNodeElement = element_findDescendant(pRoot, pPath, pathLength, NULL);
+		if (pLabelNodeElement)
 		{
 			// 子供のパラメータをすべて保持する
-			for (auto pNode = pSourcesLabelNodeElement->children.pHead; pNode != NULL; pNode = pNode->pNext)
+			for (int index = 0; index < pLabelNodeElement->childrenLength; ++index)
 			{
-				auto pChild = (Element*)pNode->value;
+				auto pChild = pLabelNodeElement->ppChildren[index];
 				if (!pChild
 				 || ((pChild->type != GlowElementType_Node) && (pChild->type != GlowElementType_Parameter)))
 					continue;
 
-				berint nNumber = pChild->number;
-				std::string sValue = std::string(pChild->glow.nodeId.pIdentifier);
-
+				const char* pValue = pChild->pIdentifier;
 				if ((pChild->type == GlowElementType_Parameter)
-				 //&& (pChild->glow.parameter.type == GlowParameterType_String)	// InterBee用プロバイダでは設定なし
-				 && (pChild->glow.parameter.value.flag == GlowParameterType_String)
-				 && (pChild->glow.parameter.value.choice.pString != nullptr)
-				 && (strlen(pChild->glow.parameter.value.choice.pString) > 0))
+				 //&& (pChild->glow.pParameter->type == GlowParameterType_String)	// InterBee用プロバイダでは設定なし
+				 && (pChild->glow.pParameter->value.flag == GlowParameterType_String)
+				 && (pChild->glow.pParameter->value.choice.pString != nullptr)
+				 && (strlen(pChild->glow.pParameter->value.choice.pString) > 0))
 				{
-					sValue = std::string(pChild->glow.parameter.value.choice.pString);
+					pValue = pChild->glow.pParameter->value.choice.pString;
 				}
-				m_mpSourceLabels.insert(std::pair(nNumber, sValue));
+				table.Set(pChild->number, pValue);
 			}
 		}
 	}
 	catch (const std::exception ex)
 	{
 		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
-		m_mpSourceLabels.clear();
+		table.Clear();
 	}
-
-	m_bInitialized = true;
 }
 
-/// <summary>ラベル取得</summary>
-/// <param name="map">参照マップ</param>
-/// <param name="number"></param>
-/// <param name="sLabel"></param>
-/// <returns></returns>
-bool MatrixLabels::GetLabel(const std::unordered_map<berint, std::string>& map, const berint number, std::string& sLabel)
+/// <summary>再確認対象パス取得</summary>
+/// <param name="stPaths"></param>
+void MatrixLabels::GetNodePaths(std::set<std::vector<berint>>& stPaths)
 {
-	sLabel = "";
-	bool res = Enabled();
-	if (res)
-	{
-		auto itr = map.find(number);
-		if (itr != map.end())
-			sLabel = (*itr).second;
-	}
-	return res;
+	if (!Valid())
+		return;
+
+	if (m_nMatrixNodePathLength > 0)
+		stPaths.insert(std::vector<berint>(m_aMatrixNodePath, m_aMatrixNodePath + m_nMatrixNodePathLength));
+	stPaths.insert(std::vector<berint>(m_aTargetsLabelNodePath, m_aTargetsLabelNodePath + m_nTargetsLabelNodePathLength));
+	stPaths.insert(std::vector<berint>(m_aSourcesLabelNodePath, m_aSourcesLabelNodePath + m_nSourcesLabelNodePathLength));
 }
+
 /// <summary>ラベル設定</summary>
 /// <param name="pContent"></param>
-/// <returns></returns>
+/// <returns>変更のあった側（MATRIX_LABEL_TARGET / MATRIX_LABEL_SOURCE の和）、変更なしは 0</returns>
 /// <remarks>
 /// パラメータ取得時のラベル文字列更新
 /// </remarks>
-bool MatrixLabels::SetLabel(const EmberContent* pContent)
+int MatrixLabels::SetLabel(const EmberContent* pContent)
 {
-	bool bUpdate = false;
+	int nUpdate = 0;
 	if (!Valid()
 	 || !pContent
 	 || !pContent->pPath
 	 || !utilities::IsRange(pContent->pathLength, 1, GLOW_MAX_TREE_DEPTH - 1)
 	 || ((pContent->type != GlowType_Node)
 	  && (pContent->type != GlowType_Parameter)))
-		return bUpdate;
+		return nUpdate;
 
 	// 既存情報にあれば更新、なければ追加
 	try
@@ -228,36 +320,15 @@ bool MatrixLabels::SetLabel(const EmberContent* pContent)
 		 && !memcmp(pContent->pPath, m_aTargetsLabelNodePath, m_nTargetsLabelNodePathLength * sizeof(berint)))
 		{
 			auto nNumber = pContent->pPath[m_nTargetsLabelNodePathLength];
-			auto sValue = std::string(pContent->nodeId.pIdentifier);
+			const char* pValue = pContent->nodeId.pIdentifier;
 			if ((pContent->type == GlowType_Parameter)
 			 //&& (pContent->parameter.type == GlowParameterType_String)	// InterBee用プロバイダでは設定なし
 			 && (pContent->parameter.value.flag == GlowParameterType_String)
 			 && (pContent->parameter.value.choice.pString != nullptr)
 			 && (strlen(pContent->parameter.value.choice.pString) > 0))
-				sValue = std::string(pContent->parameter.value.choice.pString);
-			// 既存情報があれば文字列取得ではなくイテレータを探す
-			bool bHold = false;
-			if (!m_mpTargetLabels.empty())
-			{
-				// あれば更新
-				auto itr = m_mpTargetLabels.find(nNumber);
-				if (itr != m_mpTargetLabels.end())
-				{
-					bHold = true;
-
-					if ((*itr).second != sValue)
-					{
-						(*itr).second = sValue;
-						bUpdate;
-					}
-				}
-			}
-			// なければ追加
-			if (!bHold)
-			{
-				m_mpTargetLabels.insert(std::pair(nNumber, sValue));
-				bUpdate = bHold = true;
-			}
+				pValue = pContent->parameter.value.choice.pString;
+			if (m_aTargetLabels.Set(nNumber, pValue))
+				nUpdate |= MATRIX_LABEL_TARGET;
 		}
 	}
 	catch (const std::exception ex)
@@ -271,36 +342,15 @@ bool MatrixLabels::SetLabel(const EmberContent* pContent)
 		 && !memcmp(pContent->pPath, m_aSourcesLabelNodePath, m_nSourcesLabelNodePathLength * sizeof(berint)))
 		{
 			auto nNumber = pContent->pPath[m_nSourcesLabelNodePathLength];
-			auto sValue = std::string(pContent->nodeId.pIdentifier);
+			const char* pValue = pContent->nodeId.pIdentifier;
 			if ((pContent->type == GlowType_Parameter)
 			 //&& (pContent->parameter.type == GlowParameterType_String)	// InterBee用プロバイダでは設定なし
 			 && (pContent->parameter.value.flag == GlowParameterType_String)
 			 && (pContent->parameter.value.choice.pString != nullptr)
 			 && (strlen(pContent->parameter.value.choice.pString) > 0))
-			sValue = std::string(pContent->parameter.value.choice.pString);
-			// 既存情報があれば文字列取得ではなくイテレータを探す
-			bool bHold = false;
-			if (!m_mpSourceLabels.empty())
-			{
-				// あれば更新
-				auto itr = m_mpSourceLabels.find(nNumber);
-				if (itr != m_mpSourceLabels.end())
-				{
-					bHold = true;
-
-					if ((*itr).second != sValue)
-					{
-						(*itr).second = sValue;
-						bUpdate;
-					}
-				}
-			}
-			// なければ追加
-			if (!bHold)
-			{
-				m_mpSourceLabels.insert(std::pair(nNumber, sValue));
-				bUpdate = bHold = true;
-			}
+				pValue = pContent->parameter.value.choice.pString;
+			if (m_aSourceLabels.Set(nNumber, pValue))
+				nUpdate |= MATRIX_LABEL_SOURCE;
 		}
 	}
 	catch (const std::exception ex)
@@ -308,7 +358,7 @@ bool MatrixLabels::SetLabel(const EmberContent* pContent)
 		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
 	}
 
-	return bUpdate;
+	return nUpdate;
 }
 
 
@@ -390,6 +440,13 @@ CEmberConsumer::~CEmberConsumer()
 
 		m_ptWatcher.reset();
 	}
+
+	if (m_pReplaySession)
+	{
+		releaseReplaySession(m_pReplaySession);
+		m_pReplaySession = nullptr;
+	}
+	releaseEmberTreeLock(&m_sRemoteContent);
 }
 
 /// <summary>
@@ -398,6 +455,7 @@ CEmberConsumer::~CEmberConsumer()
 void CEmberConsumer::Initialize()
 {
 	memset(&m_sRemoteContent, 0, sizeof(RemoteContent));
+	createEmberTreeLock(&m_sRemoteContent);
 	m_sRemoteContent.id = (short)((ClientSocketId)-1);
 	m_bHasEmberRoot = false;
 	m_nLastConsumerRequestId = 0;
@@ -410,18 +468,54 @@ void CEmberConsumer::Initialize()
 	if (!m_qSendMessage.empty())
 		m_qSendMessage.clear();
 	m_nMatrixNoticeCount = 0;
+	if (!m_vSalvos.empty())
+		m_vSalvos.clear();
+	m_nLastSalvoSerial = 0;
+	m_dLastSalvoMilliseconds = -1.0;
 	m_sLastNotifyMatrixPath = "";
+	memset(m_aLastNotifyMatrixPath, 0, sizeof(m_aLastNotifyMatrixPath));
+	m_nLastNotifyMatrixPathLength = 0;
 	if (!m_vMatrixLabels.empty())
 		m_vMatrixLabels.clear();
+	if (!m_mpMatrixLabelsHandles.empty())
+		m_mpMatrixLabelsHandles.clear();
+	if (!m_vMatrixChanges.empty())
+		m_vMatrixChanges.clear();
+	m_bMatrixChangesLost = false;
 	m_bUseMatrixLabels = false;
+	m_sSnapshotPath = "";
+	m_pReplaySession = nullptr;
+	if (!m_stUsedPaths.empty())
+		m_stUsedPaths.clear();
+	m_dLastRevalidateMilliseconds = -1.0;
+	for (auto& stPaths : m_aSubscriptionPaths)
+	{
+		if (!stPaths.empty())
+			stPaths.clear();
+	}
+	if (!m_mpSubscriptionRefs.empty())
+		m_mpSubscriptionRefs.clear();
+	if (!m_stSubscribed.empty())
+		m_stSubscribed.clear();
+	m_nUnresolvedSubscriptions = 0;
+	m_bSubscriptionsPending = false;
+	if (!m_mpDispatchPaths.empty())
+		m_mpDispatchPaths.clear();
+	if (!m_stDispatched.empty())
+		m_stDispatched.clear();
+	if (!m_stWatchedParameterPaths.empty())
+		m_stWatchedParameterPaths.clear();
+	if (!m_stWatchDispatched.empty())
+		m_stWatchDispatched.clear();
+	m_nUnresolvedDispatch = 0;
+	m_bDispatchPending = false;
+	m_bDispatchClear = false;
 	m_ptWorker.reset();
 	m_ptWatcher.reset();
 	m_pClientConfig = nullptr;
 	m_bCancelRequest = false;
 	m_bInitialized = false;
 	m_bUpdateDetected = false;
-	
-	start = end = 0;
 }
 /// <summary>
 /// メンバ初期化
@@ -442,18 +536,35 @@ void CEmberConsumer::Initialize(const ClientSocketId socketId)
 				     : m_pClientConfig->CreateNmosEmberSocket(m_sRemoteContent.hSocket, m_sRemoteContent.remoteAddr);
 			if (!res && (m_sRemoteContent.hSocket != 0))
 				m_sRemoteContent.hSocket = 0;
+			// 副接続先（設定時のみ、主接続先へ接続できない場合に切り替える）
+			if (socketId == ClientSocketId::SOCK_MV_EMBER)
+				m_pClientConfig->CreateMvEmberSecondaryAddress(m_sRemoteContent.secondaryAddr);
+			else
+				m_pClientConfig->CreateNmosEmberSecondaryAddress(m_sRemoteContent.secondaryAddr);
 
 			m_sRemoteContent.reconnectDelay = m_pClientConfig->SocketReconnectDelay();
+			m_sRemoteContent.connectTimeout = m_pClientConfig->SocketConnectTimeout();
+			m_sRemoteContent.keepAliveInterval = m_pClientConfig->EmberKeepAliveInterval();
+			m_sRemoteContent.keepAliveTimeout = m_pClientConfig->EmberKeepAliveTimeout();
 			m_sRemoteContent.threadDelay = m_pClientConfig->EmberThreadDelay();
 
 			m_bUseMatrixLabels = (socketId == ClientSocketId::SOCK_MV_EMBER)
 							   ? m_pClientConfig->MvEmberUseMatrixLabels()
 							   : m_pClientConfig->NmosEmberUseMatrixLabels();
+
+			m_sSnapshotPath = (socketId == ClientSocketId::SOCK_MV_EMBER)
+							? m_pClientConfig->MvEmberSnapshotPath()
+							: m_pClientConfig->NmosEmberSnapshotPath();
+			m_sRemoteContent.pSnapshotPath = m_sSnapshotPath.empty() ? NULL : m_sSnapshotPath.c_str();
 		}
 
 		m_nMatrixNoticeCount = 0;
 		m_sLastNotifyMatrixPath = "";
+		m_nLastNotifyMatrixPathLength = 0;
 		m_vMatrixLabels.clear();
+		m_mpMatrixLabelsHandles.clear();
+		m_vMatrixChanges.clear();
+		m_bMatrixChangesLost = false;
 
 		m_bInitialized = true;
 
@@ -469,13 +580,6 @@ void CEmberConsumer::Initialize(const ClientSocketId socketId)
 	}
 }
 
-//デバッグ用時間計測
-void CEmberConsumer::ProcessTimeDisp()
-{
-	std::cout << "duration = " << (double)(end - start) << " msec" << std::endl;
-	start = end = 0;
-}
-
 ///// <summary></summary>
 ///// <param name="mtx"></param>
 ///// <returns></returns>
@@ -500,49 +604,51 @@ bool CEmberConsumer::IsCancelRequest()
 	return m_bCancelRequest;
 }
 
-/// <summary>コンシューマ操作要求追加</summary>
+/// <summary>接続ソース取得</summary>
 /// <param name="nDestConnSignal"></param>
 /// <param name="vSrcs"></param>
 /// <returns></returns>
 int CEmberConsumer::GetSignalValue(int nDestConnSignal, std::vector<int>& vSrcs)
+{
+	return GetSignalValues(nDestConnSignal, 1, vSrcs);
+}
+/// <summary>接続ソース一括取得</summary>
+/// <param name="nDestConnSignal"></param>
+/// <param name="nSignalCount"></param>
+/// <param name="vSrcs"></param>
+/// <returns></returns>
+int CEmberConsumer::GetSignalValues(int nDestConnSignal, int nSignalCount, std::vector<int>& vSrcs)
 {
 	int cnt = 0;
 	vSrcs.clear();
 	// 確認するパスは最後に接続情報を受信したマトリックス
-	if (m_sLastNotifyMatrixPath.empty() || (nDestConnSignal < 0))
+	if ((m_nLastNotifyMatrixPathLength <= 0) || (nDestConnSignal < 0) || (nSignalCount <= 0))
 		return cnt;
-	berint* pPath = nullptr;
-	int len = (int)GetNodePath(m_sLastNotifyMatrixPath, &pPath);
-	if (len <= 0)
+	if (!m_sRemoteContent.pTopNode)
 		return cnt;
 
-	Element* pElement = nullptr;
-	GlowConnection* pConnection = nullptr;
-	berint* pSrcs = nullptr;
-
 	try
 	{
 		// 対象エレメント抽出
-		pElement = element_findDescendant(m_sRemoteContent.pTopNode, pPath, len, NULL);
+		EmberTreeLock treeLock(m_sRemoteContent);
+		Element* pElement = element_findDescendant(m_sRemoteContent.pTopNode, m_aLastNotifyMatrixPath, m_nLastNotifyMatrixPathLength, NULL);
 		if (!pElement)
 			return cnt;
 		// マトリックス以外は何もしない
 		if (pElement->type != GlowElementType_Matrix)
 			return cnt;
 
-		Target* pTarget = nullptr;
-		PtrListNode* pNode;
-		for (pNode = pElement->glow.matrix.targets.pHead; pNode && !pTarget; pNode = pNode->pNext)
-		{
-			auto _pTarget = (Target*)(pNode->value);
-			if (_pTarget->number == nDestConnSignal)
-				pTarget = _pTarget;
-		}
-		if (pTarget && (pTarget->connectedSourcesCount > 0))
+		// 接続表からターゲット範囲分を一括取得、バッファ不足時のみ拡張して取り直す
+		int len = element_getConnectedSources(pElement, nDestConnSignal, nSignalCount,
+											  m_vConnectedSources.data(), (int)m_vConnectedSources.size());
+		if (len > (int)m_vConnectedSources.size())
 		{
-			for (int i = 0; i < pTarget->connectedSourcesCount; ++i)
-				vSrcs.push_back(pTarget->pConnectedSources[i]);
+			m_vConnectedSources.resize(len);
+			len = element_getConnectedSources(pElement, nDestConnSignal, nSignalCount,
+											  m_vConnectedSources.data(), (int)m_vConnectedSources.size());
 		}
+		if (len > 0)
+			vSrcs.assign(m_vConnectedSources.begin(), m_vConnectedSources.begin() + std::min<int>(len, (int)m_vConnectedSources.size()));
 
 		cnt = (int)vSrcs.size();
 	}
@@ -550,41 +656,11 @@ int CEmberConsumer::GetSignalValue(int nDestConnSignal, std::vector<int>& vSrcs)
 	{
 		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
 		vSrcs.clear();
+		cnt = 0;
 	}
 
 	return cnt;
 }
-/// <summary>コンシューマ操作要求追加</summary>
-/// <param name="nDestConnSignal"></param>
-/// <param name="nSignalCount"></param>
-/// <param name="vSrcs"></param>
-/// <returns></returns>
-int CEmberConsumer::GetSignalValues(int nDestConnSignal, int nSignalCount, std::vector<int>& vSrcs)
-{
-	vSrcs.clear();
-	if (nSignalCount <= 0)
-		return 0;
-
-	for (int i = 0; i < nSignalCount; ++i)
-	{
-		try
-		{
-			std::vector<int> _vSrcs{};
-			int _cnt = GetSignalValue(nDestConnSignal + i, _vSrcs);
-			if (_cnt > 0 && !_vSrcs.empty())
-			{
-				vSrcs.insert(vSrcs.end(), _vSrcs.begin(), _vSrcs.end());
-			}
-		}
-		catch (const std::exception ex)
-		{
-			ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
-			vSrcs.clear();
-		}
-	}
-
-	return (int)vSrcs.size();
-}
 
 /// <summary>
 /// コンシューマ操作要求識別発行
@@ -606,7 +682,11 @@ int CEmberConsumer::AddConsumerRequest(EmberContent* pRequest)
 {
 	int id = 0;
 	if (IsCancelRequest() || !pRequest)
+	{
+		// 所有は受け取っているため破棄
+		releaseEmberContent(pRequest);
 		return id;
+	}
 
 	auto lock = _Lock(m_mtxConsumerRequest);
 	// 識別を付番した上でキューに追加
@@ -655,13 +735,16 @@ int CEmberConsumer::AddConsumerRequest(RequestId* pId, std::string sPath, std::s
 	int id = 0;
 	if (!m_sRemoteContent.pTopNode)
 		return id;
-	berint* pPath = nullptr;
-	int len = (int)GetNodePath(sPath, &pPath);
+	EmberPathPtr pPath;
+	int len = (int)GetNodePath(sPath, pPath);
 	if (len <= 0)
 		return id;
 
 	std::string _sValue = sValue;
-	Element* pElement = nullptr;
+	GlowElementType elementType = GlowElementType_Node;
+	GlowParameterType valueType = GlowParameterType_None;
+	bool hasArgument = false;
+	GlowParameterType argumentType = GlowParameterType_None;
 	GlowValue* pValue = nullptr;
 	GlowParameter* pParameter = nullptr;
 	GlowConnection* pConnection = nullptr;
@@ -670,24 +753,39 @@ int CEmberConsumer::AddConsumerRequest(RequestId* pId, std::string sPath, std::s
 	try
 	{
 		// 対象エレメント抽出
-		pElement = element_findDescendant(m_sRemoteContent.pTopNode, pPath, len, NULL);
-		if (!pElement)
-			return id;
+		// 要求の追加は他の排他を取得するため、必要な属性のみ控えてツリー排他を解放する
+		{
+			EmberTreeLock treeLock(m_sRemoteContent);
+			Element* pElement = element_findDescendant(m_sRemoteContent.pTopNode, pPath.get(), len, NULL);
+			if (!pElement)
+				return id;
+			elementType = pElement->type;
+			if (elementType == GlowElementType_Parameter)
+				valueType = pElement->glow.pParameter->value.flag;
+			else if ((elementType == GlowElementType_Function)
+				  && (pElement->glow.pFunction->argumentsLength > 0) && (pElement->glow.pFunction->pArguments != nullptr))
+			{
+				hasArgument = true;
+				argumentType = pElement->glow.pFunction->pArguments->type;
+			}
+		}
+		// 再接続後の再確認対象として控える
+		AddUsedPath(pPath.get(), len);
 
 		// タイプ別
 #ifdef _MSC_VER
 #pragma warning(push)
 #pragma warning(disable:26812)
 #endif
-		switch (pElement->type)
+		switch (elementType)
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
 		{
 		case GlowElementType_Parameter:
 		{
-			Trace(__FILE__, __LINE__, __FUNCTION__, "type = %d\n", pElement->glow.parameter.value.flag);
-			//pValue = CreateGlowValue(pElement->glow.parameter.value.flag, _sValue);
+			Trace(__FILE__, __LINE__, __FUNCTION__, "type = %d\n", valueType);
+			//pValue = CreateGlowValue(pElement->glow.pParameter->value.flag, _sValue);
 			if (Type == GlowParameterType::GlowParameterType_Real)
 				pValue = CreateGlowValue(GlowParameterType::GlowParameterType_Real, _sValue);
 			else
@@ -697,8 +795,9 @@ int CEmberConsumer::AddConsumerRequest(RequestId* pId, std::string sPath, std::s
 				pParameter = newobj(GlowParameter);
 				bzero_item(*pParameter);
 				glowValue_copyFrom(&pParameter->value, pValue);
-				id = AddConsumerRequest(CreateSetParameterRequest(pId, pPath, len, *pParameter));
+				id = AddConsumerRequest(CreateSetParameterRequest(pId, pPath.get(), len, *pParameter));
 				glowParameter_free(pParameter);		// CreateSetParameterRequest で EmberContent 上の parameter にコピーしたのでこの時点で用無し
+				freeMemory(pParameter);
 				pParameter = nullptr;
 
 				freeMemory(pValue);
@@ -715,14 +814,14 @@ int CEmberConsumer::AddConsumerRequest(RequestId* pId, std::string sPath, std::s
 		case GlowElementType_Function:
 		{
 			// Value が必要か
-			if ((pElement->glow.function.argumentsLength > 0) && (pElement->glow.function.pArguments != nullptr))
+			if (hasArgument)
 			{
 				// 1つのみ対応
 #ifdef _MSC_VER
 #pragma warning(push)
 #pragma warning(disable:26812)
 #endif
-				pValue = CreateGlowValue(pElement->glow.function.pArguments->type, _sValue);
+				pValue = CreateGlowValue(argumentType, _sValue);
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
@@ -735,9 +834,10 @@ int CEmberConsumer::AddConsumerRequest(RequestId* pId, std::string sPath, std::s
 				pInvocation->pArguments = pValue;	// Invocation 上の pArguments は GlowValue のアドレス
 				pInvocation->argumentsLength = 1;
 			}
-			id = AddConsumerRequest(CreateInvokeRequest(pId, pPath, len, *pInvocation));
+			id = AddConsumerRequest(CreateInvokeRequest(pId, pPath.get(), len, *pInvocation));
 			glowInvocation_free(pInvocation);		// CreateSetParameterRequest で EmberContent 上の invocation にコピーしたのでこの時点で用無し
 													// この時 pArguments も別インスタンスにコピーしている
+			freeMemory(pInvocation);
 #if false
 			if (pValue)
 			{
@@ -757,11 +857,20 @@ int CEmberConsumer::AddConsumerRequest(RequestId* pId, std::string sPath, std::s
 	try
 	{
 		if (pParameter)
+		{
 			glowParameter_free(pParameter);
+			freeMemory(pParameter);
+		}
 		if (pConnection)
+		{
 			glowConnection_free(pConnection);
+			freeMemory(pConnection);
+		}
 		if (pInvocation)
+		{
 			glowInvocation_free(pInvocation);
+			freeMemory(pInvocation);
+		}
 #if false
 		if (pValue)
 			glowValue_free(pValue);
@@ -790,149 +899,654 @@ int CEmberConsumer::AddConsumerRequest(RequestId* pId, std::string sPath, int nD
 		return id;
 	if (!m_sRemoteContent.pTopNode)
 		return id;
-	berint* pPath = nullptr;
-	int len = (int)GetNodePath(sPath, &pPath);
+	EmberPathPtr pPath;
+	int len = (int)GetNodePath(sPath, pPath);
 	if (len <= 0)
 		return id;
 
-	Element* pElement = nullptr;
-	GlowConnection* pConnection = nullptr;
-	berint* pSrcs = nullptr;
+	GlowMatrixType matrixType = GlowMatrixType_OneToN;
+	int nSourceCount = 0;
 
 	try
 	{
 		// 対象エレメント抽出
-		pElement = element_findDescendant(m_sRemoteContent.pTopNode, pPath, len, NULL);
-		if (!pElement)
-			return id;
+		// 要求の追加は他の排他を取得するため、必要な属性のみ控えてツリー排他を解放する
+		{
+			EmberTreeLock treeLock(m_sRemoteContent);
+			Element* pElement = element_findDescendant(m_sRemoteContent.pTopNode, pPath.get(), len, NULL);
+			if (!pElement)
+				return id;
+			if (pElement->type == GlowElementType_Matrix)
+			{
+				matrixType = pElement->glow.pMatrix->matrix.type;
+				nSourceCount = pElement->glow.pMatrix->matrix.sourceCount;
+			}
+			else
+				nSourceCount = -1;
+		}
+		// 再接続後の再確認対象として控える
+		AddUsedPath(pPath.get(), len);
 		// マトリックス以外は何もしない
-		if (pElement->type != GlowElementType_Matrix)
+		if (nSourceCount < 0)
 			return id;
 
-		// 切断は考慮しない
-		pConnection = newobj(GlowConnection);
-		bzero_item(*pConnection);
-		int nSrcCount = std::max(nSrcConnCount, pElement->glow.matrix.matrix.sourceCount);
-		pSrcs = newarr(berint, nSrcCount);
-		memset(pSrcs, 0, sizeof(berint) * nSrcCount);
-		pConnection->pSources = pSrcs;
-
 		// コネクション情報を生成する
 		// 当該用件では OneToN のみ運用と思われるが
 		// 定義されている MatrixType を考慮しておく
+		// 同一マトリックスへの接続はサルボとして 1要求にまとめる
+		int nSrcCount = std::max(nSrcConnCount, nSourceCount);
+		std::vector<berint> vSrcs(nSrcCount, 0);
+		std::vector<GlowConnection> vConnections{};
+		GlowConnection connection{};
+		bzero_item(connection);
+		// 切断は考慮しない
 #ifdef _MSC_VER
 #pragma warning(push)
 #pragma warning(disable:26812)
 #endif
-		pConnection->operation = GlowConnectionOperation_Connect;
+		connection.operation = GlowConnectionOperation_Connect;
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
-		switch (pElement->glow.matrix.matrix.type)
+		switch (matrixType)
 		{
 		case GlowMatrixType_OneToN:
 		case GlowMatrixType_OneToOne:
 			{
 				int cnt = std::min(nDestConnCount, nSrcConnCount);
-				pConnection->sourcesLength = 1;
+				for (int i = 0; i < cnt; ++i)
+					vSrcs[i] = (berint)(nSrcConnSignal + i);
+				connection.sourcesLength = 1;
 				for (int i = 0; i < cnt; ++i)
 				{
-					pConnection->target = (berint)(nDestConnSignal + i);
-					pConnection->pSources[0] = (berint)(nSrcConnSignal + i);
-					id = AddConsumerRequest(CreateConnectionRequest(pId, pPath, len, *pConnection));
+					connection.target = (berint)(nDestConnSignal + i);
+					connection.pSources = &vSrcs[i];
+					vConnections.push_back(connection);
 				}
 			}
 			break;
 		case GlowMatrixType_NToN:	
 			{
 				for (int i = 0; i < nSrcConnCount; ++i)
-					pConnection->pSources[i] = (berint)(nSrcConnSignal + i);
-				pConnection->sourcesLength = nSrcConnCount;
+					vSrcs[i] = (berint)(nSrcConnSignal + i);
+				connection.pSources = vSrcs.data();
+				connection.sourcesLength = nSrcConnCount;
 				for (int i = 0; i < nDestConnCount; ++i)
 				{
-					pConnection->target = (berint)(nDestConnSignal + i);
-					id = AddConsumerRequest(CreateConnectionRequest(pId, pPath, len, *pConnection));
+					connection.target = (berint)(nDestConnSignal + i);
+					vConnections.push_back(connection);
 				}
 			}
 			break;
 		}
+
+		// ソースは要求生成時に複製される
+		id = AddSalvoRequest(pId, pPath.get(), len, vConnections);
 	}
 	catch (const std::exception ex)
 	{
 		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
 	}
 
+	return id;
+}
+/// <summary>サルボ要求追加</summary>
+/// <param name="pId"></param>
+/// <param name="sPath"></param>
+/// <param name="vXpts"></param>
+/// <returns></returns>
+int CEmberConsumer::AddSalvoRequest(RequestId* pId, std::string sPath, const std::vector<std::pair<int, int>>& vXpts)
+{
+	int id = 0;
+	if (vXpts.empty())
+		return id;
+	if (!m_sRemoteContent.pTopNode)
+		return id;
+	berint* pPath = nullptr;
+	int len = (int)GetNodePath(sPath, &pPath);
+	if (len <= 0)
+		return id;
+
 	try
 	{
-		// pSrcs は自身で解放する
-		if (pSrcs)
+		// 対象エレメント抽出
+		bool isMatrix = false;
 		{
-			freeMemory(pSrcs);
-			pSrcs = nullptr;
+			EmberTreeLock treeLock(m_sRemoteContent);
+			Element* pElement = element_findDescendant(m_sRemoteContent.pTopNode, pPath, len, NULL);
+			isMatrix = pElement && (pElement->type == GlowElementType_Matrix);
 		}
-		if (pConnection)
+		// マトリックス以外は何もしない
+		if (isMatrix)
+		{
+			AddUsedPath(pPath, len);
+			std::vector<berint> vSrcs(vXpts.size(), 0);
+			std::vector<GlowConnection> vConnections{};
+			GlowConnection connection{};
+			bzero_item(connection);
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable:26812)
+#endif
+			connection.operation = GlowConnectionOperation_Connect;
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+			connection.sourcesLength = 1;
+			for (size_t i = 0; i < vXpts.size(); ++i)
+			{
+				vSrcs[i] = (berint)vXpts[i].second;
+				connection.target = (berint)vXpts[i].first;
+				connection.pSources = &vSrcs[i];
+				vConnections.push_back(connection);
+			}
+
+			id = AddSalvoRequest(pId, pPath, len, vConnections);
+		}
+	}
+	catch (const std::exception ex)
+	{
+		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
+	}
+
+	freeMemory(pPath);
+	return id;
+}
+/// <summary>サルボ要求追加</summary>
+/// <param name="pId"></param>
+/// <param name="pPath"></param>
+/// <param name="pathLength"></param>
+/// <param name="vConnections"></param>
+/// <returns></returns>
+int CEmberConsumer::AddSalvoRequest(RequestId* pId, berint* pPath, int pathLength, const std::vector<GlowConnection>& vConnections)
+{
+	int id = 0;
+	if (vConnections.empty() || (pathLength <= 0) || (pathLength > GLOW_MAX_TREE_DEPTH))
+		return id;
+
+	EmberContent* pRequest = createEmberSalvoContent(pId, pPath, pathLength, vConnections.data(), (int)vConnections.size());
+	if (!pRequest)
+		return id;
+
+	// 通知が要求追加直後に届いても取りこぼさないよう、先に完了待ちとして控える
+	SalvoStatus salvo{};
+	memcpy(salvo.m_aMatrixPath, pPath, pathLength * sizeof(berint));
+	salvo.m_nMatrixPathLength = pathLength;
+	salvo.m_nConnectionCount = (int)vConnections.size();
+	for (auto& connection : vConnections)
+	{
+		if (connection.pSources && (connection.sourcesLength > 0))
+			salvo.m_mpPendingTargets[connection.target].assign(connection.pSources, connection.pSources + connection.sourcesLength);
+	}
+	salvo.m_tTake = std::chrono::steady_clock::now();
+	{
+		auto lock = _Lock(m_mtxSalvo);
+		salvo.m_nSerial = ++m_nLastSalvoSerial;
+		m_vSalvos.push_back(salvo);
+	}
+
+	id = AddConsumerRequest(pRequest);
+
+	{
+		// 要求追加中に他のサルボの追加・完了で並びが変わるため、控え識別で照合する
+		auto lock = _Lock(m_mtxSalvo);
+		int serial = salvo.m_nSerial;
+		auto itr = std::find_if(m_vSalvos.begin(), m_vSalvos.end(),
+								[serial](const SalvoStatus& s) { return s.m_nSerial == serial; });
+		if (itr != m_vSalvos.end())
+		{
+			if (id > 0)
+				(*itr).m_nRequestId = id;
+			else
+				m_vSalvos.erase(itr);
+		}
+	}
+
+	Trace(__FILE__, __LINE__, __FUNCTION__, "salvo id = %d, connections = %d\n", id, (int)vConnections.size());
+	return id;
+}
+/// <summary>サルボ進捗更新</summary>
+/// <param name="pResult"></param>
+void CEmberConsumer::UpdateSalvoStatus(const EmberContent* pResult)
+{
+	auto lock = _Lock(m_mtxSalvo);
+	if (m_vSalvos.empty())
+		return;
+
+	auto now = std::chrono::steady_clock::now();
+	for (auto itr = m_vSalvos.begin(); itr != m_vSalvos.end(); )
+	{
+		SalvoStatus& salvo = *itr;
+
+		// 接続通知の反映
+		if (pResult
+		 && (pResult->type == GlowType_Connection)
+		 && (pResult->pathLength == salvo.m_nMatrixPathLength)
+		 && (memcmp(pResult->pPath, salvo.m_aMatrixPath, salvo.m_nMatrixPathLength * sizeof(berint)) == 0))
+		{
+			auto target = salvo.m_mpPendingTargets.find(pResult->connection.target);
+			if ((target != salvo.m_mpPendingTargets.end()) && pResult->connection.pSources)
+			{
+				// 要求した全ソースが接続されていれば確認済（一部のみの接続は未確認のまま）
+				const berint* pBegin = pResult->connection.pSources;
+				const berint* pEnd = pBegin + ((pResult->connection.sourcesLength > 0) ? pResult->connection.sourcesLength : 0);
+				bool applied = std::all_of(target->second.begin(), target->second.end(),
+										   [pBegin, pEnd](berint source) { return std::find(pBegin, pEnd, source) != pEnd; });
+				if (applied)
+					salvo.m_mpPendingTargets.erase(target);
+			}
+		}
+
+		double msec = std::chrono::duration<double, std::milli>(now - salvo.m_tTake).count();
+		if (salvo.m_mpPendingTargets.empty())
+		{
+			// 全接続確認、所要時間を控える
+			m_dLastSalvoMilliseconds = msec;
+			Trace(__FILE__, __LINE__, __FUNCTION__, "salvo id = %d completed, connections = %d, take to tally = %.1f msec\n",
+													 salvo.m_nRequestId, salvo.m_nConnectionCount, msec);
+			itr = m_vSalvos.erase(itr);
+		}
+		else if (msec > SALVO_TIMEOUT_MSEC)
+		{
+			ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "salvo id = %d timeout, %d of %d connections unconfirmed\n",
+														   salvo.m_nRequestId, (int)salvo.m_mpPendingTargets.size(), salvo.m_nConnectionCount);
+			itr = m_vSalvos.erase(itr);
+		}
+		else
+			++itr;
+	}
+}
+/// <summary>パラメータ通知処理</summary>
+/// <param name="pResult">パラメータ通知（Client 処理用に所有を移す）</param>
+void CEmberConsumer::ProcessParameterResult(EmberContentPtr& pResult)
+{
+	if (!pResult || (pResult->pathLength <= 0))
+		return;
+
+	pstr pathName = ConvertPath2String(pResult->pPath, pResult->pathLength);
+	if (pathName)
+	{
+		Trace(__FILE__, __LINE__, __FUNCTION__, " parameter path : %s\n", pathName);
+
+		// 監視パラメータの値変化により通知回数更新
+		if (NotifyParameterChange(std::string(pathName)))
+			IncrementMatrixNoticeCount();
+
+		freeMemory(pathName);
+	}
+	AddSendMessage(pResult.release());
+}
+
+/// <summary>コンシューマ操作要求取得</summary>
+/// <returns></returns>
+EmberContent* CEmberConsumer::GetConsumerRequest()
+{
+	EmberContent* pRequest = nullptr;
+	auto lock = _Lock(m_mtxConsumerRequest);
+
+	if (IsCancelRequest() || m_qPreConsumerRequests.empty())
+		return pRequest;
+
+	// 要求前キューの先頭を参照
+	try
+	{
+		pRequest = m_qPreConsumerRequests.front();
+	}
+	catch (const std::exception ex)
+	{
+		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
+		if (pRequest)
+			pRequest = nullptr;
+	}
+	if (!pRequest)
+		return pRequest;
+
+	// 要求キュー末尾に追加
+	try
+	{
+		m_qConsumerRequests.push_back(pRequest);
+	}
+	catch (const std::exception ex)
+	{
+		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
+	}
+
+	// 追加が正しく実施されたか確認
+	bool res = false;
+	if (!m_qConsumerRequests.empty())
+	{
+		EmberContent* addCont = m_qConsumerRequests.back();
+		res = addCont && (addCont->requestId.id == pRequest->requestId.id);
+	}
+	// 要求前キューから先頭を除去
+	if (res)
+		m_qPreConsumerRequests.pop_front();
+	else if (pRequest)
+		pRequest = nullptr;
+
+	// 結果を伴わない要求が溜まった分は古いものから破棄（送信中の要求は残す）
+	const EmberContent* pInFlight = getInFlightRequest(&m_sRemoteContent);
+	while ((m_qConsumerRequests.size() > CONSUMER_REQUEST_RETAIN_MAX)
+		&& (m_qConsumerRequests.front() != pInFlight))
+	{
+		releaseEmberContent(m_qConsumerRequests.front());
+		m_qConsumerRequests.pop_front();
+	}
+
+	return pRequest;
+}
+/// <summary>使用中エレメントパス登録</summary>
+/// <param name="pPath"></param>
+/// <param name="pathLength"></param>
+void CEmberConsumer::AddUsedPath(const berint* pPath, int pathLength)
+{
+	if (!pPath || (pathLength <= 0))
+		return;
+
+	auto lock = _Lock(m_mtxUsedPaths);
+	try
+	{
+		m_stUsedPaths.emplace(pPath, pPath + pathLength);
+	}
+	catch (const std::exception ex)
+	{
+		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
+	}
+}
+/// <summary>保持ツリー再確認要求</summary>
+/// <returns>要求数</returns>
+int CEmberConsumer::RevalidateUsedPaths()
+{
+	int count = 0;
+	std::set<std::vector<berint>> stPaths{};
+
+	try
+	{
+		{
+			auto lock = _Lock(m_mtxUsedPaths);
+			stPaths = m_stUsedPaths;
+		}
+		{
+			auto lock = _Lock(m_mtxMatrixNotice);
+			for (auto pMatrixLabels : m_vMatrixLabels)
+			{
+				if (pMatrixLabels)
+					pMatrixLabels->GetNodePaths(stPaths);
+			}
+		}
+
+		// ルート直下で構成変更を確認（既存ノードは重複となり配下へは展開しない）
+		if (AddConsumerRequest(CreateGetDirectoryRequest(nullptr, nullptr, 0)) > 0)
+			++count;
+		for (auto vPath : stPaths)
+		{
+			if (AddConsumerRequest(CreateGetDirectoryRequest(nullptr, vPath.data(), (int)vPath.size())) > 0)
+				++count;
+		}
+	}
+	catch (const std::exception ex)
+	{
+		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
+	}
+
+	return count;
+}
+/// <summary>購読パス設定</summary>
+/// <param name="eOwner">要求元</param>
+/// <param name="stPaths">要求元が参照するパラメータ／マトリックスのパス（前回設定との差分を反映）</param>
+/// <returns>参照中パス数</returns>
+int CEmberConsumer::SetSubscriptions(SubscriptionOwner eOwner, const std::set<std::string>& stPaths)
+{
+	if (!IsRange((int)eOwner, 0, (int)SubscriptionOwner::OWNER_COUNT - 1))
+		return -1;
+
+	auto lock = _Lock(m_mtxSubscriptions);
+	try
+	{
+		auto& stOwned = m_aSubscriptionPaths[(int)eOwner];
+		// 参照を外す
+		for (auto& sPath : stOwned)
+		{
+			if (stPaths.find(sPath) != stPaths.end())
+				continue;
+			auto itr = m_mpSubscriptionRefs.find(sPath);
+			if ((itr != m_mpSubscriptionRefs.end()) && (--(*itr).second <= 0))
+			{
+				m_mpSubscriptionRefs.erase(itr);
+				// Subscribe 済なら Unsubscribe 待ち
+				if (m_stSubscribed.find(sPath) != m_stSubscribed.end())
+					m_bSubscriptionsPending = true;
+			}
+		}
+		// 参照を加える
+		for (auto& sPath : stPaths)
+		{
+			if (sPath.empty() || (stOwned.find(sPath) != stOwned.end()))
+				continue;
+			if (++m_mpSubscriptionRefs[sPath] == 1)
+			{
+				// 参照が外れる前の Subscribe が残っていればそのまま使う
+				if (m_stSubscribed.find(sPath) == m_stSubscribed.end())
+					m_bSubscriptionsPending = true;
+			}
+		}
+		stOwned = stPaths;
+		stOwned.erase(std::string());
+	}
+	catch (const std::exception ex)
+	{
+		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
+	}
+
+	return (int)m_mpSubscriptionRefs.size();
+}
+/// <summary>購読／購読解除要求生成</summary>
+/// <param name="pId"></param>
+/// <param name="sPath"></param>
+/// <param name="bSubscribe">true : Subscribe, false : Unsubscribe</param>
+/// <returns>パス未解決時 nullptr</returns>
+EmberContent* CEmberConsumer::CreateSubscribeRequest(RequestId* pId, std::string sPath, bool bSubscribe)
+{
+	berint* pPath = nullptr;
+	int len = (int)GetNodePath(sPath, &pPath);
+	if (len <= 0)
+		return nullptr;
+	EmberContent* pCont = bSubscribe
+						? createEmberSubscribeContent(pId, pPath, len)
+						: createEmberUnsubscribeContent(pId, pPath, len);
+	freeMemory(pPath);
+	return pCont;
+}
+/// <summary>購読送出待ち有無</summary>
+/// <returns></returns>
+bool CEmberConsumer::HasPendingSubscriptions()
+{
+	auto lock = _Lock(m_mtxSubscriptions);
+	return m_bSubscriptionsPending;
+}
+/// <summary>購読送出</summary>
+/// <returns>要求数</returns>
+int CEmberConsumer::SyncSubscriptions()
+{
+	auto lock = _Lock(m_mtxSubscriptions);
+	int count = 0;
+
+	try
+	{
+		m_bSubscriptionsPending = false;
+
+		// 参照のなくなったパスを解除
+		for (auto itr = m_stSubscribed.begin(); itr != m_stSubscribed.end();)
+		{
+			if (m_mpSubscriptionRefs.find(*itr) != m_mpSubscriptionRefs.end())
+			{
+				++itr;
+				continue;
+			}
+			if (AddConsumerRequest(CreateSubscribeRequest(nullptr, *itr, false)) > 0)
+				++count;
+			itr = m_stSubscribed.erase(itr);
+		}
+		// 未送出のパスを購読
+		m_nUnresolvedSubscriptions = 0;
+		for (auto& pair : m_mpSubscriptionRefs)
+		{
+			if (m_stSubscribed.find(pair.first) != m_stSubscribed.end())
+				continue;
+			if (AddConsumerRequest(CreateSubscribeRequest(nullptr, pair.first, true)) > 0)
+			{
+				m_stSubscribed.insert(pair.first);
+				++count;
+			}
+			else
+				++m_nUnresolvedSubscriptions;
+		}
+	}
+	catch (const std::exception ex)
+	{
+		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
+	}
+
+	if (count > 0)
+		Trace(__FILE__, __LINE__, __FUNCTION__, "subscriptions = %d, requests = %d, unresolved = %d\n", (int)m_stSubscribed.size(), count, m_nUnresolvedSubscriptions);
+	return count;
+}
+/// <summary>購読状態破棄（切断によりプロバイダ側の購読が失われた場合）</summary>
+void CEmberConsumer::ResetSubscriptions()
+{
+	auto lock = _Lock(m_mtxSubscriptions);
+	if (!m_stSubscribed.empty())
+		m_stSubscribed.clear();
+	m_bSubscriptionsPending = !m_mpSubscriptionRefs.empty();
+}
+/// <summary>新規ノード受信による未解決購読の再試行</summary>
+void CEmberConsumer::RetrySubscriptions()
+{
+	auto lock = _Lock(m_mtxSubscriptions);
+	if (m_nUnresolvedSubscriptions > 0)
+		m_bSubscriptionsPending = true;
+}
+/// <summary>パラメータ通知振り分け設定</summary>
+/// <param name="mpPaths">通知を受けるパラメータのパスと振り分け識別（0 以上）</param>
+void CEmberConsumer::SetParameterDispatch(const std::unordered_map<std::string, int>& mpPaths)
+{
+	auto lock = _Lock(m_mtxSubscriptions);
+	try
+	{
+		// 外れたパスまたは識別の変わったパスがあれば全解除から登録し直す
+		for (auto& pair : m_mpDispatchPaths)
 		{
-			// pSrcs は解放済
-			pConnection->pSources = nullptr;
-			glowConnection_free(pConnection);
+			auto itr = mpPaths.find(pair.first);
+			if ((itr == mpPaths.end()) || ((*itr).second != pair.second))
+			{
+				m_bDispatchClear = true;
+				m_stDispatched.clear();
+				m_stWatchDispatched.clear();
+				break;
+			}
 		}
+		m_mpDispatchPaths = mpPaths;
+		m_bDispatchPending = m_bDispatchClear || !m_mpDispatchPaths.empty() || !m_stWatchedParameterPaths.empty();
 	}
 	catch (const std::exception ex)
 	{
 		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
 	}
-
-	return id;
 }
-
-/// <summary>コンシューマ操作要求取得</summary>
+/// <summary>振り分け登録待ち有無</summary>
 /// <returns></returns>
-EmberContent* CEmberConsumer::GetConsumerRequest()
+bool CEmberConsumer::HasPendingParameterDispatch()
 {
-	EmberContent* pRequest = nullptr;
-	auto lock = _Lock(m_mtxConsumerRequest);
-
-	if (IsCancelRequest() || m_qPreConsumerRequests.empty())
-		return pRequest;
+	auto lock = _Lock(m_mtxSubscriptions);
+	return m_bDispatchPending;
+}
+/// <summary>振り分け登録</summary>
+/// <returns>要求数</returns>
+int CEmberConsumer::SyncParameterDispatch()
+{
+	auto lock = _Lock(m_mtxSubscriptions);
+	int count = 0;
 
-	// 要求前キューの先頭を参照
 	try
 	{
-		pRequest = m_qPreConsumerRequests.front();
-	}
-	catch (const std::exception ex)
-	{
-		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
-		if (pRequest)
-			pRequest = nullptr;
-	}
-	if (!pRequest)
-		return pRequest;
+		m_bDispatchPending = false;
 
-	// 要求キュー末尾に追加
-	try
-	{
-		m_qConsumerRequests.push_back(pRequest);
+		if (m_bDispatchClear)
+		{
+			if (AddConsumerRequest(CreateDispatchRequest(nullptr, nullptr, 0, -1)) > 0)
+				++count;
+			m_bDispatchClear = false;
+		}
+		// 未登録のパスを解決して登録
+		m_nUnresolvedDispatch = 0;
+		for (auto& pair : m_mpDispatchPaths)
+		{
+			if (m_stDispatched.find(pair.first) != m_stDispatched.end())
+				continue;
+			berint* pPath = nullptr;
+			int len = (int)GetNodePath(pair.first, &pPath);
+			if ((len > 0) && (AddConsumerRequest(CreateDispatchRequest(nullptr, pPath, len, pair.second)) > 0))
+			{
+				m_stDispatched.insert(pair.first);
+				++count;
+			}
+			else
+				++m_nUnresolvedDispatch;
+			if (pPath)
+				freeMemory(pPath);
+		}
+		// 監視パスも同じ振り分け表へ登録（登録のないパスの通知は Watcher へ渡らない）
+		for (auto& sPath : m_stWatchedParameterPaths)
+		{
+			if (m_stWatchDispatched.find(sPath) != m_stWatchDispatched.end())
+				continue;
+			berint* pPath = nullptr;
+			int len = (int)GetNodePath(sPath, &pPath);
+			if ((len > 0) && (AddConsumerRequest(CreateDispatchRequest(nullptr, pPath, len, DISPATCH_KEY_WATCH)) > 0))
+			{
+				m_stWatchDispatched.insert(sPath);
+				++count;
+			}
+			else
+				++m_nUnresolvedDispatch;
+			if (pPath)
+				freeMemory(pPath);
+		}
 	}
 	catch (const std::exception ex)
 	{
 		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
 	}
 
-	// 追加が正しく実施されたか確認
-	bool res = false;
-	if (!m_qConsumerRequests.empty())
+	if (count > 0)
+		Trace(__FILE__, __LINE__, __FUNCTION__, "dispatch paths = %d, watched = %d, requests = %d, unresolved = %d\n", (int)m_stDispatched.size(), (int)m_stWatchDispatched.size(), count, m_nUnresolvedDispatch);
+	return count;
+}
+/// <summary>振り分け登録破棄（ツリー全再取得により数値パスが変わる場合）</summary>
+void CEmberConsumer::ResetParameterDispatch()
+{
+	auto lock = _Lock(m_mtxSubscriptions);
+	if (!m_stDispatched.empty() || !m_stWatchDispatched.empty())
 	{
-		EmberContent* addCont = m_qConsumerRequests.back();
-		res = addCont && (addCont->requestId.id == pRequest->requestId.id);
+		m_stDispatched.clear();
+		m_stWatchDispatched.clear();
+		m_bDispatchClear = true;
 	}
-	// 要求前キューから先頭を除去
-	if (res)
-		m_qPreConsumerRequests.pop_front();
-	else if (pRequest)
-		pRequest = nullptr;
-
-	return pRequest;
+	m_bDispatchPending = m_bDispatchClear || !m_mpDispatchPaths.empty() || !m_stWatchedParameterPaths.empty();
+}
+/// <summary>新規ノード受信による未解決振り分けの再試行</summary>
+void CEmberConsumer::RetryParameterDispatch()
+{
+	auto lock = _Lock(m_mtxSubscriptions);
+	if (m_nUnresolvedDispatch > 0)
+		m_bDispatchPending = true;
+}
+/// <summary>未送出コンシューマ操作要求有無</summary>
+/// <returns></returns>
+bool CEmberConsumer::HasPreConsumerRequest()
+{
+	auto lock = _Lock(m_mtxConsumerRequest);
+	return !m_qPreConsumerRequests.empty();
 }
 /// <summary>コンシューマ受信通知</summary>
 /// <param name="pResult"></param>
@@ -997,7 +1611,7 @@ EmberContent* CEmberConsumer::GetConsumerResult()
 			m_qConsumerRequests.pop_front();
 
 			// pRequest は自身で生成したもの、破棄
-			freeMemory(pRequest);
+			releaseEmberContent(pRequest);
 		}
 		catch (const std::exception ex)
 		{
@@ -1023,6 +1637,12 @@ void CEmberConsumer::AddSendMessage(EmberContent* pResult)
 		m_qSendMessage.push_back(pResult);
 		//パラメータ更新フラグを通知
 		m_bUpdateDetected = true;
+		// 参照されないまま溜まった分は古いものから破棄
+		while (m_qSendMessage.size() > SEND_MESSAGE_QUEUE_MAX)
+		{
+			releaseEmberContent(m_qSendMessage.front());
+			m_qSendMessage.pop_front();
+		}
 	}
 	catch (const std::exception ex)
 	{
@@ -1073,7 +1693,7 @@ EmberContent* CEmberConsumer::GetSendMessage()
 			m_qConsumerRequests.pop_front();
 
 			// pRequest は自身で生成したもの、破棄
-			freeMemory(pRequest);
+			releaseEmberContent(pRequest);
 		}
 		catch (const std::exception ex)
 		{
@@ -1127,7 +1747,10 @@ size_t CEmberConsumer::GetNodePath(std::string sPath, berint** pPath)
 
 	try
 	{
-		len = convertString2Path(m_sRemoteContent.pTopNode, (pstr)sPath.c_str(), pPath);
+		{
+			EmberTreeLock treeLock(m_sRemoteContent);
+			len = convertString2Path(m_sRemoteContent.pTopNode, (pstr)sPath.c_str(), pPath);
+		}
 		if (pPath && (len > 0))
 		{
 			berint* p = *pPath;
@@ -1157,6 +1780,26 @@ size_t CEmberConsumer::GetNodePath(std::string sPath, berint** pPath)
 
 	return len;
 }
+/// <summary>文字列パス→パス（所有）</summary>
+/// <param name="sPath"></param>
+/// <param name="pPath"></param>
+/// <returns></returns>
+size_t CEmberConsumer::GetNodePath(std::string sPath, EmberPathPtr& pPath)
+{
+	berint* pRaw = nullptr;
+	size_t len = GetNodePath(sPath, &pRaw);
+	pPath.reset(pRaw);
+	return len;
+}
+/// <summary>パス→文字列パス（ツリー排他中に変換）</summary>
+/// <param name="pPath"></param>
+/// <param name="pathLength"></param>
+/// <returns>freeMemory で解放する</returns>
+pstr CEmberConsumer::ConvertPath2String(const berint* pPath, int pathLength)
+{
+	EmberTreeLock treeLock(m_sRemoteContent);
+	return convertPath2String(m_sRemoteContent.pTopNode, pPath, pathLength);
+}
 /// <summary>
 /// コンシューマ要求用データ生成
 /// </summary>
@@ -1210,7 +1853,7 @@ GlowValue* CEmberConsumer::CreateGlowValue(GlowParameterType type, std::string s
 		{
 			if (!sValue.empty())
 			{
-				pValue->choice.pString = stringDup(sValue.c_str());
+				pValue->choice.pString = stringDupTracked(sValue.c_str(), __FILE__, __LINE__);
 			}
 
 			validType = true;
@@ -1220,7 +1863,7 @@ GlowValue* CEmberConsumer::CreateGlowValue(GlowParameterType type, std::string s
 		{
 			if (!sValue.empty())
 			{
-				char* pstr = stringDup(sValue.c_str());
+				char* pstr = stringDupTracked(sValue.c_str(), __FILE__, __LINE__);
 				pValue->choice.octets.pOctets = (byte*)pstr;
 				pValue->choice.octets.length = (int)strlen(pstr);
 			}
@@ -1241,6 +1884,7 @@ GlowValue* CEmberConsumer::CreateGlowValue(GlowParameterType type, std::string s
 	if (!validType && pValue)
 	{
 		glowValue_free(pValue);
+		freeMemory(pValue);
 		pValue = nullptr;
 	}
 
@@ -1351,23 +1995,61 @@ unsigned short CEmberConsumer::IncrementMatrixNoticeCount()
 }
 /// <summary>マトリックスラベル情報初期化</summary>
 /// <returns></returns>
+/// <remarks>
+/// 発行済の参照識別は保持し、ラベル情報のみ破棄する
+/// </remarks>
 bool CEmberConsumer::ClearMatrixLabels()
 {
 	bool res = false;
-	while (!m_vMatrixLabels.empty())
+	for (auto& pMatrixLabels : m_vMatrixLabels)
 	{
-		auto itr = m_vMatrixLabels.begin();
-		auto pMatrixLabels = *itr;
-		m_vMatrixLabels.erase(itr);
-
 		if (!pMatrixLabels)
-			delete pMatrixLabels;
+			continue;
+
+		delete pMatrixLabels;
+		pMatrixLabels = nullptr;
 
 		if (!res)
 			res = true;
 	}
 	return res;
 }
+/// <summary>マトリックスラベル参照識別取得（m_mtxMatrixNotice 取得済で呼び出す）</summary>
+/// <param name="sEmberPath"></param>
+/// <returns></returns>
+MatrixLabelsHandle CEmberConsumer::InternMatrixLabelsHandle(const std::string& sEmberPath)
+{
+	if (sEmberPath.empty())
+		return MATRIX_LABELS_HANDLE_INVALID;
+
+	auto itr = m_mpMatrixLabelsHandles.find(sEmberPath);
+	if (itr != m_mpMatrixLabelsHandles.end())
+		return (*itr).second;
+
+	auto hMatrix = (MatrixLabelsHandle)m_vMatrixLabels.size();
+	m_vMatrixLabels.push_back(nullptr);
+	m_mpMatrixLabelsHandles.emplace(sEmberPath, hMatrix);
+	return hMatrix;
+}
+/// <summary>マトリックスラベル参照識別取得</summary>
+/// <param name="sEmberPath">マトリックスノードパス</param>
+/// <returns>空パス時 MATRIX_LABELS_HANDLE_INVALID</returns>
+MatrixLabelsHandle CEmberConsumer::InternMatrixLabels(const std::string& sEmberPath)
+{
+	auto lock = _Lock(m_mtxMatrixNotice);
+	MatrixLabelsHandle hMatrix = MATRIX_LABELS_HANDLE_INVALID;
+
+	try
+	{
+		hMatrix = InternMatrixLabelsHandle(sEmberPath);
+	}
+	catch (const std::exception ex)
+	{
+		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
+	}
+
+	return hMatrix;
+}
 /// <summary>マトリックスラベル情報リセット</summary>
 /// <returns></returns>
 bool CEmberConsumer::ResetMatrixLabels()
@@ -1378,6 +2060,9 @@ bool CEmberConsumer::ResetMatrixLabels()
 	try
 	{
 		ClearMatrixLabels();
+		// 全マトリックスが対象となるため履歴ではなく全更新を求める
+		m_vMatrixChanges.clear();
+		m_bMatrixChangesLost = true;
 
 		res = true;
 	}
@@ -1406,30 +2091,26 @@ bool CEmberConsumer::ResetMatrixLabels(const EmberContent* pContent)
 		auto lock = _Lock(m_mtxMatrixNotice);
 		try
 		{
-			// 生成
-			auto pMatrixLabels = new MatrixLabels(m_sRemoteContent.pTopNode, pContent);
-			if (!pMatrixLabels->Valid())
-				return res;
-
-			// 既存なら取り除く
-			bool bFirst = true;
-			if (!m_vMatrixLabels.empty())
+			// 生成（ラベル収集中はツリー排他を保持する）
+			MatrixLabels* pMatrixLabels;
 			{
-				auto sPath = pMatrixLabels->MatrixNodePath();
-				auto itr = std::find_if(m_vMatrixLabels.begin(), m_vMatrixLabels.end(),
-										[sPath](MatrixLabels* _pCont)
-										{ return _pCont && _pCont->Enabled() && (_pCont->MatrixNodePath() == sPath); });
-				if (itr != m_vMatrixLabels.end())
-				{
-					auto _pMatrixLabels = *itr;
-					m_vMatrixLabels.erase(itr);
-
-					if (_pMatrixLabels)
-						delete _pMatrixLabels;
-
-					bFirst = false;
-				}
+				EmberTreeLock treeLock(m_sRemoteContent);
+				pMatrixLabels = new MatrixLabels(m_sRemoteContent.pTopNode, pContent);
+			}
+			auto hMatrix = pMatrixLabels->Valid()
+						 ? InternMatrixLabelsHandle(pMatrixLabels->MatrixNodePath())
+						 : MATRIX_LABELS_HANDLE_INVALID;
+			if (hMatrix == MATRIX_LABELS_HANDLE_INVALID)
+			{
+				delete pMatrixLabels;
+				return res;
 			}
+
+			// 既存なら置き換える
+			auto& pSlot = m_vMatrixLabels[hMatrix];
+			bool bFirst = !pSlot || !pSlot->Enabled();
+			if (pSlot)
+				delete pSlot;
 			// 初めてデータを追加する場合、親ノードでの GetDirectory により受信した GlowMatrixで、プロバイダが接続情報を送信しない場合がある
 			// 自ノードから GetDirectory を取得し直す
 			if (bFirst)
@@ -1438,7 +2119,8 @@ bool CEmberConsumer::ResetMatrixLabels(const EmberContent* pContent)
 			}
 
 			// 追加
-			m_vMatrixLabels.push_back(pMatrixLabels);
+			pSlot = pMatrixLabels;
+			PushMatrixChange(MatrixChangeKind::CHANGE_ALL, hMatrix, -1);
 			res = true;
 		}
 		catch (const std::exception ex)
@@ -1455,13 +2137,20 @@ bool CEmberConsumer::ResetMatrixLabels(const EmberContent* pContent)
 		try
 		{
 			// 一致するラベルがある場合、文字列を更新する
-			for (auto pMatrixLabels : m_vMatrixLabels)
+			auto nNumber = pContent->pPath[pContent->pathLength - 1];
+			for (size_t h = 0; h < m_vMatrixLabels.size(); ++h)
 			{
-				if (!pMatrixLabels->Valid())
+				auto pMatrixLabels = m_vMatrixLabels[h];
+				if (!pMatrixLabels || !pMatrixLabels->Valid())
 					continue;
 
-				if (pMatrixLabels->SetLabel(pContent))
+				int nUpdate = pMatrixLabels->SetLabel(pContent);
+				if (nUpdate != 0)
 				{
+					if (nUpdate & MATRIX_LABEL_TARGET)
+						PushMatrixChange(MatrixChangeKind::CHANGE_TARGET_LABEL, (MatrixLabelsHandle)h, nNumber);
+					if (nUpdate & MATRIX_LABEL_SOURCE)
+						PushMatrixChange(MatrixChangeKind::CHANGE_SOURCE_LABEL, (MatrixLabelsHandle)h, nNumber);
 					res = true;
 					// 別々のマトリックスで同じパラメータを参照している可能性があるので break しない
 					//break;
@@ -1476,6 +2165,122 @@ bool CEmberConsumer::ResetMatrixLabels(const EmberContent* pContent)
 
 	return res;
 }
+/// <summary>マトリックス変更履歴追加（m_mtxMatrixNotice 取得済で呼び出す）</summary>
+/// <param name="eKind"></param>
+/// <param name="hMatrix"></param>
+/// <param name="nNumber"></param>
+/// <param name="sPath"></param>
+void CEmberConsumer::PushMatrixChange(MatrixChangeKind eKind, MatrixLabelsHandle hMatrix, berint nNumber, const std::string& sPath)
+{
+	// 欠落中は全更新となるので積まない
+	if (m_bMatrixChangesLost)
+		return;
+	if (m_vMatrixChanges.size() >= MATRIX_CHANGE_JOURNAL_MAX)
+	{
+		m_vMatrixChanges.clear();
+		m_bMatrixChangesLost = true;
+		return;
+	}
+
+	MatrixChange change{};
+	change.m_eKind = eKind;
+	change.m_hMatrix = hMatrix;
+	change.m_nNumber = nNumber;
+	change.m_sPath = sPath;
+	m_vMatrixChanges.push_back(std::move(change));
+}
+/// <summary>接続変更通知</summary>
+/// <param name="sMatrixPath"></param>
+/// <param name="nTarget"></param>
+void CEmberConsumer::NotifyConnectionChange(const std::string& sMatrixPath, berint nTarget)
+{
+	auto lock = _Lock(m_mtxMatrixNotice);
+
+	try
+	{
+		auto hMatrix = InternMatrixLabelsHandle(sMatrixPath);
+		if (hMatrix != MATRIX_LABELS_HANDLE_INVALID)
+			PushMatrixChange(MatrixChangeKind::CHANGE_CONNECTION, hMatrix, nTarget);
+	}
+	catch (const std::exception ex)
+	{
+		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
+		m_bMatrixChangesLost = true;
+	}
+}
+/// <summary>パラメータ変更通知</summary>
+/// <param name="sPath"></param>
+/// <returns>監視対象の場合 true</returns>
+bool CEmberConsumer::NotifyParameterChange(const std::string& sPath)
+{
+	bool res = false;
+
+	try
+	{
+		// 監視から外した直後は振り分け表の登録が残るため、現行の監視パスか確認する
+		{
+			auto lock = _Lock(m_mtxSubscriptions);
+			if (m_stWatchedParameterPaths.find(sPath) == m_stWatchedParameterPaths.end())
+				return res;
+		}
+		auto lock = _Lock(m_mtxMatrixNotice);
+		PushMatrixChange(MatrixChangeKind::CHANGE_PARAMETER, MATRIX_LABELS_HANDLE_INVALID, -1, sPath);
+		res = true;
+	}
+	catch (const std::exception ex)
+	{
+		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
+	}
+
+	return res;
+}
+/// <summary>マトリックス変更履歴取得</summary>
+/// <param name="vChanges">前回取得以降の変更（取得後は履歴から取り除く）</param>
+/// <returns>false : 履歴が欠落しているため全更新が必要</returns>
+bool CEmberConsumer::TakeMatrixChanges(std::vector<MatrixChange>& vChanges)
+{
+	auto lock = _Lock(m_mtxMatrixNotice);
+
+	vChanges.clear();
+	vChanges.swap(m_vMatrixChanges);
+	bool res = !m_bMatrixChangesLost;
+	m_bMatrixChangesLost = false;
+	return res;
+}
+/// <summary>監視パラメータパス設定</summary>
+/// <param name="stPaths">値の変化をマトリックス変更として通知するパラメータ</param>
+/// <remarks>
+/// 監視パスは振り分け表へ登録し、コンシューマが値変化を結果として通知する
+/// 振り分け表は個別に解除できないため、外れたパスがあれば全解除から登録し直す
+/// </remarks>
+void CEmberConsumer::SetWatchedParameterPaths(const std::set<std::string>& stPaths)
+{
+	auto lock = _Lock(m_mtxSubscriptions);
+	try
+	{
+		bool bRemoved = false;
+		for (auto& sPath : m_stWatchDispatched)
+		{
+			if (stPaths.find(sPath) == stPaths.end())
+			{
+				bRemoved = true;
+				break;
+			}
+		}
+		if (bRemoved)
+		{
+			m_bDispatchClear = true;
+			m_stDispatched.clear();
+			m_stWatchDispatched.clear();
+		}
+		m_stWatchedParameterPaths = stPaths;
+		m_bDispatchPending = m_bDispatchClear || !m_mpDispatchPaths.empty() || !m_stWatchedParameterPaths.empty();
+	}
+	catch (const std::exception ex)
+	{
+		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
+	}
+}
 /// <summary>ラベル取得</summary>
 /// <param name="kind">1 : target, 2 : source</param>
 /// <param name="sEmberPath"></param>
@@ -1484,28 +2289,57 @@ bool CEmberConsumer::ResetMatrixLabels(const EmberContent* pContent)
 /// <returns></returns>
 bool CEmberConsumer::GetLabel(int kind, std::string sEmberPath, berint nSignalNumber, std::string& sLabel)
 {
-	sLabel = "";
+	if (!UseMatrixLabels())
+	{
+		sLabel = "";
+		return false;
+	}
+
+	MatrixLabelsHandle hMatrix = MATRIX_LABELS_HANDLE_INVALID;
+	{
+		auto lock = _Lock(m_mtxMatrixNotice);
+		auto itr = m_mpMatrixLabelsHandles.find(sEmberPath);
+		if (itr != m_mpMatrixLabelsHandles.end())
+			hMatrix = (*itr).second;
+	}
+	return GetLabel(kind, hMatrix, nSignalNumber, sLabel);
+}
+/// <summary>ラベル取得</summary>
+/// <param name="kind">1 : target, 2 : source</param>
+/// <param name="hMatrix"></param>
+/// <param name="nSignalNumber"></param>
+/// <param name="sLabel">未取得時は空</param>
+/// <returns></returns>
+bool CEmberConsumer::GetLabel(int kind, MatrixLabelsHandle hMatrix, berint nSignalNumber, std::string& sLabel)
+{
 	bool res = false;
 	// 対象のマトリックスがあるか
-	if (UseMatrixLabels() && !m_vMatrixLabels.empty())
+	if (!UseMatrixLabels()
+	 || (hMatrix == MATRIX_LABELS_HANDLE_INVALID))
+	{
+		sLabel = "";
+		return res;
+	}
+
+	auto lock = _Lock(m_mtxMatrixNotice);
+	if ((hMatrix >= 0) && ((size_t)hMatrix < m_vMatrixLabels.size()))
 	{
-		auto itr = std::find_if(m_vMatrixLabels.cbegin(), m_vMatrixLabels.cend(),
-								[sEmberPath](MatrixLabels* pMatrixLabels)
-								{ return pMatrixLabels && (pMatrixLabels->MatrixNodePath() == sEmberPath); });
-		if ((itr != m_vMatrixLabels.cend())
-		 && (*itr)->Enabled())
+		auto pMatrixLabels = m_vMatrixLabels[hMatrix];
+		if (pMatrixLabels && pMatrixLabels->Enabled())
 		{
 			std::string _sLabel = "";
 			auto _res = (kind == 1)
-					  ? (*itr)->GetTargetLabel(nSignalNumber, _sLabel)
-					  : (*itr)->GetSourceLabel(nSignalNumber, _sLabel);
+					  ? pMatrixLabels->GetTargetLabel(nSignalNumber, _sLabel)
+					  : pMatrixLabels->GetSourceLabel(nSignalNumber, _sLabel);
 			if (_res && !_sLabel.empty())
 			{
-				sLabel = _sLabel;
+				sLabel.swap(_sLabel);
 				res = true;
 			}
 		}
 	}
+	if (!res)
+		sLabel = "";
 
 	return res;
 }
@@ -1517,6 +2351,11 @@ void CEmberConsumer::Worker(CEmberConsumer* instance)
 	if ((instance == nullptr) || !instance->Enabled())
 		return;
 
+	// リプレイ中はプロバイダへ接続しない（受信はリプレイ側から投入）
+	auto pCapture = CCapture::GetInstance();
+	while (!instance->m_bCancelRequest && pCapture && pCapture->Replaying())
+		std::this_thread::sleep_for(std::chrono::milliseconds(instance->m_sRemoteContent.threadDelay));
+
 	while (!instance->m_bCancelRequest)
 	{
 		try
@@ -1531,6 +2370,41 @@ void CEmberConsumer::Worker(CEmberConsumer* instance)
 	}
 }
 
+/// <summary>キャプチャ受信データ投入（リプレイ）</summary>
+/// <param name="pData"></param>
+/// <param name="nLength"></param>
+void CEmberConsumer::Replay(const unsigned char* pData, int nLength)
+{
+	if (!pData || (nLength <= 0))
+		return;
+
+	try
+	{
+		if (!m_pReplaySession)
+			m_pReplaySession = createReplaySession(&m_sRemoteContent);
+		if (!m_pReplaySession)
+			return;
+
+		replaySessionBytes(m_pReplaySession, pData, nLength);
+
+		// 受信により解決できる振り分けパスを登録（登録時に受信済の値が通知される）
+		RetryParameterDispatch();
+		if (HasPendingParameterDispatch())
+			SyncParameterDispatch();
+		// run と同様に受信後の要求を展開する（送信はリプレイ用セッションで抑止）
+		EmberContent* pRequest = nullptr;
+		while ((pRequest = GetConsumerRequest()) != nullptr)
+		{
+			if (pRequest->type != QUIT_REQUEST_CONSUMER)
+				Call_handleInput(&m_sRemoteContent, pRequest);
+		}
+	}
+	catch (const std::exception ex)
+	{
+		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
+	}
+}
+
 /// <summary>
 /// ノードパス値文字列化（デバッグ用途）
 /// </summary>
@@ -1899,23 +2773,58 @@ void CEmberConsumer::Watcher(CEmberConsumer* instance)
 	auto emptyDelay = std::chrono::milliseconds(instance->m_pClientConfig->EmberThreadDelay());
 	bool requestedEmberRoot = false;
 	bool firstReceived = false;
+	size_t lastConnectionCount = 0;
+	bool requestedSnapshot = false;
+	auto snapshotQuiet = std::chrono::milliseconds(TREE_SNAPSHOT_QUIET_MSEC);
+	auto lastNodeReceived = std::chrono::steady_clock::now();
+	bool revalidating = false;
+	auto revalidateStart = std::chrono::steady_clock::now();
+	auto lastRevalidateReceived = revalidateStart;
 	while (!instance->m_bCancelRequest)
 	{
 		EmberContent* pResult = nullptr;
 		try
 		{
+			// 再接続時はツリー保持やスナップショット展開によりツリー消失を検出できないため
+			// 接続回数の変化で再確認またはデータ取得をやり直す
+			if (instance->m_sRemoteContent.connectionCount != lastConnectionCount)
+			{
+				// プロバイダ側の購読は接続単位
+				instance->ResetSubscriptions();
+				if ((lastConnectionCount != 0) && firstReceived)
+				{
+					if (instance->m_sRemoteContent.retainedTree)
+					{
+						// 保持ツリーは使用中ノードのみ再確認する
+						int count = instance->RevalidateUsedPaths();
+						Trace(__FILE__, __LINE__, __FUNCTION__, "revalidate retained tree, requests = %d\n", count);
+						revalidating = true;
+						requestedSnapshot = false;
+						revalidateStart = lastRevalidateReceived = lastNodeReceived = std::chrono::steady_clock::now();
+					}
+					else
+						requestedEmberRoot = false;
+				}
+				lastConnectionCount = instance->m_sRemoteContent.connectionCount;
+			}
 			// 必須情報取得
 			if (!requestedEmberRoot)
 			{
 				instance->AddConsumerRequest(instance->CreateGetDirectoryRequest(nullptr, nullptr, 0));
+				// 全取得し直しとなるためパスの解決からやり直す
+				instance->ResetSubscriptions();
+				instance->ResetParameterDispatch();
 				requestedEmberRoot = true;
 				firstReceived = false;
+				requestedSnapshot = false;
+				revalidating = false;
+				lastNodeReceived = std::chrono::steady_clock::now();
 				std::this_thread::sleep_for(emptyDelay);
 				continue;
 			}
 			// 1回以上受信があった後にツリーインスタンスの確認ができなくなった場合
 			// キャンセル要求以外であれば切断状態になったと判断し、データ取得をやり直す
-			if (!(instance->m_bHasEmberRoot = hasEmberTree()))
+			if (!(instance->m_bHasEmberRoot = hasEmberTree(&instance->m_sRemoteContent)))
 			{
 				if (firstReceived)
 				{
@@ -1933,10 +2842,48 @@ void CEmberConsumer::Watcher(CEmberConsumer* instance)
 			//instance->AddClientProcess(pResult);
 			if (!pResult)
 			{
+				// 再確認要求への受信が途絶えた時点で再確認完了
+				if (revalidating
+				 && ((std::chrono::steady_clock::now() - lastRevalidateReceived) >= snapshotQuiet)
+				 && !instance->HasPreConsumerRequest())
+				{
+					revalidating = false;
+					instance->m_dLastRevalidateMilliseconds = std::chrono::duration<double, std::milli>(lastRevalidateReceived - revalidateStart).count();
+					Trace(__FILE__, __LINE__, __FUNCTION__, "revalidated retained tree, %.1f msec\n", instance->m_dLastRevalidateMilliseconds);
+					// 再確認で通知されなかったエレメント（プロバイダ側で削除済）を破棄する
+					instance->AddConsumerRequest(instance->CreatePruneTreeRequest(nullptr));
+				}
+				// ディレクトリ取得が一巡した時点で購読を送出
+				if (firstReceived && !revalidating
+				 && ((std::chrono::steady_clock::now() - lastNodeReceived) >= snapshotQuiet)
+				 && !instance->HasPreConsumerRequest()
+				 && instance->HasPendingSubscriptions())
+				{
+					instance->SyncSubscriptions();
+				}
+				// パラメータ通知の振り分けは取得途中の値も受けるよう解決でき次第登録
+				if (firstReceived && instance->HasPendingParameterDispatch())
+					instance->SyncParameterDispatch();
+				// 応答のないサルボのタイムアウト確認
+				instance->UpdateSalvoStatus(nullptr);
+				// ディレクトリ取得が一巡した（未送出要求なし、ノード受信が途絶えた）時点でツリーを保存
+				if (!requestedSnapshot && firstReceived
+				 && ((std::chrono::steady_clock::now() - lastNodeReceived) >= snapshotQuiet)
+				 && !instance->HasPreConsumerRequest())
+				{
+					instance->AddConsumerRequest(instance->CreateSnapshotRequest(nullptr));
+					requestedSnapshot = true;
+					// ノード受信後に取得したパラメータで未解決の振り分けパスが解決できる可能性あり
+					instance->RetryParameterDispatch();
+				}
 				std::this_thread::sleep_for(emptyDelay);
 				continue;
 			}
+			// 通知データは処理後に破棄（Client処理用に渡す場合は所有を移す）
+			EmberContentPtr pOwnedResult(pResult);
 			firstReceived = true;
+			if (revalidating)
+				lastRevalidateReceived = std::chrono::steady_clock::now();
 			std::string cvalue = GetEmberContentString(pResult);
 			Trace(__FILE__, __LINE__, __FUNCTION__, "consumer result %s\n", cvalue.c_str());
 			// 結果に対する要求参照
@@ -1953,11 +2900,23 @@ void CEmberConsumer::Watcher(CEmberConsumer* instance)
 			{
 			case GlowType_Node:
 			case GlowType_QualifiedNode:
+				lastNodeReceived = std::chrono::steady_clock::now();
+				// 再確認中に保持ツリーにないノードを受信した場合は構成変更とみなし
+				// 保持ツリーを破棄して全再取得する
+				if (revalidating && !pResult->duplicateRequests)
+				{
+					ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "provider tree changed. rediscover.\n");
+					revalidating = false;
+					instance->AddConsumerRequest(instance->CreateResetTreeRequest(nullptr));
+					instance->ResetMatrixLabels();
+					requestedEmberRoot = false;
+					break;
+				}
 				//if (pRequest && (pRequest->type == GlowType_Command) && (pRequest->command.number == GlowCommandType_GetDirectory))
 				{
 					if (pResult && (pResult->pathLength > 0))
 					{
-						pstr pathName = convertPath2String(instance->m_sRemoteContent.pTopNode, pResult->pPath, pResult->pathLength);
+						pstr pathName = instance->ConvertPath2String(pResult->pPath, pResult->pathLength);
 						if (pathName)
 						{
 							Trace(__FILE__, __LINE__, __FUNCTION__, " node path : %s, duplicateRequests = %d\n", pathName, pResult->duplicateRequests);
@@ -1973,44 +2932,34 @@ void CEmberConsumer::Watcher(CEmberConsumer* instance)
 					}
 					// 任意ノードに対する GetDirectoryRequest で
 					// 子ノードを持たない場合に要求と同じリーフノードが返却される場合の制限
+					if (!pResult->duplicateRequests)
+						// 新規ノードにより未解決の購読パスが解決できる可能性あり
+						instance->RetrySubscriptions();
+					if (!pResult->duplicateRequests)
+						// 新規ノードにより未解決の振り分けパスが解決できる可能性あり
+						instance->RetryParameterDispatch();
 					if (!pResult->duplicateRequests)
 						// 子供がぶらさがっている可能性あり
 						// このノードで GetDirectory 要求
 						instance->AddConsumerRequest(instance->CreateGetDirectoryRequest(nullptr, pResult->pPath, pResult->pathLength));
-					if (pResult)
-						freeMemory(pResult);
 				}
 				break;
 			case GlowType_Parameter:
 			case GlowType_QualifiedParameter:
-				{
-					if (pResult && (pResult->pathLength > 0))
-					{
-						pstr pathName = convertPath2String(instance->m_sRemoteContent.pTopNode, pResult->pPath, pResult->pathLength);
-						if (pathName)
-						{
-							Trace(__FILE__, __LINE__, __FUNCTION__, " parameter path : %s\n", pathName);
-
-							freeMemory(pathName);
-						}
-						instance->AddSendMessage(pResult);
-#if false
-						// ラベル更新（対象かの確認含む）
-						if (instance->ResetMatrixLabels(pResult))
-						{
-							// ラベル更新により通知回数更新
-							instance->IncrementMatrixNoticeCount();
-						}
-#endif
-						//instance->IncrementMatrixNoticeCount();
-					}
-				}
+				instance->ProcessParameterResult(pOwnedResult);
 				break;
 			case GlowType_Connection:
 				{
 					if (pResult && (pResult->pathLength > 0))
 					{
-						pstr pathName = convertPath2String(instance->m_sRemoteContent.pTopNode, pResult->pPath, pResult->pathLength);
+						// 最後に接続情報を出してきたパスを控える（接続表参照用）
+						if (pResult->pathLength <= GLOW_MAX_TREE_DEPTH)
+						{
+							memcpy(instance->m_aLastNotifyMatrixPath, pResult->pPath, pResult->pathLength * sizeof(berint));
+							instance->m_nLastNotifyMatrixPathLength = pResult->pathLength;
+						}
+
+						pstr pathName = instance->ConvertPath2String(pResult->pPath, pResult->pathLength);
 						if (pathName)
 						{
 							// 最後に接続情報を出してきたパスを控える
@@ -2020,39 +2969,38 @@ void CEmberConsumer::Watcher(CEmberConsumer* instance)
 							freeMemory(pathName);
 						}
 					}
-					// 接続変更により通知回数更新
+					// サルボ完了確認
 					if (pResult)
+						instance->UpdateSalvoStatus(pResult);
+					// 接続変更により通知回数更新（接続ソースに変化がない通知は除く）
+					if (pResult && !pResult->duplicateRequests)
+					{
+						if (pResult->pathLength > 0)
+							instance->NotifyConnectionChange(instance->m_sLastNotifyMatrixPath, pResult->connection.target);
 						instance->IncrementMatrixNoticeCount();
-					if (pResult)
-						freeMemory(pResult);
+					}
 			}
 				break;
 			case GlowType_InvocationResult:
-				{
-				if (pResult)
-					freeMemory(pResult);
-			}
 				break;
 			case GlowType_Function:
 				{
 					if (pResult && (pResult->pathLength > 0))
 					{
-						pstr pathName = convertPath2String(instance->m_sRemoteContent.pTopNode, pResult->pPath, pResult->pathLength);
+						pstr pathName = instance->ConvertPath2String(pResult->pPath, pResult->pathLength);
 						if (pathName)
 						{
 							Trace(__FILE__, __LINE__, __FUNCTION__, " function path : %s\n", pathName);
 							freeMemory(pathName);
 						}
 					}
-					if (pResult)
-						freeMemory(pResult);
 			}
 				break;
 			case GlowType_Matrix:
 				{
 					if (pResult && (pResult->pathLength > 0))
 					{
-						pstr pathName = convertPath2String(instance->m_sRemoteContent.pTopNode, pResult->pPath, pResult->pathLength);
+						pstr pathName = instance->ConvertPath2String(pResult->pPath, pResult->pathLength);
 						if (pathName)
 						{
 							Trace(__FILE__, __LINE__, __FUNCTION__, " matrix path : %s\n", pathName);
@@ -2066,35 +3014,29 @@ void CEmberConsumer::Watcher(CEmberConsumer* instance)
 							instance->IncrementMatrixNoticeCount();
 						}
 					}
-					if (pResult)
-						freeMemory(pResult);
 			}
 				break;
 			case GlowType_Target:
 				{
 					if (pResult && (pResult->pathLength > 0))
 					{
-						pstr pathName = convertPath2String(instance->m_sRemoteContent.pTopNode, pResult->pPath, pResult->pathLength);
+						pstr pathName = instance->ConvertPath2String(pResult->pPath, pResult->pathLength);
 						if (pathName)
 						{
 							Trace(__FILE__, __LINE__, __FUNCTION__, " target matrix path : %s\n", pathName);
 							freeMemory(pathName);
 						}
 					}
-					if (pResult)
-						freeMemory(pResult);
 			}
 				break;
 			case GlowType_Source:
 				{
-						pstr pathName = convertPath2String(instance->m_sRemoteContent.pTopNode, pResult->pPath, pResult->pathLength);
+						pstr pathName = instance->ConvertPath2String(pResult->pPath, pResult->pathLength);
 						if (pathName)
 						{
 							Trace(__FILE__, __LINE__, __FUNCTION__, " source matrix path : %s\n", pathName);
 							freeMemory(pathName);
 						}
-						if (pResult)
-							freeMemory(pResult);
 			}
 				break;
 			/****
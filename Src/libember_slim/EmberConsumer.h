@@ -5,15 +5,131 @@
 #include "APIFormat.h"
 #include "ember_consumer.h"
 #include <string>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <thread>
 #include <time.h>
 #include <iostream>
+#include <chrono>
+#include <vector>
+#include <unordered_map>
+#include <set>
 
 
 // ====================================================================
 
+/// <summary>
+/// freeMemory による解放（newobj/newarr/GetNodePath の割り当て）
+/// </summary>
+struct EmberMemoryDeleter
+{
+	void operator()(void* pMemory) const { freeMemory(pMemory); }
+};
+/// <summary>
+/// releaseEmberContent による解放（要求・通知データ）
+/// </summary>
+struct EmberContentDeleter
+{
+	void operator()(EmberContent* pContent) const { releaseEmberContent(pContent); }
+};
+/// <summary>berint パス所有</summary>
+typedef std::unique_ptr<berint[], EmberMemoryDeleter> EmberPathPtr;
+/// <summary>要求・通知データ所有</summary>
+typedef std::unique_ptr<EmberContent, EmberContentDeleter> EmberContentPtr;
+/// <summary>
+/// ツリー排他（スコープ内で lockEmberTree を保持）
+/// </summary>
+/// <remarks>
+/// pTopNode 配下の Element を参照する間に使用する
+/// 保持中は通知処理と共用の排他を取得しないこと
+/// </remarks>
+class EmberTreeLock
+{
+public:
+	explicit EmberTreeLock(const RemoteContent& remote) : m_pRemoteContent(&remote) { lockEmberTree(m_pRemoteContent); }
+	~EmberTreeLock() { unlockEmberTree(m_pRemoteContent); }
+	EmberTreeLock(const EmberTreeLock&) = delete;
+	EmberTreeLock& operator=(const EmberTreeLock&) = delete;
+private:
+	const RemoteContent* m_pRemoteContent;
+};
+
+
+// ====================================================================
+
+/// <summary>ラベル格納枠長（終端含む）</summary>
+/// <remarks>
+/// OLED ラベル(16 byte)の 2 段分を枠内に保持し、超過する文字列のみ別途保持する
+/// </remarks>
+#define MATRIX_LABEL_SLOT_LENGTH	32
+
+/// <summary>マトリックスラベル参照識別</summary>
+/// <remarks>
+/// マトリックスノードパス（文字列）を一度だけ照合して得る
+/// 一度発行した識別はラベル情報の再構築後も同じマトリックスを指す
+/// </remarks>
+typedef int MatrixLabelsHandle;
+/// <summary>マトリックスラベル参照識別：無効</summary>
+#define MATRIX_LABELS_HANDLE_INVALID	(-1)
+
+/// <summary>
+/// MatrixLabelTable
+/// シグナル番号で直接索引するラベル表
+/// </summary>
+class MatrixLabelTable
+{
+public:
+	/// <summary>
+	/// コンストラクタ
+	/// </summary>
+	MatrixLabelTable() : m_nCount(0) {}
+
+	/// <summary>全消去</summary>
+	void Clear();
+	/// <summary>領域予約</summary>
+	/// <param name="count">シグナル数</param>
+	void Reserve(berint count);
+	/// <summary>登録なし</summary>
+	bool Empty() const { return m_nCount == 0; }
+	/// <summary>登録数</summary>
+	size_t Count() const { return m_nCount; }
+
+	/// <summary>ラベル取得</summary>
+	/// <param name="number"></param>
+	/// <param name="sLabel">登録時のみ設定する</param>
+	/// <returns>登録有無</returns>
+	bool Get(const berint number, std::string& sLabel) const;
+	/// <summary>ラベル設定</summary>
+	/// <param name="number"></param>
+	/// <param name="pLabel"></param>
+	/// <returns>追加または変更があった場合 true</returns>
+	bool Set(const berint number, const char* pLabel);
+
+private:
+	/// <summary>ラベル格納枠</summary>
+	struct Slot
+	{
+		char szLabel[MATRIX_LABEL_SLOT_LENGTH];
+		unsigned char nLength;
+		bool bValid;
+		/// <summary>枠に収まらず m_mpOverflow 側に保持</summary>
+		bool bOverflow;
+	};
+
+	/// <summary>シグナル番号索引のラベル枠</summary>
+	std::vector<Slot> m_vSlots;
+	/// <summary>枠超過ラベル／索引範囲外番号のラベル</summary>
+	std::unordered_map<berint, std::string> m_mpOverflow;
+	/// <summary>登録数</summary>
+	size_t m_nCount;
+};
+
+/// <summary>ラベル変更：Target</summary>
+#define MATRIX_LABEL_TARGET		0x01
+/// <summary>ラベル変更：Source</summary>
+#define MATRIX_LABEL_SOURCE		0x02
+
 /// <summary>
 /// MatrixLabels
 /// マトリックス情報クラス
@@ -44,25 +160,29 @@ public:
 	bool Valid() { return Initialized() && (m_nTargetsLabelNodePathLength > 0) && (m_nSourcesLabelNodePathLength > 0); }
 	/// <summary>参照可否</summary>
 	/// <returns></returns>
-	bool Enabled() { return Initialized() && !m_mpTargetLabels.empty() && !m_mpSourceLabels.empty(); }
+	bool Enabled() { return Initialized() && !m_aTargetLabels.Empty() && !m_aSourceLabels.Empty(); }
 
 	/// <summary>Target ラベル取得</summary>
 	/// <param name="number"></param>
-	/// <param name="sLabel"></param>
+	/// <param name="sLabel">登録時のみ設定する</param>
 	/// <returns></returns>
-	bool GetTargetLabel(const berint number, std::string& sLabel) { return GetLabel(m_mpTargetLabels, number, sLabel); }
+	bool GetTargetLabel(const berint number, std::string& sLabel) { return Enabled() && m_aTargetLabels.Get(number, sLabel); }
 	/// <summary>Source ラベル取得</summary>
 	/// <param name="number"></param>
-	/// <param name="sLabel"></param>
+	/// <param name="sLabel">登録時のみ設定する</param>
 	/// <returns></returns>
-	bool GetSourceLabel(const berint number, std::string& sLabel) { return GetLabel(m_mpSourceLabels, number, sLabel); }
+	bool GetSourceLabel(const berint number, std::string& sLabel) { return Enabled() && m_aSourceLabels.Get(number, sLabel); }
 	/// <summary>ラベル設定</summary>
 	/// <param name="pContent"></param>
-	/// <returns></returns>
+	/// <returns>変更のあった側（MATRIX_LABEL_TARGET / MATRIX_LABEL_SOURCE の和）、変更なしは 0</returns>
 	/// <remarks>
 	/// パラメータ取得時のラベル文字列更新
+	/// 変更のあったシグナル番号は pContent の末尾パス
 	/// </remarks>
-	bool SetLabel(const EmberContent* pContent);
+	int SetLabel(const EmberContent* pContent);
+	/// <summary>再確認対象パス取得</summary>
+	/// <param name="stPaths">マトリックス／ラベルノードのパスを追加する</param>
+	void GetNodePaths(std::set<std::vector<berint>>& stPaths);
 
 private:
 	/// <summary>初期化</summary>
@@ -71,13 +191,12 @@ private:
 	/// <summary>初期化</summary>
 	/// <param name="pContent"></param>
 	void Initialize(Element* pRoot, const EmberContent* pContent);
-
-	/// <summary>ラベル取得</summary>
-	/// <param name="map">参照マップ</param>
-	/// <param name="number"></param>
-	/// <param name="sLabel"></param>
-	/// <returns></returns>
-	bool GetLabel(const std::unordered_map<berint, std::string>& map, const berint number, std::string& sLabel);
+	/// <summary>ラベルノード配下からラベル収集</summary>
+	/// <param name="pRoot"></param>
+	/// <param name="pPath">ラベルノードパス</param>
+	/// <param name="pathLength"></param>
+	/// <param name="table">格納先</param>
+	void CollectLabels(Element* pRoot, const berint* pPath, int pathLength, MatrixLabelTable& table);
 
 	/// <summary>Matrix ノードパス</summary>
 	/// <remarks>固定長で所持</remarks>
@@ -94,11 +213,7 @@ private:
 	/// <summary>Matrix Targets Label ノードパス長</summary>
 	int m_nTargetsLabelNodePathLength;
 	/// <summary>Target ラベル</summary>
-	/// <remarks>
-	/// 識別の出現順が保証されていないので
-	/// vector ではなく map に識別と文字列を対で保持する
-	/// </remarks>
-	std::unordered_map<berint, std::string> m_mpTargetLabels;
+	MatrixLabelTable m_aTargetLabels;
 
 	/// <summary>Matrix Sources Label ノードパス</summary>
 	/// <remarks>固定長で所持</remarks>
@@ -106,17 +221,139 @@ private:
 	/// <summary>Matrix Sources Label ノードパス長</summary>
 	int m_nSourcesLabelNodePathLength;
 	/// <summary>Source ラベル</summary>
-	/// <remarks>
-	/// 識別の出現順が保証されていないので
-	/// vector ではなく map に識別と文字列を対で保持する
-	/// </remarks>
-	std::unordered_map<berint, std::string>	m_mpSourceLabels;
+	MatrixLabelTable m_aSourceLabels;
 
 	/// <summary>初期化済</summary>
 	bool m_bInitialized;
 };
 
 
+// ====================================================================
+
+/// <summary>サルボ完了待ち上限(ミリ秒)</summary>
+#define SALVO_TIMEOUT_MSEC		5000
+/// <summary>ツリー探索完了とみなすノード無受信時間(ミリ秒)</summary>
+/// <remarks>
+/// 経過後にツリースナップショットを保存する
+/// </remarks>
+#define TREE_SNAPSHOT_QUIET_MSEC	2000
+/// <summary>送信済要求の保持上限</summary>
+/// <remarks>
+/// 結果の対象となる要求識別は結果受信で取り除くが、結果を伴わない要求（パラメータ設定等）は残るため
+/// 超過時は送信中（応答待ち）を除き古いものから破棄する
+/// </remarks>
+#define CONSUMER_REQUEST_RETAIN_MAX	256
+/// <summary>Client処理用のコンシューマ操作結果の保持上限</summary>
+/// <remarks>
+/// 超過時は古いものから破棄する
+/// </remarks>
+#define SEND_MESSAGE_QUEUE_MAX	256
+
+/// <summary>
+/// SalvoStatus
+/// 一括接続（サルボ）進捗
+/// </summary>
+/// <remarks>
+/// 送信した接続がすべて接続通知で確認できた時点で完了とする
+/// NToN 等の複数ソース接続は、要求した全ソースが接続通知に含まれた時点で確認済とする
+/// </remarks>
+class SalvoStatus
+{
+public:
+	/// <summary>コンストラクタ</summary>
+	SalvoStatus()
+	{
+		m_nSerial = 0;
+		m_nRequestId = 0;
+		memset(m_aMatrixPath, 0, sizeof(m_aMatrixPath));
+		m_nMatrixPathLength = 0;
+		m_nConnectionCount = 0;
+		m_tTake = std::chrono::steady_clock::time_point{};
+	}
+
+	/// <summary>控え識別（要求識別の確定前の照合用）</summary>
+	int m_nSerial;
+	/// <summary>要求識別</summary>
+	int m_nRequestId;
+	/// <summary>マトリックスパス</summary>
+	berint m_aMatrixPath[GLOW_MAX_TREE_DEPTH];
+	/// <summary>マトリックスパス長</summary>
+	int m_nMatrixPathLength;
+	/// <summary>接続数</summary>
+	int m_nConnectionCount;
+	/// <summary>未確認接続（ターゲット, 要求ソース全て）</summary>
+	std::unordered_map<berint, std::vector<berint>> m_mpPendingTargets;
+	/// <summary>要求時刻</summary>
+	std::chrono::steady_clock::time_point m_tTake;
+};
+
+
+/// <summary>マトリックス変更履歴最大数</summary>
+/// <remarks>
+/// 超過時は履歴を破棄し、参照側に全更新を求める
+/// </remarks>
+#define MATRIX_CHANGE_JOURNAL_MAX	1024
+
+/// <summary>マトリックス変更種別</summary>
+enum class MatrixChangeKind : uint8_t
+{
+	/// <summary>マトリックス全体（ラベル再収集）</summary>
+	CHANGE_ALL = 0,
+	/// <summary>Target ラベル</summary>
+	CHANGE_TARGET_LABEL,
+	/// <summary>Source ラベル</summary>
+	CHANGE_SOURCE_LABEL,
+	/// <summary>接続（番号は Target）</summary>
+	CHANGE_CONNECTION,
+	/// <summary>監視パラメータ値（パスのみ有効）</summary>
+	CHANGE_PARAMETER,
+};
+
+/// <summary>
+/// MatrixChange
+/// マトリックス変更履歴
+/// </summary>
+/// <remarks>
+/// 参照側（DeviceAction）が変更のあったボタンのみ更新するために使用する
+/// </remarks>
+class MatrixChange
+{
+public:
+	/// <summary>コンストラクタ</summary>
+	MatrixChange()
+	{
+		m_eKind = MatrixChangeKind::CHANGE_ALL;
+		m_hMatrix = MATRIX_LABELS_HANDLE_INVALID;
+		m_nNumber = -1;
+	}
+
+	/// <summary>種別</summary>
+	MatrixChangeKind m_eKind;
+	/// <summary>マトリックス参照識別（CHANGE_PARAMETER 時は無効）</summary>
+	MatrixLabelsHandle m_hMatrix;
+	/// <summary>シグナル番号（CHANGE_ALL / CHANGE_PARAMETER 時は -1）</summary>
+	berint m_nNumber;
+	/// <summary>パラメータパス（CHANGE_PARAMETER 時のみ）</summary>
+	std::string m_sPath;
+};
+
+
+/// <summary>購読要求元</summary>
+/// <remarks>
+/// 要求元ごとに参照パスを保持し、パス単位で参照数を数える
+/// </remarks>
+enum class SubscriptionOwner : uint8_t
+{
+	/// <summary>表示中ページ（DeviceAction）</summary>
+	OWNER_PAGE = 0,
+	/// <summary>LINE UNIT 対応表（Client）</summary>
+	OWNER_LINE_UNIT,
+
+	/// <summary>要求元数</summary>
+	OWNER_COUNT,
+};
+
+
 // ====================================================================
 
 /// <summary>
@@ -145,6 +382,9 @@ public:
 	/// <summary>要求可否</summary>
 	/// <returns></returns>
 	bool CanRequest() { return Enabled() && m_bHasEmberRoot; }
+	/// <summary>リンク遅延（直近のキープアライブ往復時間、usec）</summary>
+	/// <returns>応答未受信は 0</returns>
+	unsigned long long LinkLatencyUsec() { return m_sRemoteContent.linkStatistics.rttUsec; }
 
 	/// <summary></summary>
 	/// <returns></returns>
@@ -153,16 +393,19 @@ public:
 		/// <returns></returns>
 	bool IsCancelRequest();
 
-	/// <summary>コンシューマ操作要求追加</summary>
+	/// <summary>接続ソース取得</summary>
 	/// <param name="nDestConnSignal"></param>
 	/// <param name="vSrcs"></param>
 	/// <returns></returns>
 	int GetSignalValue(int nDestConnSignal, std::vector<int>& vSrcs);
-	/// <summary>コンシューマ操作要求追加</summary>
-	/// <param name="nDestConnSignal"></param>
-	/// <param name="nSignalCount"></param>
+	/// <summary>接続ソース一括取得</summary>
+	/// <param name="nDestConnSignal">先頭ターゲット</param>
+	/// <param name="nSignalCount">ターゲット数</param>
 	/// <param name="vSrcs"></param>
 	/// <returns></returns>
+	/// <remarks>
+	/// 最後に接続情報を受信したマトリックスの接続表から、ターゲット順に接続ソースを連結して返す
+	/// </remarks>
 	int GetSignalValues(int nDestConnSignal, int nSignalCount, std::vector<int>& vSrcs);
 
 	/// <summary>ディレクトリ取得要求生成</summary>
@@ -218,6 +461,44 @@ public:
 	/// <param name="nSrcConnCount"></param>
 	/// <returns></returns>
 	int AddConsumerRequest(RequestId* pId, std::string sPath, int nDestTopSignal, int nDestConnCount, int nSrcTopSignal, int nSrcConnCount);
+	/// <summary>サルボ要求追加</summary>
+	/// <param name="pId"></param>
+	/// <param name="sPath">マトリックスパス</param>
+	/// <param name="vXpts">(ターゲット, ソース) の組</param>
+	/// <returns></returns>
+	/// <remarks>
+	/// 同一マトリックスへの接続を 1要求にまとめ、S101 フレーム単位で Connections を一括送信する
+	/// </remarks>
+	int AddSalvoRequest(RequestId* pId, std::string sPath, const std::vector<std::pair<int, int>>& vXpts);
+	/// <summary>直近サルボ完了所要時間(ミリ秒)</summary>
+	/// <returns>未完了時は負値</returns>
+	/// <remarks>
+	/// 要求追加から全接続の通知確認まで
+	/// </remarks>
+	double LastSalvoMilliseconds() { auto lock = std::unique_lock<std::mutex>(m_mtxSalvo); return m_dLastSalvoMilliseconds; }
+	/// <summary>直近の保持ツリー再確認所要時間(ミリ秒)</summary>
+	/// <returns>未実施時 -1</returns>
+	/// <remarks>
+	/// 再接続から再確認要求に対する最終受信までの時間
+	/// </remarks>
+	double LastRevalidateMilliseconds() { return m_dLastRevalidateMilliseconds; }
+
+	/// <summary>購読パス設定</summary>
+	/// <param name="eOwner">要求元</param>
+	/// <param name="stPaths">要求元が参照するパラメータ／マトリックスのパス（前回設定との差分を反映）</param>
+	/// <returns>参照中パス数</returns>
+	/// <remarks>
+	/// 参照数が 0→1 となったパスを Subscribe、1→0 となったパスを Unsubscribe する
+	/// 送出は Watcher がディレクトリ取得の一巡後に行う
+	/// </remarks>
+	int SetSubscriptions(SubscriptionOwner eOwner, const std::set<std::string>& stPaths);
+	/// <summary>パラメータ通知振り分け設定</summary>
+	/// <param name="mpPaths">通知を受けるパラメータのパスと振り分け識別（0 以上）</param>
+	/// <remarks>
+	/// 数値パスへの解決とコンシューマへの登録は Watcher がディレクトリ取得中に行う
+	/// 登録のないパスのパラメータ通知は __EmberCommandConverter へ渡さない
+	/// </remarks>
+	void SetParameterDispatch(const std::unordered_map<std::string, int>& mpPaths);
 
 	/// <summary>コンシューマ受信通知</summary>
 	/// <summary>コンシューマ操作要求取得</summary>
@@ -226,13 +507,20 @@ public:
 	/// <summary>コンシューマ受信通知</summary>
 	/// <param name="pResult"></param>
 	void NotifyReceivedConsumerResult(EmberContent* pResult);
+	/// <summary>キャプチャ受信データ投入（リプレイ）</summary>
+	/// <param name="pData"></param>
+	/// <param name="nLength"></param>
+	/// <remarks>
+	/// 受信時と同じ glow ハンドラで処理し、投入後に溜まった要求も送信せずに展開する
+	/// </remarks>
+	void Replay(const unsigned char* pData, int nLength);
 
 	/// <summary>Client処理用のコンシューマ操作結果格納</summary>
 /// <param name="pResult"></param>
-	void CEmberConsumer::AddSendMessage(EmberContent* pResult);
+	void AddSendMessage(EmberContent* pResult);
 	/// <summary>Client処理用のコンシューマ操作結果取得</summary>
 	/// <returns></returns>
-	EmberContent* CEmberConsumer::GetSendMessage();
+	EmberContent* GetSendMessage();
 
 	/// <summary>マトリックス操作通知回数</summary>
 	/// <returns></returns>
@@ -259,6 +547,32 @@ public:
 	/// <param name="sLabel"></param>
 	/// <returns></returns>
 	bool GetSourceLabel(const std::string sEmberPath, berint nSignalNumber, std::string& sLabel) { return GetLabel(2, sEmberPath, nSignalNumber, sLabel); }
+	/// <summary>マトリックスラベル参照識別取得</summary>
+	/// <param name="sEmberPath">マトリックスノードパス</param>
+	/// <returns>空パス時 MATRIX_LABELS_HANDLE_INVALID</returns>
+	/// <remarks>
+	/// ラベル未収集のマトリックスでも識別を発行し、収集後にそのまま参照可能となる
+	/// </remarks>
+	MatrixLabelsHandle InternMatrixLabels(const std::string& sEmberPath);
+	/// <summary>Target ラベル取得</summary>
+	/// <param name="hMatrix"></param>
+	/// <param name="nSignalNumber"></param>
+	/// <param name="sLabel">未取得時は空</param>
+	/// <returns></returns>
+	bool GetTargetLabel(MatrixLabelsHandle hMatrix, berint nSignalNumber, std::string& sLabel) { return GetLabel(1, hMatrix, nSignalNumber, sLabel); }
+	/// <summary>Source ラベル取得</summary>
+	/// <param name="hMatrix"></param>
+	/// <param name="nSignalNumber"></param>
+	/// <param name="sLabel">未取得時は空</param>
+	/// <returns></returns>
+	bool GetSourceLabel(MatrixLabelsHandle hMatrix, berint nSignalNumber, std::string& sLabel) { return GetLabel(2, hMatrix, nSignalNumber, sLabel); }
+	/// <summary>マトリックス変更履歴取得</summary>
+	/// <param name="vChanges">前回取得以降の変更（取得後は履歴から取り除く）</param>
+	/// <returns>false : 履歴が欠落しているため全更新が必要</returns>
+	bool TakeMatrixChanges(std::vector<MatrixChange>& vChanges);
+	/// <summary>監視パラメータパス設定</summary>
+	/// <param name="stPaths">値の変化をマトリックス変更として通知するパラメータ</param>
+	void SetWatchedParameterPaths(const std::set<std::string>& stPaths);
 
 	/// <summary></summary>
 	static void Worker(CEmberConsumer* instance);
@@ -277,6 +591,16 @@ public:
 	/// <param name="pPath"></param>
 	/// <returns></returns>
 	size_t GetNodePath(std::string sPath, berint** pPath);
+	/// <summary>文字列パス→パス（所有）</summary>
+	/// <param name="sPath"></param>
+	/// <param name="pPath"></param>
+	/// <returns></returns>
+	size_t GetNodePath(std::string sPath, EmberPathPtr& pPath);
+	/// <summary>パス→文字列パス（ツリー排他中に変換）</summary>
+	/// <param name="pPath"></param>
+	/// <param name="pathLength"></param>
+	/// <returns>freeMemory で解放する</returns>
+	pstr ConvertPath2String(const berint* pPath, int pathLength);
 	/// <summary>パラメータ設定要求生成</summary>
 	/// <param name="pId"></param>
 	/// <param name="pPath"></param>
@@ -291,6 +615,25 @@ public:
 	/// <param name="value"></param>
 	/// <returns></returns>
 	EmberContent* CreateInvokeRequest(RequestId* pId, berint* pPath, int pathLength, GlowInvocation& value) { return createEmberInvokeContent(pId, pPath, pathLength, &value); }
+	/// <summary>サルボ要求追加</summary>
+	/// <param name="pId"></param>
+	/// <param name="pPath"></param>
+	/// <param name="pathLength"></param>
+	/// <param name="vConnections"></param>
+	/// <returns></returns>
+	int AddSalvoRequest(RequestId* pId, berint* pPath, int pathLength, const std::vector<GlowConnection>& vConnections);
+	/// <summary>サルボ進捗更新</summary>
+	/// <param name="pResult">接続通知（nullptr の場合はタイムアウトの確認のみ）</param>
+	/// <remarks>
+	/// Watcher からのみ呼び出される想定（受信なしの間も周期的にタイムアウトを確認する）
+	/// </remarks>
+	void UpdateSalvoStatus(const EmberContent* pResult);
+	/// <summary>パラメータ通知処理</summary>
+	/// <param name="pResult">パラメータ通知（Client 処理用に渡す場合は所有を移す）</param>
+	/// <remarks>
+	/// Watcher からのみ呼び出される想定（監視パスの通知は値変化をマトリックス変更として控える）
+	/// </remarks>
+	void ProcessParameterResult(EmberContentPtr& pResult);
 
 	/// <summary>接続情報</summary>
 	RemoteContent m_sRemoteContent;
@@ -299,10 +642,6 @@ public:
 	/// <summary></summary>
 	bool m_bUpdateDetected;
 
-	clock_t start;
-	clock_t end;
-	void ProcessTimeDisp();
-
 protected:
 	/// <summary>
 	/// コンストラクタ
@@ -333,6 +672,9 @@ protected:
 	/// </summary>
 	/// <returns></returns>
 	int IssueConsumerRequestId();
+	/// <summary>未送出コンシューマ操作要求有無</summary>
+	/// <returns></returns>
+	bool HasPreConsumerRequest();
 	/// <summary>コンシューマ操作結果取得</summary>
 	/// <returns></returns>
 	EmberContent* GetConsumerResult();
@@ -346,6 +688,70 @@ protected:
 	/// <param name="pathLength"></param>
 	/// <returns></returns>
 	EmberContent* CreateGetDirectoryRequest(RequestId* pId, berint* pPath, int pathLength) { return createEmberGetDirectoryContent(pId, pPath, pathLength); }
+	/// <summary>ツリースナップショット保存要求生成</summary>
+	/// <param name="pId"></param>
+	/// <returns>スナップショット未使用時 nullptr</returns>
+	EmberContent* CreateSnapshotRequest(RequestId* pId) { return m_sSnapshotPath.empty() ? nullptr : createEmberSnapshotContent(pId, m_sSnapshotPath.c_str()); }
+	/// <summary>保持ツリー破棄要求生成</summary>
+	/// <param name="pId"></param>
+	/// <returns></returns>
+	EmberContent* CreateResetTreeRequest(RequestId* pId) { return createEmberResetTreeContent(pId); }
+	/// <summary>未確認エレメント破棄要求生成</summary>
+	/// <param name="pId"></param>
+	/// <returns></returns>
+	EmberContent* CreatePruneTreeRequest(RequestId* pId) { return createEmberPruneTreeContent(pId); }
+	/// <summary>パラメータ通知振り分け登録要求生成</summary>
+	/// <param name="pId"></param>
+	/// <param name="pPath">対象パス（nullptr 時は全登録解除）</param>
+	/// <param name="pathLength"></param>
+	/// <param name="key">振り分け識別</param>
+	/// <returns></returns>
+	EmberContent* CreateDispatchRequest(RequestId* pId, const berint* pPath, int pathLength, int key) { return createEmberDispatchContent(pId, pPath, pathLength, key); }
+	/// <summary>購読／購読解除要求生成</summary>
+	/// <param name="pId"></param>
+	/// <param name="sPath"></param>
+	/// <param name="bSubscribe">true : Subscribe, false : Unsubscribe</param>
+	/// <returns>パス未解決時 nullptr</returns>
+	EmberContent* CreateSubscribeRequest(RequestId* pId, std::string sPath, bool bSubscribe);
+	/// <summary>購読送出待ち有無</summary>
+	/// <returns></returns>
+	bool HasPendingSubscriptions();
+	/// <summary>購読送出</summary>
+	/// <returns>要求数</returns>
+	/// <remarks>
+	/// 未送出の Subscribe と参照のなくなった Unsubscribe を要求する
+	/// パスが解決できないものはツリー更新後に再試行する
+	/// </remarks>
+	int SyncSubscriptions();
+	/// <summary>購読状態破棄（切断によりプロバイダ側の購読が失われた場合）</summary>
+	void ResetSubscriptions();
+	/// <summary>新規ノード受信による未解決購読の再試行</summary>
+	void RetrySubscriptions();
+
+	/// <summary>振り分け登録待ち有無</summary>
+	/// <returns></returns>
+	bool HasPendingParameterDispatch();
+	/// <summary>振り分け登録</summary>
+	/// <returns>要求数</returns>
+	/// <remarks>
+	/// パスが解決できないものはツリー更新後に再試行する
+	/// </remarks>
+	int SyncParameterDispatch();
+	/// <summary>振り分け登録破棄（ツリー全再取得により数値パスが変わる場合）</summary>
+	void ResetParameterDispatch();
+	/// <summary>新規ノード受信による未解決振り分けの再試行</summary>
+	void RetryParameterDispatch();
+
+	/// <summary>使用中エレメントパス登録</summary>
+	/// <param name="pPath"></param>
+	/// <param name="pathLength"></param>
+	void AddUsedPath(const berint* pPath, int pathLength);
+	/// <summary>保持ツリー再確認要求</summary>
+	/// <returns>要求数</returns>
+	/// <remarks>
+	/// ルート（構成変更の確認）および使用中のエレメント／マトリックス／ラベルノードのみ GetDirectory を要求する
+	/// </remarks>
+	int RevalidateUsedPaths();
 	/// <summary>パラメータ取得要求生成</summary>
 	/// <param name="pId"></param>
 	/// <param name="pPath"></param>
@@ -383,6 +789,31 @@ protected:
 	/// <param name="sLabel"></param>
 	/// <returns></returns>
 	bool GetLabel(int kind, std::string sEmberPath, berint nSignalNumber, std::string& sLabel);
+	/// <summary>ラベル取得</summary>
+	/// <param name="kind">1 : target, 2 : source</param>
+	/// <param name="hMatrix"></param>
+	/// <param name="nSignalNumber"></param>
+	/// <param name="sLabel">未取得時は空</param>
+	/// <returns></returns>
+	bool GetLabel(int kind, MatrixLabelsHandle hMatrix, berint nSignalNumber, std::string& sLabel);
+	/// <summary>マトリックスラベル参照識別取得（m_mtxMatrixNotice 取得済で呼び出す）</summary>
+	/// <param name="sEmberPath"></param>
+	/// <returns></returns>
+	MatrixLabelsHandle InternMatrixLabelsHandle(const std::string& sEmberPath);
+	/// <summary>マトリックス変更履歴追加（m_mtxMatrixNotice 取得済で呼び出す）</summary>
+	/// <param name="eKind"></param>
+	/// <param name="hMatrix"></param>
+	/// <param name="nNumber"></param>
+	/// <param name="sPath"></param>
+	void PushMatrixChange(MatrixChangeKind eKind, MatrixLabelsHandle hMatrix, berint nNumber, const std::string& sPath = "");
+	/// <summary>接続変更通知</summary>
+	/// <param name="sMatrixPath"></param>
+	/// <param name="nTarget"></param>
+	void NotifyConnectionChange(const std::string& sMatrixPath, berint nTarget);
+	/// <summary>パラメータ変更通知</summary>
+	/// <param name="sPath"></param>
+	/// <returns>監視対象の場合 true</returns>
+	bool NotifyParameterChange(const std::string& sPath);
 
 	bool m_bHasEmberRoot;
 
@@ -416,10 +847,72 @@ protected:
 	unsigned short m_nMatrixNoticeCount;
 	/// <summary>最終接続通知マトリックスパス</summary>
 	std::string m_sLastNotifyMatrixPath;
+	/// <summary>最終接続通知マトリックスパス（数値）</summary>
+	berint m_aLastNotifyMatrixPath[GLOW_MAX_TREE_DEPTH];
+	/// <summary>最終接続通知マトリックスパス長</summary>
+	int m_nLastNotifyMatrixPathLength;
+	/// <summary>接続ソース一括取得用バッファ</summary>
+	std::vector<berint> m_vConnectedSources;
 	/// <summary>マトリックスラベル情報</summary>
+	/// <remarks>
+	/// 参照識別（MatrixLabelsHandle）で索引、未収集のマトリックスは nullptr
+	/// </remarks>
 	std::vector<MatrixLabels*> m_vMatrixLabels;
+	/// <summary>マトリックスノードパス→参照識別</summary>
+	std::unordered_map<std::string, MatrixLabelsHandle> m_mpMatrixLabelsHandles;
+	/// <summary>マトリックス変更履歴</summary>
+	std::vector<MatrixChange> m_vMatrixChanges;
+	/// <summary>マトリックス変更履歴欠落</summary>
+	bool m_bMatrixChangesLost;
 	/// <summary>マトリックスラベル使用有無</summary>
 	bool m_bUseMatrixLabels;
+	/// <summary>ツリースナップショットファイル（未使用時は空）</summary>
+	std::string m_sSnapshotPath;
+	/// <summary>リプレイ用セッション</summary>
+	Session* m_pReplaySession;
+
+	/// <summary></summary>
+	std::mutex m_mtxUsedPaths;
+	/// <summary>使用中エレメントパス（再接続後の再確認対象）</summary>
+	std::set<std::vector<berint>> m_stUsedPaths;
+	/// <summary>直近の保持ツリー再確認所要時間(ミリ秒)</summary>
+	double m_dLastRevalidateMilliseconds;
+
+	/// <summary></summary>
+	std::mutex m_mtxSubscriptions;
+	/// <summary>要求元ごとの購読パス</summary>
+	std::set<std::string> m_aSubscriptionPaths[(int)SubscriptionOwner::OWNER_COUNT];
+	/// <summary>購読パス参照数</summary>
+	std::unordered_map<std::string, int> m_mpSubscriptionRefs;
+	/// <summary>プロバイダへ Subscribe 済のパス</summary>
+	std::set<std::string> m_stSubscribed;
+	/// <summary>パス未解決の購読数</summary>
+	int m_nUnresolvedSubscriptions;
+	/// <summary>購読送出待ち</summary>
+	bool m_bSubscriptionsPending;
+	/// <summary>パラメータ通知振り分けパスと振り分け識別</summary>
+	std::unordered_map<std::string, int> m_mpDispatchPaths;
+	/// <summary>コンシューマへ登録済の振り分けパス</summary>
+	std::set<std::string> m_stDispatched;
+	/// <summary>監視パラメータパス（値変化をマトリックス変更として通知する）</summary>
+	std::set<std::string> m_stWatchedParameterPaths;
+	/// <summary>コンシューマへ監視登録済のパス</summary>
+	std::set<std::string> m_stWatchDispatched;
+	/// <summary>パス未解決の振り分け数</summary>
+	int m_nUnresolvedDispatch;
+	/// <summary>振り分け登録待ち</summary>
+	bool m_bDispatchPending;
+	/// <summary>振り分け全解除待ち</summary>
+	bool m_bDispatchClear;
+
+	/// <summary></summary>
+	std::mutex m_mtxSalvo;
+	/// <summary>完了待ちサルボ</summary>
+	std::vector<SalvoStatus> m_vSalvos;
+	/// <summary>直近のサルボ控え識別</summary>
+	int m_nLastSalvoSerial;
+	/// <summary>直近サルボ完了所要時間(ミリ秒)</summary>
+	double m_dLastSalvoMilliseconds;
 
 	/// <summary>クライアント用情報クラスインスタンス</summary>
 	CClientConfig* m_pClientConfig;
@@ -0,0 +1,286 @@
+﻿#include "LineUnitMap.h"
+#include <algorithm>
+#include <utility>
+
+using namespace utilities;
+
+#undef min
+#undef max
+
+
+/// <summary>
+/// 既定の対応表（対応表ファイルと同じ書式）
+/// </summary>
+static const char* const DefaultLineUnitMap[][(int)LineUnitMapColumn::COLUMN_COUNT] =
+{
+	// PGM 列
+	{ "select",	"1",	"25",	"/root/suite/s-1/switcher/n-1/abTrans/n-#/sw/t/btn",		"1",	"1",	"4",	"1" },
+	// PST 列
+	{ "select",	"46",	"70",	"/root/suite/s-1/switcher/n-1/abTrans/n-#/sw/b/btn",		"1",	"2",	"5",	"0" },
+	// XPT 列（上段・下段で 1 つのパス）
+	{ "select",	"91",	"115",	"/root/suite/s-1/switcher/n-1/xptSw/n-#/sw/btn",			"1",	"3",	"6",	"0" },
+	{ "select",	"136",	"160",	"/root/suite/s-1/switcher/n-1/xptSw/n-#/sw/btn",			"26",	"3",	"6",	"0" },
+	// CUT / AUTO トランジション
+	{ "invoke",	"210",	"210",	"/root/suite/s-1/switcher/n-1/abTrans/n-#/trans/cut",		"0",	"3",	"6",	"0" },
+	{ "invoke",	"211",	"211",	"/root/suite/s-1/switcher/n-1/abTrans/n-#/trans/auto",		"0",	"3",	"6",	"0" },
+	// フェーダー（レベル表示 LED は下から点灯）
+	{ "fader",	"246",	"217",	"/root/suite/s-1/switcher/n-1/scene/n-#/nextTrans/fader",	"0",	"2",	"0",	"0" },
+};
+
+/// <summary>
+/// 種別文字列を操作種別へ変換
+/// </summary>
+/// <param name="value"></param>
+/// <returns>不正時は ACTION_NONE</returns>
+static LineUnitAction ToLineUnitAction(const std::string& value)
+{
+	std::string action = ToLower(Trim(value));
+	return (action == "select") ? LineUnitAction::ACTION_SELECT
+		 : (action == "invoke") ? LineUnitAction::ACTION_INVOKE
+		 : (action == "fader") ? LineUnitAction::ACTION_FADER
+		 : LineUnitAction::ACTION_NONE;
+}
+
+/// <summary>
+/// カラム値を範囲内の数値として取得
+/// </summary>
+/// <param name="columns"></param>
+/// <param name="eColumn"></param>
+/// <param name="nMin"></param>
+/// <param name="nMax"></param>
+/// <param name="num"></param>
+/// <returns></returns>
+static bool GetColumnNumber(const std::vector<std::string>& columns, LineUnitMapColumn eColumn, int nMin, int nMax, int& num)
+{
+	std::string value{};
+	return CommGetColumnValue(columns, (int)eColumn, value)
+		&& ToNumber(Trim(value), num) && IsRange(num, nMin, nMax);
+}
+
+
+/// <summary>
+/// コンストラクタ
+/// </summary>
+/// <remarks>既定表で初期化する</remarks>
+CLineUnitMap::CLineUnitMap() :
+	m_vSwitches(),
+	m_vFaders(),
+	m_vGroups()
+{
+	Load(std::string());
+}
+
+/// <summary>
+/// デストラクタ
+/// </summary>
+CLineUnitMap::~CLineUnitMap()
+{
+}
+
+/// <summary>対応表読み込み</summary>
+/// <param name="sPath">対応表ファイル（無い場合は既定表）</param>
+/// <returns>ファイル内容を適用したか</returns>
+/// <remarks>ファイル内容が不正な場合は既定表を使用する</remarks>
+bool CLineUnitMap::Load(const std::string& sPath)
+{
+	std::vector<LineUnitSwitch> vSwitches{};
+	std::vector<int> vFaders{};
+	std::vector<LineUnitGroup> vGroups{};
+	bool applied = false;
+
+	try
+	{
+		if (!sPath.empty() && PathExists(sPath))
+		{
+			std::vector<std::vector<std::string>> lines{};
+			if ((CommReadCsvFile(sPath, lines, false) > 0) && Compile(lines, vSwitches, vFaders, vGroups))
+				applied = true;
+			else
+				ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "invalid line unit map, use default map. path = %s\n", sPath.c_str());
+		}
+		if (!applied)
+		{
+			std::vector<std::vector<std::string>> lines{};
+			for (auto& aRow : DefaultLineUnitMap)
+				lines.emplace_back(std::begin(aRow), std::end(aRow));
+			Compile(lines, vSwitches, vFaders, vGroups);
+		}
+	}
+	catch (const std::exception ex)
+	{
+		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "exception : %s\n", ex.what());
+		return false;
+	}
+
+	m_vSwitches.swap(vSwitches);
+	m_vFaders.swap(vFaders);
+	m_vGroups.swap(vGroups);
+	Trace(__FILE__, __LINE__, __FUNCTION__, "line unit map : %s, groups = %zu, switches = %zu, faders = %zu\n",
+		applied ? sPath.c_str() : "default", m_vGroups.size(), m_vSwitches.size(), m_vFaders.size());
+	return applied;
+}
+
+/// <summary>対応表生成</summary>
+/// <param name="lines">行単位カラム</param>
+/// <param name="vSwitches">スイッチ割当（出力）</param>
+/// <param name="vFaders">フェーダー割当（出力）</param>
+/// <param name="vGroups">グループ（出力）</param>
+/// <returns></returns>
+/// <remarks>
+/// スイッチ・フェーダー割当は使用する最大番号までの配列とし、番号で直接参照する
+/// 値の逆引きはグループ単位で値先頭からの配列とする
+/// </remarks>
+bool CLineUnitMap::Compile(const std::vector<std::vector<std::string>>& lines,
+	std::vector<LineUnitSwitch>& vSwitches, std::vector<int>& vFaders, std::vector<LineUnitGroup>& vGroups)
+{
+	vSwitches.clear();
+	vFaders.clear();
+	vGroups.clear();
+
+	// グループ単位の値とスイッチ番号（逆引き生成用）
+	std::vector<std::vector<std::pair<int, int>>> vValues{};
+
+	int row = 0;
+	for (auto& columns : lines)
+	{
+		++row;
+		std::string sAction{}, sPath{}, sQuery{};
+		if (!CommGetColumnValue(columns, (int)LineUnitMapColumn::COLUMN_ACTION, sAction) || Trim(sAction).empty())
+			continue;
+
+		LineUnitAction eAction = ToLineUnitAction(sAction);
+		int nFirst = 0, nLast = 0, nValue = 0, nOn = 0, nOff = 0;
+		bool bQuery = false;
+		CommGetColumnValue(columns, (int)LineUnitMapColumn::COLUMN_PATH, sPath);
+		sPath = Trim(sPath);
+		if ((eAction == LineUnitAction::ACTION_NONE) || sPath.empty()
+		 || !GetColumnNumber(columns, LineUnitMapColumn::COLUMN_SWITCH_FIRST, 1, LINE_UNIT_SWITCH_MAX, nFirst)
+		 || !GetColumnNumber(columns, LineUnitMapColumn::COLUMN_SWITCH_LAST, 1, LINE_UNIT_SWITCH_MAX, nLast)
+		 || !GetColumnNumber(columns, LineUnitMapColumn::COLUMN_VALUE_FIRST, INT16_MIN, INT16_MAX, nValue)
+		 || !GetColumnNumber(columns, LineUnitMapColumn::COLUMN_ON_PALETTE, 0, INT8_MAX, nOn)
+		 || !GetColumnNumber(columns, LineUnitMapColumn::COLUMN_OFF_PALETTE, 0, INT8_MAX, nOff))
+		{
+			ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "invalid line unit map row %d.\n", row);
+			return false;
+		}
+		// 解放時状態要求は省略可
+		if (CommGetColumnValue(columns, (int)LineUnitMapColumn::COLUMN_RELEASE_QUERY, sQuery) && !Trim(sQuery).empty())
+			ToBool(Trim(sQuery), bQuery);
+
+		// 同一パスはグループをまとめる
+		auto itr = std::find_if(vGroups.begin(), vGroups.end(), [&sPath](const LineUnitGroup& g) { return g.m_sPath == sPath; });
+		if (itr == vGroups.end())
+		{
+			if (vGroups.size() >= LINE_UNIT_GROUP_MAX)
+			{
+				ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "too many line unit map groups, row %d.\n", row);
+				return false;
+			}
+			LineUnitGroup group{};
+			group.m_eAction = eAction;
+			group.m_sPath = sPath;
+			group.m_nOnPalette = (char)nOn;
+			group.m_nOffPalette = (char)nOff;
+			group.m_bReleaseQuery = bQuery;
+			group.m_nFader = (eAction == LineUnitAction::ACTION_FADER) ? nValue : 0;
+			vGroups.push_back(group);
+			vValues.emplace_back();
+			itr = vGroups.end() - 1;
+		}
+		else if ((itr->m_eAction != eAction) || (itr->m_nOnPalette != (char)nOn) || (itr->m_nOffPalette != (char)nOff)
+			  || (itr->m_bReleaseQuery != bQuery) || ((eAction == LineUnitAction::ACTION_FADER) && (itr->m_nFader != nValue)))
+		{
+			ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "line unit map row %d conflicts with same path, %s\n", row, sPath.c_str());
+			return false;
+		}
+		int nGroup = (int)(itr - vGroups.begin());
+
+		if (eAction == LineUnitAction::ACTION_FADER)
+		{
+			// フェーダー番号で参照、スイッチはレベル表示 LED
+			if (!IsRange(nValue, 0, LINE_UNIT_FADER_MAX))
+			{
+				ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "invalid fader number at line unit map row %d.\n", row);
+				return false;
+			}
+			if ((int)vFaders.size() <= nValue)
+				vFaders.resize(nValue + 1, -1);
+			if ((vFaders[nValue] >= 0) && (vFaders[nValue] != nGroup))
+			{
+				ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "duplicate fader %d at line unit map row %d.\n", nValue, row);
+				return false;
+			}
+			vFaders[nValue] = nGroup;
+		}
+
+		int nStep = (nFirst <= nLast) ? 1 : -1;
+		for (int nSwitch = nFirst, k = 0; ; nSwitch += nStep, ++k)
+		{
+			itr->m_vSwitches.push_back((uint16_t)nSwitch);
+			if (eAction != LineUnitAction::ACTION_FADER)
+			{
+				if ((int)vSwitches.size() <= nSwitch)
+					vSwitches.resize(nSwitch + 1);
+				LineUnitSwitch& sSwitch = vSwitches[nSwitch];
+				if (sSwitch.m_eAction != LineUnitAction::ACTION_NONE)
+				{
+					ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "duplicate switch %d at line unit map row %d.\n", nSwitch, row);
+					return false;
+				}
+				sSwitch.m_eAction = eAction;
+				sSwitch.m_nGroup = (uint8_t)nGroup;
+				sSwitch.m_nValue = nValue + k;
+				vValues[nGroup].emplace_back(nValue + k, nSwitch);
+			}
+			if (nSwitch == nLast)
+				break;
+		}
+	}
+
+	// 値からスイッチ番号への逆引き
+	for (size_t i = 0; i < vGroups.size(); ++i)
+	{
+		auto& group = vGroups[i];
+		auto& values = vValues[i];
+		if ((group.m_eAction != LineUnitAction::ACTION_SELECT) || values.empty())
+			continue;
+
+		auto range = std::minmax_element(values.begin(), values.end());
+		int nMin = range.first->first;
+		int nMax = range.second->first;
+		if (nMax - nMin >= LINE_UNIT_VALUE_RANGE_MAX)
+		{
+			ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "too wide value range, %s\n", group.m_sPath.c_str());
+			return false;
+		}
+		group.m_nValueFirst = nMin;
+		group.m_vValueSwitches.assign((size_t)(nMax - nMin + 1), 0);
+		for (auto& value : values)
+		{
+			uint16_t& nSwitch = group.m_vValueSwitches[(size_t)(value.first - nMin)];
+			if (nSwitch != 0)
+			{
+				ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "duplicate value %d, %s\n", value.first, group.m_sPath.c_str());
+				return false;
+			}
+			nSwitch = (uint16_t)value.second;
+		}
+	}
+
+	return !vGroups.empty();
+}
+
+/// <summary>
+/// 単一インスタンス（実体）
+/// </summary>
+std::unique_ptr<CLineUnitMap> CLineUnitMap::m_pInstance{};
+/// <summary>
+/// インスタンス取得
+/// </summary>
+/// <returns></returns>
+CLineUnitMap* CLineUnitMap::GetInstance()
+{
+	if (!m_pInstance)
+		m_pInstance.reset(new CLineUnitMap());
+	return m_pInstance.get();
+}
@@ -0,0 +1,238 @@
+﻿#pragma once
+
+#include "Utilities.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// ====================================================================
+// LINE UNIT 対応表ファイル書式（CSV）
+// ====================================================================
+// 種別, スイッチ先頭, スイッチ末尾, Ember パス, 値先頭, 点灯パレット, 消灯パレット, 解放時状態要求
+// - 種別は select（値選択）/ invoke（関数実行）/ fader（フェーダー）
+// - スイッチ先頭から末尾へ順に値先頭から 1 ずつ増やした値を対応付ける（先頭 > 末尾も可）
+// - 同一パスの行は 1 つのグループへまとめる（値の振り分け先もグループ単位）
+// - fader の値先頭はフェーダー番号、スイッチはレベル表示 LED（先頭から点灯）
+/// <summary>スイッチ番号上限</summary>
+#define LINE_UNIT_SWITCH_MAX		0xFFFF
+/// <summary>フェーダー番号上限</summary>
+#define LINE_UNIT_FADER_MAX			0xFF
+/// <summary>グループ数上限（振り分け識別として使用）</summary>
+#define LINE_UNIT_GROUP_MAX			0xFF
+/// <summary>値範囲上限（グループ単位）</summary>
+#define LINE_UNIT_VALUE_RANGE_MAX	1024
+
+
+// ====================================================================
+
+/// <summary>
+/// 対応表カラム位置
+/// </summary>
+enum class LineUnitMapColumn : uint8_t
+{
+	/// <summary>種別</summary>
+	COLUMN_ACTION = 0,
+	/// <summary>スイッチ先頭</summary>
+	COLUMN_SWITCH_FIRST,
+	/// <summary>スイッチ末尾</summary>
+	COLUMN_SWITCH_LAST,
+	/// <summary>Ember パス</summary>
+	COLUMN_PATH,
+	/// <summary>値先頭（fader はフェーダー番号）</summary>
+	COLUMN_VALUE_FIRST,
+	/// <summary>点灯パレット</summary>
+	COLUMN_ON_PALETTE,
+	/// <summary>消灯パレット</summary>
+	COLUMN_OFF_PALETTE,
+	/// <summary>解放時状態要求</summary>
+	COLUMN_RELEASE_QUERY,
+
+
+	/// <summary>カラム数</summary>
+	COLUMN_COUNT,
+};
+
+/// <summary>
+/// スイッチ操作種別
+/// </summary>
+enum class LineUnitAction : uint8_t
+{
+	/// <summary>割当なし</summary>
+	ACTION_NONE = 0,
+	/// <summary>値選択（押下でパラメータ設定、通知で点灯切替）</summary>
+	ACTION_SELECT,
+	/// <summary>関数実行（解放で実行）</summary>
+	ACTION_INVOKE,
+	/// <summary>フェーダー</summary>
+	ACTION_FADER,
+
+
+	/// <summary>種別数</summary>
+	ACTION_COUNT,
+};
+
+/// <summary>
+/// スイッチ割当（スイッチ番号で直接参照）
+/// </summary>
+class LineUnitSwitch
+{
+public:
+	/// <summary>
+	/// コンストラクタ
+	/// </summary>
+	LineUnitSwitch() :
+		m_eAction(LineUnitAction::ACTION_NONE),
+		m_nGroup(0),
+		m_nValue(0)
+	{
+	}
+
+	/// <summary>操作種別</summary>
+	LineUnitAction m_eAction;
+	/// <summary>グループ（振り分け識別）</summary>
+	uint8_t m_nGroup;
+	/// <summary>設定値</summary>
+	int m_nValue;
+};
+
+/// <summary>
+/// 割当グループ（Ember パス単位）
+/// </summary>
+class LineUnitGroup
+{
+public:
+	/// <summary>
+	/// コンストラクタ
+	/// </summary>
+	LineUnitGroup() :
+		m_eAction(LineUnitAction::ACTION_NONE),
+		m_sPath(),
+		m_nOnPalette(0),
+		m_nOffPalette(0),
+		m_bReleaseQuery(false),
+		m_nFader(0),
+		m_vSwitches(),
+		m_nValueFirst(0),
+		m_vValueSwitches()
+	{
+	}
+
+	/// <summary>値に対応するスイッチ番号</summary>
+	/// <param name="nValue"></param>
+	/// <returns>対応なしは 0</returns>
+	int ValueSwitch(long long nValue) const
+	{
+		long long pos = nValue - m_nValueFirst;
+		return ((pos >= 0) && (pos < (long long)m_vValueSwitches.size())) ? m_vValueSwitches[(size_t)pos] : 0;
+	}
+
+	/// <summary>操作種別</summary>
+	LineUnitAction m_eAction;
+	/// <summary>Ember パス</summary>
+	std::string m_sPath;
+	/// <summary>点灯パレット</summary>
+	char m_nOnPalette;
+	/// <summary>消灯パレット</summary>
+	char m_nOffPalette;
+	/// <summary>解放時にグループ内スイッチの状態を要求する</summary>
+	bool m_bReleaseQuery;
+	/// <summary>フェーダー番号（fader のみ）</summary>
+	int m_nFader;
+	/// <summary>スイッチ番号（記述順、fader はレベル表示 LED）</summary>
+	std::vector<uint16_t> m_vSwitches;
+	/// <summary>値先頭</summary>
+	int m_nValueFirst;
+	/// <summary>値からスイッチ番号への逆引き（値先頭からの相対位置）</summary>
+	std::vector<uint16_t> m_vValueSwitches;
+};
+
+
+// ====================================================================
+
+/// <summary>
+/// CLineUnitMap
+/// LINE UNIT スイッチ対応表クラス
+/// </summary>
+/// <remarks>
+/// シングルトン使用想定
+/// 対応表ファイルが無い場合は組込の既定表を使用する
+/// 読み込み時にスイッチ番号で直接参照する配列と、グループからの逆引きを生成する
+/// </remarks>
+class CLineUnitMap
+{
+public:
+	/// <summary>
+	/// コンストラクタ
+	/// </summary>
+	CLineUnitMap();
+
+	/// <summary>
+	/// デストラクタ
+	/// </summary>
+	~CLineUnitMap();
+
+	/// <summary>対応表読み込み</summary>
+	/// <param name="sPath">対応表ファイル（無い場合は既定表）</param>
+	/// <returns>ファイル内容を適用したか</returns>
+	/// <remarks>ファイル内容が不正な場合は既定表を使用する</remarks>
+	bool Load(const std::string& sPath);
+
+	/// <summary>スイッチ割当</summary>
+	/// <param name="nSwitch">スイッチ番号</param>
+	/// <returns>割当なしは nullptr</returns>
+	const LineUnitSwitch* Switch(int nSwitch) const
+	{
+		if ((nSwitch < 0) || (nSwitch >= (int)m_vSwitches.size()))
+			return nullptr;
+		const LineUnitSwitch* pSwitch = &m_vSwitches[nSwitch];
+		return (pSwitch->m_eAction != LineUnitAction::ACTION_NONE) ? pSwitch : nullptr;
+	}
+	/// <summary>フェーダー割当</summary>
+	/// <param name="nFader">フェーダー番号</param>
+	/// <returns>割当なしは nullptr</returns>
+	const LineUnitGroup* Fader(int nFader) const
+	{
+		if ((nFader < 0) || (nFader >= (int)m_vFaders.size()) || (m_vFaders[nFader] < 0))
+			return nullptr;
+		return &m_vGroups[m_vFaders[nFader]];
+	}
+	/// <summary>グループ</summary>
+	/// <param name="nGroup">グループ（振り分け識別）</param>
+	/// <returns>範囲外は nullptr</returns>
+	const LineUnitGroup* Group(int nGroup) const
+	{
+		return ((nGroup >= 0) && (nGroup < (int)m_vGroups.size())) ? &m_vGroups[nGroup] : nullptr;
+	}
+	/// <summary>グループ一覧</summary>
+	/// <returns></returns>
+	const std::vector<LineUnitGroup>& Groups() const { return m_vGroups; }
+
+	/// <summary>
+	/// インスタンス取得
+	/// </summary>
+	/// <returns></returns>
+	static CLineUnitMap* GetInstance();
+
+private:
+	/// <summary>対応表生成</summary>
+	/// <param name="lines">行単位カラム</param>
+	/// <param name="vSwitches">スイッチ割当（出力）</param>
+	/// <param name="vFaders">フェーダー割当（出力）</param>
+	/// <param name="vGroups">グループ（出力）</param>
+	/// <returns></returns>
+	static bool Compile(const std::vector<std::vector<std::string>>& lines,
+		std::vector<LineUnitSwitch>& vSwitches, std::vector<int>& vFaders, std::vector<LineUnitGroup>& vGroups);
+
+	/// <summary>スイッチ割当（スイッチ番号で参照）</summary>
+	std::vector<LineUnitSwitch> m_vSwitches;
+	/// <summary>フェーダー割当（フェーダー番号で参照、値はグループ、未割当は -1）</summary>
+	std::vector<int> m_vFaders;
+	/// <summary>グループ</summary>
+	std::vector<LineUnitGroup> m_vGroups;
+
+	/// <summary>
+	/// 単一インスタンス（宣言）
+	/// </summary>
+	static std::unique_ptr<CLineUnitMap> m_pInstance;
+};
@@ -0,0 +1,387 @@
+﻿#include "LineUnitPanel.h"
+#include "Capture.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace utilities;
+
+
+/// <summary>
+/// コンストラクタ
+/// </summary>
+/// <param name="hSocket">接続済ソケット（リプレイ時は 0）</param>
+/// <param name="nId">パネル識別</param>
+/// <param name="sAddress">接続元</param>
+CLineUnitPanel::CLineUnitPanel(SOCKET hSocket, int nId, const std::string& sAddress) :
+	m_bLongPush(false),
+	m_nFaderValue(0),
+	m_bInitialized(false),
+	m_mtxQueue(),
+	m_hSocket(hSocket),
+	m_nId(nId),
+	m_sAddress(sAddress),
+	m_bConnected(true),
+	m_vReceived(),
+	m_dqFrames(),
+	m_nHeadOffset(0),
+	m_sStatistics(),
+	m_tpAccepted(std::chrono::steady_clock::now()),
+	m_pBringUp()
+{
+}
+
+/// <summary>
+/// デストラクタ
+/// </summary>
+CLineUnitPanel::~CLineUnitPanel()
+{
+	Close();
+}
+
+/// <summary>受信データを FORA フレームへ分割</summary>
+/// <param name="pBuffer"></param>
+/// <param name="length"></param>
+/// <param name="fnFrame">フレーム単位の処理（フレーム先頭, フレーム長）</param>
+/// <returns>処理フレーム数</returns>
+/// <remarks>
+/// フレーム途中までの受信は次回の受信と連結する
+/// ヘッダ不一致の位置は読み飛ばし、次のヘッダから再同期する
+/// </remarks>
+size_t CLineUnitPanel::Receive(const char* pBuffer, int length, const std::function<void(char*, int)>& fnFrame)
+{
+	static const char aHeader[] = { 'F', 'O', 'R', 'A' };
+
+	if (pBuffer && (length > 0))
+		m_vReceived.insert(m_vReceived.end(), pBuffer, pBuffer + length);
+
+	size_t nFrames = 0;
+	size_t pos = 0;
+	while (m_vReceived.size() - pos >= LINE_UNIT_FRAME_HEADER_SIZE)
+	{
+		char* pFrame = m_vReceived.data() + pos;
+		if (memcmp(pFrame, aHeader, sizeof(aHeader)) != 0)
+		{
+			++pos;
+			continue;
+		}
+
+		//コマンド番号以降のデータ長をバイトカウントから取得
+		int nByteCount = ((unsigned char)pFrame[4] << 8) + (unsigned char)pFrame[5];
+		int nFrameLength = LINE_UNIT_FRAME_HEADER_SIZE + nByteCount;
+		if ((nByteCount == 0) || (nFrameLength > LINE_UNIT_FRAME_MAX))
+		{
+			pos += sizeof(aHeader);
+			continue;
+		}
+		if (m_vReceived.size() - pos < (size_t)nFrameLength)
+			break;
+
+		fnFrame(pFrame, nFrameLength);
+		pos += nFrameLength;
+		++nFrames;
+	}
+	m_vReceived.erase(m_vReceived.begin(), m_vReceived.begin() + pos);
+	return nFrames;
+}
+
+/// <summary>送信（パネル個別）</summary>
+/// <param name="pBuffer"></param>
+/// <param name="length"></param>
+/// <returns>送信不能（切断済）の場合は false</returns>
+bool CLineUnitPanel::Send(const char* pBuffer, int length)
+{
+	if (!pBuffer || (length <= 0))
+		return true;
+	return Send(std::make_shared<const std::vector<char>>(pBuffer, pBuffer + length));
+}
+
+/// <summary>送信（符号化済フレームの共有）</summary>
+/// <param name="pFrames"></param>
+/// <returns>送信不能（切断済）の場合は false</returns>
+/// <remarks>
+/// 送信待ちが無ければその場で送信し、送信できない分のみ送信待ちへ残す
+/// </remarks>
+bool CLineUnitPanel::Send(const LineUnitFrames& pFrames)
+{
+	std::lock_guard<std::mutex> lock(m_mtxQueue);
+	if (!m_bConnected)
+		return false;
+	if (!pFrames || pFrames->empty())
+		return true;
+
+	enqueue(pFrames);
+	return flush();
+}
+
+/// <summary>初期表示の送信（送信完了で準備完了とする）</summary>
+/// <param name="pFrames"></param>
+/// <returns>送信不能（切断済）の場合は false</returns>
+/// <remarks>
+/// 先行する送信待ちがあればその後に送信し、送信完了時に受け付けからの時間を記録する
+/// </remarks>
+bool CLineUnitPanel::BringUp(const LineUnitFrames& pFrames)
+{
+	std::lock_guard<std::mutex> lock(m_mtxQueue);
+	if (!m_bConnected)
+		return false;
+	if (!pFrames || pFrames->empty())
+		return true;
+
+	m_pBringUp = pFrames;
+	enqueue(pFrames);
+	return flush();
+}
+
+/// <summary>送信待ちの出力</summary>
+/// <returns>送信不能（切断済）の場合は false</returns>
+bool CLineUnitPanel::Flush()
+{
+	std::lock_guard<std::mutex> lock(m_mtxQueue);
+	return m_bConnected && flush();
+}
+
+/// <summary>送信待ちあり</summary>
+/// <returns></returns>
+bool CLineUnitPanel::Pending()
+{
+	std::lock_guard<std::mutex> lock(m_mtxQueue);
+	return !m_dqFrames.empty();
+}
+
+/// <summary>切断（以降の送信は破棄）</summary>
+void CLineUnitPanel::Close()
+{
+	std::lock_guard<std::mutex> lock(m_mtxQueue);
+	m_bConnected = false;
+	m_dqFrames.clear();
+	m_nHeadOffset = 0;
+	m_sStatistics.m_nQueuedBytes = 0;
+	m_pBringUp.reset();
+	if (m_hSocket != 0)
+	{
+		try
+		{
+			closesocket(m_hSocket);
+		}
+		catch (...) {}
+		m_hSocket = 0;
+	}
+}
+
+/// <summary>送信集計</summary>
+/// <returns></returns>
+LineUnitQueueStatistics CLineUnitPanel::Statistics()
+{
+	std::lock_guard<std::mutex> lock(m_mtxQueue);
+	LineUnitQueueStatistics sStatistics = m_sStatistics;
+	sStatistics.m_nQueued = m_dqFrames.size();
+	return sStatistics;
+}
+
+/// <summary>送信待ちへ追加（ロック済）</summary>
+/// <param name="pFrames"></param>
+/// <remarks>
+/// 上限を超えた場合は送信途中のものを除き古いものから破棄する
+/// </remarks>
+void CLineUnitPanel::enqueue(const LineUnitFrames& pFrames)
+{
+	m_dqFrames.push_back(pFrames);
+	m_sStatistics.m_nQueuedBytes += pFrames->size();
+
+	size_t pos = (m_nHeadOffset > 0) ? 1 : 0;
+	while ((m_sStatistics.m_nQueuedBytes > LINE_UNIT_QUEUE_MAX_BYTES) && (m_dqFrames.size() > pos + 1))
+	{
+		if (m_dqFrames[pos] == m_pBringUp)
+			m_pBringUp.reset();
+		m_sStatistics.m_nQueuedBytes -= m_dqFrames[pos]->size();
+		m_dqFrames.erase(m_dqFrames.begin() + pos);
+		++m_sStatistics.m_nDropped;
+	}
+	m_sStatistics.m_nMaxQueuedBytes = std::max(m_sStatistics.m_nMaxQueuedBytes, m_sStatistics.m_nQueuedBytes);
+}
+
+/// <summary>送信待ちの出力（ロック済）</summary>
+/// <returns></returns>
+/// <remarks>
+/// 送信内容はキャプチャ有効時に記録する
+/// リプレイ中は送信せず、送信済として扱う
+/// </remarks>
+bool CLineUnitPanel::flush()
+{
+	auto pCapture = CCapture::GetInstance();
+	while (!m_dqFrames.empty())
+	{
+		const auto& pFrames = m_dqFrames.front();
+		const char* pBuffer = pFrames->data() + m_nHeadOffset;
+		int length = (int)(pFrames->size() - m_nHeadOffset);
+
+		int sendlen = length;
+		if (!pCapture->Replaying())
+		{
+			sendlen = send(m_hSocket, pBuffer, length, 0);
+			if (sendlen <= 0)
+			{
+				if ((sendlen < 0) && SocketWouldBlock())
+					break;
+
+				Trace(__FILE__, __LINE__, __FUNCTION__, "panel %d send failed.\n", m_nId);
+				m_bConnected = false;
+				m_dqFrames.clear();
+				m_nHeadOffset = 0;
+				m_sStatistics.m_nQueuedBytes = 0;
+				m_pBringUp.reset();
+				return false;
+			}
+			if (pCapture->Recording())
+				pCapture->Record(ClientSocketId::SOCK_HWIF, CaptureDirection::CAPTURE_SEND, pBuffer, sendlen);
+		}
+
+		m_nHeadOffset += sendlen;
+		m_sStatistics.m_nQueuedBytes -= sendlen;
+		m_sStatistics.m_nSentBytes += sendlen;
+		if (m_nHeadOffset >= pFrames->size())
+		{
+			if (m_pBringUp && (pFrames == m_pBringUp))
+			{
+				m_pBringUp.reset();
+				m_sStatistics.m_dReadyMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_tpAccepted).count();
+				Trace(__FILE__, __LINE__, __FUNCTION__, "panel %d ready, %.3f msec from accept.\n", m_nId, m_sStatistics.m_dReadyMilliseconds);
+			}
+			m_dqFrames.pop_front();
+			m_nHeadOffset = 0;
+		}
+	}
+	return true;
+}
+
+
+// ====================================================================
+
+/// <summary>
+/// コンストラクタ
+/// </summary>
+CLineUnitPanels::CLineUnitPanels() :
+	m_mtxPanels(),
+	m_vPanels(),
+	m_nNextId(1),
+	m_tpReport(std::chrono::steady_clock::now())
+{
+}
+
+/// <summary>
+/// デストラクタ
+/// </summary>
+/// <remarks>各パネルのソケットはパネルの破棄時に閉じる</remarks>
+CLineUnitPanels::~CLineUnitPanels()
+{
+}
+
+/// <summary>パネル追加</summary>
+/// <param name="hSocket">接続済ソケット</param>
+/// <param name="cad">接続元</param>
+/// <returns>上限超過時は nullptr</returns>
+std::shared_ptr<CLineUnitPanel> CLineUnitPanels::Add(SOCKET hSocket, const struct sockaddr_in& cad)
+{
+	char address[INET_ADDRSTRLEN] = "";
+	inet_ntop(AF_INET, (void*)&cad.sin_addr, address, sizeof(address));
+	std::string sAddress = std::string(address) + ":" + std::to_string(ntohs(cad.sin_port));
+
+	std::lock_guard<std::mutex> lock(m_mtxPanels);
+	if (m_vPanels.size() >= LINE_UNIT_PANEL_MAX)
+	{
+		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "too many panels, refused %s.\n", sAddress.c_str());
+		return nullptr;
+	}
+	if (!SetSocketNonBlocking(hSocket, true))
+		ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "panel socket is blocking, %s.\n", sAddress.c_str());
+
+	auto pPanel = std::make_shared<CLineUnitPanel>(hSocket, m_nNextId++, sAddress);
+	m_vPanels.push_back(pPanel);
+	Trace(__FILE__, __LINE__, __FUNCTION__, "panel %d connected, %s, panels = %zu.\n", pPanel->Id(), sAddress.c_str(), m_vPanels.size());
+	return pPanel;
+}
+
+/// <summary>パネル削除（切断）</summary>
+/// <param name="pPanel"></param>
+void CLineUnitPanels::Remove(const std::shared_ptr<CLineUnitPanel>& pPanel)
+{
+	if (!pPanel)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxPanels);
+		m_vPanels.erase(std::remove(m_vPanels.begin(), m_vPanels.end(), pPanel), m_vPanels.end());
+	}
+
+	auto sStatistics = pPanel->Statistics();
+	Trace(__FILE__, __LINE__, __FUNCTION__, "panel %d disconnected, %s, sent = %zu bytes, max queued = %zu bytes, dropped = %zu.\n",
+		pPanel->Id(), pPanel->Address().c_str(), sStatistics.m_nSentBytes, sStatistics.m_nMaxQueuedBytes, sStatistics.m_nDropped);
+	pPanel->Close();
+}
+
+/// <summary>全パネル削除（切断）</summary>
+void CLineUnitPanels::Clear()
+{
+	for (auto& pPanel : Panels())
+		Remove(pPanel);
+}
+
+/// <summary>接続中パネル一覧</summary>
+/// <returns></returns>
+std::vector<std::shared_ptr<CLineUnitPanel>> CLineUnitPanels::Panels()
+{
+	std::lock_guard<std::mutex> lock(m_mtxPanels);
+	return m_vPanels;
+}
+
+/// <summary>接続中パネル数</summary>
+/// <returns></returns>
+size_t CLineUnitPanels::Count()
+{
+	std::lock_guard<std::mutex> lock(m_mtxPanels);
+	return m_vPanels.size();
+}
+
+/// <summary>全パネルへ送信</summary>
+/// <param name="pFrames">符号化済フレーム（全パネルで共有）</param>
+/// <remarks>
+/// 送信できないパネルはキューへ残し、他パネルへの送信を待たせない
+/// 切断検出時の削除は受信側（メインスレッド）で行う
+/// </remarks>
+void CLineUnitPanels::Broadcast(const LineUnitFrames& pFrames)
+{
+	for (auto& pPanel : Panels())
+		pPanel->Send(pFrames);
+}
+
+/// <summary>送信待ち状況の出力（前回出力から間隔経過時のみ）</summary>
+/// <param name="bForce">間隔によらず出力</param>
+void CLineUnitPanels::Report(bool bForce)
+{
+	auto now = std::chrono::steady_clock::now();
+	if (!bForce && (now - m_tpReport < std::chrono::milliseconds(LINE_UNIT_REPORT_MSEC)))
+		return;
+	m_tpReport = now;
+
+	for (auto& pPanel : Panels())
+	{
+		auto sStatistics = pPanel->Statistics();
+		Trace(__FILE__, __LINE__, __FUNCTION__, "panel %d, %s : ready = %.3f msec, queued = %zu (%zu bytes), max queued = %zu bytes, sent = %zu bytes, dropped = %zu\n",
+			pPanel->Id(), pPanel->Address().c_str(), sStatistics.m_dReadyMilliseconds, sStatistics.m_nQueued, sStatistics.m_nQueuedBytes,
+			sStatistics.m_nMaxQueuedBytes, sStatistics.m_nSentBytes, sStatistics.m_nDropped);
+	}
+}
+
+/// <summary>
+/// 単一インスタンス（実体）
+/// </summary>
+std::unique_ptr<CLineUnitPanels> CLineUnitPanels::m_pInstance{};
+/// <summary>
+/// インスタンス取得
+/// </summary>
+/// <returns></returns>
+CLineUnitPanels* CLineUnitPanels::GetInstance()
+{
+	if (!m_pInstance)
+		m_pInstance.reset(new CLineUnitPanels());
+	return m_pInstance.get();
+}
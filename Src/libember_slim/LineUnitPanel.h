@@ -0,0 +1,248 @@
+﻿#pragma once
+
+#include "SocketEx.h"
+#include "Utilities.h"
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+// ====================================================================
+// LINE UNIT パネル接続
+// ====================================================================
+// 各パネルは個別の受信状態（ボタン状態）と送信待ちキューを持つ
+// Ember+ 通知から生成したフレームは 1 度だけ符号化し、全パネルのキューで共有する
+// ソケットはノンブロッキングとし、送信できない分はキューへ残して後続のパネルを待たせない
+// 受信はパネル単位に蓄積し、ヘッダ（"FORA" + バイトカウント(2)）でフレームへ分割する
+// 接続直後の初期表示は 1 つの送信にまとめ、送信完了までを受け付けからの準備時間として計測する
+/// <summary>同時接続パネル数上限</summary>
+#define LINE_UNIT_PANEL_MAX			8
+/// <summary>パネル単位の送信待ち上限（バイト数、超過時は古いものから破棄）</summary>
+#define LINE_UNIT_QUEUE_MAX_BYTES	(64 * 1024)
+/// <summary>送信待ち状況の出力間隔（msec）</summary>
+#define LINE_UNIT_REPORT_MSEC		10000
+/// <summary>FORA フレームヘッダ長（"FORA" + バイトカウント）</summary>
+#define LINE_UNIT_FRAME_HEADER_SIZE	6
+/// <summary>FORA フレーム長上限（受信、超過時はヘッダを破棄して再同期）</summary>
+#define LINE_UNIT_FRAME_MAX			4096
+
+
+// ====================================================================
+
+/// <summary>
+/// 符号化済送信フレーム（複数フレームの連結、全パネルで共有）
+/// </summary>
+typedef std::shared_ptr<const std::vector<char>> LineUnitFrames;
+
+/// <summary>
+/// パネル送信集計
+/// </summary>
+class LineUnitQueueStatistics
+{
+public:
+	/// <summary>
+	/// コンストラクタ
+	/// </summary>
+	LineUnitQueueStatistics() :
+		m_nQueued(0),
+		m_nQueuedBytes(0),
+		m_nMaxQueuedBytes(0),
+		m_nSentBytes(0),
+		m_nDropped(0),
+		m_dReadyMilliseconds(-1)
+	{
+	}
+
+	/// <summary>送信待ち数</summary>
+	size_t m_nQueued;
+	/// <summary>送信待ちバイト数</summary>
+	size_t m_nQueuedBytes;
+	/// <summary>送信待ちバイト数（最大）</summary>
+	size_t m_nMaxQueuedBytes;
+	/// <summary>送信済バイト数</summary>
+	size_t m_nSentBytes;
+	/// <summary>上限超過による破棄数</summary>
+	size_t m_nDropped;
+	/// <summary>受け付けから初期表示の送信完了まで（msec、未完了は負数）</summary>
+	double m_dReadyMilliseconds;
+};
+
+/// <summary>
+/// CLineUnitPanel
+/// LINE UNIT パネル接続クラス
+/// </summary>
+/// <remarks>
+/// 受信処理とボタン状態はメインスレッドのみで参照する
+/// 送信はメインスレッド・コンシューマスレッドの双方から呼び出される
+/// </remarks>
+class CLineUnitPanel
+{
+public:
+	/// <summary>
+	/// コンストラクタ
+	/// </summary>
+	/// <param name="hSocket">接続済ソケット（リプレイ時は 0）</param>
+	/// <param name="nId">パネル識別</param>
+	/// <param name="sAddress">接続元</param>
+	CLineUnitPanel(SOCKET hSocket, int nId, const std::string& sAddress);
+
+	/// <summary>
+	/// デストラクタ
+	/// </summary>
+	~CLineUnitPanel();
+
+	/// <summary>ソケット</summary>
+	/// <returns></returns>
+	SOCKET Socket() { return m_hSocket; }
+	/// <summary>パネル識別</summary>
+	/// <returns></returns>
+	int Id() { return m_nId; }
+	/// <summary>接続元</summary>
+	/// <returns></returns>
+	const std::string& Address() { return m_sAddress; }
+
+	/// <summary>受信データを FORA フレームへ分割</summary>
+	/// <param name="pBuffer"></param>
+	/// <param name="length"></param>
+	/// <param name="fnFrame">フレーム単位の処理（フレーム先頭, フレーム長）</param>
+	/// <returns>処理フレーム数</returns>
+	/// <remarks>フレーム途中までの受信は次回の受信と連結する</remarks>
+	size_t Receive(const char* pBuffer, int length, const std::function<void(char*, int)>& fnFrame);
+
+	/// <summary>送信（パネル個別）</summary>
+	/// <param name="pBuffer"></param>
+	/// <param name="length"></param>
+	/// <returns>送信不能（切断済）の場合は false</returns>
+	bool Send(const char* pBuffer, int length);
+	/// <summary>送信（符号化済フレームの共有）</summary>
+	/// <param name="pFrames"></param>
+	/// <returns>送信不能（切断済）の場合は false</returns>
+	bool Send(const LineUnitFrames& pFrames);
+	/// <summary>初期表示の送信（送信完了で準備完了とする）</summary>
+	/// <param name="pFrames"></param>
+	/// <returns>送信不能（切断済）の場合は false</returns>
+	bool BringUp(const LineUnitFrames& pFrames);
+	/// <summary>送信待ちの出力</summary>
+	/// <returns>送信不能（切断済）の場合は false</returns>
+	bool Flush();
+	/// <summary>送信待ちあり</summary>
+	/// <returns></returns>
+	bool Pending();
+	/// <summary>切断（以降の送信は破棄）</summary>
+	void Close();
+	/// <summary>送信集計</summary>
+	/// <returns></returns>
+	LineUnitQueueStatistics Statistics();
+
+	/// <summary>長押し判定（PGM 列の解放後に押下継続を受け付ける）</summary>
+	bool m_bLongPush;
+	/// <summary>直近のフェーダー送信値（百分率）</summary>
+	int m_nFaderValue;
+	/// <summary>初期設定済</summary>
+	bool m_bInitialized;
+
+private:
+	/// <summary>送信待ちへ追加（ロック済）</summary>
+	/// <param name="pFrames"></param>
+	void enqueue(const LineUnitFrames& pFrames);
+	/// <summary>送信待ちの出力（ロック済）</summary>
+	/// <returns></returns>
+	bool flush();
+
+	/// <summary></summary>
+	std::mutex m_mtxQueue;
+	/// <summary>ソケット</summary>
+	SOCKET m_hSocket;
+	/// <summary>パネル識別</summary>
+	int m_nId;
+	/// <summary>接続元</summary>
+	std::string m_sAddress;
+	/// <summary>接続中</summary>
+	bool m_bConnected;
+	/// <summary>受信途中のデータ</summary>
+	std::vector<char> m_vReceived;
+	/// <summary>送信待ち</summary>
+	std::deque<LineUnitFrames> m_dqFrames;
+	/// <summary>先頭の送信済位置</summary>
+	size_t m_nHeadOffset;
+	/// <summary>送信集計</summary>
+	LineUnitQueueStatistics m_sStatistics;
+	/// <summary>受け付け時刻</summary>
+	std::chrono::steady_clock::time_point m_tpAccepted;
+	/// <summary>送信完了待ちの初期表示</summary>
+	LineUnitFrames m_pBringUp;
+};
+
+
+// ====================================================================
+
+/// <summary>
+/// CLineUnitPanels
+/// LINE UNIT パネル接続一覧クラス
+/// </summary>
+/// <remarks>
+/// シングルトン使用想定
+/// 追加・削除はメインスレッド、一斉送信はコンシューマスレッドから呼び出される
+/// </remarks>
+class CLineUnitPanels
+{
+public:
+	/// <summary>
+	/// コンストラクタ
+	/// </summary>
+	CLineUnitPanels();
+
+	/// <summary>
+	/// デストラクタ
+	/// </summary>
+	~CLineUnitPanels();
+
+	/// <summary>パネル追加</summary>
+	/// <param name="hSocket">接続済ソケット</param>
+	/// <param name="cad">接続元</param>
+	/// <returns>上限超過時は nullptr</returns>
+	std::shared_ptr<CLineUnitPanel> Add(SOCKET hSocket, const struct sockaddr_in& cad);
+	/// <summary>パネル削除（切断）</summary>
+	/// <param name="pPanel"></param>
+	void Remove(const std::shared_ptr<CLineUnitPanel>& pPanel);
+	/// <summary>全パネル削除（切断）</summary>
+	void Clear();
+	/// <summary>接続中パネル一覧</summary>
+	/// <returns></returns>
+	std::vector<std::shared_ptr<CLineUnitPanel>> Panels();
+	/// <summary>接続中パネル数</summary>
+	/// <returns></returns>
+	size_t Count();
+
+	/// <summary>全パネルへ送信</summary>
+	/// <param name="pFrames">符号化済フレーム（全パネルで共有）</param>
+	void Broadcast(const LineUnitFrames& pFrames);
+	/// <summary>送信待ち状況の出力（前回出力から間隔経過時のみ）</summary>
+	/// <param name="bForce">間隔によらず出力</param>
+	void Report(bool bForce);
+
+	/// <summary>
+	/// インスタンス取得
+	/// </summary>
+	/// <returns></returns>
+	static CLineUnitPanels* GetInstance();
+
+private:
+	/// <summary></summary>
+	std::mutex m_mtxPanels;
+	/// <summary>接続中パネル</summary>
+	std::vector<std::shared_ptr<CLineUnitPanel>> m_vPanels;
+	/// <summary>次のパネル識別</summary>
+	int m_nNextId;
+	/// <summary>直近の状況出力時刻</summary>
+	std::chrono::steady_clock::time_point m_tpReport;
+
+	/// <summary>
+	/// 単一インスタンス（宣言）
+	/// </summary>
+	static std::unique_ptr<CLineUnitPanels> m_pInstance;
+};
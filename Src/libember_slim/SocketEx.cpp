@@ -66,6 +66,58 @@ namespace utilities
         return res;
     }
 
+    /// <summary>
+    /// 接続先情報生成（ソケットは生成しない）
+    /// </summary>
+    /// <param name="ipaddr">IPアドレス</param>
+    /// <param name="port">ポート番号</param>
+    /// <param name="sad">接続先情報（不正時は 0 クリア）</param>
+    /// <returns></returns>
+    bool CreateSocketAddress(std::string ipaddr, unsigned short port, struct sockaddr_in& sad)
+    {
+        memset(&sad, 0, sizeof(struct sockaddr_in));
+        if (!IsIPv4(ipaddr) || (port == 0))
+            return false;
+
+        sad.sin_family = AF_INET;
+        inet_pton(sad.sin_family, ipaddr.c_str(), &sad.sin_addr);
+        sad.sin_port = htons(port);
+        return true;
+    }
+
+    /// <summary>
+    /// ソケットのブロッキング設定
+    /// </summary>
+    /// <param name="socketHandle">ソケットハンドル</param>
+    /// <param name="nonBlocking">ノンブロッキングとする</param>
+    /// <returns></returns>
+    bool SetSocketNonBlocking(SOCKET socketHandle, bool nonBlocking)
+    {
+#if defined WIN32
+        u_long mode = nonBlocking ? 1 : 0;
+        return (ioctlsocket(socketHandle, FIONBIO, &mode) == 0);
+#else
+        int flags = fcntl(socketHandle, F_GETFL, 0);
+        if (flags < 0)
+            return false;
+        flags = nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+        return (fcntl(socketHandle, F_SETFL, flags) == 0);
+#endif
+    }
+
+    /// <summary>
+    /// 直前のソケット操作が完了待ち（ノンブロッキング）で終了したか
+    /// </summary>
+    /// <returns></returns>
+    bool SocketWouldBlock()
+    {
+#if defined WIN32
+        return (WSAGetLastError() == WSAEWOULDBLOCK);
+#else
+        return (errno == EWOULDBLOCK) || (errno == EAGAIN);
+#endif
+    }
+
 
     // ====================================================================
 }
@@ -16,6 +16,7 @@ typedef int SOCKET;
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <string.h>
 #endif
@@ -38,5 +39,28 @@ namespace utilities
     /// <param name="sad">接続先情報</param>
     /// <returns></returns>
     extern bool CreateSocketHandle(std::string ipaddr, unsigned short port, SOCKET& socketHandle, struct sockaddr_in& sad);
+
+    /// <summary>
+    /// 接続先情報生成（ソケットは生成しない）
+    /// </summary>
+    /// <param name="ipaddr">IPアドレス</param>
+    /// <param name="port">ポート番号</param>
+    /// <param name="sad">接続先情報（不正時は 0 クリア）</param>
+    /// <returns></returns>
+    extern bool CreateSocketAddress(std::string ipaddr, unsigned short port, struct sockaddr_in& sad);
+
+    /// <summary>
+    /// ソケットのブロッキング設定
+    /// </summary>
+    /// <param name="socketHandle">ソケットハンドル</param>
+    /// <param name="nonBlocking">ノンブロッキングとする</param>
+    /// <returns></returns>
+    extern bool SetSocketNonBlocking(SOCKET socketHandle, bool nonBlocking);
+
+    /// <summary>
+    /// 直前のソケット操作が完了待ち（ノンブロッキング）で終了したか
+    /// </summary>
+    /// <returns></returns>
+    extern bool SocketWouldBlock();
 }
 #endif
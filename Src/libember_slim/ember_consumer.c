@@ -22,6 +22,7 @@ extern "C" {
 
 #ifndef WIN32
 #include <unistd.h>
+#include <pthread.h>
 
 
 #define Sleep(msec) usleep(msec * 1000)
@@ -57,7 +58,8 @@ extern bool __CharToDouble(const char* pSrc, double* pDest);
 extern bool __GetQuitConsumerRequest(short socketId);
 extern EmberContent* __GetConsumerRequest(short socketId);
 extern void __NotifyReceivedConsumerResult(short socketId, EmberContent* pResult);
-extern void __EmberCommandConverter(EmberContent* pResult);
+extern void __EmberCommandConverter(int dispatchKey, const GlowParameter* pParameter);
+extern void __CaptureTraffic(short socketId, bool isSend, const void* pData, int length);
 
 
 // ====================================================================
@@ -101,52 +103,636 @@ static void onFailAssertion(pcstr pFileName, int lineNumber)
     __ErrorHandler(pFileName, lineNumber, __FUNCTION__, "called @ ber.\n");
 }
 
-static volatile int allocCount = 0;
-static void* allocMemoryImpl(size_t size)
+#if defined WIN32
+#define atomicIncrement(pValue) InterlockedIncrement(pValue)
+#define atomicDecrement(pValue) InterlockedDecrement(pValue)
+#define atomicCompareExchange(pValue, exchange, comparand) InterlockedCompareExchange(pValue, exchange, comparand)
+#define atomicAdd64(pValue, addend) InterlockedAdd64(pValue, addend)
+#define atomicCompareExchange64(pValue, exchange, comparand) InterlockedCompareExchange64(pValue, exchange, comparand)
+#else
+#define atomicIncrement(pValue) __sync_add_and_fetch(pValue, 1)
+#define atomicDecrement(pValue) __sync_sub_and_fetch(pValue, 1)
+#define atomicCompareExchange(pValue, exchange, comparand) __sync_val_compare_and_swap(pValue, comparand, exchange)
+#define atomicAdd64(pValue, addend) __sync_add_and_fetch(pValue, addend)
+#define atomicCompareExchange64(pValue, exchange, comparand) __sync_val_compare_and_swap(pValue, comparand, exchange)
+#endif
+
+
+static unsigned long long getMonotonicUsec();
+
+// ====================================================================
+//
+// allocation accounting
+//
+// ====================================================================
+// ember_init の割り当て関数はプロセスで共通のため、集計は全セッション合計
+// 各ブロックの先頭に割り当て元と長さを持つヘッダを置き、解放時に割り当て元の集計を戻す
+// 割り当て元の登録・集計はロックを使わず、登録は空き枠の確保のみ比較交換で行う
+/// <summary>集計ブロック識別（確保中）</summary>
+#define ALLOC_BLOCK_MAGIC	0x4D454D42u
+/// <summary>集計ブロック識別（解放済）</summary>
+#define ALLOC_BLOCK_FREED	0x44454144u
+
+/// <summary>
+/// 集計ブロックヘッダ（16 byte、後続の割り当て領域の境界を malloc と同じに保つ）
+/// </summary>
+typedef struct tagAllocBlockHeader
+{
+    /// <summary>集計ブロック識別</summary>
+    unsigned int magic;
+    /// <summary>割り当て元</summary>
+    unsigned int site;
+    /// <summary>割り当て長</summary>
+    unsigned long long size;
+} AllocBlockHeader;
+
+/// <summary>
+/// 割り当て元集計
+/// </summary>
+typedef struct tagAllocSite
+{
+    /// <summary>登録状態（0:空き, 1:登録中, 2:登録済）</summary>
+    volatile long state;
+    /// <summary>型名</summary>
+    pcstr pType;
+    /// <summary>ファイル</summary>
+    pcstr pFileName;
+    /// <summary>行</summary>
+    int lineNumber;
+    /// <summary>確保中の数</summary>
+    volatile long long live;
+    /// <summary>確保中の数（最大）</summary>
+    volatile long long peak;
+    /// <summary>割り当て数（累計）</summary>
+    volatile long long total;
+    /// <summary>確保中のバイト数</summary>
+    volatile long long liveBytes;
+    /// <summary>確保中のバイト数（最大）</summary>
+    volatile long long peakBytes;
+    /// <summary>前回出力時の確保中の数</summary>
+    long long reportedLive;
+} AllocSite;
+
+/// <summary>割り当て元（先頭は上限超過分、次はライブラリ内部）</summary>
+static AllocSite allocSites[ALLOC_SITE_MAX] = {
+    { 2, "(overflow)", NULL, 0, 0, 0, 0, 0, 0, 0 },
+    { 2, "libember", NULL, 0, 0, 0, 0, 0, 0, 0 },
+};
+/// <summary>全体の集計</summary>
+static AllocSite allocTotal = { 2, NULL, NULL, 0, 0, 0, 0, 0, 0, 0 };
+/// <summary>集計外のブロックの解放要求数（解放せずに残す）</summary>
+static volatile long long allocForeignFrees = 0;
+/// <summary>次の定期出力時刻（usec、0 は未出力）</summary>
+static volatile long long allocReportDueUsec = 0;
+
+/// <summary>最大値の更新</summary>
+static void atomicMax64(volatile long long* pValue, long long value)
+{
+    long long current = *pValue;
+    while (current < value)
+    {
+        long long previous = atomicCompareExchange64(pValue, value, current);
+        if (previous == current)
+            break;
+        current = previous;
+    }
+}
+
+/// <summary>割り当て元の照合</summary>
+static bool allocSite_equals(const AllocSite* pSite, pcstr pType, pcstr pFileName, int lineNumber)
+{
+    if (pSite->lineNumber != lineNumber)
+        return false;
+    if ((pSite->pType != pType) && ((pSite->pType == NULL) || (pType == NULL) || (strcmp(pSite->pType, pType) != 0)))
+        return false;
+    return (pSite->pFileName == pFileName) || ((pSite->pFileName != NULL) && (pFileName != NULL) && (strcmp(pSite->pFileName, pFileName) == 0));
+}
+
+/// <summary>割り当て元の検索（未登録時は登録）</summary>
+/// <returns>枠の位置、空きがない場合は 0</returns>
+static unsigned int allocSite_find(pcstr pType, pcstr pFileName, int lineNumber)
+{
+    const unsigned int reserved = 2;
+    const unsigned int slots = ALLOC_SITE_MAX - reserved;
+    unsigned int hash = (unsigned int)lineNumber * 2654435761u;
+    const char* p;
+
+    for (p = pType; (p != NULL) && (*p != '\0'); ++p)
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+
+    for (unsigned int probe = 0; probe < slots; ++probe)
+    {
+        unsigned int index = reserved + ((hash + probe) % slots);
+        AllocSite* pSite = &allocSites[index];
+
+        if (pSite->state == 0)
+        {
+            if (atomicCompareExchange(&pSite->state, 1, 0) == 0)
+            {
+                pSite->pType = pType;
+                pSite->pFileName = pFileName;
+                pSite->lineNumber = lineNumber;
+                atomicCompareExchange(&pSite->state, 2, 1);
+                return index;
+            }
+        }
+        // 他スレッドが登録中の場合は完了を待つ（登録は数命令のため、実行権を譲りながら待つ）
+        while (pSite->state == 1)
+            Sleep(0);
+        if (allocSite_equals(pSite, pType, pFileName, lineNumber))
+            return index;
+    }
+
+    return 0;
+}
+
+/// <summary>割り当ての集計</summary>
+static void allocSite_add(AllocSite* pSite, long long size)
+{
+    atomicAdd64(&pSite->total, 1);
+    atomicMax64(&pSite->peak, atomicAdd64(&pSite->live, 1));
+    atomicMax64(&pSite->peakBytes, atomicAdd64(&pSite->liveBytes, size));
+}
+
+/// <summary>解放の集計</summary>
+static void allocSite_remove(AllocSite* pSite, long long size)
+{
+    atomicAdd64(&pSite->live, -1);
+    atomicAdd64(&pSite->liveBytes, -size);
+}
+
+/// <summary>集計ブロック割り当て</summary>
+static void* allocBlock(size_t size, unsigned int site)
 {
+    AllocBlockHeader* pHeader;
+
     if (!size)
         return NULL;
 
-    void* pMemory = malloc(size);
-    //if(sizeof(void *) == 8)
-    //    printf("allocate %lu bytes: %llX\n", size, (unsigned long long)pMemory);
-    //else
-    //    printf("allocate %lu bytes: %lX\n", size, (unsigned long)pMemory);
+    pHeader = (AllocBlockHeader*)malloc(sizeof(AllocBlockHeader) + size);
+    if (pHeader == NULL)
+        return NULL;
+
+    pHeader->magic = ALLOC_BLOCK_MAGIC;
+    pHeader->site = site;
+    pHeader->size = size;
+    allocSite_add(&allocSites[site], (long long)size);
+    allocSite_add(&allocTotal, (long long)size);
+    return pHeader + 1;
+}
 
-    allocCount++;
-    return pMemory;
+/// <summary>割り当て（ember_init へ渡す、ライブラリ内部の割り当て）</summary>
+static void* allocMemoryImpl(size_t size)
+{
+    return allocBlock(size, 1);
 }
+/// <summary>解放（ember_init へ渡す、freeMemory の実体）</summary>
 static void freeMemoryImpl(void* pMemory)
 {
+    AllocBlockHeader* pHeader;
+
     if (!pMemory)
         return;
-    //if(sizeof(void *) == 8)
-    //    printf("free: %llX\n", (unsigned long long)pMemory);
-    //else
-    //    printf("free: %lX\n", (unsigned long)pMemory);
 
-    allocCount--;
-    free(pMemory);
+    pHeader = (AllocBlockHeader*)pMemory - 1;
+    if ((pHeader->magic != ALLOC_BLOCK_MAGIC) || (pHeader->site >= ALLOC_SITE_MAX))
+    {
+        // 二重解放・集計外（malloc 等）のブロックは解放せずに残す
+        __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "free of %s block %p.\n",
+                       (pHeader->magic == ALLOC_BLOCK_FREED) ? "freed" : "unknown", pMemory);
+        atomicAdd64(&allocForeignFrees, 1);
+        return;
+    }
+
+    allocSite_remove(&allocSites[pHeader->site], (long long)pHeader->size);
+    allocSite_remove(&allocTotal, (long long)pHeader->size);
+    pHeader->magic = ALLOC_BLOCK_FREED;
+    free(pHeader);
 }
-/// <summary></summary>
-/// <returns></returns>
+
+DLLAPI void* allocTracked(size_t size, pcstr pType, pcstr pFileName, int lineNumber)
+{
+    return allocBlock(size, allocSite_find(pType, pFileName, lineNumber));
+}
+
 /// <remarks>
 /// サンプルコードは以下の記述であったが
-/// 内部で malloc を使用する strdup 利用では
-/// allocCount をインクリメントしない
+/// 内部で malloc を使用する strdup では freeMemory で集計を戻せない
 /// #define stringDup(pStr) \
 ///     ((pStr != NULL) ? _strdup(pStr) : NULL)
 /// </remarks>
-static pstr stringDup(pcstr pStr)
+DLLAPI pstr stringDupTracked(pcstr pStr, pcstr pFileName, int lineNumber)
 {
-    pstr value = NULL;
-    if (pStr != NULL)
+    size_t length;
+    pstr value;
+
+    if (pStr == NULL)
+        return NULL;
+
+    length = strlen(pStr) + 1;
+    value = (pstr)allocTracked(length, "string", pFileName, lineNumber);
+    if (value != NULL)
+        memcpy(value, pStr, length);
+    return value;
+}
+#define stringDup(pStr) stringDupTracked(pStr, __FILE__, __LINE__)
+
+/// <summary>割り当て集計の複写</summary>
+static void allocSite_copy(const AllocSite* pSite, AllocationStatistics* pStatistics)
+{
+    pStatistics->pType = pSite->pType;
+    pStatistics->pFileName = pSite->pFileName;
+    pStatistics->lineNumber = pSite->lineNumber;
+    pStatistics->live = pSite->live;
+    pStatistics->peak = pSite->peak;
+    pStatistics->total = pSite->total;
+    pStatistics->liveBytes = pSite->liveBytes;
+    pStatistics->peakBytes = pSite->peakBytes;
+}
+
+DLLAPI int getAllocationStatistics(AllocationStatistics* pTotal, AllocationStatistics* pSites, int sitesLength)
+{
+    int count = 0;
+
+    if (pTotal != NULL)
+        allocSite_copy(&allocTotal, pTotal);
+
+    for (int i = 0; i < ALLOC_SITE_MAX; ++i)
     {
-        value = _strdup(pStr);
+        if ((allocSites[i].state != 2) || (allocSites[i].total == 0))
+            continue;
+        if ((pSites != NULL) && (count < sitesLength))
+            allocSite_copy(&allocSites[i], &pSites[count]);
+        ++count;
     }
-    allocCount++;
-    return value;
+
+    return count;
+}
+
+/// <summary>ファイル名（ディレクトリを除く）</summary>
+static pcstr allocSite_baseName(pcstr pFileName)
+{
+    pcstr pBase = pFileName;
+
+    if (pFileName == NULL)
+        return "-";
+    for (; *pFileName != '\0'; ++pFileName)
+    {
+        if ((*pFileName == '/') || (*pFileName == '\\'))
+            pBase = pFileName + 1;
+    }
+    return pBase;
+}
+
+DLLAPI void reportAllocations(bool force)
+{
+    long long now = (long long)getMonotonicUsec();
+    long long due = allocReportDueUsec;
+
+    // 定期出力は 1 スレッドのみ（次回時刻を更新できたスレッド）
+    if (!force)
+    {
+        if ((due != 0) && (now < due))
+            return;
+        if (atomicCompareExchange64(&allocReportDueUsec, now + (ALLOC_REPORT_INTERVAL_MSEC * 1000ll), due) != due)
+            return;
+    }
+
+    __Trace(__FILE__, __LINE__, __FUNCTION__, "memory live = %lld blocks (%lld bytes), peak = %lld blocks (%lld bytes), total = %lld allocations, foreign frees = %lld\n",
+            allocTotal.live, allocTotal.liveBytes, allocTotal.peak, allocTotal.peakBytes, allocTotal.total, allocForeignFrees);
+
+    for (int i = 0; i < ALLOC_SITE_MAX; ++i)
+    {
+        AllocSite* pSite = &allocSites[i];
+        long long live;
+
+        if (pSite->state != 2)
+            continue;
+        live = pSite->live;
+        if ((live != pSite->reportedLive) || (force && (live > 0)))
+        {
+            __Trace(__FILE__, __LINE__, __FUNCTION__, "  %s %s(%d): live = %lld (%+lld), %lld bytes, peak = %lld (%lld bytes), total = %lld\n",
+                    pSite->pType, allocSite_baseName(pSite->pFileName), pSite->lineNumber,
+                    live, live - pSite->reportedLive, pSite->liveBytes, pSite->peak, pSite->peakBytes, pSite->total);
+            pSite->reportedLive = live;
+        }
+    }
+}
+
+
+// ====================================================================
+//
+// tree lock
+//
+// ====================================================================
+// ツリーの更新はコンシューマスレッド、参照は上位ラッパの各スレッドで行うため
+// 構造の変更（追加・破棄）と他スレッドからの走査を接続情報ごとに排他する
+// （NMOS・MV 等の接続は互いに待ち合わせない）
+// 同一スレッド内では再入可能（getRootTop 等を取得中に呼び出すため）
+
+struct tagTreeLock
+{
+#if defined WIN32
+    CRITICAL_SECTION section;
+#else
+    pthread_mutex_t mutex;
+#endif
+};
+
+/// <summary>ツリー排他生成</summary>
+/// <param name="pRemoteContent">接続情報（runConsumer へ渡す前に生成する）</param>
+/// <returns></returns>
+/// <remarks>
+/// 接続情報と同じく呼び出し元の存続期間に従うため、割り当て集計（newobj）の対象外とする
+/// </remarks>
+DLLAPI bool createEmberTreeLock(RemoteContent* pRemoteContent)
+{
+    TreeLock* pLock;
+    if ((pRemoteContent == NULL) || (pRemoteContent->pTreeLock != NULL))
+        return false;
+
+    pLock = (TreeLock*)malloc(sizeof(TreeLock));
+    if (pLock == NULL)
+    {
+        __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "failed to allocate tree lock.\n");
+        return false;
+    }
+#if defined WIN32
+    InitializeCriticalSection(&pLock->section);
+#else
+    {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(&pLock->mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+    }
+#endif
+    pRemoteContent->pTreeLock = pLock;
+    return true;
+}
+/// <summary>ツリー排他破棄</summary>
+/// <param name="pRemoteContent">接続情報（コンシューマスレッドの終了後に破棄する）</param>
+DLLAPI void releaseEmberTreeLock(RemoteContent* pRemoteContent)
+{
+    if ((pRemoteContent == NULL) || (pRemoteContent->pTreeLock == NULL))
+        return;
+#if defined WIN32
+    DeleteCriticalSection(&pRemoteContent->pTreeLock->section);
+#else
+    pthread_mutex_destroy(&pRemoteContent->pTreeLock->mutex);
+#endif
+    free(pRemoteContent->pTreeLock);
+    pRemoteContent->pTreeLock = NULL;
+}
+/// <summary>ツリー排他取得</summary>
+/// <param name="pRemoteContent">接続情報（排他未生成時は何もしない）</param>
+/// <remarks>
+/// 取得中に上位ラッパの排他を取得しないこと（通知処理との順序逆転を避ける）
+/// </remarks>
+DLLAPI void lockEmberTree(const RemoteContent* pRemoteContent)
+{
+    if ((pRemoteContent == NULL) || (pRemoteContent->pTreeLock == NULL))
+        return;
+#if defined WIN32
+    EnterCriticalSection(&pRemoteContent->pTreeLock->section);
+#else
+    pthread_mutex_lock(&pRemoteContent->pTreeLock->mutex);
+#endif
+}
+/// <summary>ツリー排他解放</summary>
+/// <param name="pRemoteContent">接続情報</param>
+DLLAPI void unlockEmberTree(const RemoteContent* pRemoteContent)
+{
+    if ((pRemoteContent == NULL) || (pRemoteContent->pTreeLock == NULL))
+        return;
+#if defined WIN32
+    LeaveCriticalSection(&pRemoteContent->pTreeLock->section);
+#else
+    pthread_mutex_unlock(&pRemoteContent->pTreeLock->mutex);
+#endif
+}
+
+
+// ====================================================================
+//
+// interned strings
+//
+// ====================================================================
+// 識別子・説明・スキーマ識別子は同一内容を 1 つだけ保持し、全ツリー・通知データで共有する
+// 共有文字列は解放しない（保持数はプロバイダが使う文字列の種類数で決まる）
+// 文字列はまとめて確保した領域へ詰めて格納し、割り当て単位のヘッダ・端数を省く
+// 参照はコンシューマスレッドと上位ラッパ（パス変換）の双方から行うため、表はスピンロックで保護する
+/// <summary>共有文字列表の初期枠数（2 のべき乗）</summary>
+#define INTERN_TABLE_INITIAL	4096
+/// <summary>共有文字列の格納領域長</summary>
+#define INTERN_CHUNK_SIZE	(64 * 1024)
+
+/// <summary>
+/// 共有文字列表の枠
+/// </summary>
+typedef struct tagInternSlot
+{
+    /// <summary>ハッシュ値</summary>
+    unsigned int hash;
+    /// <summary>共有文字列（NULL は空き）</summary>
+    pcstr pString;
+} InternSlot;
+
+/// <summary>共有文字列表のロック（各接続のコンシューマスレッドが待ち合わせるためブロックする）</summary>
+#if defined WIN32
+static SRWLOCK internLock = SRWLOCK_INIT;
+#else
+static pthread_mutex_t internLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+/// <summary>共有文字列表</summary>
+static InternSlot* pInternTable = NULL;
+/// <summary>共有文字列表の枠数</summary>
+static unsigned int internTableSize = 0;
+/// <summary>格納中の格納領域</summary>
+static char* pInternChunk = NULL;
+/// <summary>格納中の格納領域の使用済長</summary>
+static size_t internChunkUsed = 0;
+/// <summary>共有文字列集計</summary>
+static InternStatistics internStatistics = { 0 };
+
+static void internLock_acquire()
+{
+#if defined WIN32
+    AcquireSRWLockExclusive(&internLock);
+#else
+    pthread_mutex_lock(&internLock);
+#endif
+}
+static void internLock_release()
+{
+#if defined WIN32
+    ReleaseSRWLockExclusive(&internLock);
+#else
+    pthread_mutex_unlock(&internLock);
+#endif
+}
+
+static unsigned int intern_hash(pcstr pStr, size_t* pLength)
+{
+    unsigned int hash = 2166136261u;
+    pcstr p;
+
+    for (p = pStr; *p != '\0'; ++p)
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    *pLength = (size_t)(p - pStr);
+    return hash;
+}
+
+/// <summary>共有文字列の検索（ロック済）</summary>
+/// <returns>格納先の枠（未登録は空き枠）</returns>
+static InternSlot* intern_findSlot(pcstr pStr, unsigned int hash)
+{
+    unsigned int mask = internTableSize - 1;
+    unsigned int index = hash & mask;
+
+    while (pInternTable[index].pString != NULL)
+    {
+        if ((pInternTable[index].hash == hash) && (strcmp(pInternTable[index].pString, pStr) == 0))
+            break;
+        index = (index + 1) & mask;
+    }
+    return &pInternTable[index];
+}
+
+/// <summary>共有文字列表の拡張（ロック済、使用率 1/2 を超えた場合）</summary>
+static bool intern_reserve()
+{
+    InternSlot* pOldTable = pInternTable;
+    unsigned int oldSize = internTableSize;
+    unsigned int size = (oldSize > 0) ? (oldSize * 2) : INTERN_TABLE_INITIAL;
+    unsigned int index;
+
+    if ((oldSize > 0) && ((internStatistics.strings + 1) * 2 <= oldSize))
+        return true;
+
+    pInternTable = newarr(InternSlot, size);
+    if (pInternTable == NULL)
+    {
+        pInternTable = pOldTable;
+        return false;
+    }
+    memset(pInternTable, 0, sizeof(InternSlot) * size);
+    internTableSize = size;
+
+    for (index = 0; index < oldSize; ++index)
+    {
+        if (pOldTable[index].pString != NULL)
+            *intern_findSlot(pOldTable[index].pString, pOldTable[index].hash) = pOldTable[index];
+    }
+    if (pOldTable != NULL)
+        freeMemory(pOldTable);
+    else
+        internStatistics.blocks++;
+    return true;
+}
+
+/// <summary>共有文字列の格納（ロック済）</summary>
+static pcstr intern_store(pcstr pStr, size_t length)
+{
+    pstr pValue;
+
+    // 格納領域の 1/4 を超える文字列は個別に確保
+    if (length + 1 > INTERN_CHUNK_SIZE / 4)
+    {
+        pValue = newarr(char, length + 1);
+        if (pValue != NULL)
+            internStatistics.blocks++;
+    }
+    else
+    {
+        if ((pInternChunk == NULL) || (internChunkUsed + length + 1 > INTERN_CHUNK_SIZE))
+        {
+            pInternChunk = newarr(char, INTERN_CHUNK_SIZE);
+            internChunkUsed = 0;
+            if (pInternChunk == NULL)
+                return NULL;
+            internStatistics.blocks++;
+        }
+        pValue = &pInternChunk[internChunkUsed];
+        internChunkUsed += length + 1;
+    }
+
+    if (pValue != NULL)
+    {
+        memcpy(pValue, pStr, length + 1);
+        internStatistics.strings++;
+        internStatistics.bytes += length + 1;
+    }
+    return pValue;
+}
+
+/// <summary>共有文字列取得（未登録は登録）</summary>
+/// <param name="pStr"></param>
+/// <returns>pStr が NULL の場合は NULL</returns>
+static pcstr internString(pcstr pStr)
+{
+    pcstr pValue = NULL;
+    InternSlot* pSlot;
+    unsigned int hash;
+    size_t length;
+
+    if (pStr == NULL)
+        return NULL;
+
+    hash = intern_hash(pStr, &length);
+    internLock_acquire();
+    internStatistics.lookups++;
+    if (intern_reserve())
+    {
+        pSlot = intern_findSlot(pStr, hash);
+        if (pSlot->pString != NULL)
+            internStatistics.hits++;
+        else
+        {
+            pSlot->pString = intern_store(pStr, length);
+            pSlot->hash = hash;
+        }
+        // 解放後は他スレッドの拡張で表が移動するため、枠ではなく文字列を控える
+        pValue = pSlot->pString;
+    }
+    internLock_release();
+
+    return pValue;
+}
+
+/// <summary>共有文字列検索（登録しない）</summary>
+/// <param name="pStr"></param>
+/// <returns>未登録の場合は NULL</returns>
+static pcstr findInternedString(pcstr pStr)
+{
+    pcstr pValue = NULL;
+    unsigned int hash;
+    size_t length;
+
+    if (pStr == NULL)
+        return NULL;
+
+    hash = intern_hash(pStr, &length);
+    internLock_acquire();
+    if (pInternTable != NULL)
+        pValue = intern_findSlot(pStr, hash)->pString;
+    internLock_release();
+
+    return pValue;
+}
+
+DLLAPI bool getInternStatistics(InternStatistics* pStatistics)
+{
+    if (pStatistics == NULL)
+        return false;
+
+    internLock_acquire();
+    memcpy(pStatistics, &internStatistics, sizeof(InternStatistics));
+    internLock_release();
+    return true;
 }
+
 /// <summary>
 /// （デバッグ用途）16進表現文字列
 /// </summary>
@@ -187,18 +773,30 @@ static char* hex2string(byte* p, int len)
     return ret;
 }
 
-static bool initializedEmberContents = false;
+/// <summary>libember_slim初期処理状態（0:未初期化, 1:初期化中, 2:初期化済）</summary>
+static volatile long initializedEmberContents = 0;
+/// <summary>runConsumer 実行中の数（未解放メモリの確認は最後の終了時のみ）</summary>
+static volatile long runningConsumers = 0;
 /// <summary>libember_slim初期処理</summary>
 /// <remarks>
 /// runConsumer 呼び出し以前に
 /// newobj/newarr/allocMemory/freeMemory 使用したい場合に呼び出す
+/// 複数スレッドから呼び出しても初期化は 1 度のみ（初期化中は完了を待つ）
 /// </remarks>
 DLLAPI void initEmberContents()
 {
-    if (!initializedEmberContents)
+    if (initializedEmberContents == 2)
+        return;
+
+    if (atomicCompareExchange(&initializedEmberContents, 1, 0) == 0)
     {
         ember_init(onThrowError, onFailAssertion, allocMemoryImpl, freeMemoryImpl);
-        initializedEmberContents = true;
+        atomicCompareExchange(&initializedEmberContents, 2, 1);
+    }
+    else
+    {
+        while (initializedEmberContents != 2)
+            Sleep(1);
     }
 }
 
@@ -227,6 +825,27 @@ static void shutdownSockets()
 #endif
 }
 
+/// <summary>
+/// 経過時間計測用時刻（usec）
+/// </summary>
+/// <returns></returns>
+static unsigned long long getMonotonicUsec()
+{
+#if defined WIN32
+    static LARGE_INTEGER frequency = { 0 };
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (unsigned long long)((counter.QuadPart / frequency.QuadPart) * 1000000
+                              + ((counter.QuadPart % frequency.QuadPart) * 1000000) / frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((unsigned long long)ts.tv_sec * 1000000ull) + (unsigned long long)(ts.tv_nsec / 1000);
+#endif
+}
+
 
 // ====================================================================
 //
@@ -452,30 +1071,56 @@ DLLAPI EmberContent* createEmberGetDirectoryContent(RequestId* pId, const berint
     return pContent;
 }
 /// <summary>
-/// Ember Invoke 送受信要素生成
+/// Ember Subscribe 送受信要素生成
 /// </summary>
 /// <param name="pId"></param>
 /// <param name="pPath"></param>
 /// <param name="pathLength"></param>
-/// <param name="pInvocation"></param>
 /// <returns></returns>
-EmberContent* createEmberInvokeContent(RequestId* pId, const berint* pPath, int pathLength, GlowInvocation* pInvocation)
+EmberContent* createEmberSubscribeContent(RequestId* pId, const berint* pPath, int pathLength)
 {
-    EmberContent* pContent = createEmberCommandContent(pId, pPath, pathLength, GlowCommandType_Invoke);
-    if (pContent && pInvocation)
-    {
-        memcpy(&pContent->command.options.invocation, pInvocation, sizeof(GlowInvocation));
+    EmberContent* pContent = createEmberCommandContent(pId, pPath, pathLength, GlowCommandType_Subscribe);
 
-        // argument の複製
-        pContent->command.options.invocation.pArguments = NULL;
-        if ((pInvocation->pArguments != NULL) && (pInvocation->argumentsLength > 0))
-        {
-            GlowValue* pArguments = newarr(GlowValue, pInvocation->argumentsLength);
-            for (int i = 0; i < pInvocation->argumentsLength; ++i)
-            {
-                glowValue_copyFrom(&pArguments[i], &pInvocation->pArguments[i]);
-            }
-            pContent->command.options.invocation.pArguments = pArguments;
+    return pContent;
+}
+/// <summary>
+/// Ember Unsubscribe 送受信要素生成
+/// </summary>
+/// <param name="pId"></param>
+/// <param name="pPath"></param>
+/// <param name="pathLength"></param>
+/// <returns></returns>
+EmberContent* createEmberUnsubscribeContent(RequestId* pId, const berint* pPath, int pathLength)
+{
+    EmberContent* pContent = createEmberCommandContent(pId, pPath, pathLength, GlowCommandType_Unsubscribe);
+
+    return pContent;
+}
+/// <summary>
+/// Ember Invoke 送受信要素生成
+/// </summary>
+/// <param name="pId"></param>
+/// <param name="pPath"></param>
+/// <param name="pathLength"></param>
+/// <param name="pInvocation"></param>
+/// <returns></returns>
+EmberContent* createEmberInvokeContent(RequestId* pId, const berint* pPath, int pathLength, GlowInvocation* pInvocation)
+{
+    EmberContent* pContent = createEmberCommandContent(pId, pPath, pathLength, GlowCommandType_Invoke);
+    if (pContent && pInvocation)
+    {
+        memcpy(&pContent->command.options.invocation, pInvocation, sizeof(GlowInvocation));
+
+        // argument の複製
+        pContent->command.options.invocation.pArguments = NULL;
+        if ((pInvocation->pArguments != NULL) && (pInvocation->argumentsLength > 0))
+        {
+            GlowValue* pArguments = newarr(GlowValue, pInvocation->argumentsLength);
+            for (int i = 0; i < pInvocation->argumentsLength; ++i)
+            {
+                glowValue_copyFrom(&pArguments[i], &pInvocation->pArguments[i]);
+            }
+            pContent->command.options.invocation.pArguments = pArguments;
         }
         // id設定
         pContent->command.options.invocation.invocationId = pId->id;
@@ -719,6 +1364,186 @@ EmberContent* createEmberConnectionContent(RequestId* pId, const berint* pPath,
     return pContent;
 }
 
+/// <summary>
+/// Ember マトリックス一括接続 送信要素生成
+/// </summary>
+/// <param name="pId"></param>
+/// <param name="pPath"></param>
+/// <param name="pathLength"></param>
+/// <param name="pValues"></param>
+/// <param name="valuesLength"></param>
+/// <returns></returns>
+EmberContent* createEmberSalvoContent(RequestId* pId, const berint* pPath, int pathLength, const GlowConnection* pValues, int valuesLength)
+{
+    if ((pValues == NULL) || (valuesLength <= 0))
+        return NULL;
+
+    EmberContent* pContent = createEmberContent(pId, pPath, pathLength);
+    if (pContent)
+    {
+        GlowConnection* pConnections = newarr(GlowConnection, valuesLength);
+        memcpy(pConnections, pValues, sizeof(GlowConnection) * valuesLength);
+
+        // ポインタデータは複製を設定し直す
+        for (int i = 0; i < valuesLength; ++i)
+        {
+            if (pValues[i].pSources && (pValues[i].sourcesLength > 0))
+            {
+                pConnections[i].pSources = newarr(berint, pValues[i].sourcesLength);
+                memcpy(pConnections[i].pSources, pValues[i].pSources, sizeof(berint) * pValues[i].sourcesLength);
+            }
+            else
+            {
+                pConnections[i].pSources = NULL;
+                pConnections[i].sourcesLength = 0;
+            }
+        }
+
+        pContent->salvo.pConnections = pConnections;
+        pContent->salvo.connectionsLength = valuesLength;
+        pContent->type = (GlowType)SALVO_REQUEST_CONSUMER;
+    }
+
+    return pContent;
+}
+
+/// <summary>
+/// ツリースナップショット保存 要求要素生成
+/// </summary>
+/// <param name="pId"></param>
+/// <param name="pFilePath"></param>
+/// <returns></returns>
+EmberContent* createEmberSnapshotContent(RequestId* pId, pcstr pFilePath)
+{
+    if ((pFilePath == NULL) || (*pFilePath == '\0'))
+        return NULL;
+
+    EmberContent* pContent = createEmberContent(pId, NULL, 0);
+    if (pContent)
+    {
+        pContent->stringValue.pString = stringDup(pFilePath);
+        pContent->stringValue.length = (int)strlen(pFilePath);
+        pContent->type = (GlowType)SNAPSHOT_REQUEST_CONSUMER;
+    }
+
+    return pContent;
+}
+
+/// <summary>
+/// 保持ツリー破棄 要求要素生成
+/// </summary>
+/// <param name="pId"></param>
+/// <returns></returns>
+EmberContent* createEmberResetTreeContent(RequestId* pId)
+{
+    EmberContent* pContent = createEmberContent(pId, NULL, 0);
+    if (pContent)
+        pContent->type = (GlowType)RESET_TREE_REQUEST_CONSUMER;
+
+    return pContent;
+}
+
+/// <summary>
+/// 未確認エレメント破棄 要求要素生成
+/// </summary>
+/// <param name="pId"></param>
+/// <returns></returns>
+EmberContent* createEmberPruneTreeContent(RequestId* pId)
+{
+    EmberContent* pContent = createEmberContent(pId, NULL, 0);
+    if (pContent)
+        pContent->type = (GlowType)PRUNE_TREE_REQUEST_CONSUMER;
+
+    return pContent;
+}
+
+/// <summary>
+/// パラメータ通知振り分け登録 要求要素生成
+/// </summary>
+/// <param name="pId"></param>
+/// <param name="pPath">対象パス（NULL 時は全登録解除）</param>
+/// <param name="pathLength"></param>
+/// <param name="key">振り分け識別（0 以上、または DISPATCH_KEY_WATCH）</param>
+/// <returns></returns>
+EmberContent* createEmberDispatchContent(RequestId* pId, const berint* pPath, int pathLength, int key)
+{
+    if ((pPath != NULL) && (key < 0) && (key != DISPATCH_KEY_WATCH))
+        return NULL;
+
+    EmberContent* pContent = createEmberContent(pId, pPath, (pPath != NULL) ? pathLength : 0);
+    if (pContent)
+    {
+        pContent->dispatchKey = key;
+        pContent->type = (GlowType)DISPATCH_REQUEST_CONSUMER;
+    }
+
+    return pContent;
+}
+
+/// <summary>
+/// 送受信要素破棄
+/// </summary>
+/// <param name="pContent"></param>
+void releaseEmberContent(EmberContent* pContent)
+{
+    if (pContent == NULL)
+        return;
+
+    if (pContent->type == (GlowType)SALVO_REQUEST_CONSUMER)
+    {
+        if (pContent->salvo.pConnections != NULL)
+        {
+            for (int i = 0; i < pContent->salvo.connectionsLength; ++i)
+            {
+                if (pContent->salvo.pConnections[i].pSources != NULL)
+                    freeMemory(pContent->salvo.pConnections[i].pSources);
+            }
+            freeMemory(pContent->salvo.pConnections);
+        }
+    }
+    else if (pContent->type == (GlowType)SNAPSHOT_REQUEST_CONSUMER)
+    {
+        if (pContent->stringValue.pString != NULL)
+            freeMemory(pContent->stringValue.pString);
+    }
+    else if (pContent->type == GlowType_Connection)
+    {
+        if (pContent->connection.pSources != NULL)
+            freeMemory(pContent->connection.pSources);
+    }
+    else if ((pContent->type == GlowType_Parameter) || (pContent->type == GlowType_QualifiedParameter))
+    {
+        // 値の文字列は生成時に複製している（識別子等はツリーと共有のため解放しない）
+        if ((pContent->parameter.value.flag == GlowParameterType_String) && (pContent->parameter.value.choice.pString != NULL))
+            freeMemory(pContent->parameter.value.choice.pString);
+        else if ((pContent->parameter.value.flag == GlowParameterType_Octets) && (pContent->parameter.value.choice.octets.pOctets != NULL))
+            freeMemory(pContent->parameter.value.choice.octets.pOctets);
+    }
+    else if ((pContent->type == GlowType_Command) && (pContent->command.number == GlowCommandType_Invoke))
+    {
+        if (pContent->command.options.invocation.pArguments != NULL)
+        {
+            for (int i = 0; i < pContent->command.options.invocation.argumentsLength; ++i)
+                glowValue_free(&pContent->command.options.invocation.pArguments[i]);
+            freeMemory(pContent->command.options.invocation.pArguments);
+        }
+    }
+    else if (pContent->type == GlowType_InvocationResult)
+    {
+        if (pContent->invocationResult.pResult != NULL)
+        {
+            for (int i = 0; i < pContent->invocationResult.resultLength; ++i)
+                glowValue_free(&pContent->invocationResult.pResult[i]);
+            freeMemory(pContent->invocationResult.pResult);
+        }
+    }
+
+    if (pContent->pPath != NULL)
+        freeMemory(pContent->pPath);
+
+    freeMemory(pContent);
+}
+
 /// <summary>
 /// Ember ファンクション 送受信要素生成
 /// </summary>
@@ -782,6 +1607,7 @@ static EmberContent* createEmberInvocationResultContent(RequestId* pId, const Gl
         else
         {
             // argument の複製
+            pContent->invocationResult.pResult = NULL;
             if ((pValue->pResult != NULL) && (pValue->resultLength > 0))
             {
                 GlowValue* pResult = newarr(GlowValue, pValue->resultLength);
@@ -854,6 +1680,45 @@ void ptrList_free(PtrList *pThis)
 //
 // ====================================================================
 
+/// <summary>
+/// エレメント（共通部）長
+/// </summary>
+/// <returns>newobj(Element) で確保する長さ</returns>
+DLLAPI size_t element_headerSize()
+{
+    return sizeof(Element);
+}
+
+/// <summary>
+/// 子エレメント追加（格納枠は倍々で拡張）
+/// </summary>
+static void element_addChild(Element *pThis, Element *pChild)
+{
+    Element **ppChildren;
+    int capacity;
+
+    if(pThis->childrenLength >= pThis->childrenCapacity)
+    {
+        capacity = (pThis->childrenCapacity > 0) ? (pThis->childrenCapacity * 2) : 4;
+        ppChildren = newarr(Element *, capacity);
+        if(ppChildren == NULL)
+        {
+            __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "children allocation failed (%d).\n", capacity);
+            return;
+        }
+
+        if(pThis->ppChildren != NULL)
+        {
+            memcpy(ppChildren, pThis->ppChildren, sizeof(Element *) * pThis->childrenLength);
+            freeMemory(pThis->ppChildren);
+        }
+        pThis->ppChildren = ppChildren;
+        pThis->childrenCapacity = capacity;
+    }
+
+    pThis->ppChildren[pThis->childrenLength++] = pChild;
+}
+
 static void element_init(Element *pThis, Element *pParent, GlowElementType type, berint number)
 {
     bzero_item(*pThis);
@@ -862,13 +1727,36 @@ static void element_init(Element *pThis, Element *pParent, GlowElementType type,
     pThis->type = type;
     pThis->number = number;
 
-    ptrList_init(&pThis->children);
+    // 種別毎の属性は種別に応じた長さで確保
+    switch(type)
+    {
+        case GlowElementType_Node:
+            pThis->glow.pNode = newobj(GlowNode);
+            if(pThis->glow.pNode != NULL)
+            {
+                bzero_item(*pThis->glow.pNode);
+                pThis->glow.pNode->isOnline = true;
+            }
+            break;
+        case GlowElementType_Parameter:
+            pThis->glow.pParameter = newobj(GlowParameter);
+            if(pThis->glow.pParameter != NULL)
+                bzero_item(*pThis->glow.pParameter);
+            break;
+        case GlowElementType_Matrix:
+            pThis->glow.pMatrix = newobj(ElementMatrix);
+            if(pThis->glow.pMatrix != NULL)
+                bzero_item(*pThis->glow.pMatrix);
+            break;
+        case GlowElementType_Function:
+            pThis->glow.pFunction = newobj(GlowFunction);
+            if(pThis->glow.pFunction != NULL)
+                bzero_item(*pThis->glow.pFunction);
+            break;
+    }
 
     if(pParent != NULL)
-        ptrList_addLast(&pParent->children, pThis);
-
-    if(pThis->type == GlowElementType_Node)
-        pThis->glow.node.isOnline = true;
+        element_addChild(pParent, pThis);
 }
 
 static void element_free(Element *pThis)
@@ -876,32 +1764,40 @@ static void element_free(Element *pThis)
     Element *pChild;
     Target *pTarget;
     PtrListNode *pNode;
+    int index;
 
-    for(pNode = pThis->children.pHead; pNode != NULL; pNode = pNode->pNext)
+    for(index = 0; index < pThis->childrenLength; index++)
     {
-        pChild = (Element *)pNode->value;
+        pChild = pThis->ppChildren[index];
         element_free(pChild);
         freeMemory(pChild);
     }
 
-    ptrList_free(&pThis->children);
+    if(pThis->ppChildren != NULL)
+        freeMemory(pThis->ppChildren);
 
-    if(pThis->type == GlowElementType_Parameter)
+    // 識別子・説明・スキーマ識別子は共有文字列のため解放しない
+    if((pThis->type == GlowElementType_Parameter) && (pThis->glow.pParameter != NULL))
     {
-        glowValue_free(&pThis->glow.parameter.value);
+        glowValue_free(&pThis->glow.pParameter->value);
+
+        if(pThis->glow.pParameter->pEnumeration != NULL)
+            freeMemory((void *)pThis->glow.pParameter->pEnumeration);
+        if(pThis->glow.pParameter->pFormula != NULL)
+            freeMemory((void *)pThis->glow.pParameter->pFormula);
+        if(pThis->glow.pParameter->pFormat != NULL)
+            freeMemory((void *)pThis->glow.pParameter->pFormat);
 
-        if(pThis->glow.parameter.pEnumeration != NULL)
-            freeMemory((void *)pThis->glow.parameter.pEnumeration);
-        if(pThis->glow.parameter.pFormula != NULL)
-            freeMemory((void *)pThis->glow.parameter.pFormula);
-        if(pThis->glow.parameter.pFormat != NULL)
-            freeMemory((void *)pThis->glow.parameter.pFormat);
+        freeMemory(pThis->glow.pParameter);
     }
-    else if(pThis->type == GlowElementType_Matrix)
+    else if((pThis->type == GlowElementType_Matrix) && (pThis->glow.pMatrix != NULL))
     {
-        glowMatrix_free(&pThis->glow.matrix.matrix);
+        pThis->glow.pMatrix->matrix.pIdentifier = NULL;
+        pThis->glow.pMatrix->matrix.pDescription = NULL;
+        pThis->glow.pMatrix->matrix.pSchemaIdentifiers = NULL;
+        glowMatrix_free(&pThis->glow.pMatrix->matrix);
 
-        for(pNode = pThis->glow.matrix.targets.pHead; pNode != NULL; pNode = pNode->pNext)
+        for(pNode = pThis->glow.pMatrix->targets.pHead; pNode != NULL; pNode = pNode->pNext)
         {
             pTarget = (Target *)pNode->value;
 
@@ -911,22 +1807,38 @@ static void element_free(Element *pThis)
             freeMemory(pTarget);
         }
 
-        for(pNode = pThis->glow.matrix.sources.pHead; pNode != NULL; pNode = pNode->pNext)
+        for(pNode = pThis->glow.pMatrix->sources.pHead; pNode != NULL; pNode = pNode->pNext)
         {
             if(pNode->value != NULL)
                 freeMemory(pNode->value);
         }
 
-        ptrList_free(&pThis->glow.matrix.targets);
-        ptrList_free(&pThis->glow.matrix.sources);
+        ptrList_free(&pThis->glow.pMatrix->targets);
+        ptrList_free(&pThis->glow.pMatrix->sources);
+
+        if(pThis->glow.pMatrix->ppTargetTable != NULL)
+            freeMemory(pThis->glow.pMatrix->ppTargetTable);
+        if(pThis->glow.pMatrix->ppSourceTable != NULL)
+            freeMemory(pThis->glow.pMatrix->ppSourceTable);
+
+        freeMemory(pThis->glow.pMatrix);
     }
-    else if(pThis->type == GlowElementType_Function)
+    else if((pThis->type == GlowElementType_Function) && (pThis->glow.pFunction != NULL))
     {
-        glowFunction_free(&pThis->glow.function);
+        pThis->glow.pFunction->pIdentifier = NULL;
+        pThis->glow.pFunction->pDescription = NULL;
+        glowFunction_free(pThis->glow.pFunction);
+
+        freeMemory(pThis->glow.pFunction);
     }
-    else if(pThis->type == GlowElementType_Node)
+    else if((pThis->type == GlowElementType_Node) && (pThis->glow.pNode != NULL))
     {
-        glowNode_free(&pThis->glow.node);
+        pThis->glow.pNode->pIdentifier = NULL;
+        pThis->glow.pNode->pDescription = NULL;
+        pThis->glow.pNode->pSchemaIdentifiers = NULL;
+        glowNode_free(pThis->glow.pNode);
+
+        freeMemory(pThis->glow.pNode);
     }
 
     bzero_item(*pThis);
@@ -934,15 +1846,7 @@ static void element_free(Element *pThis)
 
 static pcstr element_getIdentifier(const Element *pThis)
 {
-    switch(pThis->type)
-    {
-        case GlowElementType_Node: return pThis->glow.node.pIdentifier;
-        case GlowElementType_Parameter: return pThis->glow.parameter.pIdentifier;
-        case GlowElementType_Matrix: return pThis->glow.matrix.matrix.pIdentifier;
-        case GlowElementType_Function: return pThis->glow.function.pIdentifier;
-    }
-
-    return NULL;
+    return pThis->pIdentifier;
 }
 
 /*static*/ berint* element_getPath(const Element* pThis, berint* pBuffer, int* pCount)
@@ -996,11 +1900,11 @@ static pcstr element_getIdentifierPath(const Element *pThis, pstr pBuffer, int b
 static Element *element_findChild(const Element *pThis, berint number)
 {
     Element *pChild;
-    PtrListNode *pNode;
+    int index;
 
-    for(pNode = pThis->children.pHead; pNode != NULL; pNode = pNode->pNext)
+    for(index = 0; index < pThis->childrenLength; index++)
     {
-        pChild = (Element *)pNode->value;
+        pChild = pThis->ppChildren[index];
 
         if(pChild->number == number)
             return pChild;
@@ -1013,14 +1917,26 @@ static Element *element_findChildByIdentifier(const Element *pThis, pcstr pIdent
 {
     Element *pChild;
     pcstr pIdent;
-    PtrListNode *pNode;
+    pcstr pInterned;
+    int index;
 
-    for(pNode = pThis->children.pHead; pNode != NULL; pNode = pNode->pNext)
+    // 大文字・小文字まで一致する場合は共有文字列のアドレス比較のみで済ませる
+    pInterned = findInternedString(pIdentifier);
+    if(pInterned != NULL)
     {
-        pChild = (Element *)pNode->value;
+        for(index = 0; index < pThis->childrenLength; index++)
+        {
+            if(pThis->ppChildren[index]->pIdentifier == pInterned)
+                return pThis->ppChildren[index];
+        }
+    }
+
+    for(index = 0; index < pThis->childrenLength; index++)
+    {
+        pChild = pThis->ppChildren[index];
         pIdent = element_getIdentifier(pChild);
 
-        if(_stricmp(pIdent, pIdentifier) == 0)
+        if((pIdent != NULL) && (_stricmp(pIdent, pIdentifier) == 0))
             return pChild;
     }
 
@@ -1066,35 +1982,101 @@ static GlowParameterType element_getParameterType(const Element *pThis)
             return GlowParameterType_Enum;
 
         if(pThis->paramFields & GlowFieldFlag_Value)
-            return pThis->glow.parameter.value.flag;
+            return pThis->glow.pParameter->value.flag;
 
         if(pThis->paramFields & GlowFieldFlag_Type)
-            return pThis->glow.parameter.type;
+            return pThis->glow.pParameter->type;
     }
 
     return (GlowParameterType)0;
 }
 
-static Target *element_findOrCreateTarget(Element *pThis, berint number)
+/// <summary>
+/// 番号索引表の拡張
+/// </summary>
+/// <param name="pTable">索引表（NULL 可）</param>
+/// <param name="pLength">索引表要素数</param>
+/// <param name="number">索引する番号</param>
+/// <returns>number を格納可能な索引表、索引対象外の番号は NULL</returns>
+static voidptr *signalTable_reserve(voidptr *pTable, int *pLength, berint number)
+{
+    voidptr *pNewTable;
+    int length;
+
+    if(number < 0 || number >= MATRIX_SIGNAL_TABLE_MAX)
+        return NULL;
+    if(pTable != NULL && number < *pLength)
+        return pTable;
+
+    length = *pLength > 0 ? *pLength : 64;
+    while(length <= number)
+        length *= 2;
+    if(length > MATRIX_SIGNAL_TABLE_MAX)
+        length = MATRIX_SIGNAL_TABLE_MAX;
+
+    pNewTable = newarr(voidptr, length);
+    memset(pNewTable, 0, sizeof(voidptr) * length);
+
+    if(pTable != NULL)
+    {
+        memcpy(pNewTable, pTable, sizeof(voidptr) * (*pLength));
+        freeMemory(pTable);
+    }
+
+    *pLength = length;
+    return pNewTable;
+}
+
+Target *element_findTarget(const Element *pThis, berint number)
 {
     Target *pTarget;
     PtrListNode *pNode;
 
-    if(pThis->type == GlowElementType_Matrix)
+    if(pThis == NULL || pThis->type != GlowElementType_Matrix)
+        return NULL;
+
+    // 索引範囲内は索引表のみで判断
+    if(number >= 0 && number < MATRIX_SIGNAL_TABLE_MAX)
     {
-        for(pNode = pThis->glow.matrix.targets.pHead; pNode != NULL; pNode = pNode->pNext)
-        {
-            pTarget = (Target *)pNode->value;
+        return number < pThis->glow.pMatrix->targetTableLength
+            ? pThis->glow.pMatrix->ppTargetTable[number]
+            : NULL;
+    }
 
-            if(pTarget->number == number)
-                return pTarget;
-        }
+    for(pNode = pThis->glow.pMatrix->targets.pHead; pNode != NULL; pNode = pNode->pNext)
+    {
+        pTarget = (Target *)pNode->value;
+
+        if(pTarget->number == number)
+            return pTarget;
+    }
+
+    return NULL;
+}
+
+static Target *element_findOrCreateTarget(Element *pThis, berint number)
+{
+    Target *pTarget;
+    voidptr *pTable;
+
+    if(pThis->type == GlowElementType_Matrix)
+    {
+        pTarget = element_findTarget(pThis, number);
+        if(pTarget != NULL)
+            return pTarget;
 
         pTarget = newobj(Target);
         bzero_item(*pTarget);
         pTarget->number = number;
 
-        ptrList_addLast(&pThis->glow.matrix.targets, pTarget);
+        ptrList_addLast(&pThis->glow.pMatrix->targets, pTarget);
+
+        pTable = signalTable_reserve((voidptr *)pThis->glow.pMatrix->ppTargetTable, &pThis->glow.pMatrix->targetTableLength, number);
+        if(pTable != NULL)
+        {
+            pThis->glow.pMatrix->ppTargetTable = (Target **)pTable;
+            pThis->glow.pMatrix->ppTargetTable[number] = pTarget;
+        }
         return pTarget;
     }
 
@@ -1108,7 +2090,15 @@ static Source *element_findSource(const Element *pThis, berint number)
 
     if(pThis->type == GlowElementType_Matrix)
     {
-        for(pNode = pThis->glow.matrix.sources.pHead; pNode != NULL; pNode = pNode->pNext)
+        // 索引範囲内は索引表のみで判断
+        if(number >= 0 && number < MATRIX_SIGNAL_TABLE_MAX)
+        {
+            return number < pThis->glow.pMatrix->sourceTableLength
+                ? pThis->glow.pMatrix->ppSourceTable[number]
+                : NULL;
+        }
+
+        for(pNode = pThis->glow.pMatrix->sources.pHead; pNode != NULL; pNode = pNode->pNext)
         {
             pSource = (Source *)pNode->value;
 
@@ -1120,57 +2110,238 @@ static Source *element_findSource(const Element *pThis, berint number)
     return NULL;
 }
 
-/****/
-static int validityPathLength = 0;
-static Element* element_setNode(const GlowNode* pNode, GlowFieldFlags fields, const berint* pPath, int pathLength, Element* pRootTop, int* pDuplicateRequest)
+static Source *element_findOrCreateSource(Element *pThis, berint number)
 {
-    Element* pElement;
-    Element* pParent;
-    int nDuplicateRequest = 0;
-
-    pElement = element_findDescendant(pRootTop, pPath, pathLength, &pParent);
+    Source *pSource;
+    voidptr *pTable;
 
-    if (pParent != NULL)
+    if(pThis->type == GlowElementType_Matrix)
     {
-        if (pElement == NULL)
-        {
-            if (validityPathLength < pathLength)
-                validityPathLength = pathLength;
+        pSource = element_findSource(pThis, number);
+        if(pSource != NULL)
+            return pSource;
 
-            pElement = newobj(Element);
-            element_init(pElement, pParent, GlowElementType_Node, pPath[pathLength - 1]);
+        pSource = newobj(Source);
+        bzero_item(*pSource);
+        pSource->number = number;
 
-            if (fields & GlowFieldFlag_Identifier)
-                pElement->glow.node.pIdentifier = stringDup(pNode->pIdentifier);
-        }
-        else
-            nDuplicateRequest = 1;
+        ptrList_addLast(&pThis->glow.pMatrix->sources, pSource);
 
-        if (fields & GlowFieldFlag_Description)
-            pElement->glow.node.pDescription = stringDup(pNode->pDescription);
+        pTable = signalTable_reserve((voidptr *)pThis->glow.pMatrix->ppSourceTable, &pThis->glow.pMatrix->sourceTableLength, number);
+        if(pTable != NULL)
+        {
+            pThis->glow.pMatrix->ppSourceTable = (Source **)pTable;
+            pThis->glow.pMatrix->ppSourceTable[number] = pSource;
+        }
+        return pSource;
+    }
 
-        if (fields & GlowFieldFlag_IsOnline)
-            pElement->glow.node.isOnline = pNode->isOnline;
+    return NULL;
+}
+
+int element_getConnectedSources(const Element *pThis, berint firstTarget, int targetCount, berint *pSources, int sourcesLength)
+{
+    const Target *pTarget;
+    int count = 0;
+    int index;
+    int n;
+
+    if(pThis == NULL || pThis->type != GlowElementType_Matrix || targetCount <= 0)
+        return count;
+
+    for(index = 0; index < targetCount; index++)
+    {
+        pTarget = element_findTarget(pThis, firstTarget + index);
+        if(pTarget == NULL || pTarget->pConnectedSources == NULL)
+            continue;
+
+        for(n = 0; n < pTarget->connectedSourcesCount; n++, count++)
+        {
+            if(pSources != NULL && count < sourcesLength)
+                pSources[count] = pTarget->pConnectedSources[n];
+        }
+    }
+
+    return count;
+}
+
+/// <summary>
+/// エレメント文字列項目の置き換え
+/// </summary>
+/// <remarks>
+/// 受信由来・スナップショット由来とも共有文字列を設定する
+/// 置き換え前の文字列も共有文字列のため解放不要（置き換えによる解放漏れは生じない）
+/// 通知データはエレメントの項目を複写するが、共有文字列は解放されないため参照し続けてよい
+/// </remarks>
+static void element_replaceString(pstr* ppDest, pcstr pSrc)
+{
+    *ppDest = (pstr)internString(pSrc);
+}
+
+/// <summary>
+/// エレメント識別子の置き換え（本体・属性の双方）
+/// </summary>
+static void element_replaceIdentifier(Element* pThis, pstr* ppDest, pcstr pSrc)
+{
+    element_replaceString(ppDest, pSrc);
+    pThis->pIdentifier = *ppDest;
+}
+
+/// <summary>
+/// 配下全エレメントを未確認とする（再接続時の再確認用）
+/// </summary>
+static void element_markStale(Element* pThis)
+{
+    int index;
+
+    if (pThis->pParent != NULL)
+        pThis->isStale = true;
+    pThis->isDirectoryRequested = false;
+
+    for (index = 0; index < pThis->childrenLength; index++)
+        element_markStale(pThis->ppChildren[index]);
+}
+
+/// <summary>
+/// 受信したエレメントと上位を確認済とする
+/// </summary>
+/// <remarks>
+/// 配下のみ通知された場合も、経路上のエレメントは存在している
+/// </remarks>
+static void element_confirm(Element* pThis)
+{
+    Element* pElement;
+
+    for (pElement = pThis; (pElement != NULL) && pElement->isStale; pElement = pElement->pParent)
+        pElement->isStale = false;
+}
+
+/// <summary>
+/// 再確認で通知されなかったエレメントの破棄
+/// </summary>
+/// <returns>破棄したエレメント数（配下は含まない）</returns>
+/// <remarks>
+/// 一覧を要求したエレメント（確認済の場合）の子で未確認のもの、
+/// 一覧を要求したが自身が未確認のもの（応答時に通知されるため）を破棄する
+/// 一覧を要求していないエレメントは配下が通知されないため残す
+/// </remarks>
+static int element_pruneStale(Element* pThis)
+{
+    Element* pChild;
+    bool isListed = pThis->isDirectoryRequested && !pThis->isStale;
+    int count = 0;
+    int index;
+    int kept = 0;
+
+    for (index = 0; index < pThis->childrenLength; index++)
+    {
+        pChild = pThis->ppChildren[index];
+        if (pChild->isStale && (isListed || pChild->isDirectoryRequested))
+        {
+            element_free(pChild);
+            freeMemory(pChild);
+            count++;
+            continue;
+        }
+        count += element_pruneStale(pChild);
+        pThis->ppChildren[kept++] = pChild;
+    }
+    pThis->childrenLength = kept;
+
+    return count;
+}
+
+/// <summary>
+/// パラメータ値比較
+/// </summary>
+static bool glowValue_equals(const GlowValue* pValue1, const GlowValue* pValue2)
+{
+    if (pValue1->flag != pValue2->flag)
+        return false;
+
+    switch (pValue1->flag)
+    {
+    case GlowParameterType_Integer:
+    case GlowParameterType_Enum:
+        return pValue1->choice.integer == pValue2->choice.integer;
+    case GlowParameterType_Real:
+        return pValue1->choice.real == pValue2->choice.real;
+    case GlowParameterType_Boolean:
+        return pValue1->choice.boolean == pValue2->choice.boolean;
+    case GlowParameterType_String:
+        if ((pValue1->choice.pString == NULL) || (pValue2->choice.pString == NULL))
+            return pValue1->choice.pString == pValue2->choice.pString;
+        return strcmp(pValue1->choice.pString, pValue2->choice.pString) == 0;
+    case GlowParameterType_Octets:
+        return (pValue1->choice.octets.length == pValue2->choice.octets.length)
+            && ((pValue1->choice.octets.length <= 0)
+             || (memcmp(pValue1->choice.octets.pOctets, pValue2->choice.octets.pOctets, pValue1->choice.octets.length) == 0));
+    default:
+        return true;
+    }
+}
+
+/****/
+static Element* element_setNode(const GlowNode* pNode, GlowFieldFlags fields, const berint* pPath, int pathLength, Element* pRootTop, const RemoteContent* pRemoteContent, int* pDuplicateRequest)
+{
+    Element* pElement;
+    Element* pParent;
+    int nDuplicateRequest = 0;
+
+    lockEmberTree(pRemoteContent);
+    pElement = element_findDescendant(pRootTop, pPath, pathLength, &pParent);
+
+    if (pParent != NULL)
+    {
+        if (pElement == NULL)
+        {
+            pElement = newobj(Element);
+            element_init(pElement, pParent, GlowElementType_Node, pPath[pathLength - 1]);
+
+            if (fields & GlowFieldFlag_Identifier)
+                element_replaceIdentifier(pElement, &pElement->glow.pNode->pIdentifier, pNode->pIdentifier);
+        }
+        else if (pElement->isCached)
+        {
+            // スナップショット由来のノードは初回確認時に新規扱いとし、配下の探索を継続させる
+            if (fields & GlowFieldFlag_Identifier)
+                element_replaceIdentifier(pElement, &pElement->glow.pNode->pIdentifier, pNode->pIdentifier);
+        }
+        else
+            nDuplicateRequest = 1;
+
+        if (fields & GlowFieldFlag_Description)
+            element_replaceString(&pElement->glow.pNode->pDescription, pNode->pDescription);
+
+        if (fields & GlowFieldFlag_IsOnline)
+            pElement->glow.pNode->isOnline = pNode->isOnline;
 
         if (fields & GlowFieldFlag_IsRoot)
-            pElement->glow.node.isRoot = pNode->isRoot;
+            pElement->glow.pNode->isRoot = pNode->isRoot;
 
         if (fields & GlowFieldFlag_SchemaIdentifier)
-            pElement->glow.node.pSchemaIdentifiers = stringDup(pNode->pSchemaIdentifiers);
+            element_replaceString(&pElement->glow.pNode->pSchemaIdentifiers, pNode->pSchemaIdentifiers);
+
+        pElement->isCached = false;
+        element_confirm(pElement);
     }
 
     if (pDuplicateRequest)
         *pDuplicateRequest = nDuplicateRequest;
 
+    unlockEmberTree(pRemoteContent);
     return pElement;
 }
 
-static Element* element_setParameter(const GlowParameter* pParameter, GlowFieldFlags fields, const berint* pPath, int pathLength, Element* pRootTop)
+/// <param name="pUnchanged">再確認で値に変化がなかった場合 true（NULL 可）</param>
+static Element* element_setParameter(const GlowParameter* pParameter, GlowFieldFlags fields, const berint* pPath, int pathLength, Element* pRootTop, const RemoteContent* pRemoteContent, bool* pUnchanged)
 {
     Element* pElement;
     Element* pParent;
     GlowParameter* pLocalParam;
+    bool isUnchanged = false;
 
+    lockEmberTree(pRemoteContent);
     pElement = element_findDescendant(pRootTop, pPath, pathLength, &pParent);
 
     if (pParent != NULL)
@@ -1181,12 +2352,17 @@ static Element* element_setParameter(const GlowParameter* pParameter, GlowFieldF
             element_init(pElement, pParent, GlowElementType_Parameter, pPath[pathLength - 1]);
         }
 
-        pLocalParam = &pElement->glow.parameter;
+        pLocalParam = pElement->glow.pParameter;
+
+        // 再接続前から保持している値との差分
+        if (pElement->isStale)
+            isUnchanged = !(fields & GlowFieldFlag_Value)
+                       || (((pElement->paramFields & GlowFieldFlag_Value) != 0) && glowValue_equals(&pLocalParam->value, &pParameter->value));
 
         if ((fields & GlowFieldFlag_Identifier) == GlowFieldFlag_Identifier)
-            pLocalParam->pIdentifier = stringDup(pParameter->pIdentifier);
+            element_replaceIdentifier(pElement, &pLocalParam->pIdentifier, pParameter->pIdentifier);
         if (fields & GlowFieldFlag_Description)
-            pLocalParam->pDescription = stringDup(pParameter->pDescription);
+            element_replaceString(&pLocalParam->pDescription, pParameter->pDescription);
         if (fields & GlowFieldFlag_Value)
         {
             glowValue_free(&pLocalParam->value);
@@ -1211,19 +2387,26 @@ static Element* element_setParameter(const GlowParameter* pParameter, GlowFieldF
         if (fields & GlowFieldFlag_StreamDescriptor)
             memcpy(&pLocalParam->streamDescriptor, &pParameter->streamDescriptor, sizeof(GlowStreamDescription));
         if (fields & GlowFieldFlag_SchemaIdentifier)
-            pLocalParam->pSchemaIdentifiers = stringDup(pParameter->pSchemaIdentifiers);
+            element_replaceString(&pLocalParam->pSchemaIdentifiers, pParameter->pSchemaIdentifiers);
 
         pElement->paramFields = (GlowFieldFlags)(pElement->paramFields | fields);
+        pElement->isCached = false;
+        element_confirm(pElement);
     }
 
+    if (pUnchanged)
+        *pUnchanged = isUnchanged;
+
+    unlockEmberTree(pRemoteContent);
     return pElement;
 }
 
-static Element* element_setMatrix(const GlowMatrix* pMatrix, const berint* pPath, int pathLength, Element* pRootTop)
+static Element* element_setMatrix(const GlowMatrix* pMatrix, const berint* pPath, int pathLength, Element* pRootTop, const RemoteContent* pRemoteContent)
 {
     Element* pElement;
     Element* pParent;
 
+    lockEmberTree(pRemoteContent);
     pElement = element_findDescendant(pRootTop, pPath, pathLength, &pParent);
 
     if (pParent != NULL)
@@ -1234,88 +2417,104 @@ static Element* element_setMatrix(const GlowMatrix* pMatrix, const berint* pPath
             element_init(pElement, pParent, GlowElementType_Matrix, pPath[pathLength - 1]);
         }
 
-        memcpy(&pElement->glow.matrix.matrix, pMatrix, sizeof(*pMatrix));
-        pElement->glow.matrix.matrix.pIdentifier = stringDup(pMatrix->pIdentifier);
-        pElement->glow.matrix.matrix.pDescription = stringDup(pMatrix->pDescription);
-        pElement->glow.matrix.matrix.pSchemaIdentifiers = stringDup(pMatrix->pSchemaIdentifiers);
+        memcpy(&pElement->glow.pMatrix->matrix, pMatrix, sizeof(*pMatrix));
+        element_replaceIdentifier(pElement, &pElement->glow.pMatrix->matrix.pIdentifier, pMatrix->pIdentifier);
+        element_replaceString(&pElement->glow.pMatrix->matrix.pDescription, pMatrix->pDescription);
+        element_replaceString(&pElement->glow.pMatrix->matrix.pSchemaIdentifiers, pMatrix->pSchemaIdentifiers);
         if ((pMatrix->pLabels != NULL) && (pMatrix->labelsLength > 0))
         {
-            pElement->glow.matrix.matrix.pLabels = newarr(GlowLabel, pMatrix->labelsLength);
-            //pElement->glow.matrix.matrix.labelsLength = pMatrix->labelsLength;    // 先の memcpy で設定済
-            //memcpy(pElement->glow.matrix.matrix.pLabels, pMatrix->pLabels, sizeof(GlowLabel) * pMatrix->labelsLength);
-            for (int i = 0; i < pElement->glow.matrix.matrix.labelsLength; ++i)
+            pElement->glow.pMatrix->matrix.pLabels = newarr(GlowLabel, pMatrix->labelsLength);
+            //pElement->glow.pMatrix->matrix.labelsLength = pMatrix->labelsLength;    // 先の memcpy で設定済
+            //memcpy(pElement->glow.pMatrix->matrix.pLabels, pMatrix->pLabels, sizeof(GlowLabel) * pMatrix->labelsLength);
+            for (int i = 0; i < pElement->glow.pMatrix->matrix.labelsLength; ++i)
             {
-                memcpy(pElement->glow.matrix.matrix.pLabels[i].basePath, pMatrix->pLabels[i].basePath, sizeof(pMatrix->pLabels[i].basePath));
-                pElement->glow.matrix.matrix.pLabels[i].basePathLength = pMatrix->pLabels[i].basePathLength;
-                pElement->glow.matrix.matrix.pLabels[i].pDescription = stringDup(pMatrix->pLabels[i].pDescription);
+                memcpy(pElement->glow.pMatrix->matrix.pLabels[i].basePath, pMatrix->pLabels[i].basePath, sizeof(pMatrix->pLabels[i].basePath));
+                pElement->glow.pMatrix->matrix.pLabels[i].basePathLength = pMatrix->pLabels[i].basePathLength;
+                pElement->glow.pMatrix->matrix.pLabels[i].pDescription = stringDup(pMatrix->pLabels[i].pDescription);
             }
         }
+        pElement->isCached = false;
+        element_confirm(pElement);
     }
 
+    unlockEmberTree(pRemoteContent);
     return pElement;
 }
 
-static Element* element_setTarget(const GlowSignal* pSignal, const berint* pPath, int pathLength, Element* pRootTop)
+static Element* element_setTarget(const GlowSignal* pSignal, const berint* pPath, int pathLength, Element* pRootTop, const RemoteContent* pRemoteContent)
 {
     Element* pElement;
 
+    lockEmberTree(pRemoteContent);
     pElement = element_findDescendant(pRootTop, pPath, pathLength, NULL);
 
     if (pElement != NULL
         && pElement->type == GlowElementType_Matrix)
         element_findOrCreateTarget(pElement, pSignal->number);
 
+    unlockEmberTree(pRemoteContent);
     return pElement;
 }
 
-static Element* element_setSource(const GlowSignal* pSignal, const berint* pPath, int pathLength, Element* pRootTop)
+static Element* element_setSource(const GlowSignal* pSignal, const berint* pPath, int pathLength, Element* pRootTop, const RemoteContent* pRemoteContent)
 {
     Element* pElement;
-    Source* pSource;
 
+    lockEmberTree(pRemoteContent);
     pElement = element_findDescendant(pRootTop, pPath, pathLength, NULL);
 
     if (pElement != NULL
         && pElement->type == GlowElementType_Matrix)
-    {
-        pSource = newobj(Source);
-        bzero_item(*pSource);
-        pSource->number = pSignal->number;
-
-        ptrList_addLast(&pElement->glow.matrix.sources, pSource);
-    }
+        element_findOrCreateSource(pElement, pSignal->number);
 
+    unlockEmberTree(pRemoteContent);
     return pElement;
 }
 
-static Element* element_setConnection(const GlowConnection* pConnection, const berint* pPath, int pathLength, Element* pRootTop)
+/// <param name="pUnchanged">既存ターゲットの接続ソースに変化がなかった場合 true（NULL 可）</param>
+static Element* element_setConnection(const GlowConnection* pConnection, const berint* pPath, int pathLength, Element* pRootTop, const RemoteContent* pRemoteContent, bool* pUnchanged)
 {
     Element* pElement;
     Target* pTarget;
+    bool isUnchanged = false;
 
+    lockEmberTree(pRemoteContent);
     pElement = element_findDescendant(pRootTop, pPath, pathLength, NULL);
 
     if (pElement != NULL
         && pElement->type == GlowElementType_Matrix)
     {
-        pTarget = element_findOrCreateTarget(pElement, pConnection->target);
-
+        pTarget = element_findTarget(pElement, pConnection->target);
         if (pTarget != NULL)
         {
-            if (pTarget->pConnectedSources != NULL)
+            int sourcesLength = pConnection->sourcesLength > 0 ? pConnection->sourcesLength : 0;
+            isUnchanged = (pTarget->connectedSourcesCount == sourcesLength)
+                       && ((sourcesLength == 0)
+                        || (memcmp(pTarget->pConnectedSources, pConnection->pSources, sourcesLength * sizeof(berint)) == 0));
+        }
+        else
+            pTarget = element_findOrCreateTarget(pElement, pConnection->target);
+
+        if ((pTarget != NULL) && !isUnchanged)
+        {
+            // 確保済領域に収まる限りその場で更新
+            if (pConnection->sourcesLength > pTarget->connectedSourcesCapacity)
             {
-                freeMemory(pTarget->pConnectedSources);
-                pTarget->pConnectedSources = NULL;
+                if (pTarget->pConnectedSources != NULL)
+                    freeMemory(pTarget->pConnectedSources);
+                pTarget->pConnectedSources = newarr(berint, pConnection->sourcesLength);
+                pTarget->connectedSourcesCapacity = pConnection->sourcesLength;
             }
             if (pConnection->sourcesLength > 0)
-            {
-                pTarget->pConnectedSources = newarr(berint, pConnection->sourcesLength);
                 memcpy(pTarget->pConnectedSources, pConnection->pSources, pConnection->sourcesLength * sizeof(berint));
-                pTarget->connectedSourcesCount = pConnection->sourcesLength;
-            }
+            pTarget->connectedSourcesCount = pConnection->sourcesLength > 0 ? pConnection->sourcesLength : 0;
         }
     }
 
+    if (pUnchanged)
+        *pUnchanged = isUnchanged;
+
+    unlockEmberTree(pRemoteContent);
     return pElement;
 }
 
@@ -1324,12 +2523,13 @@ static void cloneTupleItemDescription(GlowTupleItemDescription* pDest, const Glo
     memcpy(pDest, pSource, sizeof(*pSource));
     pDest->pName = stringDup(pSource->pName);
 }
-static Element* element_setFunction(const GlowFunction* pFunction, const berint* pPath, int pathLength, Element* pRootTop)
+static Element* element_setFunction(const GlowFunction* pFunction, const berint* pPath, int pathLength, Element* pRootTop, const RemoteContent* pRemoteContent)
 {
     Element* pElement;
     Element* pParent;
     int index;
 
+    lockEmberTree(pRemoteContent);
     pElement = element_findDescendant(pRootTop, pPath, pathLength, &pParent);
 
     if (pParent != NULL)
@@ -1339,33 +2539,641 @@ static Element* element_setFunction(const GlowFunction* pFunction, const berint*
             pElement = newobj(Element);
             element_init(pElement, pParent, GlowElementType_Function, pPath[pathLength - 1]);
         }
+        else if (pElement->isCached)
+        {
+            // スナップショット由来の内容は置き換える（共有文字列は除く）
+            pElement->glow.pFunction->pIdentifier = NULL;
+            pElement->glow.pFunction->pDescription = NULL;
+            glowFunction_free(pElement->glow.pFunction);
+        }
 
-        memcpy(&pElement->glow.function, pFunction, sizeof(*pFunction));
-        pElement->glow.function.pIdentifier = stringDup(pFunction->pIdentifier);
-        pElement->glow.function.pDescription = stringDup(pFunction->pDescription);
+        memcpy(pElement->glow.pFunction, pFunction, sizeof(*pFunction));
+        element_replaceIdentifier(pElement, &pElement->glow.pFunction->pIdentifier, pFunction->pIdentifier);
+        element_replaceString(&pElement->glow.pFunction->pDescription, pFunction->pDescription);
 
         // clone arguments
         if (pFunction->pArguments != NULL)
         {
-            pElement->glow.function.pArguments = newarr(GlowTupleItemDescription, pFunction->argumentsLength);
+            pElement->glow.pFunction->pArguments = newarr(GlowTupleItemDescription, pFunction->argumentsLength);
 
             for (index = 0; index < pFunction->argumentsLength; index++)
-                cloneTupleItemDescription(&pElement->glow.function.pArguments[index], &pFunction->pArguments[index]);
+                cloneTupleItemDescription(&pElement->glow.pFunction->pArguments[index], &pFunction->pArguments[index]);
         }
 
         // clone result
         if (pFunction->pResult != NULL)
         {
-            pElement->glow.function.pResult = newarr(GlowTupleItemDescription, pFunction->resultLength);
+            pElement->glow.pFunction->pResult = newarr(GlowTupleItemDescription, pFunction->resultLength);
 
             for (index = 0; index < pFunction->resultLength; index++)
-                cloneTupleItemDescription(&pElement->glow.function.pResult[index], &pFunction->pResult[index]);
+                cloneTupleItemDescription(&pElement->glow.pFunction->pResult[index], &pFunction->pResult[index]);
+        }
+        pElement->isCached = false;
+        element_confirm(pElement);
+    }
+
+    unlockEmberTree(pRemoteContent);
+    return pElement;
+}
+
+
+// ====================================================================
+//
+// snapshot
+//
+// ====================================================================
+
+/// <summary>スナップショット書式識別</summary>
+#define SNAPSHOT_HEADER "EMBERSNAPSHOT"
+/// <summary>スナップショット書式版数</summary>
+#define SNAPSHOT_VERSION 1
+
+/// <summary>
+/// スナップショット行の読み出し位置
+/// </summary>
+typedef struct SSnapshotFields
+{
+    pstr* ppFields;
+    int count;
+    int index;
+} SnapshotFields;
+
+static FILE* snapshot_open(pcstr pPath, pcstr pMode)
+{
+    FILE* pFile = NULL;
+#if defined WIN32
+    if (fopen_s(&pFile, pPath, pMode) != 0)
+        pFile = NULL;
+#else
+    pFile = fopen(pPath, pMode);
+#endif
+    return pFile;
+}
+
+/// <summary>
+/// 文字列項目書き出し
+/// </summary>
+/// <remarks>
+/// 区切り（タブ）、改行および \ はエスケープする
+/// NULL は空項目とする
+/// </remarks>
+static void snapshot_writeString(FILE* pFile, pcstr pStr)
+{
+    fputc('\t', pFile);
+    if (pStr == NULL)
+        return;
+
+    for (; *pStr != '\0'; ++pStr)
+    {
+        switch (*pStr)
+        {
+        case '\\': fputs("\\\\", pFile); break;
+        case '\t': fputs("\\t", pFile); break;
+        case '\n': fputs("\\n", pFile); break;
+        case '\r': fputs("\\r", pFile); break;
+        default: fputc(*pStr, pFile); break;
+        }
+    }
+}
+
+static void snapshot_writePath(FILE* pFile, const berint* pPath, int pathLength)
+{
+    int index;
+
+    fputc('\t', pFile);
+    for (index = 0; index < pathLength; index++)
+        fprintf(pFile, index > 0 ? ".%d" : "%d", pPath[index]);
+}
+
+static void snapshot_writeMinMax(FILE* pFile, const GlowMinMax* pValue)
+{
+    if (pValue->flag == GlowParameterType_Integer)
+        fprintf(pFile, "\t%d\t%lld", pValue->flag, (long long)pValue->choice.integer);
+    else if (pValue->flag == GlowParameterType_Real)
+        fprintf(pFile, "\t%d\t%.17g", pValue->flag, pValue->choice.real);
+    else
+        fprintf(pFile, "\t%d\t", GlowParameterType_None);
+}
+
+static void snapshot_writeValue(FILE* pFile, const GlowValue* pValue)
+{
+    switch (pValue->flag)
+    {
+    case GlowParameterType_Integer:
+    case GlowParameterType_Enum:
+        fprintf(pFile, "\t%d\t%lld", pValue->flag, (long long)pValue->choice.integer);
+        break;
+    case GlowParameterType_Real:
+        fprintf(pFile, "\t%d\t%.17g", pValue->flag, pValue->choice.real);
+        break;
+    case GlowParameterType_Boolean:
+        fprintf(pFile, "\t%d\t%d", pValue->flag, pValue->choice.boolean ? 1 : 0);
+        break;
+    case GlowParameterType_String:
+        fprintf(pFile, "\t%d", pValue->flag);
+        snapshot_writeString(pFile, pValue->choice.pString);
+        break;
+    default:
+        // Octets 等は保存しない（再取得で補完）
+        fprintf(pFile, "\t%d\t", GlowParameterType_None);
+        break;
+    }
+}
+
+static void snapshot_writeTupleItems(FILE* pFile, const GlowTupleItemDescription* pItems, int itemsLength)
+{
+    int index;
+
+    if (pItems == NULL || itemsLength < 0)
+        itemsLength = 0;
+
+    fprintf(pFile, "\t%d", itemsLength);
+    for (index = 0; index < itemsLength; index++)
+    {
+        fprintf(pFile, "\t%d", pItems[index].type);
+        snapshot_writeString(pFile, pItems[index].pName);
+    }
+}
+
+/// <summary>
+/// エレメント（子孫含む）書き出し
+/// </summary>
+/// <remarks>
+/// 親が先行する前順で 1 エレメント 1 行
+/// 種別 パス 種別毎の項目... をタブ区切りで出力する
+/// スナップショットから読み込んだまま未確認のエレメントは出力しない
+/// </remarks>
+static int snapshot_writeElement(FILE* pFile, const Element* pThis, berint* pPath, int pathLength)
+{
+    const Element* pChild;
+    const GlowParameter* pParameter;
+    const GlowMatrix* pMatrix;
+    int count = 0;
+    int index;
+
+    if (pThis->pParent != NULL)
+    {
+        if (pThis->isCached)
+            return 0;
+
+        fprintf(pFile, "%d", pThis->type);
+        snapshot_writePath(pFile, pPath, pathLength);
+
+        switch (pThis->type)
+        {
+        case GlowElementType_Node:
+            snapshot_writeString(pFile, pThis->glow.pNode->pIdentifier);
+            snapshot_writeString(pFile, pThis->glow.pNode->pDescription);
+            fprintf(pFile, "\t%d\t%d", pThis->glow.pNode->isRoot ? 1 : 0, pThis->glow.pNode->isOnline ? 1 : 0);
+            snapshot_writeString(pFile, pThis->glow.pNode->pSchemaIdentifiers);
+            break;
+
+        case GlowElementType_Parameter:
+            pParameter = pThis->glow.pParameter;
+            fprintf(pFile, "\t%d", (int)pThis->paramFields);
+            snapshot_writeString(pFile, pParameter->pIdentifier);
+            snapshot_writeString(pFile, pParameter->pDescription);
+            snapshot_writeValue(pFile, &pParameter->value);
+            snapshot_writeMinMax(pFile, &pParameter->minimum);
+            snapshot_writeMinMax(pFile, &pParameter->maximum);
+            fprintf(pFile, "\t%d\t%d\t%d\t%d\t%d\t%d", pParameter->access, pParameter->factor, pParameter->isOnline ? 1 : 0,
+                                                      pParameter->step, pParameter->type, pParameter->streamIdentifier);
+            snapshot_writeString(pFile, pParameter->pSchemaIdentifiers);
+            break;
+
+        case GlowElementType_Matrix:
+            pMatrix = &pThis->glow.pMatrix->matrix;
+            snapshot_writeString(pFile, pMatrix->pIdentifier);
+            snapshot_writeString(pFile, pMatrix->pDescription);
+            fprintf(pFile, "\t%d\t%d\t%d\t%d\t%d\t%d", pMatrix->type, pMatrix->addressingMode, pMatrix->targetCount,
+                                                      pMatrix->sourceCount, pMatrix->maximumTotalConnects, pMatrix->maximumConnectsPerTarget);
+            snapshot_writeString(pFile, pMatrix->pSchemaIdentifiers);
+            fprintf(pFile, "\t%d", pMatrix->pLabels != NULL ? pMatrix->labelsLength : 0);
+            for (index = 0; (pMatrix->pLabels != NULL) && (index < pMatrix->labelsLength); index++)
+            {
+                snapshot_writePath(pFile, pMatrix->pLabels[index].basePath, pMatrix->pLabels[index].basePathLength);
+                snapshot_writeString(pFile, pMatrix->pLabels[index].pDescription);
+            }
+            break;
+
+        case GlowElementType_Function:
+            snapshot_writeString(pFile, pThis->glow.pFunction->pIdentifier);
+            snapshot_writeString(pFile, pThis->glow.pFunction->pDescription);
+            snapshot_writeTupleItems(pFile, pThis->glow.pFunction->pArguments, pThis->glow.pFunction->argumentsLength);
+            snapshot_writeTupleItems(pFile, pThis->glow.pFunction->pResult, pThis->glow.pFunction->resultLength);
+            break;
+        }
+
+        fputc('\n', pFile);
+        count++;
+    }
+
+    if (pathLength >= GLOW_MAX_TREE_DEPTH)
+        return count;
+
+    for (index = 0; index < pThis->childrenLength; index++)
+    {
+        pChild = pThis->ppChildren[index];
+        pPath[pathLength] = pChild->number;
+        count += snapshot_writeElement(pFile, pChild, pPath, pathLength + 1);
+    }
+
+    return count;
+}
+
+/// <summary>
+/// 1 行読み出し（行末の改行は除去）
+/// </summary>
+/// <returns>終端時 false</returns>
+static bool snapshot_readLine(FILE* pFile, pstr* ppBuffer, int* pBufferSize)
+{
+    pstr pNewBuffer;
+    int length = 0;
+
+    if (*ppBuffer == NULL)
+    {
+        *pBufferSize = 1024;
+        *ppBuffer = newarr(char, *pBufferSize);
+    }
+
+    while (fgets(&(*ppBuffer)[length], *pBufferSize - length, pFile) != NULL)
+    {
+        length += (int)strlen(&(*ppBuffer)[length]);
+        if ((length > 0) && ((*ppBuffer)[length - 1] == '\n'))
+            break;
+
+        // 行が収まらない場合は倍に拡張して継続
+        pNewBuffer = newarr(char, *pBufferSize * 2);
+        memcpy(pNewBuffer, *ppBuffer, length + 1);
+        freeMemory(*ppBuffer);
+        *ppBuffer = pNewBuffer;
+        *pBufferSize *= 2;
+    }
+
+    while ((length > 0) && (((*ppBuffer)[length - 1] == '\n') || ((*ppBuffer)[length - 1] == '\r')))
+        (*ppBuffer)[--length] = '\0';
+
+    return (length > 0) || !feof(pFile);
+}
+
+/// <summary>
+/// 行のタブ分割（バッファ内で分割、エスケープを復元）
+/// </summary>
+static void snapshot_splitFields(pstr pLine, SnapshotFields* pFields)
+{
+    pstr pRead;
+    pstr pWrite;
+    int count = 1;
+
+    for (pRead = pLine; *pRead != '\0'; ++pRead)
+    {
+        if (*pRead == '\t')
+            count++;
+    }
+
+    pFields->ppFields = newarr(pstr, count);
+    pFields->count = 0;
+    pFields->index = 0;
+
+    pFields->ppFields[pFields->count++] = pLine;
+    for (pRead = pWrite = pLine; *pRead != '\0'; ++pRead)
+    {
+        if (*pRead == '\t')
+        {
+            *pWrite++ = '\0';
+            pFields->ppFields[pFields->count++] = pWrite;
+        }
+        else if ((*pRead == '\\') && (pRead[1] != '\0'))
+        {
+            ++pRead;
+            *pWrite++ = (*pRead == 't') ? '\t' : (*pRead == 'n') ? '\n' : (*pRead == 'r') ? '\r' : *pRead;
         }
+        else
+        {
+            *pWrite++ = *pRead;
+        }
+    }
+    *pWrite = '\0';
+}
+
+static pcstr snapshot_nextField(SnapshotFields* pFields)
+{
+    if (pFields->index >= pFields->count)
+        return "";
+    return pFields->ppFields[pFields->index++];
+}
+
+static pstr snapshot_nextString(SnapshotFields* pFields)
+{
+    pcstr pField = snapshot_nextField(pFields);
+    return (*pField != '\0') ? stringDup(pField) : NULL;
+}
+
+/// <summary>識別子・説明・スキーマ識別子（共有文字列）</summary>
+static pstr snapshot_nextInternedString(SnapshotFields* pFields)
+{
+    pcstr pField = snapshot_nextField(pFields);
+    return (*pField != '\0') ? (pstr)internString(pField) : NULL;
+}
+
+static long long snapshot_nextInteger(SnapshotFields* pFields)
+{
+    return strtoll(snapshot_nextField(pFields), NULL, 10);
+}
+
+static double snapshot_nextReal(SnapshotFields* pFields)
+{
+    return strtod(snapshot_nextField(pFields), NULL);
+}
+
+static int snapshot_nextPath(SnapshotFields* pFields, berint* pPath)
+{
+    pcstr pField = snapshot_nextField(pFields);
+    pstr pEnd;
+    int pathLength = 0;
+
+    while ((*pField != '\0') && (pathLength < GLOW_MAX_TREE_DEPTH))
+    {
+        pPath[pathLength++] = (berint)strtol(pField, &pEnd, 10);
+        if (pEnd == pField)
+            return 0;
+        pField = (*pEnd == '.') ? pEnd + 1 : pEnd;
+    }
+
+    return pathLength;
+}
+
+static void snapshot_nextMinMax(SnapshotFields* pFields, GlowMinMax* pValue)
+{
+    pValue->flag = (GlowParameterType)snapshot_nextInteger(pFields);
+    if (pValue->flag == GlowParameterType_Integer)
+        pValue->choice.integer = (berlong)snapshot_nextInteger(pFields);
+    else if (pValue->flag == GlowParameterType_Real)
+        pValue->choice.real = snapshot_nextReal(pFields);
+    else
+    {
+        pValue->flag = GlowParameterType_None;
+        snapshot_nextField(pFields);
+    }
+}
+
+static void snapshot_nextValue(SnapshotFields* pFields, GlowValue* pValue)
+{
+    pValue->flag = (GlowParameterType)snapshot_nextInteger(pFields);
+    switch (pValue->flag)
+    {
+    case GlowParameterType_Integer:
+    case GlowParameterType_Enum:
+        pValue->choice.integer = (berlong)snapshot_nextInteger(pFields);
+        break;
+    case GlowParameterType_Real:
+        pValue->choice.real = snapshot_nextReal(pFields);
+        break;
+    case GlowParameterType_Boolean:
+        pValue->choice.boolean = snapshot_nextInteger(pFields) != 0;
+        break;
+    case GlowParameterType_String:
+        pValue->choice.pString = snapshot_nextString(pFields);
+        if (pValue->choice.pString == NULL)
+            pValue->choice.pString = stringDup("");
+        break;
+    default:
+        pValue->flag = GlowParameterType_None;
+        snapshot_nextField(pFields);
+        break;
     }
+}
+
+static GlowTupleItemDescription* snapshot_nextTupleItems(SnapshotFields* pFields, int* pItemsLength)
+{
+    GlowTupleItemDescription* pItems = NULL;
+    int itemsLength = (int)snapshot_nextInteger(pFields);
+    int index;
+
+    if (itemsLength < 0 || itemsLength > (pFields->count - pFields->index) / 2)
+        itemsLength = 0;
+
+    if (itemsLength > 0)
+    {
+        pItems = newarr(GlowTupleItemDescription, itemsLength);
+        for (index = 0; index < itemsLength; index++)
+        {
+            pItems[index].type = (GlowParameterType)snapshot_nextInteger(pFields);
+            pItems[index].pName = snapshot_nextString(pFields);
+        }
+    }
+
+    *pItemsLength = itemsLength;
+    return pItems;
+}
+
+/// <summary>
+/// スナップショット 1 行からエレメント生成
+/// </summary>
+/// <returns>生成したエレメント、親未登録や既存の場合 NULL</returns>
+static Element* snapshot_readElement(Element* pRoot, SnapshotFields* pFields)
+{
+    berint path[GLOW_MAX_TREE_DEPTH];
+    Element* pElement;
+    Element* pParent;
+    GlowElementType type;
+    GlowParameter* pParameter;
+    GlowMatrix* pMatrix;
+    int pathLength;
+    int index;
+
+    type = (GlowElementType)snapshot_nextInteger(pFields);
+    pathLength = snapshot_nextPath(pFields, path);
+    if (pathLength <= 0)
+        return NULL;
+
+    pElement = element_findDescendant(pRoot, path, pathLength, &pParent);
+    if ((pElement != NULL) || (pParent == NULL))
+        return NULL;
+
+    switch (type)
+    {
+    case GlowElementType_Node:
+        pElement = newobj(Element);
+        element_init(pElement, pParent, type, path[pathLength - 1]);
+        pElement->glow.pNode->pIdentifier = snapshot_nextInternedString(pFields);
+        pElement->glow.pNode->pDescription = snapshot_nextInternedString(pFields);
+        pElement->glow.pNode->isRoot = snapshot_nextInteger(pFields) != 0;
+        pElement->glow.pNode->isOnline = snapshot_nextInteger(pFields) != 0;
+        pElement->glow.pNode->pSchemaIdentifiers = snapshot_nextInternedString(pFields);
+        pElement->pIdentifier = pElement->glow.pNode->pIdentifier;
+        break;
+
+    case GlowElementType_Parameter:
+        pElement = newobj(Element);
+        element_init(pElement, pParent, type, path[pathLength - 1]);
+        pParameter = pElement->glow.pParameter;
+        pElement->paramFields = (GlowFieldFlags)snapshot_nextInteger(pFields);
+        pParameter->pIdentifier = snapshot_nextInternedString(pFields);
+        pParameter->pDescription = snapshot_nextInternedString(pFields);
+        pElement->pIdentifier = pParameter->pIdentifier;
+        snapshot_nextValue(pFields, &pParameter->value);
+        snapshot_nextMinMax(pFields, &pParameter->minimum);
+        snapshot_nextMinMax(pFields, &pParameter->maximum);
+        pParameter->access = (GlowAccess)snapshot_nextInteger(pFields);
+        pParameter->factor = (int)snapshot_nextInteger(pFields);
+        pParameter->isOnline = snapshot_nextInteger(pFields) != 0;
+        pParameter->step = (int)snapshot_nextInteger(pFields);
+        pParameter->type = (GlowParameterType)snapshot_nextInteger(pFields);
+        pParameter->streamIdentifier = (int)snapshot_nextInteger(pFields);
+        pParameter->pSchemaIdentifiers = snapshot_nextInternedString(pFields);
+        // 保存しない項目は取得済として扱わない
+        pElement->paramFields = (GlowFieldFlags)(pElement->paramFields & ~(GlowFieldFlag_Format | GlowFieldFlag_Formula | GlowFieldFlag_Enumeration
+                                                                         | GlowFieldFlag_DefaultValue | GlowFieldFlag_StreamDescriptor
+                                                                         | GlowFieldFlag_TemplateReference));
+        break;
+
+    case GlowElementType_Matrix:
+        pElement = newobj(Element);
+        element_init(pElement, pParent, type, path[pathLength - 1]);
+        pMatrix = &pElement->glow.pMatrix->matrix;
+        pMatrix->pIdentifier = snapshot_nextInternedString(pFields);
+        pMatrix->pDescription = snapshot_nextInternedString(pFields);
+        pElement->pIdentifier = pMatrix->pIdentifier;
+        pMatrix->type = (GlowMatrixType)snapshot_nextInteger(pFields);
+        pMatrix->addressingMode = (GlowMatrixAddressingMode)snapshot_nextInteger(pFields);
+        pMatrix->targetCount = (berint)snapshot_nextInteger(pFields);
+        pMatrix->sourceCount = (berint)snapshot_nextInteger(pFields);
+        pMatrix->maximumTotalConnects = (berint)snapshot_nextInteger(pFields);
+        pMatrix->maximumConnectsPerTarget = (berint)snapshot_nextInteger(pFields);
+        pMatrix->pSchemaIdentifiers = snapshot_nextInternedString(pFields);
+        pMatrix->labelsLength = (int)snapshot_nextInteger(pFields);
+        if (pMatrix->labelsLength < 0 || pMatrix->labelsLength > (pFields->count - pFields->index) / 2)
+            pMatrix->labelsLength = 0;
+        if (pMatrix->labelsLength > 0)
+        {
+            pMatrix->pLabels = newarr(GlowLabel, pMatrix->labelsLength);
+            for (index = 0; index < pMatrix->labelsLength; index++)
+            {
+                pMatrix->pLabels[index].basePathLength = snapshot_nextPath(pFields, pMatrix->pLabels[index].basePath);
+                pMatrix->pLabels[index].pDescription = snapshot_nextString(pFields);
+            }
+        }
+        break;
+
+    case GlowElementType_Function:
+        pElement = newobj(Element);
+        element_init(pElement, pParent, type, path[pathLength - 1]);
+        pElement->glow.pFunction->pIdentifier = snapshot_nextInternedString(pFields);
+        pElement->glow.pFunction->pDescription = snapshot_nextInternedString(pFields);
+        pElement->pIdentifier = pElement->glow.pFunction->pIdentifier;
+        pElement->glow.pFunction->pArguments = snapshot_nextTupleItems(pFields, &pElement->glow.pFunction->argumentsLength);
+        pElement->glow.pFunction->pResult = snapshot_nextTupleItems(pFields, &pElement->glow.pFunction->resultLength);
+        break;
+
+    default:
+        return NULL;
+    }
+
+    pElement->isCached = true;
 
     return pElement;
 }
 
+int element_writeSnapshot(const Element* pRoot, pcstr pFilePath)
+{
+    berint path[GLOW_MAX_TREE_DEPTH];
+    pstr pTempPath;
+    FILE* pFile;
+    size_t length;
+    int count;
+    bool isError;
+
+    if ((pRoot == NULL) || (pFilePath == NULL) || (*pFilePath == '\0'))
+        return -1;
+
+    // 書き出し途中の破損を避けるため一時ファイルへ出力後に置き換える
+    length = strlen(pFilePath) + 5;
+    pTempPath = newarr(char, length);
+    snprintf(pTempPath, length, "%s.tmp", pFilePath);
+    pFile = snapshot_open(pTempPath, "wb");
+    if (pFile == NULL)
+    {
+        __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "snapshot open error, %s\n", pTempPath);
+        freeMemory(pTempPath);
+        return -1;
+    }
+
+    fprintf(pFile, "%s\t%d\n", SNAPSHOT_HEADER, SNAPSHOT_VERSION);
+    count = snapshot_writeElement(pFile, pRoot, path, 0);
+
+    isError = fclose(pFile) != 0;
+    if (!isError)
+    {
+        // 置き換え（途中で停止しても旧ファイルか新ファイルのいずれかが残る）
+#if defined WIN32
+        // Windows の rename は既存ファイルがあると失敗するため、上書き指定で置き換える
+        isError = !MoveFileExA(pTempPath, pFilePath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+        isError = rename(pTempPath, pFilePath) != 0;
+#endif
+    }
+    if (isError)
+    {
+        __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "snapshot write error, %s\n", pFilePath);
+        remove(pTempPath);
+        freeMemory(pTempPath);
+        return -1;
+    }
+    freeMemory(pTempPath);
+
+    __Trace(__FILE__, __LINE__, __FUNCTION__, "snapshot saved, %s, elements = %d\n", pFilePath, count);
+    return count;
+}
+
+int element_readSnapshot(Element* pRoot, pcstr pFilePath)
+{
+    SnapshotFields fields;
+    FILE* pFile;
+    pstr pLine = NULL;
+    int lineSize = 0;
+    int count = -1;
+
+    if ((pRoot == NULL) || (pFilePath == NULL) || (*pFilePath == '\0'))
+        return -1;
+
+    pFile = snapshot_open(pFilePath, "rb");
+    if (pFile == NULL)
+        return -1;
+
+    // 書式確認
+    if (snapshot_readLine(pFile, &pLine, &lineSize))
+    {
+        snapshot_splitFields(pLine, &fields);
+        if ((strcmp(snapshot_nextField(&fields), SNAPSHOT_HEADER) == 0)
+         && (snapshot_nextInteger(&fields) == SNAPSHOT_VERSION))
+            count = 0;
+        freeMemory(fields.ppFields);
+    }
+
+    while ((count >= 0) && snapshot_readLine(pFile, &pLine, &lineSize))
+    {
+        if (*pLine == '\0')
+            continue;
+
+        snapshot_splitFields(pLine, &fields);
+        if (snapshot_readElement(pRoot, &fields) != NULL)
+            count++;
+        freeMemory(fields.ppFields);
+    }
+
+    fclose(pFile);
+    if (pLine != NULL)
+        freeMemory(pLine);
+
+    if (count < 0)
+        __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "snapshot format error, %s\n", pFilePath);
+    else
+        __Trace(__FILE__, __LINE__, __FUNCTION__, "snapshot loaded, %s, elements = %d\n", pFilePath, count);
+
+    return count;
+}
+
 
 /// <summary>
 /// 文字列化パスデリミタ
@@ -1413,6 +3221,9 @@ static size_t split(char* dst[], char* src, char delim)
 /// <param name="pathValue"></param>
 /// <param name="ppPath"></param>
 /// <returns></returns>
+/// <remarks>
+/// 上位ラッパのスレッドから呼び出す場合は lockEmberTree を取得しておくこと
+/// </remarks>
 size_t convertString2Path(Element* pRoot, const pstr pathValue, berint** ppPath)
 {
 //#pragma warning(push)
@@ -1502,7 +3313,7 @@ size_t convertString2Path(Element* pRoot, const pstr pathValue, berint** ppPath)
     }
     else
     {
-        __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "unknown path %s, lost depth = %d, topNode children count = %d\n", pathValue, chkdepth, pRoot->children.count);
+        __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "unknown path %s, lost depth = %d, topNode children count = %d\n", pathValue, chkdepth, pRoot->childrenLength);
         count = 0;
     }
 
@@ -1522,6 +3333,9 @@ size_t convertString2Path(Element* pRoot, const pstr pathValue, berint** ppPath)
 /// <param name="pPath"></param>
 /// <param name="pPathLength"></param>
 /// <returns></returns>
+/// <remarks>
+/// 上位ラッパのスレッドから呼び出す場合は lockEmberTree を取得しておくこと
+/// </remarks>
 pstr convertPath2String(Element* pRoot, const berint* pPath, int pathLength)
 {
 //#pragma warning(push)
@@ -1543,7 +3357,7 @@ pstr convertPath2String(Element* pRoot, const berint* pPath, int pathLength)
         return pd;
     }
 
-    pstr* ids = NULL;
+    pcstr* ids = NULL;
     pstr value = NULL;
 
 #if defined WIN32
@@ -1555,7 +3369,7 @@ pstr convertPath2String(Element* pRoot, const berint* pPath, int pathLength)
 #endif
         {
             // 一時枠確保
-            ids = newarr(pstr, pathLength);
+            ids = newarr(pcstr, pathLength);
             bzero_item(*ids);
             int _pathLength = 0;
             size_t totalLength = 0;
@@ -1570,7 +3384,7 @@ pstr convertPath2String(Element* pRoot, const berint* pPath, int pathLength)
                      || (pCursor->type == GlowElementType_Matrix)
                      || (pCursor->type == GlowElementType_Function))
                     {
-                        ids[pathIndex] = pCursor->glow.nodeId.pIdentifier;
+                        ids[pathIndex] = pCursor->pIdentifier;
                         totalLength += strlen(ids[pathIndex]);
                         ++_pathLength;
                     }
@@ -1640,35 +3454,100 @@ typedef struct tagSession
 #pragma pack()
 */
 
-static Session* pActiveSession = NULL;
-static void setActiveSession(Session* pSession)
+/// <summary>接続中セッションの設定（呼び出し元の接続情報へ反映）</summary>
+/// <param name="pSession"></param>
+/// <param name="active"></param>
+static void setActiveSession(Session* pSession, bool active)
+{
+    if (pSession->pOwner != NULL)
+    {
+        lockEmberTree(pSession->pOwner);
+        pSession->pOwner->pActiveSession = active ? pSession : NULL;
+        unlockEmberTree(pSession->pOwner);
+    }
+}
+/// <summary>送信中要求の設定</summary>
+/// <param name="pSession"></param>
+/// <param name="pRequest">応答待ちの要求（NULL で解除）</param>
+/// <remarks>
+/// getInFlightRequest と排他する
+/// </remarks>
+static void setInFlightRequest(Session* pSession, EmberContent* pRequest)
 {
-    pActiveSession = pSession;
+    lockEmberTree(&pSession->remoteContent);
+    pSession->pRequest = pRequest;
+    unlockEmberTree(&pSession->remoteContent);
+}
+/// <summary>送信中要求取得</summary>
+/// <param name="pRemoteContent">接続情報（runConsumer へ渡したもの）</param>
+/// <returns>応答待ちの要求（接続中でない場合・応答待ちがない場合 NULL）</returns>
+/// <remarks>
+/// C++ からは Session の配置（C の bool 長に依存）を参照せず、本関数で取得する
+/// </remarks>
+const EmberContent* getInFlightRequest(const RemoteContent* pRemoteContent)
+{
+    const EmberContent* pRequest = NULL;
+    if (pRemoteContent == NULL)
+        return NULL;
+    lockEmberTree(pRemoteContent);
+    if (pRemoteContent->pActiveSession != NULL)
+        pRequest = pRemoteContent->pActiveSession->pRequest;
+    unlockEmberTree(pRemoteContent);
+    return pRequest;
 }
 /// <summary>ツリー先頭取得</summary></summary>
+/// <param name="pRemoteContent">接続情報（runConsumer へ渡したもの）</param>
 /// <returns></returns>
-Element* getRootTop()
+/// <remarks>
+/// 短時間の切断中は保持しているツリーを返す
+/// 戻り値の配下を走査する間は呼び出し元で lockEmberTree を取得すること
+/// （保持期限の経過・構成変更でコンシューマスレッドが破棄するため）
+/// </remarks>
+Element* getRootTop(const RemoteContent* pRemoteContent)
 {
     Element* pRootTop = NULL;
-    if (pActiveSession != NULL)
+    if (pRemoteContent == NULL)
+        return NULL;
+    lockEmberTree(pRemoteContent);
+    if (pRemoteContent->pActiveSession != NULL)
     {
-        pRootTop = &pActiveSession->root;
+        pRootTop = &pRemoteContent->pActiveSession->root;
     }
+    else
+    {
+        pRootTop = pRemoteContent->pRetainedRoot;
+    }
+    unlockEmberTree(pRemoteContent);
     return pRootTop;
 }
 /// <summary>ツリー先頭取得有無</summary>
+/// <param name="pRemoteContent">接続情報（runConsumer へ渡したもの）</param>
 /// <returns></returns>
-bool hasEmberTree()
+bool hasEmberTree(const RemoteContent* pRemoteContent)
 {
     bool ena = false;
-    Element* pRootTop = getRootTop();
+    lockEmberTree(pRemoteContent);
+    Element* pRootTop = getRootTop(pRemoteContent);
     if (pRootTop != NULL)
     {
-        ena = pRootTop->children.count > 0;
+        ena = pRootTop->childrenLength > 0;
     }
+    unlockEmberTree(pRemoteContent);
 
     return ena;
 }
+/// <summary>送信集計取得</summary>
+/// <param name="pRemoteContent">接続情報（runConsumer へ渡したもの）</param>
+/// <param name="pStatistics">格納先</param>
+/// <returns>接続中（リプレイ含む）のセッションがない場合 false</returns>
+bool getTxStatistics(const RemoteContent* pRemoteContent, TxStatistics* pStatistics)
+{
+    const Session* pSession = (pRemoteContent != NULL) ? pRemoteContent->pActiveSession : NULL;
+    if ((pStatistics == NULL) || (pSession == NULL))
+        return false;
+    memcpy(pStatistics, &pSession->txStatistics, sizeof(TxStatistics));
+    return true;
+}
 
 
 static bool getQuitConsumerRequest(const Session* pSession)
@@ -1692,48 +3571,177 @@ static void notifyReceivedConsumerResult(const Session* pSession, EmberContent*
         id = pSession->remoteContent.id;
     __NotifyReceivedConsumerResult(id, pResult);
 }
+/// <summary>
+/// パッケージ送信
+/// </summary>
+/// <param name="pSession"></param>
+/// <param name="sock"></param>
+/// <param name="pBuffer"></param>
+/// <param name="length"></param>
+/// <returns>送信バイト数</returns>
+/// <remarks>
+/// 送信内容はキャプチャ有効時に記録する
+/// リプレイ中のセッションは送信せず、送信済として扱う
+/// </remarks>
+static int sendPackage(const Session* pSession, SOCKET sock, const byte* pBuffer, int length)
+{
+    if (pSession->replay)
+        return length;
+
+    int sendlen = send(sock, (const char*)pBuffer, length, 0);
+    if (sendlen > 0)
+        __CaptureTraffic(pSession->remoteContent.id, true, pBuffer, sendlen);
+    return sendlen;
+}
+
+
+/// <summary>
+/// ノード受信
+/// </summary>
+/// <param name="pNode"></param>
+/// <param name="fields"></param>
+/// <param name="pPath"></param>
+/// <param name="pathLength"></param>
+/// <param name="state"></param>
+static void onNode(const GlowNode *pNode, GlowFieldFlags fields, const berint *pPath, int pathLength, voidptr state)
+{
+    __Trace(__FILE__, __LINE__, __FUNCTION__, "state = 0x%016llx\n", state);
+    Session* pSession = (Session*)state;
+    if (!pSession)
+        return;
+
+    // ツリーへ反映
+    int nDuplicateRequest = false;
+    Element* pElement = element_setNode(pNode, fields, pPath, pathLength, &pSession->root, &pSession->remoteContent, &nDuplicateRequest);
+    if (!pElement)
+        return;
+    if (pSession->validityPathLength < pathLength)
+        pSession->validityPathLength = pathLength;
+
+    RequestId* pId = NULL;
+    if (pSession->pRequest
+     && (pSession->pRequest->type == GlowType_Command)
+     && (pSession->pRequest->command.number == GlowCommandType_GetDirectory))
+    {
+        pId = &pSession->pRequest->requestId;
+        setInFlightRequest(pSession, NULL);
+    }
+    // ツリーに反映したインスタンスから通知データを生成する
+    //EmberContent* pResult = createEmberNodeContent(pId, pPath, pathLength, pNode, fields);
+    EmberContent* pResult = createEmberNodeContent(pId, pPath, pathLength, pElement->glow.pNode, fields);
+    if (pResult)
+    {
+        // 上位ラッパへ通知
+        pResult->duplicateRequests = nDuplicateRequest;
+        notifyReceivedConsumerResult(pSession, pResult);
+    }
+}
 
+/// <summary>
+/// パラメータ通知振り分け表の子検索
+/// </summary>
+/// <param name="pNode"></param>
+/// <param name="number">パス要素番号</param>
+/// <param name="pIndex">未登録時の挿入位置</param>
+/// <returns>未登録時 NULL</returns>
+static DispatchNode* findDispatchChild(const DispatchNode* pNode, berint number, int* pIndex)
+{
+    int low = 0;
+    int high = pNode->childrenLength - 1;
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+        berint current = pNode->pChildren[middle].number;
+        if (current == number)
+            return &pNode->pChildren[middle];
+        if (current < number)
+            low = middle + 1;
+        else
+            high = middle - 1;
+    }
+    if (pIndex)
+        *pIndex = low;
+    return NULL;
+}
+/// <summary>
+/// パラメータ通知振り分け登録
+/// </summary>
+/// <param name="pRoot"></param>
+/// <param name="pPath"></param>
+/// <param name="pathLength"></param>
+/// <param name="key">振り分け識別（DISPATCH_KEY_WATCH は監視のみ設定し、振り分け識別は変えない）</param>
+static void insertDispatch(DispatchNode* pRoot, const berint* pPath, int pathLength, int key)
+{
+    DispatchNode* pNode = pRoot;
+    int depth;
 
+    for (depth = 0; depth < pathLength; depth++)
+    {
+        int index = 0;
+        DispatchNode* pChild = findDispatchChild(pNode, pPath[depth], &index);
+        if (pChild == NULL)
+        {
+            if (pNode->childrenLength >= pNode->childrenCapacity)
+            {
+                int capacity = (pNode->childrenCapacity > 0) ? (pNode->childrenCapacity * 2) : 4;
+                DispatchNode* pChildren = newarr(DispatchNode, capacity);
+                if (pNode->pChildren != NULL)
+                {
+                    memcpy(pChildren, pNode->pChildren, sizeof(DispatchNode) * pNode->childrenLength);
+                    freeMemory(pNode->pChildren);
+                }
+                pNode->pChildren = pChildren;
+                pNode->childrenCapacity = capacity;
+            }
+            memmove(&pNode->pChildren[index + 1], &pNode->pChildren[index], sizeof(DispatchNode) * (pNode->childrenLength - index));
+            pChild = &pNode->pChildren[index];
+            bzero_item(*pChild);
+            pChild->number = pPath[depth];
+            pChild->key = -1;
+            pNode->childrenLength++;
+        }
+        pNode = pChild;
+    }
+    if (key == DISPATCH_KEY_WATCH)
+        pNode->watched = 1;
+    else
+        pNode->key = key;
+}
+/// <summary>
+/// パラメータ通知振り分け先取得
+/// </summary>
+/// <param name="pRoot"></param>
+/// <param name="pPath"></param>
+/// <param name="pathLength"></param>
+/// <returns>未登録時 NULL（途中要素のみの場合は振り分け識別 -1 かつ監視なし）</returns>
+static const DispatchNode* findDispatch(const DispatchNode* pRoot, const berint* pPath, int pathLength)
+{
+    const DispatchNode* pNode = pRoot;
+    int depth;
+
+    if ((pPath == NULL) || (pathLength <= 0))
+        return NULL;
+    for (depth = 0; (depth < pathLength) && (pNode != NULL); depth++)
+        pNode = findDispatchChild(pNode, pPath[depth], NULL);
+    return pNode;
+}
 /// <summary>
-/// ノード受信
+/// パラメータ通知振り分け表の破棄
 /// </summary>
 /// <param name="pNode"></param>
-/// <param name="fields"></param>
-/// <param name="pPath"></param>
-/// <param name="pathLength"></param>
-/// <param name="state"></param>
-static void onNode(const GlowNode *pNode, GlowFieldFlags fields, const berint *pPath, int pathLength, voidptr state)
+static void clearDispatch(DispatchNode* pNode)
 {
-    __Trace(__FILE__, __LINE__, __FUNCTION__, "state = 0x%016llx\n", state);
-    Session* pSession = (Session*)state;
-    if (!pSession)
-        return;
-
-    // ツリーへ反映
-    int nDuplicateRequest = false;
-    Element* pElement = element_setNode(pNode, fields, pPath, pathLength, &pSession->root, &nDuplicateRequest);
-    if (!pElement)
-        return;
+    int index;
 
-    RequestId* pId = NULL;
-    if (pSession->pRequest
-     && (pSession->pRequest->type == GlowType_Command)
-     && (pSession->pRequest->command.number == GlowCommandType_GetDirectory))
-    {
-        pId = &pSession->pRequest->requestId;
-        pSession->pRequest = NULL;
-    }
-    // ツリーに反映したインスタンスから通知データを生成する
-    //EmberContent* pResult = createEmberNodeContent(pId, pPath, pathLength, pNode, fields);
-    EmberContent* pResult = createEmberNodeContent(pId, pPath, pathLength, &pElement->glow.node, fields);
-    if (pResult)
-    {
-        // 上位ラッパへ通知
-        pResult->duplicateRequests = nDuplicateRequest;
-        notifyReceivedConsumerResult(pSession, pResult);
-    }
+    for (index = 0; index < pNode->childrenLength; index++)
+        clearDispatch(&pNode->pChildren[index]);
+    if (pNode->pChildren != NULL)
+        freeMemory(pNode->pChildren);
+    pNode->pChildren = NULL;
+    pNode->childrenLength = 0;
+    pNode->childrenCapacity = 0;
 }
-EmberContent* m_pResult = NULL;
+
 /// <summary>
 /// パラメータ受信
 /// </summary>
@@ -1750,27 +3758,34 @@ static void onParameter(const GlowParameter *pParameter, GlowFieldFlags fields,
         return;
 
     // ツリーへ反映
-    Element* pElement = element_setParameter(pParameter, fields, pPath, pathLength, &pSession->root);
+    bool isUnchanged = false;
+    Element* pElement = element_setParameter(pParameter, fields, pPath, pathLength, &pSession->root, &pSession->remoteContent, &isUnchanged);
     if (!pElement)
         return;
+    // 再接続後の再確認で値に変化がなければ通知しない
+    if (isUnchanged)
+        return;
 
-    RequestId* pId = NULL;
     if (pSession->pRequest
      && (pSession->pRequest->type == GlowType_Parameter)
      && (pSession->pRequest->pathLength == pSession->pRequest->pathLength)
      && isSamePath(pSession->pRequest->pPath, pPath, pathLength))
     {
-        pId = &pSession->pRequest->requestId;
-        pSession->pRequest = NULL;
+        setInFlightRequest(pSession, NULL);
     }
-    // ツリーに反映したインスタンスから通知データを生成する
-    //EmberContent* pResult = createEmberParameterContent(pId, pPath, pathLength, pParameter, fields);
-    EmberContent* pResult = createEmberParameterContent(pId, pPath, pathLength, &pElement->glow.parameter, fields);
-    if (pResult)
+    // 振り分け・監視登録のないパスは通知しない
+    const DispatchNode* pDispatch = findDispatch(&pSession->dispatchRoot, pPath, pathLength);
+    if (pDispatch == NULL)
+        return;
+    // ツリーに反映したインスタンスを通知する
+    if (pDispatch->key >= 0)
+        __EmberCommandConverter(pDispatch->key, pElement->glow.pParameter);
+    // 監視パスは値変化を結果として通知する（ボタン表示の更新用）
+    if (pDispatch->watched)
     {
-        // 上位ラッパへ通知
-        //notifyReceivedConsumerResult(pSession, pResult);
-		__EmberCommandConverter(pResult);
+        EmberContent* pResult = createEmberParameterContent(NULL, pPath, pathLength, pElement->glow.pParameter, fields);
+        if (pResult)
+            notifyReceivedConsumerResult(pSession, pResult);
     }
 }
 
@@ -1789,7 +3804,7 @@ static void onMatrix(const GlowMatrix *pMatrix, const berint *pPath, int pathLen
         return;
 
     // ツリーへ反映
-    Element* pElement = element_setMatrix(pMatrix, pPath, pathLength, &pSession->root);
+    Element* pElement = element_setMatrix(pMatrix, pPath, pathLength, &pSession->root, &pSession->remoteContent);
     if (!pElement)
         return;
 
@@ -1800,7 +3815,7 @@ static void onMatrix(const GlowMatrix *pMatrix, const berint *pPath, int pathLen
 #endif
     // ツリーに反映したインスタンスから通知データを生成する
     //EmberContent* pResult = createEmberMatrixContent(pId, pPath, pathLength, pMatrix);
-    EmberContent* pResult = createEmberMatrixContent(pId, pPath, pathLength, &pElement->glow.matrix.matrix);
+    EmberContent* pResult = createEmberMatrixContent(pId, pPath, pathLength, &pElement->glow.pMatrix->matrix);
     if (pResult)
     {
         // 上位ラッパへ通知
@@ -1822,7 +3837,7 @@ static void onTarget(const GlowSignal *pSignal, const berint *pPath, int pathLen
         return;
 
     // ツリーへ反映
-    Element* pElement = element_setTarget(pSignal, pPath, pathLength, &pSession->root);
+    Element* pElement = element_setTarget(pSignal, pPath, pathLength, &pSession->root, &pSession->remoteContent);
 
     RequestId* pId = NULL;
 #if false
@@ -1851,7 +3866,7 @@ static void onSource(const GlowSignal *pSignal, const berint *pPath, int pathLen
         return;
 
     // ツリーへ反映
-    Element* pElement = element_setSource(pSignal, pPath, pathLength, &pSession->root);
+    Element* pElement = element_setSource(pSignal, pPath, pathLength, &pSession->root, &pSession->remoteContent);
 
     RequestId* pId = NULL;
 #if false
@@ -1880,7 +3895,8 @@ static void onConnection(const GlowConnection *pConnection, const berint *pPath,
         return;
 
     // ツリーへ反映
-    Element* pElement = element_setConnection(pConnection, pPath, pathLength, &pSession->root);
+    bool isUnchanged = false;
+    Element* pElement = element_setConnection(pConnection, pPath, pathLength, &pSession->root, &pSession->remoteContent, &isUnchanged);
 
     RequestId* pId = NULL;
     if (pSession->pRequest)
@@ -1893,6 +3909,8 @@ static void onConnection(const GlowConnection *pConnection, const berint *pPath,
     EmberContent* pResult = createEmberConnectionContent(pId, pPath, pathLength, _pConnection);
     if (pResult)
     {
+        // 接続ソースに変化がない場合は重複として通知（サルボ完了確認には使用する）
+        pResult->duplicateRequests = isUnchanged;
         // 上位ラッパへ通知
         notifyReceivedConsumerResult(pSession, pResult);
     }
@@ -1913,7 +3931,7 @@ static void onFunction(const GlowFunction *pFunction, const berint *pPath, int p
         return;
 
     // ツリーへ反映
-    Element* pElement = element_setFunction(pFunction, pPath, pathLength, &pSession->root);
+    Element* pElement = element_setFunction(pFunction, pPath, pathLength, &pSession->root, &pSession->remoteContent);
     if (!pElement)
         return;
 
@@ -1924,7 +3942,7 @@ static void onFunction(const GlowFunction *pFunction, const berint *pPath, int p
 #endif
     // ツリーに反映したインスタンスから通知データを生成する
     //EmberContent* pResult = createEmberFunctionContent(pId, pPath, pathLength, pFunction);
-    EmberContent* pResult = createEmberFunctionContent(pId, pPath, pathLength, &pElement->glow.function);
+    EmberContent* pResult = createEmberFunctionContent(pId, pPath, pathLength, pElement->glow.pFunction);
     if (pResult)
     {
         // 上位ラッパへ通知
@@ -1949,7 +3967,7 @@ static void onInvocationResult(const GlowInvocationResult *pInvocationResult, vo
      && (pSession->pRequest->command.options.invocation.invocationId == pInvocationResult->invocationId))
     {
         pId = &pSession->pRequest->requestId;
-        pSession->pRequest = NULL;
+        setInFlightRequest(pSession, NULL);
     }
     EmberContent* pResult = createEmberInvocationResultContent(pId, pInvocationResult);
     if (pResult)
@@ -1972,12 +3990,32 @@ static void onOtherPackageReceived(const byte *pPackage, int length, voidptr sta
     unsigned int txLength;
 
     if (length >= 4
+     && pPackage[1] == EMBER_MESSAGE_ID
+     && pPackage[2] == EMBER_COMMAND_KEEPALIVE_RESPONSE)
+    {
+        // 応答待ちの要求からの往復時間をリンク遅延として記録する
+        if (pSession->keepAliveSentUsec != 0ull)
+        {
+            LinkStatistics* pStatistics = (pSession->pOwner != NULL) ? &pSession->pOwner->linkStatistics : NULL;
+            unsigned long long rttUsec = getMonotonicUsec() - pSession->keepAliveSentUsec;
+            pSession->keepAliveSentUsec = 0ull;
+            if (pStatistics != NULL)
+            {
+                pStatistics->responses++;
+                pStatistics->rttUsec = rttUsec;
+                pStatistics->rttTotalUsec += rttUsec;
+                if (pStatistics->rttMaxUsec < rttUsec)
+                    pStatistics->rttMaxUsec = rttUsec;
+            }
+        }
+    }
+    else if (length >= 4
      && pPackage[1] == EMBER_MESSAGE_ID
      && pPackage[2] == EMBER_COMMAND_KEEPALIVE_REQUEST)
     {
         pBuffer = newarr(byte, bufferSize);
-        txLength = emberFraming_writeKeepAliveResponse(pBuffer, sizeof(pBuffer), pPackage[0]);
-        int sendlen = send(sock, (char *)pBuffer, txLength, 0);
+        txLength = emberFraming_writeKeepAliveResponse(pBuffer, bufferSize, pPackage[0]);
+        int sendlen = sendPackage(pSession, sock, pBuffer, txLength);
         if (sendlen != txLength)
         {
             int eno = errno;
@@ -2039,16 +4077,573 @@ static Element *findElement(pcstr pIdentifier, const Session *pSession)
 {
     if(strcmp(pIdentifier, ".") == 0)
     {
-        return pSession->pCursor;
+        return pSession->pCursor;
+    }
+    else if(strcmp(pIdentifier, "..") == 0)
+    {
+        return pSession->pCursor->pParent;
+    }
+
+    return element_findChildByIdentifier(pSession->pCursor, pIdentifier);
+}
+#endif
+
+/// <summary>
+/// 一括接続 1接続あたりの符号長見積り（エスケープ前）
+/// </summary>
+/// <param name="pConnection"></param>
+/// <returns></returns>
+/// <remarks>
+/// Connection [APPLICATION 16] 内 target / sources / operation / disposition の上限値
+/// </remarks>
+static int salvoConnectionLength(const GlowConnection* pConnection)
+{
+    return 32 + (6 * (pConnection->sourcesLength > 0 ? pConnection->sourcesLength : 0));
+}
+/// <summary>
+/// 一括接続 フレームヘッダ・Connections 前後の符号長見積り（エスケープ前）
+/// </summary>
+/// <param name="pathLength"></param>
+/// <returns></returns>
+static int salvoPrefixLength(int pathLength)
+{
+    return 64 + (6 * pathLength);
+}
+
+/// <summary>S101 ヘッダ長（エスケープ前、アプリケーションバイト含む）</summary>
+#define S101_HEADER_LENGTH  9
+/// <summary>S101 CRC 長（エスケープ前）</summary>
+#define S101_CRC_LENGTH     2
+/// <summary>S101 エスケープ対象の下限値</summary>
+#define S101_ESCAPE_MIN     0xF8
+/// <summary>S101 フレーム内ペイロード上限（エスケープ後）</summary>
+/// <remarks>
+/// フレーム長上限から BOF/EOF とエスケープ後のヘッダ・CRC の最大長を除く
+/// </remarks>
+#define S101_PAYLOAD_LIMIT  (EMBER_MAXIMUM_PACKAGE_LENGTH - 2 - (2 * (S101_HEADER_LENGTH + S101_CRC_LENGTH)))
+
+/// <summary>
+/// 値の符号長見積り
+/// </summary>
+/// <param name="pValue"></param>
+/// <returns></returns>
+static int estimateValueLength(const GlowValue* pValue)
+{
+    int length = 16;
+    if ((pValue->flag == GlowParameterType_String) && (pValue->choice.pString != NULL))
+        length += (int)strlen(pValue->choice.pString);
+    else if ((pValue->flag == GlowParameterType_Octets) && (pValue->choice.octets.length > 0))
+        length += pValue->choice.octets.length;
+    return length;
+}
+/// <summary>
+/// 要求の符号長見積り
+/// </summary>
+/// <param name="pRequest"></param>
+/// <param name="pathLength"></param>
+/// <param name="top">一括接続の先頭</param>
+/// <param name="count">一括接続の接続数</param>
+/// <returns></returns>
+static int estimateRequestLength(const EmberContent* pRequest, int pathLength, int top, int count)
+{
+    int length = salvoPrefixLength(pathLength);
+    int index;
+
+    if (pRequest->type == GlowType_Command)
+    {
+        if (pRequest->command.number == GlowCommandType_Invoke)
+        {
+            const GlowInvocation* pInvocation = &pRequest->command.options.invocation;
+            for (index = 0; (index < pInvocation->argumentsLength) && (pInvocation->pArguments != NULL); index++)
+                length += estimateValueLength(&pInvocation->pArguments[index]);
+        }
+    }
+    else if ((pRequest->type == GlowType_Parameter) || (pRequest->type == GlowType_QualifiedParameter))
+    {
+        length += estimateValueLength(&pRequest->parameter.value);
+    }
+    else if (pRequest->type == GlowType_Connection)
+    {
+        length += salvoConnectionLength(&pRequest->connection);
+    }
+    else if (pRequest->type == (GlowType)SALVO_REQUEST_CONSUMER)
+    {
+        for (index = top; (index < top + count) && (pRequest->salvo.pConnections != NULL); index++)
+            length += salvoConnectionLength(&pRequest->salvo.pConnections[index]);
+    }
+    return length;
+}
+
+/// <summary>
+/// 送信用バッファ確保
+/// </summary>
+/// <param name="pSession"></param>
+/// <param name="size">必要長</param>
+/// <returns>上限超過時 false</returns>
+/// <remarks>
+/// 確保済の長さで足りる場合はそのまま再利用する
+/// </remarks>
+static bool reserveTxArena(Session* pSession, int size)
+{
+    int arenaSize;
+
+    if (size > TX_ARENA_MAX_SIZE)
+        return false;
+    if ((pSession->pTxArena != NULL) && (pSession->txArenaSize >= size))
+        return true;
+
+    arenaSize = (pSession->txArenaSize > 0) ? pSession->txArenaSize : TX_ARENA_INITIAL_SIZE;
+    while (arenaSize < size)
+        arenaSize *= 2;
+    if (arenaSize > TX_ARENA_MAX_SIZE)
+        arenaSize = TX_ARENA_MAX_SIZE;
+
+    if (pSession->pTxArena != NULL)
+    {
+        freeMemory(pSession->pTxArena);
+        pSession->txStatistics.arenaGrowths++;
+    }
+    pSession->pTxArena = newarr(byte, arenaSize);
+    pSession->txArenaSize = arenaSize;
+    pSession->txStatistics.arenaSize = arenaSize;
+    return true;
+}
+/// <summary>
+/// 送信用バッファ解放
+/// </summary>
+/// <param name="pSession"></param>
+static void freeTxArena(Session* pSession)
+{
+    if (pSession->pTxArena != NULL)
+        freeMemory(pSession->pTxArena);
+    pSession->pTxArena = NULL;
+    pSession->txArenaSize = 0;
+    if (pSession->pTxTemplates != NULL)
+        freeMemory(pSession->pTxTemplates);
+    pSession->pTxTemplates = NULL;
+}
+
+/// <summary>
+/// 送信時間集計
+/// </summary>
+/// <param name="pStatistics"></param>
+/// <param name="encodeUsec">符号化時間</param>
+/// <param name="sendUsec">送信時間</param>
+static void recordTxTime(TxStatistics* pStatistics, unsigned long long encodeUsec, unsigned long long sendUsec)
+{
+    pStatistics->requests++;
+    pStatistics->encodeTotalUsec += encodeUsec;
+    if (pStatistics->encodeMaxUsec < encodeUsec)
+        pStatistics->encodeMaxUsec = encodeUsec;
+    pStatistics->sendTotalUsec += sendUsec;
+    if (pStatistics->sendMaxUsec < sendUsec)
+        pStatistics->sendMaxUsec = sendUsec;
+}
+
+/// <summary>
+/// 要求の符号化（ルート要素内）
+/// </summary>
+/// <param name="pOut"></param>
+/// <param name="pRequest"></param>
+/// <param name="pElement"></param>
+/// <param name="pathLength"></param>
+/// <param name="top">一括接続の先頭</param>
+/// <param name="count">一括接続の接続数</param>
+static void encodeRequest(GlowOutput* pOut, const EmberContent* pRequest, const Element* pElement, int pathLength, int top, int count)
+{
+    int index;
+
+    if (pRequest->type == GlowType_Command)
+    {
+        glow_writeQualifiedCommand(pOut, &pRequest->command, pRequest->pPath, pathLength, pElement->type);
+    }
+    else if ((pRequest->type == GlowType_Parameter) || (pRequest->type == GlowType_QualifiedParameter))
+    {
+        glow_writeQualifiedParameter(pOut, &pRequest->parameter, GlowFieldFlag_Value, pRequest->pPath, pathLength);
+    }
+    else if (pRequest->type == GlowType_Connection)
+    {
+        glow_writeConnectionsPrefix(pOut, pRequest->pPath, pathLength);
+        glow_writeConnection(pOut, &pRequest->connection);
+        glow_writeConnectionsSuffix(pOut);
+    }
+    else if (pRequest->type == (GlowType)SALVO_REQUEST_CONSUMER)
+    {
+        glow_writeConnectionsPrefix(pOut, pRequest->pPath, pathLength);
+        for (index = top; index < top + count; index++)
+            glow_writeConnection(pOut, &pRequest->salvo.pConnections[index]);
+        glow_writeConnectionsSuffix(pOut);
+    }
+}
+
+/// <summary>
+/// ペイロードのフレーム化と送信
+/// </summary>
+/// <param name="pSession"></param>
+/// <param name="pPayload">Glow ルート要素の符号</param>
+/// <param name="payloadLength"></param>
+/// <returns>送信フレーム数、失敗時 -1</returns>
+/// <remarks>
+/// 1 フレームに収まらない場合は先頭／継続／最終フラグ付きの複数フレームに分割する
+/// </remarks>
+static int sendPackages(Session* pSession, const byte* pPayload, int payloadLength)
+{
+    static const byte appBytes[] = { (byte)(GLOW_SCHEMA_VERSION & 0xFF), (byte)((GLOW_SCHEMA_VERSION >> 8) & 0xFF) };
+    byte frame[EMBER_MAXIMUM_PACKAGE_LENGTH];
+    BerFramingOutput framing;
+    int position = 0;
+    int frames = 0;
+
+    while (position < payloadLength)
+    {
+        // エスケープ後の長さで区切る
+        int chunkLength = 0;
+        int escapedLength = 0;
+        while ((position + chunkLength < payloadLength) && (escapedLength < S101_PAYLOAD_LIMIT - 1))
+        {
+            escapedLength += (pPayload[position + chunkLength] >= S101_ESCAPE_MIN) ? 2 : 1;
+            ++chunkLength;
+        }
+
+        int flags = 0;
+        if (position == 0)
+            flags |= EmberFramingFlag_FirstPackage;
+        if (position + chunkLength >= payloadLength)
+            flags |= EmberFramingFlag_LastPackage;
+
+        berFramingOutput_init(&framing, frame, sizeof(frame), 0, EMBER_DTD_GLOW, appBytes, (byte)sizeof(appBytes));
+        berFramingOutput_writeHeader(&framing, (EmberFramingFlags)flags);
+        framing.base.base.writeBytes(&framing.base.base, &pPayload[position], chunkLength);
+        int txLength = (int)berFramingOutput_finish(&framing);
+
+        int sendlen = sendPackage(pSession, pSession->remoteContent.hSocket, frame, txLength);
+        if (sendlen != txLength)
+        {
+            int eno = errno;
+            char message[128] = { 0 };
+            strerror_s(message, sizeof(message), eno);
+            __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "send error, (%d)%s\n", eno, message);
+            pSession->txStatistics.errors++;
+            return -1;
+        }
+        pSession->txStatistics.frames++;
+        pSession->txStatistics.bytes += sendlen;
+
+        position += chunkLength;
+        ++frames;
+    }
+    return frames;
+}
+/// <summary>
+/// 要求の符号化と送信
+/// </summary>
+/// <param name="pSession"></param>
+/// <param name="pRequest"></param>
+/// <param name="pElement"></param>
+/// <param name="pathLength"></param>
+/// <param name="top">一括接続の先頭</param>
+/// <param name="count">一括接続の接続数</param>
+/// <returns></returns>
+/// <remarks>
+/// 符号化はセッションの送信用バッファ上で行い、見積りで足りない場合は拡張して符号化し直す
+/// フレーム化（エスケープ・CRC）は送信時に行うため、符号化は長さ上限のないメモリ出力で行う
+/// </remarks>
+static bool sendRequest(Session* pSession, const EmberContent* pRequest, const Element* pElement, int pathLength, int top, int count)
+{
+    TxStatistics* pStatistics = &pSession->txStatistics;
+    GlowOutput output;
+    BerTag rootTag;
+    int payloadLength = 0;
+    int size = estimateRequestLength(pRequest, pathLength, top, count);
+
+    berTag_init(&rootTag, BerClass_Application, 0);
+
+    unsigned long long encodeStart = getMonotonicUsec();
+    for (;;)
+    {
+        if (!reserveTxArena(pSession, size))
+        {
+            __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "request too large, id = %d, size = %d\n", pRequest->requestId.id, size);
+            pStatistics->errors++;
+            return false;
+        }
+        glowOutput_init(&output, pSession->pTxArena, pSession->txArenaSize, 0);
+        berMemoryOutput_init(&output.base.base, pSession->pTxArena, pSession->txArenaSize);
+        ember_writeContainerBegin(&output.base.base.base, &rootTag, GlowType_RootElementCollection);
+        encodeRequest(&output, pRequest, pElement, pathLength, top, count);
+        ember_writeContainerEnd(&output.base.base.base);
+        payloadLength = (int)output.base.base.position;
+        // 末尾まで書き込まれた場合は切り詰められているものとして拡張する
+        if (payloadLength < pSession->txArenaSize)
+            break;
+        size = pSession->txArenaSize * 2;
+    }
+    unsigned long long sendStart = getMonotonicUsec();
+
+    int frames = sendPackages(pSession, pSession->pTxArena, payloadLength);
+    if (frames > 1)
+        pStatistics->splitPackages++;
+    unsigned long long sendEnd = getMonotonicUsec();
+
+    recordTxTime(pStatistics, sendStart - encodeStart, sendEnd - sendStart);
+    return (frames > 0);
+}
+
+/// <summary>
+/// S101 CRC 更新（CRC-CCITT）
+/// </summary>
+/// <param name="crc"></param>
+/// <param name="value"></param>
+/// <returns></returns>
+static unsigned short s101Crc(unsigned short crc, byte value)
+{
+    static unsigned short table[256];
+    static bool initialized = false;
+    if (!initialized)
+    {
+        for (int index = 0; index < 256; index++)
+        {
+            unsigned short entry = (unsigned short)index;
+            for (int bit = 0; bit < 8; bit++)
+                entry = (entry & 1) ? (unsigned short)((entry >> 1) ^ 0x8408) : (unsigned short)(entry >> 1);
+            table[index] = entry;
+        }
+        initialized = true;
+    }
+    return (unsigned short)((crc >> 8) ^ table[(crc ^ value) & 0xFF]);
+}
+/// <summary>
+/// S101 エスケープ付き書き込み
+/// </summary>
+/// <param name="pFrame"></param>
+/// <param name="position"></param>
+/// <param name="value"></param>
+/// <returns>書き込み後の位置</returns>
+static int s101Escape(byte* pFrame, int position, byte value)
+{
+    if (value >= S101_ESCAPE_MIN)
+    {
+        pFrame[position++] = 0xFD;
+        pFrame[position++] = (byte)(value ^ 0x20);
+    }
+    else
+    {
+        pFrame[position++] = value;
+    }
+    return position;
+}
+
+/// <summary>
+/// パラメータ値の符号化
+/// </summary>
+/// <param name="pValue"></param>
+/// <param name="pBuffer"></param>
+/// <param name="bufferSize"></param>
+/// <returns>符号長、対象外の値種別は 0</returns>
+/// <remarks>
+/// QualifiedParameter の contents.value [2] を単独で符号化する
+/// </remarks>
+static int encodeParameterValue(const GlowValue* pValue, byte* pBuffer, int bufferSize)
+{
+    BerMemoryOutput output;
+    BerTag tag;
+
+    berMemoryOutput_init(&output, pBuffer, bufferSize);
+    berTag_init(&tag, BerClass_ContextSpecific, 2);
+    switch (pValue->flag)
+    {
+    case GlowParameterType_Integer:
+        ember_writeLong(&output.base, &tag, pValue->choice.integer);
+        break;
+    case GlowParameterType_Real:
+        ember_writeReal(&output.base, &tag, pValue->choice.real);
+        break;
+    case GlowParameterType_Boolean:
+        ember_writeBoolean(&output.base, &tag, pValue->choice.boolean);
+        break;
+    default:
+        return 0;
+    }
+    return (int)output.position;
+}
+
+/// <summary>
+/// パラメータ設定テンプレート生成
+/// </summary>
+/// <param name="pSession"></param>
+/// <param name="pTemplate">格納先</param>
+/// <param name="pRequest"></param>
+/// <param name="pathLength"></param>
+/// <remarks>
+/// 値なしの符号（値直前まで＋コンテナ終端）と値ありの符号を比較し、値の位置を確認できない場合は使用不可とする
+/// </remarks>
+static void buildParameterTemplate(Session* pSession, ParameterTemplate* pTemplate, const EmberContent* pRequest, int pathLength)
+{
+    static const byte appBytes[] = { (byte)(GLOW_SCHEMA_VERSION & 0xFF), (byte)((GLOW_SCHEMA_VERSION >> 8) & 0xFF) };
+    GlowOutput output;
+    BerFramingOutput framing;
+    BerTag rootTag;
+    byte value[32];
+    int encoded[2];
+    int index;
+
+    memcpy(pTemplate->path, pRequest->pPath, sizeof(berint) * pathLength);
+    pTemplate->pathLength = pathLength;
+    pTemplate->valueType = pRequest->parameter.value.flag;
+    pTemplate->disabled = true;
+    pTemplate->headLength = 0;
+    pTemplate->tailLength = 0;
+    pSession->txStatistics.templateBuilds++;
+
+    int size = estimateRequestLength(pRequest, pathLength, 0, 0);
+    if (!reserveTxArena(pSession, size * 2))
+        return;
+
+    // [0] 値なし、[1] 値あり
+    berTag_init(&rootTag, BerClass_Application, 0);
+    for (index = 0; index < 2; index++)
+    {
+        byte* pBuffer = pSession->pTxArena + (size * index);
+        glowOutput_init(&output, pBuffer, size, 0);
+        berMemoryOutput_init(&output.base.base, pBuffer, size);
+        ember_writeContainerBegin(&output.base.base.base, &rootTag, GlowType_RootElementCollection);
+        glow_writeQualifiedParameter(&output, &pRequest->parameter, (index == 0) ? (GlowFieldFlags)0 : GlowFieldFlag_Value, pRequest->pPath, pathLength);
+        ember_writeContainerEnd(&output.base.base.base);
+        encoded[index] = (int)output.base.base.position;
+        if (encoded[index] >= size)
+            return;
+    }
+
+    const byte* pShell = pSession->pTxArena;
+    const byte* pFull = pSession->pTxArena + size;
+    int valueLength = encodeParameterValue(&pRequest->parameter.value, value, sizeof(value));
+    int tailLength = 0;
+    while ((tailLength < encoded[0]) && (pShell[encoded[0] - tailLength - 1] == 0))
+        ++tailLength;
+    int prefixLength = encoded[0] - tailLength;
+    if ((valueLength <= 0)
+     || (prefixLength <= 0)
+     || (encoded[1] != encoded[0] + valueLength)
+     || (memcmp(pShell, pFull, prefixLength) != 0)
+     || (memcmp(&pFull[prefixLength], value, valueLength) != 0)
+     || (memcmp(&pShell[prefixLength], &pFull[prefixLength + valueLength], tailLength) != 0))
+        return;
+    // エスケープで倍長となる場合も収まる長さのみ
+    if ((1 + (2 * (S101_HEADER_LENGTH + prefixLength))) > TX_TEMPLATE_HEAD_SIZE)
+        return;
+
+    berFramingOutput_init(&framing, pTemplate->head, TX_TEMPLATE_HEAD_SIZE, 0, EMBER_DTD_GLOW, appBytes, (byte)sizeof(appBytes));
+    berFramingOutput_writeHeader(&framing, (EmberFramingFlags)(EmberFramingFlag_FirstPackage | EmberFramingFlag_LastPackage));
+    framing.base.base.writeBytes(&framing.base.base, pShell, prefixLength);
+    pTemplate->headLength = (int)framing.base.position;
+    pTemplate->headCrc = framing.crc;
+    pTemplate->tailLength = tailLength;
+    pTemplate->disabled = false;
+}
+/// <summary>
+/// パラメータ設定テンプレート取得
+/// </summary>
+/// <param name="pSession"></param>
+/// <param name="pRequest"></param>
+/// <param name="pathLength"></param>
+/// <returns>対象外の場合 NULL</returns>
+static ParameterTemplate* findParameterTemplate(Session* pSession, const EmberContent* pRequest, int pathLength)
+{
+    ParameterTemplate* pTemplate = NULL;
+    ParameterTemplate* pOldest = NULL;
+    int index;
+
+    if ((pathLength <= 0) || (pathLength > TX_TEMPLATE_PATH_MAX) || (pRequest->pPath == NULL))
+        return NULL;
+    if (pSession->pTxTemplates == NULL)
+    {
+        pSession->pTxTemplates = newarr(ParameterTemplate, TX_TEMPLATE_MAX);
+        memset(pSession->pTxTemplates, 0, sizeof(ParameterTemplate) * TX_TEMPLATE_MAX);
+    }
+
+    for (index = 0; index < TX_TEMPLATE_MAX; index++)
+    {
+        ParameterTemplate* pEntry = &pSession->pTxTemplates[index];
+        if ((pEntry->pathLength == pathLength)
+         && (pEntry->valueType == pRequest->parameter.value.flag)
+         && (memcmp(pEntry->path, pRequest->pPath, sizeof(berint) * pathLength) == 0))
+        {
+            pTemplate = pEntry;
+            break;
+        }
+        if ((pOldest == NULL) || (pEntry->lastUse < pOldest->lastUse))
+            pOldest = pEntry;
+    }
+    if (pTemplate == NULL)
+    {
+        pTemplate = pOldest;
+        buildParameterTemplate(pSession, pTemplate, pRequest, pathLength);
+    }
+    pTemplate->lastUse = ++pSession->txTemplateUse;
+    return pTemplate->disabled ? NULL : pTemplate;
+}
+/// <summary>
+/// テンプレートによるパラメータ設定送信
+/// </summary>
+/// <param name="pSession"></param>
+/// <param name="pRequest"></param>
+/// <param name="pathLength"></param>
+/// <returns>テンプレート対象外の場合 false（通常の符号化で送信する）</returns>
+/// <remarks>
+/// 整数・実数・真偽値のみ対象とする
+/// </remarks>
+static bool sendParameterTemplate(Session* pSession, const EmberContent* pRequest, int pathLength)
+{
+    TxStatistics* pStatistics = &pSession->txStatistics;
+    byte frame[EMBER_MAXIMUM_PACKAGE_LENGTH];
+    byte value[32];
+    int index;
+
+    unsigned long long encodeStart = getMonotonicUsec();
+    int valueLength = encodeParameterValue(&pRequest->parameter.value, value, sizeof(value));
+    if (valueLength <= 0)
+        return false;
+    const ParameterTemplate* pTemplate = findParameterTemplate(pSession, pRequest, pathLength);
+    if (pTemplate == NULL)
+        return false;
+
+    memcpy(frame, pTemplate->head, pTemplate->headLength);
+    int position = pTemplate->headLength;
+    unsigned short crc = pTemplate->headCrc;
+    for (index = 0; index < valueLength; index++)
+    {
+        crc = s101Crc(crc, value[index]);
+        position = s101Escape(frame, position, value[index]);
     }
-    else if(strcmp(pIdentifier, "..") == 0)
+    for (index = 0; index < pTemplate->tailLength; index++)
     {
-        return pSession->pCursor->pParent;
+        crc = s101Crc(crc, 0);
+        frame[position++] = 0;
     }
-
-    return element_findChildByIdentifier(pSession->pCursor, pIdentifier);
+    crc = (unsigned short)~crc;
+    position = s101Escape(frame, position, (byte)(crc & 0xFF));
+    position = s101Escape(frame, position, (byte)((crc >> 8) & 0xFF));
+    frame[position++] = 0xFF;
+    unsigned long long sendStart = getMonotonicUsec();
+
+    int sendlen = sendPackage(pSession, pSession->remoteContent.hSocket, frame, position);
+    if (sendlen != position)
+    {
+        int eno = errno;
+        char message[128] = { 0 };
+        strerror_s(message, sizeof(message), eno);
+        __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "send error, (%d)%s\n", eno, message);
+        pStatistics->errors++;
+    }
+    else
+    {
+        pStatistics->frames++;
+        pStatistics->bytes += sendlen;
+    }
+    pStatistics->templateHits++;
+    recordTxTime(pStatistics, sendStart - encodeStart, getMonotonicUsec() - sendStart);
+    return true;
 }
-#endif
 
 static bool handleInput(Session* pSession, EmberContent* pRequest)
 {
@@ -2058,6 +4653,53 @@ static bool handleInput(Session* pSession, EmberContent* pRequest)
     // GlowType 定義にない QUIT_REQUEST_CONSUMER であった場合、この関数の戻りは true となる
     if (pRequest->type == QUIT_REQUEST_CONSUMER)
         return true;
+    // ツリースナップショット保存はツリーを更新するこのスレッド上で実施する
+    if (pRequest->type == SNAPSHOT_REQUEST_CONSUMER)
+    {
+        element_writeSnapshot(&pSession->root, pRequest->stringValue.pString);
+        return false;
+    }
+    // 保持ツリーの破棄（構成変更による全再取得）
+    if (pRequest->type == RESET_TREE_REQUEST_CONSUMER)
+    {
+        __Trace(__FILE__, __LINE__, __FUNCTION__, "reset tree, id = %d\n", pRequest->requestId.id);
+        lockEmberTree(&pSession->remoteContent);
+        element_free(&pSession->root);
+        element_init(&pSession->root, NULL, GlowElementType_Node, 0);
+        unlockEmberTree(&pSession->remoteContent);
+        pSession->validityPathLength = 0;
+        // 数値パスは再取得後に登録し直す
+        clearDispatch(&pSession->dispatchRoot);
+        return false;
+    }
+    // 再確認で通知されなかったエレメントの破棄
+    if (pRequest->type == PRUNE_TREE_REQUEST_CONSUMER)
+    {
+        lockEmberTree(&pSession->remoteContent);
+        int pruned = element_pruneStale(&pSession->root);
+        unlockEmberTree(&pSession->remoteContent);
+        __Trace(__FILE__, __LINE__, __FUNCTION__, "prune tree, id = %d, removed = %d\n", pRequest->requestId.id, pruned);
+        return false;
+    }
+    // パラメータ通知振り分け登録
+    if (pRequest->type == DISPATCH_REQUEST_CONSUMER)
+    {
+        if ((pRequest->pathLength <= 0) || (pRequest->pPath == NULL))
+        {
+            clearDispatch(&pSession->dispatchRoot);
+            return false;
+        }
+        insertDispatch(&pSession->dispatchRoot, pRequest->pPath, pRequest->pathLength, pRequest->dispatchKey);
+        // 登録以前に受信済の値を通知する（監視は登録時点の表示を全更新で作るため通知しない）
+        if (pRequest->dispatchKey < 0)
+            return false;
+        Element* pRegistered = element_findDescendant(&pSession->root, pRequest->pPath, pRequest->pathLength, NULL);
+        if ((pRegistered != NULL)
+         && (pRegistered->type == GlowElementType_Parameter)
+         && (pRegistered->glow.pParameter->value.flag != GlowParameterType_None))
+            __EmberCommandConverter(pRequest->dispatchKey, pRegistered->glow.pParameter);
+        return false;
+    }
 
     //
     // 対象エレメント確認
@@ -2092,10 +4734,6 @@ static bool handleInput(Session* pSession, EmberContent* pRequest)
         return false;
     pstr pathName = convertPath2String(&pSession->root, pRequest->pPath, pRequest->pathLength);
 
-    GlowOutput output;
-    const int bufferSize = 512;
-    byte *pBuffer = NULL;
-
 #if defined WIN32
     __try
 #endif
@@ -2114,19 +4752,14 @@ static bool handleInput(Session* pSession, EmberContent* pRequest)
                     || ((pRequest->command.number == GlowCommandType_Invoke)
                      && (pElement->type == GlowElementType_Function))))
             {
-                pBuffer = newarr(byte, bufferSize);
-                glowOutput_init(&output, pBuffer, bufferSize, 0);
-                glowOutput_beginPackage(&output, true);
-                glow_writeQualifiedCommand(
-                    &output,
-                    &pRequest->command,
-                    pRequest->pPath,
-                    pathLength,
-                    pElement->type);
-                pSession->pRequest = pRequest;
+                setInFlightRequest(pSession, pRequest);
 
                 if (pRequest->command.number == GlowCommandType_GetDirectory)
+                {
+                    // 応答で通知されない配下は再確認後に破棄する
+                    pElement->isDirectoryRequested = true;
                     __Trace(__FILE__, __LINE__, __FUNCTION__, "send GetDirectory request\n");
+                }
                 else if (pRequest->command.number == GlowCommandType_Subscribe)
                     __Trace(__FILE__, __LINE__, __FUNCTION__, "send Subscribe request\n");
                 else if (pRequest->command.number == GlowCommandType_Unsubscribe)
@@ -2139,56 +4772,22 @@ static bool handleInput(Session* pSession, EmberContent* pRequest)
                         __Trace(__FILE__, __LINE__, __FUNCTION__, "send Invoke request, invocationId = %d\n", pRequest->command.options.invocation.invocationId);
                 }
 
-                int txLength = glowOutput_finishPackage(&output);
-                int sendlen = send(pSession->remoteContent.hSocket, (char *)pBuffer, txLength, 0);
-                if (sendlen != txLength)
-                {
-                    int eno = errno;
-                    bzero_item(*pBuffer);
-                    strerror_s(pBuffer, bufferSize, eno);
-                    __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "send error, (%d)%s\n", eno, pBuffer);
-                }
-                freeMemory(pBuffer);
-                pBuffer = NULL;
+                sendRequest(pSession, pRequest, pElement, pathLength, 0, 0);
             }
             else if (((pRequest->type == GlowType_Parameter)
                    || (pRequest->type == GlowType_QualifiedParameter))
                   && (pElement->type == GlowElementType_Parameter))
             {
-                pBuffer = newarr(byte, bufferSize);
-                glowOutput_init(&output, pBuffer, bufferSize, 0);
-                glowOutput_beginPackage(&output, true);
-                glow_writeQualifiedParameter(
-                    &output,
-                    &pRequest->parameter,
-                    GlowFieldFlag_Value,
-                    pRequest->pPath,
-                    pathLength);
                 if (pathName)
                     __Trace(__FILE__, __LINE__, __FUNCTION__, "send Set Parameter request %s\n", pathName);
                 else
                     __Trace(__FILE__, __LINE__, __FUNCTION__, "send Set Parameter request\n");
-                int txLength = glowOutput_finishPackage(&output);
-                int sendlen = send(pSession->remoteContent.hSocket, (char*)pBuffer, txLength, 0);
-                if (sendlen != txLength)
-                {
-                    int eno = errno;
-                    bzero_item(*pBuffer);
-                    strerror_s(pBuffer, bufferSize, eno);
-                    __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "send error, (%d)%s\n", eno, pBuffer);
-                }
-                freeMemory(pBuffer);
-                pBuffer = NULL;
+                if (!sendParameterTemplate(pSession, pRequest, pathLength))
+                    sendRequest(pSession, pRequest, pElement, pathLength, 0, 0);
             }
             else if ((pRequest->type == GlowType_Connection)
                   && (pElement->type == GlowElementType_Matrix))
             {
-                pBuffer = newarr(byte, bufferSize);
-                glowOutput_init(&output, pBuffer, bufferSize, 0);
-                glowOutput_beginPackage(&output, true);
-                glow_writeConnectionsPrefix(&output, pRequest->pPath, pathLength);
-                glow_writeConnection(&output, &pRequest->connection);
-                glow_writeConnectionsSuffix(&output);
                 {
                     int bufflen = 256;
                     pstr pbuff = newarr(char, bufflen);
@@ -2225,17 +4824,38 @@ static bool handleInput(Session* pSession, EmberContent* pRequest)
                     freeMemory(pSrcs);
                     freeMemory(pbuff);
                 }
-                int txLength = glowOutput_finishPackage(&output);
-                int sendlen = send(pSession->remoteContent.hSocket, (char *)pBuffer, txLength, 0);
-                if (sendlen != txLength)
+                sendRequest(pSession, pRequest, pElement, pathLength, 0, 0);
+            }
+            else if ((pRequest->type == (GlowType)SALVO_REQUEST_CONSUMER)
+                  && (pElement->type == GlowElementType_Matrix))
+            {
+                // S101 フレーム毎に収まる分の接続を 1つの Connections にまとめて送信
+                const int payloadLimit = EMBER_MAXIMUM_PACKAGE_LENGTH - salvoPrefixLength(pathLength);
+                const GlowConnection* pConnections = pRequest->salvo.pConnections;
+                int connectionsLength = pRequest->salvo.connectionsLength;
+                int frameCount = 0;
+
+                for (int top = 0; (top < connectionsLength) && (pConnections != NULL); )
                 {
-                    int eno = errno;
-                    bzero_item(*pBuffer);
-                    strerror_s(pBuffer, bufferSize, eno);
-                    __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "send error, (%d)%s\n", eno, pBuffer);
+                    int payloadLength = 0;
+                    int count = 0;
+                    while ((top + count) < connectionsLength)
+                    {
+                        int length = salvoConnectionLength(&pConnections[top + count]);
+                        if ((count > 0) && ((payloadLength + length) > payloadLimit))
+                            break;
+                        payloadLength += length;
+                        ++count;
+                    }
+
+                    if (!sendRequest(pSession, pRequest, pElement, pathLength, top, count))
+                        break;
+
+                    top += count;
+                    ++frameCount;
                 }
-                freeMemory(pBuffer);
-                pBuffer = NULL;
+                __Trace(__FILE__, __LINE__, __FUNCTION__, "send Salvo request, id = %d, path = %s, connections = %d, frames = %d\n",
+                                                            pRequest->requestId.id, pathName ? pathName : "", connectionsLength, frameCount);
             }
         }
 #if defined WIN32
@@ -2248,20 +4868,82 @@ static bool handleInput(Session* pSession, EmberContent* pRequest)
     {
 		if (pathName != NULL)
 			freeMemory(pathName);
-		if (pBuffer != NULL)
-			freeMemory(pBuffer);
 	}
 
     return false;
 }
 
-bool Call_handleInput(EmberContent* pRequest)
+bool Call_handleInput(RemoteContent* pRemoteContent, EmberContent* pRequest)
 {
-	bool result = handleInput(pActiveSession, pRequest);
+	bool result = handleInput((pRemoteContent != NULL) ? pRemoteContent->pActiveSession : NULL, pRequest);
 
 	return result;
 }
 
+/// <summary>
+/// 受信リーダ初期化
+/// </summary>
+/// <param name="pReader"></param>
+/// <param name="pSession"></param>
+/// <param name="pRxBuffer"></param>
+/// <param name="rxBufferSize"></param>
+static void initSessionReader(GlowReader* pReader, Session* pSession, byte* pRxBuffer, int rxBufferSize)
+{
+    glowReader_init(pReader, onNode, onParameter, NULL, NULL, (voidptr)pSession, pRxBuffer, rxBufferSize);
+    pReader->base.onMatrix = onMatrix;
+    pReader->base.onTarget = onTarget;
+    pReader->base.onSource = onSource;
+    pReader->base.onConnection = onConnection;
+    pReader->base.onFunction = onFunction;
+    pReader->base.onInvocationResult = onInvocationResult;
+    pReader->onOtherPackageReceived = onOtherPackageReceived;
+    pReader->base.onUnsupportedTltlv = onUnsupportedTltlv;
+}
+
+/// <summary>
+/// リンク監視（S101 キープアライブ）
+/// </summary>
+/// <param name="pSession"></param>
+/// <param name="now">現在時刻（usec）</param>
+/// <returns>応答待ち上限を超過した場合 false</returns>
+/// <remarks>
+/// 受信ループの周期によらず、要求時刻・応答期限の時刻で判定する
+/// TCP の切断通知がない片側切断も応答期限で検出する
+/// </remarks>
+static bool superviseLink(Session* pSession, unsigned long long now)
+{
+    const RemoteContent* pRemoteContent = &pSession->remoteContent;
+    LinkStatistics* pStatistics = (pSession->pOwner != NULL) ? &pSession->pOwner->linkStatistics : NULL;
+    dword interval = (pRemoteContent->keepAliveInterval > 0) ? pRemoteContent->keepAliveInterval : KEEPALIVE_INTERVAL_DEFAULT_MSEC;
+    dword timeout = (pRemoteContent->keepAliveTimeout > 0) ? pRemoteContent->keepAliveTimeout : KEEPALIVE_TIMEOUT_DEFAULT_MSEC;
+
+    if (pSession->keepAliveSentUsec != 0ull)
+    {
+        if ((now - pSession->keepAliveSentUsec) < (timeout * 1000ull))
+            return true;
+
+        if (pStatistics != NULL)
+            pStatistics->timeouts++;
+        __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "keep-alive timeout (%u msec), reconnect.\n", (unsigned)timeout);
+        pSession->linkTimedOut = true;
+        return false;
+    }
+
+    if (now < pSession->keepAliveDueUsec)
+        return true;
+
+    byte frame[16];
+    int txLength = (int)emberFraming_writeKeepAliveRequest(frame, sizeof(frame), 0);
+    if (sendPackage(pSession, pRemoteContent->hSocket, frame, txLength) == txLength)
+    {
+        pSession->keepAliveSentUsec = now;
+        if (pStatistics != NULL)
+            pStatistics->requests++;
+    }
+    pSession->keepAliveDueUsec = now + (interval * 1000ull);
+    return true;
+}
+
 static bool run(Session *pSession)
 {
     static char s_input[256];
@@ -2278,19 +4960,21 @@ static bool run(Session *pSession)
     byte *pRxBuffer = newarr(byte, rxBufferSize);
     SOCKET sock = pSession->remoteContent.hSocket;
 
-    glowReader_init(pReader, onNode, onParameter, NULL, NULL, (voidptr)pSession, pRxBuffer, rxBufferSize);
-    pReader->base.onMatrix = onMatrix;
-    pReader->base.onTarget = onTarget;
-    pReader->base.onSource = onSource;
-    pReader->base.onConnection = onConnection;
-    pReader->base.onFunction = onFunction;
-    pReader->base.onInvocationResult = onInvocationResult;
-    pReader->onOtherPackageReceived = onOtherPackageReceived;
-    pReader->base.onUnsupportedTltlv = onUnsupportedTltlv;
+    initSessionReader(pReader, pSession, pRxBuffer, rxBufferSize);
 
-    setActiveSession(pSession);
+    pSession->keepAliveDueUsec = getMonotonicUsec();
+    pSession->keepAliveSentUsec = 0ull;
+    pSession->linkTimedOut = false;
+
+    setActiveSession(pSession, true);
     while (!(isQuitReq = getQuitConsumerRequest(pSession)) && !lostConnection)
     {
+        if (!superviseLink(pSession, getMonotonicUsec()))
+        {
+            lostConnection = true;
+            break;
+        }
+
         //
         // 前の要求手続きがない場合のみ
         // 次の要求手続きを展開する
@@ -2328,6 +5012,8 @@ static bool run(Session *pSession)
 
                     if (read > 0)
                     {
+                        __CaptureTraffic(pSession->remoteContent.id, false, buffer, read);
+
                         char* strBuf = hex2string(buffer, read);
                         if (strBuf)
                         {
@@ -2341,7 +5027,7 @@ static bool run(Session *pSession)
                         // 受信実績あれば送信控えをクリアする
                         // ここでのインスタンス削除はしない（上位キューが手続き）
                         if (pSession->pRequest)
-                            pSession->pRequest = NULL;
+                            setInFlightRequest(pSession, NULL);
                     }
                     else
                         //isQuitReq = true;
@@ -2355,9 +5041,26 @@ static bool run(Session *pSession)
             }
         }
 
+        reportAllocations(false);
         Sleep(pSession->remoteContent.threadDelay);
     }
-    setActiveSession(NULL);
+    setActiveSession(pSession, false);
+
+    {
+        const TxStatistics* pStatistics = &pSession->txStatistics;
+        __Trace(__FILE__, __LINE__, __FUNCTION__, "tx requests = %zu, frames = %zu, split = %zu, bytes = %zu, errors = %zu, encode avg/max = %llu/%llu usec, send avg/max = %llu/%llu usec, arena = %d (%d growths), templates = %zu hits (%zu builds)\n",
+                pStatistics->requests, pStatistics->frames, pStatistics->splitPackages, pStatistics->bytes, pStatistics->errors,
+                (pStatistics->requests > 0) ? (pStatistics->encodeTotalUsec / pStatistics->requests) : 0ull, pStatistics->encodeMaxUsec,
+                (pStatistics->requests > 0) ? (pStatistics->sendTotalUsec / pStatistics->requests) : 0ull, pStatistics->sendMaxUsec,
+                pStatistics->arenaSize, pStatistics->arenaGrowths, pStatistics->templateHits, pStatistics->templateBuilds);
+    }
+    if (pSession->pOwner != NULL)
+    {
+        const LinkStatistics* pStatistics = &pSession->pOwner->linkStatistics;
+        __Trace(__FILE__, __LINE__, __FUNCTION__, "keep-alive requests = %zu, responses = %zu, timeouts = %zu, rtt last/avg/max = %llu/%llu/%llu usec\n",
+                pStatistics->requests, pStatistics->responses, pStatistics->timeouts, pStatistics->rttUsec,
+                (pStatistics->responses > 0) ? (pStatistics->rttTotalUsec / pStatistics->responses) : 0ull, pStatistics->rttMaxUsec);
+    }
 
     glowReader_free(pReader);
     freeMemory(pRxBuffer);
@@ -2367,6 +5070,313 @@ static bool run(Session *pSession)
 }
 
 
+// ====================================================================
+//
+// capture replay
+//
+// ====================================================================
+/// <summary>
+/// リプレイ用セッション
+/// </summary>
+/// <remarks>
+/// glow ハンドラへは先頭の session を渡すため先頭メンバとする
+/// </remarks>
+typedef struct tagReplaySession
+{
+    Session session;
+    GlowReader reader;
+    byte* pRxBuffer;
+} ReplaySession;
+
+/// <summary>
+/// リプレイ用セッション生成
+/// </summary>
+/// <param name="pRemoteContent"></param>
+/// <returns></returns>
+/// <remarks>
+/// 接続中のセッションがある場合は生成しない
+/// </remarks>
+Session* createReplaySession(RemoteContent* pRemoteContent)
+{
+    const int rxBufferSize = 1290; // max size of unescaped package
+    ReplaySession* pReplay;
+
+    if (!pRemoteContent)
+        return NULL;
+    if (pRemoteContent->pActiveSession != NULL)
+    {
+        __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "active session exists.\n");
+        return NULL;
+    }
+
+    initEmberContents();
+
+    pReplay = newobj(ReplaySession);
+    bzero_item(*pReplay);
+    memcpy(&pReplay->session.remoteContent, pRemoteContent, sizeof(RemoteContent));
+    pReplay->session.pOwner = pRemoteContent;
+    pReplay->session.replay = true;
+    lockEmberTree(pRemoteContent);
+    element_init(&pReplay->session.root, NULL, GlowElementType_Node, 0);
+    unlockEmberTree(pRemoteContent);
+
+    pReplay->pRxBuffer = newarr(byte, rxBufferSize);
+    initSessionReader(&pReplay->reader, &pReplay->session, pReplay->pRxBuffer, rxBufferSize);
+
+    lockEmberTree(pRemoteContent);
+    pRemoteContent->pRetainedRoot = NULL;
+    pRemoteContent->pTopNode = &pReplay->session.root;
+    unlockEmberTree(pRemoteContent);
+    pRemoteContent->retainedTree = false;
+    pRemoteContent->connectionCount = 1;
+    setActiveSession(&pReplay->session, true);
+
+    return &pReplay->session;
+}
+/// <summary>
+/// リプレイ受信データ投入
+/// </summary>
+/// <param name="pSession"></param>
+/// <param name="pData"></param>
+/// <param name="length"></param>
+/// <remarks>
+/// 受信時（run）と同じ glow ハンドラで処理する
+/// </remarks>
+void replaySessionBytes(Session* pSession, const byte* pData, int length)
+{
+    ReplaySession* pReplay = (ReplaySession*)pSession;
+    if (!pReplay || !pReplay->session.replay || !pData || (length <= 0))
+        return;
+
+    glowReader_readBytes(&pReplay->reader, pData, length);
+
+    if (pReplay->session.pRequest)
+        setInFlightRequest(&pReplay->session, NULL);
+}
+/// <summary>
+/// リプレイ用セッション解放
+/// </summary>
+/// <param name="pSession"></param>
+void releaseReplaySession(Session* pSession)
+{
+    ReplaySession* pReplay = (ReplaySession*)pSession;
+    if (!pReplay || !pReplay->session.replay)
+        return;
+
+    if ((pReplay->session.pOwner != NULL) && (pReplay->session.pOwner->pActiveSession == &pReplay->session))
+        setActiveSession(&pReplay->session, false);
+
+    glowReader_free(&pReplay->reader);
+    freeMemory(pReplay->pRxBuffer);
+    freeTxArena(&pReplay->session);
+    clearDispatch(&pReplay->session.dispatchRoot);
+    lockEmberTree(&pReplay->session.remoteContent);
+    element_free(&pReplay->session.root);
+    unlockEmberTree(&pReplay->session.remoteContent);
+    freeMemory(pReplay);
+}
+
+
+/// <summary>
+/// スナップショットから読み込んだマトリックスを上位ラッパへ通知
+/// </summary>
+/// <remarks>
+/// プロバイダからの受信を待たずにラベルを使用可能にする
+/// 通知データはエレメントとラベル領域を共有する（受信時と同様）
+/// </remarks>
+static int notifyCachedMatrices(Session* pSession, const Element* pThis, berint* pPath, int pathLength)
+{
+    const Element* pChild;
+    EmberContent* pResult;
+    int count = 0;
+    int index;
+
+    if ((pThis->type == GlowElementType_Matrix) && pThis->isCached)
+    {
+        pResult = createEmberMatrixContent(NULL, pPath, pathLength, &pThis->glow.pMatrix->matrix);
+        if (pResult)
+        {
+            notifyReceivedConsumerResult(pSession, pResult);
+            count++;
+        }
+    }
+
+    if (pathLength >= GLOW_MAX_TREE_DEPTH)
+        return count;
+
+    for (index = 0; index < pThis->childrenLength; index++)
+    {
+        pChild = pThis->ppChildren[index];
+        pPath[pathLength] = pChild->number;
+        count += notifyCachedMatrices(pSession, pChild, pPath, pathLength + 1);
+    }
+
+    return count;
+}
+/// <summary>
+/// スナップショットからツリーを展開
+/// </summary>
+/// <returns>展開できた場合は true（ツリーは初期化済）</returns>
+/// <remarks>
+/// 接続前に展開し、プロバイダへ接続できない間も前回のラベルを使用可能にする
+/// 展開したエレメントは接続後の受信内容で順次確認・更新する
+/// </remarks>
+static bool loadCachedTree(Session* pSession, RemoteContent* pRemoteContent)
+{
+    berint path[GLOW_MAX_TREE_DEPTH];
+    bool hasCached;
+
+    if (pSession->remoteContent.pSnapshotPath == NULL)
+        return false;
+
+    lockEmberTree(pRemoteContent);
+    element_init(&pSession->root, NULL, GlowElementType_Node, 0);
+    pSession->validityPathLength = 0;
+    hasCached = element_readSnapshot(&pSession->root, pSession->remoteContent.pSnapshotPath) > 0;
+    if (hasCached)
+    {
+        pRemoteContent->pRetainedRoot = &pSession->root;
+        pRemoteContent->pTopNode = &pSession->root;
+    }
+    else
+    {
+        element_free(&pSession->root);
+    }
+    unlockEmberTree(pRemoteContent);
+
+    // 通知は上位ラッパの排他を取得するため、ツリー排他の解放後に行う
+    if (hasCached)
+        notifyCachedMatrices(pSession, &pSession->root, path, 0);
+    return hasCached;
+}
+
+
+// ====================================================================
+//
+// connection
+//
+// ====================================================================
+/// <summary>
+/// ソケットのブロッキング設定
+/// </summary>
+/// <param name="sock"></param>
+/// <param name="nonBlocking"></param>
+/// <returns></returns>
+static bool setSocketNonBlocking(SOCKET sock, bool nonBlocking)
+{
+#if defined WIN32
+    u_long mode = nonBlocking ? 1 : 0;
+    return (ioctlsocket(sock, FIONBIO, &mode) == 0);
+#else
+    int flags = fcntl(sock, F_GETFL, 0);
+    if (flags < 0)
+        return false;
+    flags = nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return (fcntl(sock, F_SETFL, flags) == 0);
+#endif
+}
+
+/// <summary>
+/// プロバイダへ接続
+/// </summary>
+/// <param name="pAddr">接続先</param>
+/// <param name="timeoutMsec">接続完了の待ち上限</param>
+/// <returns>接続済ソケット（失敗時は 0）</returns>
+/// <remarks>
+/// 試行ごとに新しいソケットを生成し、ノンブロッキングで接続して待ち上限で打ち切る
+/// 接続後は受信処理（run）のためにブロッキングへ戻す
+/// </remarks>
+static SOCKET connectProvider(const struct sockaddr_in* pAddr, dword timeoutMsec)
+{
+    SOCKET sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if ((sock == 0) || (sock == (SOCKET)-1))
+    {
+        __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "socket creation failed.\n");
+        return 0;
+    }
+
+    bool connected = false;
+    if (setSocketNonBlocking(sock, true))
+    {
+        if (connect(sock, (const struct sockaddr*)pAddr, sizeof(struct sockaddr_in)) != SOCKET_ERROR)
+        {
+            connected = true;
+        }
+#if defined WIN32
+        else if (WSAGetLastError() == WSAEWOULDBLOCK)
+#else
+        else if (errno == EINPROGRESS)
+#endif
+        {
+            struct timeval timeout = { (long)(timeoutMsec / 1000), (long)((timeoutMsec % 1000) * 1000) };
+            fd_set wfdset = { 0 };
+            fd_set efdset = { 0 };
+            FD_ZERO(&wfdset);
+            FD_ZERO(&efdset);
+            FD_SET(sock, &wfdset);
+            FD_SET(sock, &efdset);
+            if ((select((int)(sock + 1), NULL, &wfdset, &efdset, &timeout) > 0)
+             && FD_ISSET(sock, &wfdset) && !FD_ISSET(sock, &efdset))
+            {
+                int error = 0;
+                socklen_t length = sizeof(error);
+                connected = (getsockopt(sock, SOL_SOCKET, SO_ERROR, (char*)&error, &length) == 0) && (error == 0);
+            }
+        }
+    }
+
+    if (!connected || !setSocketNonBlocking(sock, false))
+    {
+        closesocket(sock);
+        return 0;
+    }
+    return sock;
+}
+
+/// <summary>再接続待ち時間の算出</summary>
+/// <param name="pBackoff">現在の待ち（次回分へ更新される）</param>
+/// <param name="maxDelay">待ちの上限（msec）</param>
+/// <param name="pSeed">ばらつき用の乱数状態</param>
+/// <returns>今回の待ち（msec）</returns>
+/// <remarks>
+/// 複数の接続元が同時に再接続しないよう、待ちは半分から全量の間でばらつかせる
+/// </remarks>
+dword nextReconnectDelay(dword* pBackoff, dword maxDelay, unsigned int* pSeed)
+{
+    dword backoff = *pBackoff;
+    if (backoff < RECONNECT_BACKOFF_INITIAL_MSEC)
+        backoff = RECONNECT_BACKOFF_INITIAL_MSEC;
+    if ((maxDelay > 0) && (backoff > maxDelay))
+        backoff = maxDelay;
+
+    *pSeed = (*pSeed * 1103515245u) + 12345u;
+    dword delay = (backoff / 2) + (dword)((*pSeed >> 16) % ((backoff / 2) + 1));
+
+    *pBackoff = ((maxDelay > 0) && (backoff > maxDelay / 2)) ? maxDelay : (backoff * 2);
+    return delay;
+}
+
+/// <summary>
+/// 再接続待ち
+/// </summary>
+/// <param name="pSession"></param>
+/// <param name="delay">待ち（msec）</param>
+/// <returns>待ちの間に上位ラッパの離脱要求があった場合 false</returns>
+static bool waitReconnect(const Session* pSession, dword delay)
+{
+    dword slice = (pSession->remoteContent.threadDelay > 0) ? pSession->remoteContent.threadDelay : 20;
+    while (delay > 0)
+    {
+        if (getQuitConsumerRequest(pSession))
+            return false;
+        dword wait = (delay < slice) ? delay : slice;
+        Sleep(wait);
+        delay -= wait;
+    }
+    return true;
+}
+
+
 // ====================================================================
 //
 // consumer sample entry point
@@ -2376,64 +5386,180 @@ static bool run(Session *pSession)
 /// <param name="pRemoteContent"></param>
 void runConsumer(RemoteContent* pRemoteContent)
 {
-    int result;
     Session session;
     bzero_item(session);
     if (!pRemoteContent)
         return;
     memcpy(&session.remoteContent, pRemoteContent, sizeof(RemoteContent));
+    session.pOwner = pRemoteContent;
 
     initEmberContents();
     initSockets();
+    atomicIncrement(&runningConsumers);
+
+    // 呼び出し元で生成したソケットは使用せず、接続試行ごとに生成し直す
+    if (pRemoteContent->hSocket != 0)
+    {
+        closesocket(pRemoteContent->hSocket);
+        pRemoteContent->hSocket = 0;
+    }
+    session.remoteContent.hSocket = 0;
 
-    if (session.remoteContent.hSocket != 0)
+    if (session.remoteContent.remoteAddr.sin_port != 0)
     {
-        char addr[32] = { 0 };
-        inet_ntop(AF_INET, &session.remoteContent.remoteAddr.sin_addr, addr, sizeof(addr));
-        int port = ntohs(session.remoteContent.remoteAddr.sin_port);
+        ConnectStatistics* pConnectStatistics = &pRemoteContent->connectStatistics;
+        bool hasSecondary = (session.remoteContent.secondaryAddr.sin_port != 0);
+        dword connectTimeout = (session.remoteContent.connectTimeout > 0) ? session.remoteContent.connectTimeout : CONNECT_TIMEOUT_DEFAULT_MSEC;
 
         // 切断により run メソッドが終了しても上位ラッパの離脱要求があるまで再接続を試行する
         size_t connCount = 0ull;
         bool isQuitReq = false;
+        // 前回保存したツリーを接続前に展開（初回の接続で受信内容により確認する）
+        bool hasCached = loadCachedTree(&session, pRemoteContent);
+        // 短時間の切断ではツリーを保持し、再接続後に再確認する
+        bool hasTree = hasCached;
+        time_t disconnectedTime = 0;
+        // 失敗が続く間のみ待ちを倍増させる（切断直後は待たずに再接続する）
+        dword backoff = RECONNECT_BACKOFF_INITIAL_MSEC;
+        unsigned int jitterSeed = (unsigned int)time(NULL) ^ ((unsigned int)session.remoteContent.id << 16);
+        // 副アドレスがある場合は失敗ごとに切り替え、両方失敗した時点で待つ
+        bool useSecondary = false;
+        int failedInRound = 0;
+        unsigned long long disconnectedUsec = 0ull;
         while (!(isQuitReq = getQuitConsumerRequest(&session)))
         {
+            if (hasTree && !hasCached && (difftime(time(NULL), disconnectedTime) > TREE_RETAIN_SECONDS))
+            {
+                __Trace(__FILE__, __LINE__, __FUNCTION__, "discard retained tree.\n");
+                lockEmberTree(pRemoteContent);
+                pRemoteContent->pRetainedRoot = NULL;
+                element_free(&session.root);
+                unlockEmberTree(pRemoteContent);
+                // 接続中に保存したスナップショットで置き換える
+                hasCached = loadCachedTree(&session, pRemoteContent);
+                hasTree = hasCached;
+            }
+
+            const struct sockaddr_in* pAddr = useSecondary ? &session.remoteContent.secondaryAddr : &session.remoteContent.remoteAddr;
+            char addr[32] = { 0 };
+            inet_ntop(AF_INET, &pAddr->sin_addr, addr, sizeof(addr));
+            int port = ntohs(pAddr->sin_port);
+
             __Guidance("\n");
-            __Trace(__FILE__, __LINE__, __FUNCTION__, "connecting to %s:%d (%zu)...\n", addr, port, connCount);
-            result = connect(session.remoteContent.hSocket, (const struct sockaddr*)&session.remoteContent.remoteAddr, sizeof(struct sockaddr_in));
+            __Trace(__FILE__, __LINE__, __FUNCTION__, "connecting to %s:%d%s (%zu)...\n", addr, port, useSecondary ? " (secondary)" : "", connCount);
+            pConnectStatistics->attempts++;
+            SOCKET sock = connectProvider(pAddr, connectTimeout);
 
-            if (result != SOCKET_ERROR)
+            if (sock != 0)
             {
+                session.remoteContent.hSocket = sock;
+                failedInRound = 0;
+                if (useSecondary)
+                    pConnectStatistics->secondaryConnections++;
+                if (disconnectedUsec != 0ull)
+                {
+                    unsigned long long reconnectMsec = (getMonotonicUsec() - disconnectedUsec) / 1000ull;
+                    pConnectStatistics->reconnects++;
+                    pConnectStatistics->lastReconnectMsec = reconnectMsec;
+                    pConnectStatistics->reconnectTotalMsec += reconnectMsec;
+                    if (pConnectStatistics->reconnectMaxMsec < reconnectMsec)
+                        pConnectStatistics->reconnectMaxMsec = reconnectMsec;
+                    __Trace(__FILE__, __LINE__, __FUNCTION__, "reconnected in %llu msec (reconnects = %zu, avg/max = %llu/%llu msec, failures = %zu, failovers = %zu).\n",
+                            reconnectMsec, pConnectStatistics->reconnects,
+                            pConnectStatistics->reconnectTotalMsec / pConnectStatistics->reconnects, pConnectStatistics->reconnectMaxMsec,
+                            pConnectStatistics->failures, pConnectStatistics->failovers);
+                    disconnectedUsec = 0ull;
+                }
+
                 if (connCount == SIZE_MAX)
                     connCount = 0ull;
                 ++connCount;
 
-                element_init(&session.root, NULL, GlowElementType_Node, 0);
+                // スナップショットから展開したツリーはそのまま使用する（isCached で確認する）
+                bool isRetained = hasTree && !hasCached && (session.root.childrenLength > 0);
+                lockEmberTree(pRemoteContent);
+                if (isRetained)
+                {
+                    // 保持ツリーは受信内容で再確認するまで未確認とする
+                    element_markStale(&session.root);
+                }
+                else if (!hasCached)
+                {
+                    if (hasTree)
+                        element_free(&session.root);
+                    element_init(&session.root, NULL, GlowElementType_Node, 0);
+                    hasTree = true;
+                    session.validityPathLength = 0;
+                }
+                pRemoteContent->pRetainedRoot = NULL;
                 pRemoteContent->pTopNode = &session.root;
-                validityPathLength = 0;
-                __Trace(__FILE__, __LINE__, __FUNCTION__, "connected provider.\n");
+                unlockEmberTree(pRemoteContent);
+                hasCached = false;
+                pRemoteContent->retainedTree = isRetained ? 1 : 0;
+                pRemoteContent->connectionCount = connCount;
+                __Trace(__FILE__, __LINE__, __FUNCTION__, "connected provider.%s\n", isRetained ? " (retained tree)" : "");
 
+                unsigned long long connectedUsec = getMonotonicUsec();
                 run(&session);
 
-                element_free(&session.root);
+                lockEmberTree(pRemoteContent);
+                pRemoteContent->pRetainedRoot = &session.root;
+                unlockEmberTree(pRemoteContent);
+                disconnectedTime = time(NULL);
+                disconnectedUsec = getMonotonicUsec();
                 closesocket(session.remoteContent.hSocket);
+                session.remoteContent.hSocket = 0;
+
+                // 安定して接続していた場合・キープアライブ応答がなく切断した場合は待たずに再接続し、
+                // 接続直後の切断が続く場合は待ちを増やす
+                // 再接続後は保持ツリーを受信内容で再確認する（全再取得しない）
+                if (session.linkTimedOut || ((disconnectedUsec - connectedUsec) >= (RECONNECT_STABLE_MSEC * 1000ull)))
+                    backoff = RECONNECT_BACKOFF_INITIAL_MSEC;
+                else if (!waitReconnect(&session, nextReconnectDelay(&backoff, session.remoteContent.reconnectDelay, &jitterSeed)))
+                    break;
             }
             else
             {
                 //__ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "connect error.\n"));
-                __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "connect error.\n");
-            }
+                __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "connect error, %s:%d.\n", addr, port);
+                pConnectStatistics->failures++;
 
-            Sleep(session.remoteContent.reconnectDelay);
+                // 副アドレスへは待たずに切り替える
+                failedInRound++;
+                if (hasSecondary)
+                {
+                    useSecondary = !useSecondary;
+                    pConnectStatistics->failovers++;
+                }
+                if (failedInRound >= (hasSecondary ? 2 : 1))
+                {
+                    failedInRound = 0;
+                    if (!waitReconnect(&session, nextReconnectDelay(&backoff, session.remoteContent.reconnectDelay, &jitterSeed)))
+                        break;
+                }
+            }
         }
+
+        lockEmberTree(pRemoteContent);
+        pRemoteContent->pRetainedRoot = NULL;
+        if (hasTree)
+            element_free(&session.root);
+        unlockEmberTree(pRemoteContent);
+        freeTxArena(&session);
+        clearDispatch(&session.dispatchRoot);
     }
     else
     {
         __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "address or port error.\n");
     }
 
-    if (allocCount > 0)
+    // 他のコンシューマが実行中の場合は確保中のメモリがあるため、最後の終了時のみ確認する
+    // 上位ラッパが保持中の要求・通知も含むため、割り当て元を出力してリーク箇所の特定に用いる
+    // 共有文字列（解放しない）の確保分は除く
+    if ((atomicDecrement(&runningConsumers) == 0) && (allocTotal.live > (long long)internStatistics.blocks))
     {
-        __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "UNFREED MEMORY DETECTED %d!\n", allocCount);
+        __ErrorHandler(__FILE__, __LINE__, __FUNCTION__, "UNFREED MEMORY DETECTED %lld!\n", allocTotal.live - (long long)internStatistics.blocks);
+        reportAllocations(true);
     }
 
     shutdownSockets();
@@ -20,6 +20,14 @@ extern "C" {
 #include "glow.h"
 #include "emberinternal.h"
 #include <limits.h>
+#include <stddef.h>
+
+/// <summary>コンパイル時検査（C / C++ 共通）</summary>
+#if defined __cplusplus
+#define EMBER_STATIC_ASSERT(condition, name) static_assert(condition, #name)
+#else
+#define EMBER_STATIC_ASSERT(condition, name) typedef char name[(condition) ? 1 : -1]
+#endif
 
 
 // ====================================================================
@@ -31,6 +39,104 @@ extern "C" {
 /// GlowType の適用外値
 /// </remarks>
 #define QUIT_REQUEST_CONSUMER	0xFFFF
+/// <summary>マトリックス一括接続（サルボ）要求</summary>
+/// <remarks>
+/// GlowType の適用外値
+/// 同一マトリックスへの複数接続を単一の Connections としてまとめて送信する
+/// </remarks>
+#define SALVO_REQUEST_CONSUMER	0xFFFE
+/// <summary>ツリースナップショット保存要求</summary>
+/// <remarks>
+/// GlowType の適用外値
+/// ツリーを更新するコンシューマスレッド上で保存するため要求として受け渡す
+/// </remarks>
+#define SNAPSHOT_REQUEST_CONSUMER	0xFFFD
+/// <summary>保持ツリー破棄要求</summary>
+/// <remarks>
+/// GlowType の適用外値
+/// 再接続後の再確認で構成変更を検出した場合に全再取得のため使用する
+/// </remarks>
+#define RESET_TREE_REQUEST_CONSUMER	0xFFFC
+/// <summary>パラメータ通知振り分け登録要求</summary>
+/// <remarks>
+/// GlowType の適用外値
+/// 振り分け表はコンシューマスレッド上で参照するため要求として受け渡す
+/// パス長 0 の場合は全登録を解除する
+/// </remarks>
+#define DISPATCH_REQUEST_CONSUMER	0xFFFB
+/// <summary>値変化の監視登録（振り分け識別の代わりに指定）</summary>
+/// <remarks>
+/// 監視パスの値変化は振り分けとは別に GlowType_Parameter の結果として上位ラッパへ通知する
+/// </remarks>
+#define DISPATCH_KEY_WATCH	(-2)
+/// <summary>未確認エレメント破棄要求</summary>
+/// <remarks>
+/// GlowType の適用外値
+/// 再接続後の再確認完了時、一覧を要求したが通知されなかったエレメントを破棄するため使用する
+/// </remarks>
+#define PRUNE_TREE_REQUEST_CONSUMER	0xFFFA
+
+/// <summary>切断中にツリーを保持する上限(秒)</summary>
+/// <remarks>
+/// 上限内に再接続できた場合は保持ツリーを再確認し、超過時は破棄して全再取得する
+/// </remarks>
+#define TREE_RETAIN_SECONDS	30
+
+/// <summary>接続試行の待ち上限デフォルト(msec)</summary>
+#define CONNECT_TIMEOUT_DEFAULT_MSEC	3000
+/// <summary>再接続待ちの初期値(msec)</summary>
+/// <remarks>
+/// 接続失敗ごとに倍増し、RemoteContent.reconnectDelay を上限とする（実際の待ちは半分から全量の間でばらつかせる）
+/// </remarks>
+#define RECONNECT_BACKOFF_INITIAL_MSEC	250
+/// <summary>再接続待ちを初期値へ戻す接続継続時間(msec)</summary>
+/// <remarks>
+/// 接続直後の切断を繰り返すプロバイダに対しては待ちを増やし続ける
+/// </remarks>
+#define RECONNECT_STABLE_MSEC	10000
+
+/// <summary>キープアライブ要求の送信間隔デフォルト(msec)</summary>
+#define KEEPALIVE_INTERVAL_DEFAULT_MSEC	2000
+/// <summary>キープアライブ応答の待ち上限デフォルト(msec)</summary>
+/// <remarks>
+/// 上限までに応答がない場合は接続断とみなし、待たずに再接続する
+/// </remarks>
+#define KEEPALIVE_TIMEOUT_DEFAULT_MSEC	3000
+
+/// <summary>マトリックス接続表の直接索引上限（ターゲット／ソース番号）</summary>
+/// <remarks>
+/// 上限以上の番号は索引せずリスト検索とする
+/// </remarks>
+#define MATRIX_SIGNAL_TABLE_MAX	65536
+
+/// <summary>送信用バッファ初期長</summary>
+#define TX_ARENA_INITIAL_SIZE	(2 * EMBER_MAXIMUM_PACKAGE_LENGTH)
+/// <summary>送信用バッファ上限</summary>
+/// <remarks>
+/// 上限を超える要求は送信しない
+/// </remarks>
+#define TX_ARENA_MAX_SIZE	(1024 * 1024)
+
+/// <summary>割り当て集計の割り当て元数上限</summary>
+/// <remarks>
+/// 割り当て元は 型名・ファイル・行 の組、上限超過分は先頭（集計外）へまとめる
+/// </remarks>
+#define ALLOC_SITE_MAX	256
+/// <summary>割り当て状況の定期出力間隔(msec)</summary>
+/// <remarks>
+/// 前回出力から確保中の数が変化した割り当て元のみ出力する（増え続ける割り当て元がリーク候補）
+/// </remarks>
+#define ALLOC_REPORT_INTERVAL_MSEC	60000
+
+/// <summary>パラメータ設定テンプレート保持数</summary>
+/// <remarks>
+/// 超過時は最も長く使用していないテンプレートを置き換える
+/// </remarks>
+#define TX_TEMPLATE_MAX	32
+/// <summary>パラメータ設定テンプレートのパス長上限</summary>
+#define TX_TEMPLATE_PATH_MAX	16
+/// <summary>パラメータ設定テンプレートのフレーム先頭部長上限（エスケープ後）</summary>
+#define TX_TEMPLATE_HEAD_SIZE	256
 
 #pragma pack(1)
 
@@ -39,6 +145,7 @@ typedef struct STarget
 	berint number;
 	berint* pConnectedSources;
 	int connectedSourcesCount;
+	int connectedSourcesCapacity;
 } Target;
 
 typedef struct SSource
@@ -65,31 +172,62 @@ typedef struct tagGlowNodeId
 	pstr pDescription;
 } GlowNodeId;
 
+/// <summary>
+/// マトリックス属性（接続状態を含む）
+/// </summary>
+typedef struct SElementMatrix
+{
+	GlowMatrix matrix;
+	PtrList targets;
+	PtrList sources;
+	// ターゲット／ソース番号による直接索引（実体は targets / sources 側）
+	Target** ppTargetTable;
+	int targetTableLength;
+	Source** ppSourceTable;
+	int sourceTableLength;
+} ElementMatrix;
+
+/// <summary>
+/// ツリー要素
+/// </summary>
+/// <remarks>
+/// 探索で参照する項目のみ本体に置き、種別毎の属性は種別に応じた長さで別に確保する
+/// 識別子・説明・スキーマ識別子は共有文字列（同一内容は同一アドレス、解放しない）
+/// 属性側の pIdentifier も本体と同じ共有文字列を指す
+/// </remarks>
 typedef struct SElement
 {
 	berint number;
 	GlowElementType type;
 	GlowFieldFlags paramFields;
+	/// <summary>識別子（共有文字列、未取得は NULL）</summary>
+	pcstr pIdentifier;
 
+	/// <summary>種別毎の属性（element_init で確保）</summary>
 	union
 	{
-		GlowNodeId nodeId;
-		GlowNode node;
-		GlowParameter parameter;
-
-		struct
-		{
-			GlowMatrix matrix;
-			PtrList targets;
-			PtrList sources;
-		} matrix;
-
-		GlowFunction function;
+		GlowNode* pNode;
+		GlowParameter* pParameter;
+		ElementMatrix* pMatrix;
+		GlowFunction* pFunction;
 	} glow;
 
-	PtrList children;
+	/// <summary>子エレメント（追加順）</summary>
+	struct SElement** ppChildren;
+	/// <summary>子エレメント数</summary>
+	int childrenLength;
+	/// <summary>子エレメント格納枠数</summary>
+	int childrenCapacity;
 	struct SElement* pParent;
+	// 状態は byte とし、C（bool は int）と C++ でエレメント長を一致させる
+	/// <summary>スナップショットから読み込み、プロバイダ未確認</summary>
+	byte isCached;
+	/// <summary>再接続前から保持、プロバイダ未確認</summary>
+	byte isStale;
+	/// <summary>再接続後に配下の一覧を要求済</summary>
+	byte isDirectoryRequested;
 } Element;
+EMBER_STATIC_ASSERT(offsetof(Element, isDirectoryRequested) + sizeof(byte) == sizeof(Element), element_flagsLast);
 
 typedef struct tagEmberStringValue
 {
@@ -144,31 +282,268 @@ typedef struct tagEmberContent
 		GlowConnection connection;
 
 		EmberStringValue stringValue;
+
+		/// <summary>一括接続（SALVO_REQUEST_CONSUMER 時）</summary>
+		struct
+		{
+			GlowConnection* pConnections;
+			int connectionsLength;
+		} salvo;
+		/// <summary>振り分け識別（DISPATCH_REQUEST_CONSUMER 時）</summary>
+		int dispatchKey;
 	};
 } EmberContent;
 
+/// <summary>
+/// 接続集計
+/// </summary>
+typedef struct tagConnectStatistics
+{
+	/// <summary>接続試行数</summary>
+	size_t attempts;
+	/// <summary>接続失敗数</summary>
+	size_t failures;
+	/// <summary>副アドレスへの切替数</summary>
+	size_t failovers;
+	/// <summary>再接続数（切断後の接続完了）</summary>
+	size_t reconnects;
+	/// <summary>直近の再接続時間（切断から接続完了まで、msec）</summary>
+	unsigned long long lastReconnectMsec;
+	/// <summary>再接続時間合計（msec）</summary>
+	unsigned long long reconnectTotalMsec;
+	/// <summary>再接続時間最大（msec）</summary>
+	unsigned long long reconnectMaxMsec;
+	/// <summary>副アドレスでの接続数</summary>
+	size_t secondaryConnections;
+} ConnectStatistics;
+
+/// <summary>
+/// リンク監視集計（S101 キープアライブ）
+/// </summary>
+typedef struct tagLinkStatistics
+{
+	/// <summary>キープアライブ要求数</summary>
+	size_t requests;
+	/// <summary>キープアライブ応答数</summary>
+	size_t responses;
+	/// <summary>応答待ち上限超過数</summary>
+	size_t timeouts;
+	/// <summary>直近の往復時間（usec、リンク遅延）</summary>
+	unsigned long long rttUsec;
+	/// <summary>往復時間合計（usec）</summary>
+	unsigned long long rttTotalUsec;
+	/// <summary>往復時間最大（usec）</summary>
+	unsigned long long rttMaxUsec;
+} LinkStatistics;
+
+/// <summary>ツリー排他（接続情報ごと、実体はコンシューマ内部）</summary>
+typedef struct tagTreeLock TreeLock;
+
 typedef struct tagRemoteContent
 {
 	short id;
+	/// <summary>ソケット（接続試行ごとに生成し直すため、呼び出し元で生成したものは runConsumer で閉じる）</summary>
 	SOCKET hSocket;
 	struct sockaddr_in remoteAddr;
+	/// <summary>副アドレス（プロバイダ冗長時、sin_port 0 は未使用）</summary>
+	struct sockaddr_in secondaryAddr;
 
+	/// <summary>再接続待ちの上限（msec）</summary>
 	dword reconnectDelay;
 	dword threadDelay;
+	/// <summary>接続試行の待ち上限（msec、0 はデフォルト）</summary>
+	dword connectTimeout;
+	/// <summary>キープアライブ要求の送信間隔（msec、0 はデフォルト）</summary>
+	dword keepAliveInterval;
+	/// <summary>キープアライブ応答の待ち上限（msec、0 はデフォルト）</summary>
+	dword keepAliveTimeout;
 
 	Element* pTopNode;
+
+	/// <summary>ツリースナップショットファイル（NULL 時は読み込まない）</summary>
+	pcstr pSnapshotPath;
+	/// <summary>接続回数（再接続の検出用）</summary>
+	size_t connectionCount;
+
+	/// <summary>接続中（リプレイ含む）のセッション（コンシューマ内部で設定）</summary>
+	struct tagSession* pActiveSession;
+	/// <summary>切断中も保持しているツリー先頭（コンシューマ内部で設定）</summary>
+	Element* pRetainedRoot;
+	/// <summary>ツリー排他（createEmberTreeLock で生成、複製した接続情報とも共有する）</summary>
+	TreeLock* pTreeLock;
+	/// <summary>接続集計（コンシューマ内部で設定）</summary>
+	ConnectStatistics connectStatistics;
+	/// <summary>リンク監視集計（コンシューマ内部で設定）</summary>
+	LinkStatistics linkStatistics;
+
+	// C の bool は int（bertypes.h）で C++ と長さが異なるため、C++ 側が確保する構造体の状態は byte とする
+	/// <summary>直近の接続で前回のツリーを保持した</summary>
+	byte retainedTree;
 } RemoteContent;
 
+/// <summary>
+/// 送信集計
+/// </summary>
+typedef struct tagTxStatistics
+{
+	/// <summary>送信要求数</summary>
+	size_t requests;
+	/// <summary>送信フレーム数</summary>
+	size_t frames;
+	/// <summary>複数フレームに分割した送信数</summary>
+	size_t splitPackages;
+	/// <summary>送信バイト数</summary>
+	size_t bytes;
+	/// <summary>送信失敗数</summary>
+	size_t errors;
+	/// <summary>符号化時間合計（usec）</summary>
+	unsigned long long encodeTotalUsec;
+	/// <summary>符号化時間最大（usec）</summary>
+	unsigned long long encodeMaxUsec;
+	/// <summary>送信時間合計（usec）</summary>
+	unsigned long long sendTotalUsec;
+	/// <summary>送信時間最大（usec）</summary>
+	unsigned long long sendMaxUsec;
+	/// <summary>送信用バッファ長</summary>
+	int arenaSize;
+	/// <summary>送信用バッファ拡張回数</summary>
+	int arenaGrowths;
+	/// <summary>テンプレートで送信したパラメータ設定数</summary>
+	size_t templateHits;
+	/// <summary>パラメータ設定テンプレート生成数</summary>
+	size_t templateBuilds;
+} TxStatistics;
+
+/// <summary>
+/// 割り当て集計（割り当て元単位）
+/// </summary>
+typedef struct tagAllocationStatistics
+{
+	/// <summary>型名（ライブラリ内部の割り当ては "libember"）</summary>
+	pcstr pType;
+	/// <summary>ファイル（ライブラリ内部の割り当ては NULL）</summary>
+	pcstr pFileName;
+	/// <summary>行</summary>
+	int lineNumber;
+	/// <summary>確保中の数</summary>
+	long long live;
+	/// <summary>確保中の数（最大）</summary>
+	long long peak;
+	/// <summary>割り当て数（累計）</summary>
+	long long total;
+	/// <summary>確保中のバイト数</summary>
+	long long liveBytes;
+	/// <summary>確保中のバイト数（最大）</summary>
+	long long peakBytes;
+} AllocationStatistics;
+
+/// <summary>
+/// 共有文字列集計（識別子・説明・スキーマ識別子）
+/// </summary>
+typedef struct tagInternStatistics
+{
+	/// <summary>共有文字列数</summary>
+	size_t strings;
+	/// <summary>共有文字列長合計（終端含む）</summary>
+	size_t bytes;
+	/// <summary>確保中のブロック数（表・格納領域）</summary>
+	size_t blocks;
+	/// <summary>登録要求数</summary>
+	size_t lookups;
+	/// <summary>登録済だった要求数</summary>
+	size_t hits;
+} InternStatistics;
+
+/// <summary>
+/// パラメータ設定テンプレート
+/// </summary>
+/// <remarks>
+/// パスと値種別が同じ設定要求は値以外の符号が一致するため、値の直前までを S101 フレーム化した状態で保持し、
+/// 送信時は値の符号と CRC のみ追記する
+/// </remarks>
+typedef struct tagParameterTemplate
+{
+	/// <summary>対象パス</summary>
+	berint path[TX_TEMPLATE_PATH_MAX];
+	/// <summary>対象パス長（0 は未使用）</summary>
+	int pathLength;
+	/// <summary>値種別（GlowParameterType）</summary>
+	int valueType;
+	/// <summary>使用不可（値の位置を特定できなかった）</summary>
+	bool disabled;
+	/// <summary>最終使用順</summary>
+	size_t lastUse;
+	/// <summary>フレーム先頭から値直前までのフレーム化済バイト列</summary>
+	byte head[TX_TEMPLATE_HEAD_SIZE];
+	/// <summary>フレーム化済バイト列長</summary>
+	int headLength;
+	/// <summary>値直前までの CRC</summary>
+	unsigned short headCrc;
+	/// <summary>値以降のコンテナ終端長</summary>
+	int tailLength;
+} ParameterTemplate;
+
+/// <summary>
+/// パラメータ通知振り分け表（数値パスのトライ木）
+/// </summary>
+typedef struct tagDispatchNode
+{
+	/// <summary>パス要素番号</summary>
+	berint number;
+	/// <summary>振り分け識別（未登録時 -1）</summary>
+	int key;
+	/// <summary>子（番号昇順）</summary>
+	struct tagDispatchNode* pChildren;
+	/// <summary>子の数</summary>
+	int childrenLength;
+	/// <summary>子の確保数</summary>
+	int childrenCapacity;
+	/// <summary>値変化の監視（DISPATCH_KEY_WATCH で登録）</summary>
+	byte watched;
+} DispatchNode;
+
 typedef struct tagSession
 {
 	RemoteContent remoteContent;
+	/// <summary>呼び出し元の接続情報（接続中セッション・保持ツリーの設定先）</summary>
+	RemoteContent* pOwner;
 	EmberContent* pRequest;
 
 	Element root;
+	/// <summary>キャプチャのリプレイ中（送信しない）</summary>
+	bool replay;
+
+	/// <summary>送信用バッファ（要求の符号化先、不足時に拡張して再利用する）</summary>
+	byte* pTxArena;
+	/// <summary>送信用バッファ長</summary>
+	int txArenaSize;
+	/// <summary>送信集計</summary>
+	TxStatistics txStatistics;
+	/// <summary>パラメータ設定テンプレート（TX_TEMPLATE_MAX 個、初回使用時に確保）</summary>
+	ParameterTemplate* pTxTemplates;
+	/// <summary>テンプレート使用順カウンタ</summary>
+	size_t txTemplateUse;
+	/// <summary>パラメータ通知振り分け表（登録のないパスの通知は上位へ渡さない）</summary>
+	DispatchNode dispatchRoot;
+	/// <summary>受信済エレメントのパス長（最大）</summary>
+	int validityPathLength;
+	/// <summary>次のキープアライブ要求時刻（usec）</summary>
+	unsigned long long keepAliveDueUsec;
+	/// <summary>応答待ちのキープアライブ要求時刻（usec、0 は応答待ちなし）</summary>
+	unsigned long long keepAliveSentUsec;
+	/// <summary>キープアライブ応答がなく切断した</summary>
+	bool linkTimedOut;
 } Session;
 
 #pragma pack()
 
+// C の bool は int（bertypes.h）で C++ と長さが異なる
+// RemoteContent は C++ 側で確保し C 側で書き込むため bool を含めない（状態は末尾の byte）
+EMBER_STATIC_ASSERT(offsetof(RemoteContent, retainedTree) + sizeof(byte) == sizeof(RemoteContent), remoteContent_flagLast);
+EMBER_STATIC_ASSERT(offsetof(RemoteContent, linkStatistics) + sizeof(LinkStatistics) == offsetof(RemoteContent, retainedTree), remoteContent_flagOnly);
+// Session は bool を含むため C++ からは項目を参照しない（getInFlightRequest 等を使用する）
+EMBER_STATIC_ASSERT(offsetof(Session, pRequest) == sizeof(RemoteContent) + sizeof(RemoteContent*), session_requestAfterRemoteContent);
+
 // ====================================================================
 // 
 // ====================================================================
@@ -177,17 +552,80 @@ typedef struct tagSession
 /// <remarks>
 /// runConsumer 呼び出し以前に
 /// newobj/newarr/allocMemory/freeMemory 使用したい場合に呼び出す
+/// 複数スレッドから呼び出しても初期化は 1 度のみ
 /// </remarks>
 DLLAPI extern void initEmberContents();
 
+/// <summary>割り当て（割り当て元単位で集計）</summary>
+/// <param name="size"></param>
+/// <param name="pType">型名</param>
+/// <param name="pFileName">割り当て元ファイル</param>
+/// <param name="lineNumber">割り当て元行</param>
+/// <returns></returns>
+/// <remarks>
+/// 解放は freeMemory（ライブラリ内部の割り当てと同じ集計ブロック）
+/// </remarks>
+DLLAPI extern void* allocTracked(size_t size, pcstr pType, pcstr pFileName, int lineNumber);
+/// <summary>文字列複製（割り当て元単位で集計）</summary>
+/// <param name="pStr"></param>
+/// <param name="pFileName">割り当て元ファイル</param>
+/// <param name="lineNumber">割り当て元行</param>
+/// <returns>pStr が NULL の場合は NULL</returns>
+DLLAPI extern pstr stringDupTracked(pcstr pStr, pcstr pFileName, int lineNumber);
+/// <summary>割り当て集計取得</summary>
+/// <param name="pTotal">全体の集計格納先（NULL 可、型名・ファイルは NULL）</param>
+/// <param name="pSites">割り当て元単位の格納先（NULL 可）</param>
+/// <param name="sitesLength">格納先要素数</param>
+/// <returns>割り当て元数（格納先に収まらない分も含む）</returns>
+DLLAPI extern int getAllocationStatistics(AllocationStatistics* pTotal, AllocationStatistics* pSites, int sitesLength);
+/// <summary>割り当て状況の出力</summary>
+/// <param name="force">間隔によらず確保中の全割り当て元を出力</param>
+DLLAPI extern void reportAllocations(bool force);
+/// <summary>共有文字列集計取得</summary>
+/// <param name="pStatistics">格納先</param>
+/// <returns>pStatistics が NULL の場合 false</returns>
+DLLAPI extern bool getInternStatistics(InternStatistics* pStatistics);
+
+// newobj/newarr は呼び出し位置を割り当て元として集計する
+#undef newobj
+#undef newarr
+#define newobj(type) ((type *)allocTracked(sizeof(type), #type, __FILE__, __LINE__))
+#define newarr(type, count) ((type *)allocTracked(sizeof(type) * (count), #type "[]", __FILE__, __LINE__))
+
 extern berint* element_getPath(const Element* pThis, berint* pBuffer, int* pCount);
+/// <summary>エレメント（共通部）長</summary>
+/// <returns>C 側で確保する長さ（種別毎の属性・子の配列は含まない）</returns>
+DLLAPI extern size_t element_headerSize();
 
 /// <summary>ツリー先頭取得</summary></summary>
+/// <param name="pRemoteContent">接続情報（runConsumer へ渡したもの）</param>
 /// <returns></returns>
-extern Element* getRootTop();
+extern Element* getRootTop(const RemoteContent* pRemoteContent);
 /// <summary>ツリー先頭取得有無</summary>
+/// <param name="pRemoteContent">接続情報（runConsumer へ渡したもの）</param>
+/// <returns></returns>
+extern bool hasEmberTree(const RemoteContent* pRemoteContent);
+/// <summary>ツリー排他生成</summary>
+/// <param name="pRemoteContent">接続情報（runConsumer・createReplaySession へ渡す前に生成する）</param>
 /// <returns></returns>
-extern bool hasEmberTree();
+DLLAPI extern bool createEmberTreeLock(RemoteContent* pRemoteContent);
+/// <summary>ツリー排他破棄</summary>
+/// <param name="pRemoteContent">接続情報（コンシューマスレッドの終了後に破棄する）</param>
+DLLAPI extern void releaseEmberTreeLock(RemoteContent* pRemoteContent);
+/// <summary>ツリー排他取得（同一スレッド内で再入可）</summary>
+/// <param name="pRemoteContent">接続情報（runConsumer へ渡したもの）</param>
+/// <remarks>
+/// getRootTop・pTopNode から得たエレメントを走査する間は取得しておくこと
+/// 排他は接続情報ごとのため、他の接続のコンシューマスレッドとは待ち合わせない
+/// </remarks>
+DLLAPI extern void lockEmberTree(const RemoteContent* pRemoteContent);
+/// <summary>ツリー排他解放</summary>
+/// <param name="pRemoteContent">接続情報（runConsumer へ渡したもの）</param>
+DLLAPI extern void unlockEmberTree(const RemoteContent* pRemoteContent);
+/// <summary>送信中要求取得</summary>
+/// <param name="pRemoteContent">接続情報（runConsumer へ渡したもの）</param>
+/// <returns>応答待ちの要求（NULL 時はなし）</returns>
+extern const EmberContent* getInFlightRequest(const RemoteContent* pRemoteContent);
 /// <summary>ツリー内エレメント取得</summary>
 /// <param name="pThis"></param>
 /// <param name="pPath"></param>
@@ -195,6 +633,43 @@ extern bool hasEmberTree();
 /// <param name="ppParent"></param>
 /// <returns></returns>
 extern Element* element_findDescendant(const Element* pThis, const berint* pPath, int pathLength, Element** ppParent);
+/// <summary>送信集計取得</summary>
+/// <param name="pRemoteContent">接続情報（runConsumer へ渡したもの）</param>
+/// <param name="pStatistics">格納先</param>
+/// <returns>接続中（リプレイ含む）のセッションがない場合 false</returns>
+extern bool getTxStatistics(const RemoteContent* pRemoteContent, TxStatistics* pStatistics);
+/// <summary>マトリックス内ターゲット取得</summary>
+/// <param name="pThis">マトリックス</param>
+/// <param name="number">ターゲット番号</param>
+/// <returns>未取得時 NULL</returns>
+extern Target* element_findTarget(const Element* pThis, berint number);
+/// <summary>マトリックス接続ソース一括取得</summary>
+/// <param name="pThis">マトリックス</param>
+/// <param name="firstTarget">先頭ターゲット番号</param>
+/// <param name="targetCount">ターゲット数</param>
+/// <param name="pSources">格納先（NULL 時は件数のみ）</param>
+/// <param name="sourcesLength">格納先要素数</param>
+/// <returns>対象ターゲット範囲の接続ソース総数</returns>
+/// <remarks>
+/// ターゲット番号順に接続ソースを連結して格納、格納先に収まらない分は件数のみ加算
+/// </remarks>
+extern int element_getConnectedSources(const Element* pThis, berint firstTarget, int targetCount, berint* pSources, int sourcesLength);
+/// <summary>ツリースナップショット保存</summary>
+/// <param name="pRoot">ツリー先頭</param>
+/// <param name="pFilePath">保存先</param>
+/// <returns>保存エレメント数、失敗時 -1</returns>
+/// <remarks>
+/// 識別子・番号・種別・パラメータ属性・マトリックスラベルを保存する（接続状態は保存しない）
+/// </remarks>
+extern int element_writeSnapshot(const Element* pRoot, pcstr pFilePath);
+/// <summary>ツリースナップショット読み込み</summary>
+/// <param name="pRoot">ツリー先頭</param>
+/// <param name="pFilePath">保存先</param>
+/// <returns>読み込みエレメント数、ファイルなし・書式不正時 -1</returns>
+/// <remarks>
+/// 読み込んだエレメントはプロバイダから受信するまで isCached とする
+/// </remarks>
+extern int element_readSnapshot(Element* pRoot, pcstr pFilePath);
 
 /// <summary>
 /// Ember GetDirectory 送受信要素生成
@@ -205,6 +680,22 @@ extern Element* element_findDescendant(const Element* pThis, const berint* pPath
 /// <returns></returns>
 DLLAPI extern EmberContent* createEmberGetDirectoryContent(RequestId* pId, const berint* pPath, int pathLength);
 /// <summary>
+/// Ember Subscribe 送受信要素生成
+/// </summary>
+/// <param name="pId"></param>
+/// <param name="pPath"></param>
+/// <param name="pathLength"></param>
+/// <returns></returns>
+extern EmberContent* createEmberSubscribeContent(RequestId* pId, const berint* pPath, int pathLength);
+/// <summary>
+/// Ember Unsubscribe 送受信要素生成
+/// </summary>
+/// <param name="pId"></param>
+/// <param name="pPath"></param>
+/// <param name="pathLength"></param>
+/// <returns></returns>
+extern EmberContent* createEmberUnsubscribeContent(RequestId* pId, const berint* pPath, int pathLength);
+/// <summary>
 /// Ember Invoke 送受信要素生成
 /// </summary>
 /// <param name="pId"></param>
@@ -242,6 +733,52 @@ extern EmberContent* createEmberSetParameterContent(RequestId* pId, const berint
 /// <param name="pValue"></param>
 /// <returns></returns>
 extern EmberContent* createEmberConnectionContent(RequestId* pId, const berint* pPath, int pathLength, const GlowConnection* pValue);
+/// <summary>
+/// Ember マトリックス一括接続 送信要素生成
+/// </summary>
+/// <param name="pId"></param>
+/// <param name="pPath">マトリックスパス</param>
+/// <param name="pathLength"></param>
+/// <param name="pValues">接続（ソースは複製する）</param>
+/// <param name="valuesLength">接続数</param>
+/// <returns></returns>
+extern EmberContent* createEmberSalvoContent(RequestId* pId, const berint* pPath, int pathLength, const GlowConnection* pValues, int valuesLength);
+/// <summary>
+/// ツリースナップショット保存 要求要素生成
+/// </summary>
+/// <param name="pId"></param>
+/// <param name="pFilePath">保存先</param>
+/// <returns></returns>
+extern EmberContent* createEmberSnapshotContent(RequestId* pId, pcstr pFilePath);
+/// <summary>
+/// 保持ツリー破棄 要求要素生成
+/// </summary>
+/// <param name="pId"></param>
+/// <returns></returns>
+extern EmberContent* createEmberResetTreeContent(RequestId* pId);
+/// <summary>
+/// 未確認エレメント破棄 要求要素生成
+/// </summary>
+/// <param name="pId"></param>
+/// <returns></returns>
+extern EmberContent* createEmberPruneTreeContent(RequestId* pId);
+/// <summary>
+/// パラメータ通知振り分け登録 要求要素生成
+/// </summary>
+/// <param name="pId"></param>
+/// <param name="pPath">対象パス（NULL 時は全登録解除）</param>
+/// <param name="pathLength"></param>
+/// <param name="key">振り分け識別（0 以上、または DISPATCH_KEY_WATCH）</param>
+/// <returns></returns>
+extern EmberContent* createEmberDispatchContent(RequestId* pId, const berint* pPath, int pathLength, int key);
+/// <summary>
+/// 送受信要素破棄
+/// </summary>
+/// <param name="pContent"></param>
+/// <remarks>
+/// パスおよび接続／一括接続で複製したソースを含めて解放する
+/// </remarks>
+extern void releaseEmberContent(EmberContent* pContent);
 
 /// <summary>
 /// 文字列パス→パス
@@ -250,6 +787,9 @@ extern EmberContent* createEmberConnectionContent(RequestId* pId, const berint*
 /// <param name="pathValue"></param>
 /// <param name="ppPath"></param>
 /// <returns></returns>
+/// <remarks>
+/// 上位ラッパのスレッドから呼び出す場合は lockEmberTree を取得しておくこと
+/// </remarks>
 extern size_t convertString2Path(Element* pRoot, const pstr pathValue, berint** ppPath);
 /// <summary>
 /// パス→文字列パス
@@ -258,14 +798,44 @@ extern size_t convertString2Path(Element* pRoot, const pstr pathValue, berint**
 /// <param name="pPath"></param>
 /// <param name="pPathLength"></param>
 /// <returns></returns>
+/// <remarks>
+/// 上位ラッパのスレッドから呼び出す場合は lockEmberTree を取得しておくこと
+/// </remarks>
 extern pstr convertPath2String(Element* pRoot, const berint* pPath, int pathLength);
 
 
+/// <summary>再接続待ち時間の算出</summary>
+/// <param name="pBackoff">現在の待ち（次回分へ更新される）</param>
+/// <param name="maxDelay">待ちの上限（msec）</param>
+/// <param name="pSeed">ばらつき用の乱数状態</param>
+/// <returns>今回の待ち（msec）</returns>
+extern dword nextReconnectDelay(dword* pBackoff, dword maxDelay, unsigned int* pSeed);
+
 /// <summary>コンシューマ機能</summary>
 /// <param name="pRemoteContent"></param>
+/// <remarks>
+/// 接続情報単位にセッションを持つため、異なる接続情報であれば複数スレッドで同時に実行できる
+/// </remarks>
 extern void runConsumer(RemoteContent* pRemoteContent);
 
-extern bool Call_handleInput(EmberContent* pRequest);
+/// <summary>要求手続き（接続中のセッションで処理）</summary>
+/// <param name="pRemoteContent">接続情報（runConsumer へ渡したもの）</param>
+/// <param name="pRequest"></param>
+/// <returns></returns>
+extern bool Call_handleInput(RemoteContent* pRemoteContent, EmberContent* pRequest);
+
+/// <summary>リプレイ用セッション生成</summary>
+/// <param name="pRemoteContent"></param>
+/// <returns></returns>
+extern Session* createReplaySession(RemoteContent* pRemoteContent);
+/// <summary>リプレイ受信データ投入</summary>
+/// <param name="pSession"></param>
+/// <param name="pData"></param>
+/// <param name="length"></param>
+extern void replaySessionBytes(Session* pSession, const byte* pData, int length);
+/// <summary>リプレイ用セッション解放</summary>
+/// <param name="pSession"></param>
+extern void releaseReplaySession(Session* pSession);
 
 
 #ifdef __cplusplus